@@ -0,0 +1,349 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/Notify>
+#include <osgEarth/OGRFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <osgEarth/ObjectIndex>
+#include <osgEarth/StringUtils>
+#include <osg/ArgumentParser>
+#include <osg/Geometry>
+#include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+
+#define LC "[featurebench] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const char* name, const std::string& error)
+{
+    OE_NOTICE
+        << "Reads several OGR feature layers at the same time and writes a JSON"
+        << "\nreport of read throughput. Use local data (shapefile, GeoPackage...)"
+        << "\nso runs are reproducible."
+        << "\nError: " << error
+        << "\nUsage:"
+        << "\n" << name
+        << "\n  <file> [<file> ...]      ; feature files to read, one layer each"
+        << "\n  [--driver <name>]        ; OGR driver, e.g. GeoJSON or GPKG (default ESRI Shapefile)"
+        << "\n  [--spatial-index]        ; build (or load) a spatial index for each layer"
+        << "\n  [--readers <n>]          ; concurrent cursors per layer (default 1)"
+        << "\n  [--grid <n>]             ; split each layer into n x n bounded queries (default 1)"
+        << "\n  [--work-us <n>]          ; simulated processing per feature, in microseconds (default 0)"
+        << "\n  [--repeat <n>]           ; read everything this many times (default 1)"
+        << "\n  [--tag]                  ; tag each feature's vertices in a shared ObjectIndex"
+        << "\n  [--out <file.json>]      ; write the report here instead of stdout"
+        << std::endl;
+
+    return -1;
+}
+
+namespace
+{
+    std::string quote(const std::string& s)
+    {
+        return "\"" + s + "\"";
+    }
+
+    struct Layer
+    {
+        std::string name;
+        osg::ref_ptr<OGRFeatureSource> source;
+        std::vector<Bounds> cells;
+        unsigned features;
+        unsigned points;
+        unsigned queries;
+        double seconds;
+    };
+
+    // Reads every n-th query cell of one layer.
+    struct Reader : public OpenThreads::Thread
+    {
+        Reader(Layer& layer, unsigned first, unsigned stride, unsigned repeat, unsigned workUS, ObjectIndex* index) :
+            _layer(layer), _first(first), _stride(stride), _repeat(repeat), _workUS(workUS), _index(index),
+            _features(0u), _points(0u), _queries(0u), _seconds(0.0),
+            _tagged(0u), _taggedVerts(0u), _tagSeconds(0.0) { }
+
+        // Tags the feature's vertices in the cell geometry, the way a compiler
+        // tags each feature's range after merging a cell into one drawable.
+        void tag(Feature* f, osg::Geometry* geom)
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            osg::Vec3Array* verts = static_cast<osg::Vec3Array*>(geom->getVertexArray());
+            unsigned first = verts->size();
+            unsigned count = f->getGeometry() ? f->getGeometry()->getTotalPointCount() : 0u;
+            verts->resize(first + count);
+
+            ObjectID id = _index->insert(f);
+            _index->tagRange(geom, id, first, count);
+
+            ++_tagged;
+            _taggedVerts += count;
+            _tagSeconds += osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        }
+
+        void run()
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            osg::ref_ptr<osg::Geometry> geom;
+            if (_index)
+            {
+                geom = new osg::Geometry();
+                geom->setUseVertexBufferObjects(true);
+                geom->setUseDisplayList(false);
+            }
+
+            for (unsigned r = 0; r < _repeat; ++r)
+            {
+                for (unsigned c = _first; c < _layer.cells.size(); c += _stride)
+                {
+                    Query query;
+                    if (_layer.cells.size() > 1)
+                        query.bounds() = _layer.cells[c];
+
+                    if (geom.valid())
+                    {
+                        geom->setVertexArray(new osg::Vec3Array());
+                        geom->setVertexAttribArray(_index->getObjectIDAttribLocation(), 0L);
+                    }
+
+                    osg::ref_ptr<FeatureCursor> cursor = _layer.source->createFeatureCursor(query, 0L);
+                    ++_queries;
+                    while (cursor.valid() && cursor->hasMore())
+                    {
+                        Feature* f = cursor->nextFeature();
+                        ++_features;
+                        if (f->getGeometry())
+                            _points += f->getGeometry()->getTotalPointCount();
+
+                        if (geom.valid())
+                            tag(f, geom.get());
+
+                        if (_workUS > 0)
+                            OpenThreads::Thread::microSleep(_workUS);
+                    }
+                }
+            }
+
+            _seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        }
+
+        Layer& _layer;
+        unsigned _first, _stride, _repeat, _workUS;
+        ObjectIndex* _index;
+        unsigned _features, _points, _queries;
+        double _seconds;
+        unsigned _tagged, _taggedVerts;
+        double _tagSeconds;
+    };
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (arguments.read("--help"))
+        return usage(argv[0], "Help");
+
+    unsigned readers = 1u, grid = 1u, workUS = 0u, repeat = 1u;
+    arguments.read("--readers", readers);
+    arguments.read("--grid", grid);
+    arguments.read("--work-us", workUS);
+    arguments.read("--repeat", repeat);
+    readers = osg::maximum(readers, 1u);
+    grid = osg::maximum(grid, 1u);
+    repeat = osg::maximum(repeat, 1u);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    std::string driver;
+    arguments.read("--driver", driver);
+
+    bool spatialIndex = arguments.read("--spatial-index");
+
+    // one index shared by every reader, like the registry's
+    osg::ref_ptr<ObjectIndex> index;
+    if (arguments.read("--tag"))
+        index = new ObjectIndex();
+
+    std::vector<Layer> layers;
+    for (int i = 1; i < arguments.argc(); ++i)
+    {
+        if (arguments.isOption(i))
+            return usage(argv[0], Stringify() << "Unknown option " << arguments[i]);
+
+        Layer layer;
+        layer.name = arguments[i];
+        layer.source = new OGRFeatureSource();
+        layer.source->setURL(layer.name);
+        if (!driver.empty())
+            layer.source->setOGRDriver(driver);
+        if (spatialIndex)
+            layer.source->setBuildSpatialIndex(true);
+
+        // index building happens here, outside the timed run
+        if (layer.source->open().isError())
+            return usage(argv[0], layer.source->getStatus().toString());
+
+        const FeatureProfile* profile = layer.source->getFeatureProfile();
+        if (!profile || !profile->getExtent().isValid())
+            return usage(argv[0], Stringify() << layer.name << " has no valid extent");
+
+        const GeoExtent& ex = profile->getExtent();
+        double dx = ex.width() / (double)grid, dy = ex.height() / (double)grid;
+        for (unsigned y = 0; y < grid; ++y)
+        {
+            for (unsigned x = 0; x < grid; ++x)
+            {
+                layer.cells.push_back(Bounds(
+                    ex.xMin() + dx*(double)x, ex.yMin() + dy*(double)y,
+                    ex.xMin() + dx*(double)(x+1), ex.yMin() + dy*(double)(y+1)));
+            }
+        }
+
+        layer.features = layer.points = layer.queries = 0u;
+        layer.seconds = 0.0;
+        layers.push_back(layer);
+    }
+
+    if (layers.empty())
+        return usage(argv[0], "No feature files");
+
+    // Start every reader on every layer at once.
+    std::vector<Reader*> threads;
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        for (unsigned r = 0; r < readers; ++r)
+        {
+            Reader* reader = new Reader(layers[i], r, readers, repeat, workUS, index.get());
+            threads.push_back(reader);
+            reader->start();
+        }
+    }
+
+    for (unsigned t = 0; t < threads.size(); ++t)
+    {
+        threads[t]->join();
+        Layer& layer = threads[t]->_layer;
+        layer.features += threads[t]->_features;
+        layer.points += threads[t]->_points;
+        layer.queries += threads[t]->_queries;
+        layer.seconds = osg::maximum(layer.seconds, threads[t]->_seconds);
+    }
+
+    double elapsed = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    // tag seconds are summed across threads, so the rates are per thread
+    unsigned tagged = 0u, taggedVerts = 0u;
+    double tagSeconds = 0.0;
+    for (unsigned t = 0; t < threads.size(); ++t)
+    {
+        tagged += threads[t]->_tagged;
+        taggedVerts += threads[t]->_taggedVerts;
+        tagSeconds += threads[t]->_tagSeconds;
+    }
+
+    for (unsigned t = 0; t < threads.size(); ++t)
+        delete threads[t];
+
+    unsigned totalFeatures = 0u, totalQueries = 0u;
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        totalFeatures += layers[i].features;
+        totalQueries += layers[i].queries;
+    }
+
+    // Assemble the report.
+    std::stringstream buf;
+    buf << std::fixed << std::setprecision(3)
+        << "{\n"
+        << "  \"driver\": " << quote(driver) << ",\n"
+        << "  \"spatial_index\": " << (spatialIndex ? "true" : "false") << ",\n"
+        << "  \"readers_per_layer\": " << readers << ",\n"
+        << "  \"grid\": " << grid << ",\n"
+        << "  \"work_us\": " << workUS << ",\n"
+        << "  \"repeat\": " << repeat << ",\n"
+        << "  \"elapsed_s\": " << elapsed << ",\n"
+        << "  \"features\": " << totalFeatures << ",\n"
+        << "  \"features_per_second\": " << (elapsed > 0.0 ? (double)totalFeatures / elapsed : 0.0) << ",\n"
+        << "  \"queries\": " << totalQueries << ",\n"
+        << "  \"queries_per_second\": " << (elapsed > 0.0 ? (double)totalQueries / elapsed : 0.0) << ",\n";
+
+    if (index.valid())
+    {
+        buf
+            << "  \"tag\": { \"objects\": " << tagged
+            << ", \"vertices\": " << taggedVerts
+            << ", \"seconds\": " << tagSeconds
+            << ", \"objects_per_second\": " << (tagSeconds > 0.0 ? (double)tagged / tagSeconds : 0.0)
+            << ", \"vertices_per_second\": " << (tagSeconds > 0.0 ? (double)taggedVerts / tagSeconds : 0.0)
+            << ", \"index_objects\": " << index->size()
+            << ", \"index_bytes\": " << index->getMemoryUsage()
+            << " },\n";
+    }
+
+    buf
+        << "  \"layers\": [\n";
+
+    for (unsigned i = 0; i < layers.size(); ++i)
+    {
+        const Layer& layer = layers[i];
+        buf << "    { \"file\": " << quote(layer.name)
+            << ", \"features\": " << layer.features
+            << ", \"points\": " << layer.points
+            << ", \"queries\": " << layer.queries
+            << ", \"elapsed_s\": " << layer.seconds
+            << ", \"features_per_second\": " << (layer.seconds > 0.0 ? (double)layer.features / layer.seconds : 0.0)
+            << " }" << (i + 1 < layers.size() ? "," : "") << "\n";
+    }
+
+    buf << "  ]\n"
+        << "}\n";
+
+    if (outFile.empty())
+    {
+        std::cout << buf.str();
+    }
+    else
+    {
+        std::ofstream out(outFile.c_str());
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Failed to open " << outFile << std::endl;
+            return -1;
+        }
+        out << buf.str();
+    }
+
+    return 0;
+}
@@ -79,9 +79,9 @@ void printFeature( Feature* feature )
     std::cout << std::endl;
 }
 
-void printAllFeatures(FeatureSource* features)
+void printAllFeatures(FeatureSource* features, const Query& query)
 {
-    osg::ref_ptr< FeatureCursor > cursor = features->createFeatureCursor(0L);
+    osg::ref_ptr< FeatureCursor > cursor = features->createFeatureCursor(query, 0L);
     while (cursor.valid() && cursor->hasMore())
     {
         osg::ref_ptr< Feature > feature = cursor->nextFeature();
@@ -102,6 +102,9 @@ usage( const std::string& msg )
         << "USAGE: osgearth_featureinfo [options] filename" << std::endl
         << std::endl
         << "    --printfeatures                   ; Prints all features in the source" << std::endl
+        << "    --where expr                      ; Only prints features matching the SQL WHERE expression" << std::endl
+        << "    --attributes a,b,...              ; Only reads and prints the named attributes" << std::endl
+        << "    --nogeometry                      ; Skips reading and printing the geometry" << std::endl
         << "    --delete fid                      ; Deletes the given FID from the source." << std::endl
         << "    --fid fid                         ; Displays the given FID." << std::endl
         << std::endl;
@@ -135,6 +138,16 @@ int main(int argc, char** argv)
     bool printFeatures = false;
     if (arguments.read("--printfeatures" )) printFeatures = true;
 
+    // let the source skip decoding anything we won't print:
+    Query query;
+    std::string value;
+    if (arguments.read("--where", value))
+        query.expression() = value;
+    if (arguments.read("--attributes", value))
+        osgEarth::Util::StringTokenizer(value, query.attributes(), ",", "", false, true);
+    if (arguments.read("--nogeometry"))
+        query.includeGeometry() = false;
+
     std::string filename;
 
     //Get the first argument that is not an option
@@ -198,7 +211,7 @@ int main(int argc, char** argv)
 
         if (printFeatures)
         {
-            printAllFeatures( features.get() );
+            printAllFeatures( features.get(), query );
         }
     }
 
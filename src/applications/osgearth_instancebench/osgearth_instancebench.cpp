@@ -0,0 +1,358 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/Notify>
+#include <osgEarth/DrawInstanced>
+#include <osgDB/ReadFile>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/RenderStage>
+#include <osgUtil/StateGraph>
+#include <osg/ArgumentParser>
+#include <osg/Geometry>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/Timer>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+#define LC "[instancebench] "
+
+using namespace osgEarth;
+
+int
+usage(const char* name, const std::string& error)
+{
+    OE_NOTICE
+        << "Times the cull traversal of model placements built two ways: one"
+        << "\nMatrixTransform per placement, and a single instanced node from"
+        << "\nDrawInstanced::createInstancedNode. Runs a real osgUtil::CullVisitor"
+        << "\nwithout a graphics context and writes a JSON report."
+        << "\nError: " << error
+        << "\nUsage:"
+        << "\n" << name
+        << "\n  [--model <file>]         ; model to place (default a 10m box)"
+        << "\n  [--instances <n>]        ; number of placements (default 10000)"
+        << "\n  [--frames <n>]           ; timed frames per view (default 200)"
+        << "\n  [--size <w> <h>]         ; virtual viewport size (default 1920 1080)"
+        << "\n  [--max-tbo-size <bytes>] ; texture buffer limit to assume (default 128MB)"
+        << "\n  [--out <file.json>]      ; write the report here instead of stdout"
+        << std::endl;
+
+    return -1;
+}
+
+namespace
+{
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::vector<double>::iterator i = values.begin() + (std::size_t)((values.size() - 1) * p);
+        std::nth_element(values.begin(), i, values.end());
+        return *i;
+    }
+
+    std::string quote(const std::string& in)
+    {
+        std::stringstream buf;
+        buf << '"';
+        for (std::string::const_iterator c = in.begin(); c != in.end(); ++c)
+        {
+            if (*c == '"' || *c == '\\') buf << '\\';
+            buf << *c;
+        }
+        buf << '"';
+        return buf.str();
+    }
+
+    // Runs the same cull setup osgViewer's SceneView does, minus the draw.
+    // Nothing here touches GL, so it works on a headless machine.
+    struct HeadlessCull
+    {
+        osg::ref_ptr<osg::Node> _root;
+        osg::ref_ptr<osg::Camera> _camera;
+        osg::ref_ptr<osg::FrameStamp> _frameStamp;
+        osg::ref_ptr<osgUtil::CullVisitor> _cull;
+        osg::ref_ptr<osgUtil::StateGraph> _stateGraph;
+        osg::ref_ptr<osgUtil::RenderStage> _renderStage;
+        osg::ref_ptr<osg::State> _state;
+
+        HeadlessCull(osg::Node* root, int width, int height) :
+            _root(root)
+        {
+            _camera = new osg::Camera();
+            _camera->setViewport(0, 0, width, height);
+            _camera->setProjectionMatrixAsPerspective(30.0, (double)width/(double)height, 1.0, 1e7);
+
+            _frameStamp = new osg::FrameStamp();
+            _cull = new osgUtil::CullVisitor();
+            _stateGraph = new osgUtil::StateGraph();
+            _renderStage = new osgUtil::RenderStage();
+            _state = new osg::State();
+        }
+
+        //! Culls one frame and returns the time spent in the traversal
+        double frame(const osg::Matrixd& viewMatrix)
+        {
+            unsigned fn = _frameStamp->getFrameNumber() + 1;
+            _frameStamp->setFrameNumber(fn);
+
+            _camera->setViewMatrix(viewMatrix);
+
+            _cull->reset();
+            _stateGraph->clean();
+            _renderStage->reset();
+            _renderStage->setCamera(_camera.get());
+            _renderStage->setViewport(_camera->getViewport());
+
+            _cull->setFrameStamp(_frameStamp.get());
+            _cull->setTraversalNumber(fn);
+            _cull->setState(_state.get());
+            _cull->setStateGraph(_stateGraph.get());
+            _cull->setRenderStage(_renderStage.get());
+
+            _cull->pushViewport(_camera->getViewport());
+            _cull->pushProjectionMatrix(new osg::RefMatrix(_camera->getProjectionMatrix()));
+            _cull->pushModelViewMatrix(new osg::RefMatrix(viewMatrix), osg::Transform::ABSOLUTE_RF);
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            _root->accept(*_cull);
+            double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            _cull->popModelViewMatrix();
+            _cull->popProjectionMatrix();
+            _cull->popViewport();
+
+            return seconds;
+        }
+
+        //! Drawables the last cull traversal queued for rendering
+        unsigned leaves() const
+        {
+            return countLeaves(_stateGraph.get());
+        }
+
+        static unsigned countLeaves(const osgUtil::StateGraph* sg)
+        {
+            unsigned count = sg->_leaves.size();
+            for (osgUtil::StateGraph::ChildList::const_iterator i = sg->_children.begin(); i != sg->_children.end(); ++i)
+                count += countLeaves(i->second.get());
+            return count;
+        }
+    };
+
+    // 10m box with a single indexed primitive set, so the instanced
+    // conversion has something representative to work on.
+    osg::Node* createBoxModel()
+    {
+        const float h = 5.0f;
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        for (int i = 0; i < 8; ++i)
+            verts->push_back(osg::Vec3((i & 1) ? h : -h, (i & 2) ? h : -h, (i & 4) ? h : -h));
+
+        const GLushort faces[36] = {
+            0,2,1, 1,2,3,  4,5,6, 5,7,6,  0,1,4, 1,5,4,
+            2,6,3, 3,6,7,  0,4,2, 2,4,6,  1,3,5, 3,7,5 };
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseVertexBufferObjects(true);
+        geom->setUseDisplayList(false);
+        geom->setVertexArray(verts);
+        geom->addPrimitiveSet(new osg::DrawElementsUShort(GL_TRIANGLES, 36, faces));
+
+        osg::Geode* geode = new osg::Geode();
+        geode->addDrawable(geom);
+        return geode;
+    }
+
+    struct CullTimes
+    {
+        std::vector<double> seconds;
+        unsigned leaves;
+    };
+
+    void timeCull(osg::Node* root, const osg::Matrixd& view, int width, int height, unsigned frames, CullTimes& out)
+    {
+        HeadlessCull cull(root, width, height);
+
+        // warm up caches and the render graph allocations
+        for (unsigned i = 0; i < 10u; ++i)
+            cull.frame(view);
+
+        out.seconds.clear();
+        out.seconds.reserve(frames);
+        for (unsigned i = 0; i < frames; ++i)
+            out.seconds.push_back(cull.frame(view));
+
+        out.leaves = cull.leaves();
+    }
+
+    void writeCullTimes(std::ostream& buf, const CullTimes& t)
+    {
+        double sum = 0.0;
+        for (unsigned i = 0; i < t.seconds.size(); ++i)
+            sum += t.seconds[i];
+
+        buf << "{ \"cull_ms\": { \"mean\": " << (t.seconds.empty() ? 0.0 : sum / (double)t.seconds.size()) * 1000.0
+            << ", \"p50\": " << percentile(t.seconds, 0.5) * 1000.0
+            << ", \"p95\": " << percentile(t.seconds, 0.95) * 1000.0 << " }"
+            << ", \"leaves\": " << t.leaves << " }";
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osgEarth::initialize();
+
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (arguments.read("--help"))
+        return usage(argv[0], "");
+
+    std::string modelFile;
+    arguments.read("--model", modelFile);
+
+    unsigned numInstances = 10000u;
+    arguments.read("--instances", numInstances);
+
+    unsigned frames = 200u;
+    arguments.read("--frames", frames);
+
+    int width = 1920, height = 1080;
+    arguments.read("--size", width, height);
+
+    // a typical GL_MAX_TEXTURE_BUFFER_SIZE; the real one needs a context
+    int maxTBOSize = 1 << 27;
+    arguments.read("--max-tbo-size", maxTBOSize);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    if (numInstances == 0u || frames == 0u)
+        return usage(argv[0], "--instances and --frames must be positive");
+
+    osg::ref_ptr<osg::Node> model;
+    if (modelFile.empty())
+        model = createBoxModel();
+    else
+        model = osgDB::readRefNodeFile(modelFile);
+
+    if (!model.valid())
+        return usage(argv[0], "Failed to load " + modelFile);
+
+    // Lay the placements out on a square grid in the XY plane, each with its
+    // own heading, the way SubstituteModelFilter places them around a tile.
+    const double radius = osg::maximum((double)model->getBound().radius(), 1.0);
+    const double spacing = 3.0 * radius;
+    const unsigned side = (unsigned)ceil(sqrt((double)numInstances));
+    const double halfExtent = 0.5 * spacing * (double)(side - 1);
+
+    DrawInstanced::InstanceList instances(numInstances);
+    for (unsigned i = 0; i < numInstances; ++i)
+    {
+        DrawInstanced::Instance& inst = instances[i];
+        inst.position.set(
+            (float)(spacing * (double)(i % side) - halfExtent),
+            (float)(spacing * (double)(i / side) - halfExtent),
+            0.0f);
+        inst.rotation.makeRotate(fmod((double)i * 2.399963, 2.0 * osg::PI), osg::Vec3d(0, 0, 1));
+        inst.objectID = i + 1u;
+    }
+
+    // The legacy path: one transform per placement sharing the model.
+    osg::ref_ptr<osg::Group> transforms = new osg::Group();
+    for (unsigned i = 0; i < numInstances; ++i)
+    {
+        osg::MatrixTransform* xform = new osg::MatrixTransform();
+        xform->setMatrix(
+            osg::Matrixd::scale(instances[i].scale) *
+            osg::Matrixd::rotate(instances[i].rotation) *
+            osg::Matrixd::translate(instances[i].position));
+        xform->addChild(model.get());
+        transforms->addChild(xform);
+    }
+
+    // The instanced path alters its model, so give it a private copy. The
+    // TBO limit is passed in because there's no context to query it from.
+    osg::ref_ptr<osg::Node> modelCopy = osg::clone(model.get(), osg::CopyOp::DEEP_COPY_ALL);
+    osg::ref_ptr<osg::Node> instanced = DrawInstanced::createInstancedNode(modelCopy.get(), instances, maxTBOSize);
+    if (!instanced.valid())
+        return usage(argv[0], "Failed to build the instanced node");
+
+    // "overview" sees every placement; "closeup" looks across one corner of
+    // the grid so most placements are outside the frustum.
+    const double fovy = 30.0;
+    const double distance = 1.1 * halfExtent * sqrt(2.0) / tan(osg::DegreesToRadians(0.5 * fovy)) + radius;
+    const osg::Vec3d corner(-halfExtent, -halfExtent, 0.0);
+
+    const char* viewNames[2] = { "overview", "closeup" };
+    osg::Matrixd views[2] = {
+        osg::Matrixd::lookAt(osg::Vec3d(0, 0, distance), osg::Vec3d(0, 0, 0), osg::Vec3d(0, 1, 0)),
+        osg::Matrixd::lookAt(corner + osg::Vec3d(0, -5.0 * spacing, 3.0 * spacing), corner + osg::Vec3d(0, 10.0 * spacing, 0), osg::Vec3d(0, 0, 1))
+    };
+
+    std::stringstream buf;
+    buf << std::fixed << std::setprecision(4);
+    buf << "{\n"
+        << "  \"model\": " << quote(modelFile.empty() ? "box" : modelFile) << ",\n"
+        << "  \"instances\": " << numInstances << ",\n"
+        << "  \"frames\": " << frames << ",\n"
+        << "  \"views\": [\n";
+
+    for (unsigned v = 0; v < 2; ++v)
+    {
+        CullTimes xformTimes, instancedTimes;
+        timeCull(transforms.get(), views[v], width, height, frames, xformTimes);
+        timeCull(instanced.get(), views[v], width, height, frames, instancedTimes);
+
+        buf << "    { \"name\": " << quote(viewNames[v]) << ",\n"
+            << "      \"transforms\": ";
+        writeCullTimes(buf, xformTimes);
+        buf << ",\n      \"instanced\": ";
+        writeCullTimes(buf, instancedTimes);
+        buf << " }" << (v + 1 < 2 ? "," : "") << "\n";
+    }
+
+    buf << "  ]\n"
+        << "}\n";
+
+    if (outFile.empty())
+    {
+        std::cout << buf.str();
+    }
+    else
+    {
+        std::ofstream out(outFile.c_str());
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Failed to open " << outFile << std::endl;
+            return -1;
+        }
+        out << buf.str();
+    }
+
+    return 0;
+}
@@ -37,6 +37,14 @@
 #include <osg/Depth>
 #include <osgEarth/TerrainTileNode>
 #include <osgEarth/FileUtils>
+#include <osgDB/DatabasePager>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/UpdateVisitor>
+#include <osgUtil/RenderStage>
+#include <osgUtil/StateGraph>
+#include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <iostream>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -107,6 +115,206 @@ osg::Node* createPlane(osg::Node* node, const GeoPoint& pos, const SpatialRefere
     return positioner;
 }
 
+// Runs the update and cull traversals without a graphics context,
+// so the terrain pages in around the observer for the intersector path.
+struct HeadlessFrameLoop
+{
+    osg::ref_ptr<osg::Node> _root;
+    osg::ref_ptr<osg::Camera> _camera;
+    osg::ref_ptr<osgDB::DatabasePager> _pager;
+    osg::ref_ptr<osg::FrameStamp> _frameStamp;
+    osg::ref_ptr<osgUtil::UpdateVisitor> _update;
+    osg::ref_ptr<osgUtil::CullVisitor> _cull;
+    osg::ref_ptr<osgUtil::StateGraph> _stateGraph;
+    osg::ref_ptr<osgUtil::RenderStage> _renderStage;
+    osg::ref_ptr<osg::State> _state;
+
+    HeadlessFrameLoop(osg::Node* root, int width, int height) :
+        _root(root)
+    {
+        _camera = new osg::Camera();
+        _camera->setViewport(0, 0, width, height);
+        _camera->setProjectionMatrixAsPerspective(30.0, (double)width/(double)height, 1.0, 1e7);
+
+        _pager = osgDB::DatabasePager::create();
+        _pager->setDoPreCompile(false);
+        _pager->setUnrefImageDataAfterApplyPolicy(false, false);
+
+        _frameStamp = new osg::FrameStamp();
+        _update = new osgUtil::UpdateVisitor();
+        _cull = new osgUtil::CullVisitor();
+        _stateGraph = new osgUtil::StateGraph();
+        _renderStage = new osgUtil::RenderStage();
+        _state = new osg::State();
+    }
+
+    ~HeadlessFrameLoop()
+    {
+        _pager->cancel();
+    }
+
+    void frame(const osg::Matrixd& viewMatrix)
+    {
+        unsigned fn = _frameStamp->getFrameNumber() + 1;
+        double t = osg::Timer::instance()->time_s();
+        _frameStamp->setFrameNumber(fn);
+        _frameStamp->setReferenceTime(t);
+        _frameStamp->setSimulationTime(t);
+
+        _pager->signalBeginFrame(_frameStamp.get());
+        _pager->updateSceneGraph(*_frameStamp);
+
+        _update->reset();
+        _update->setFrameStamp(_frameStamp.get());
+        _update->setTraversalNumber(fn);
+        _root->accept(*_update);
+
+        _camera->setViewMatrix(viewMatrix);
+
+        _cull->reset();
+        _stateGraph->clean();
+        _renderStage->reset();
+        _renderStage->setCamera(_camera.get());
+        _renderStage->setViewport(_camera->getViewport());
+
+        _cull->setFrameStamp(_frameStamp.get());
+        _cull->setTraversalNumber(fn);
+        _cull->setDatabaseRequestHandler(_pager.get());
+        _cull->setState(_state.get());
+        _cull->setStateGraph(_stateGraph.get());
+        _cull->setRenderStage(_renderStage.get());
+
+        _cull->pushViewport(_camera->getViewport());
+        _cull->pushProjectionMatrix(new osg::RefMatrix(_camera->getProjectionMatrix()));
+        _cull->pushModelViewMatrix(new osg::RefMatrix(viewMatrix), osg::Transform::ABSOLUTE_RF);
+        _root->accept(*_cull);
+        _cull->popModelViewMatrix();
+        _cull->popProjectionMatrix();
+        _cull->popViewport();
+
+        _pager->signalEndFrame();
+    }
+
+    bool idle() const
+    {
+        return !_pager->getRequestsInProgress();
+    }
+};
+
+struct BenchmarkOptions
+{
+    BenchmarkOptions() : numSpokes(1000), radius(5000.0), rounds(5u), spacing(10.0), timeout(60.0) { }
+    int numSpokes;
+    double radius;
+    unsigned rounds;
+    double spacing;
+    double timeout;
+};
+
+// Compares the intersector and elevation methods of a RadialLineOfSightNode
+// after paging in the terrain around the observer.
+int
+runBenchmark(const BenchmarkOptions& options, osg::Node* earthNode, MapNode* mapNode)
+{
+    int numSpokes = options.numSpokes;
+    double radius = options.radius;
+    unsigned rounds = options.rounds;
+    double spacing = options.spacing;
+    double timeout = options.timeout;
+
+    const SpatialReference* geoSRS = mapNode->getMapSRS()->getGeographicSRS();
+
+    osg::ref_ptr<RadialLineOfSightNode> radial = new RadialLineOfSightNode( mapNode );
+    radial->setCenter( GeoPoint(geoSRS, -121.515, 46.054, 847.604, ALTMODE_ABSOLUTE) );
+    radial->setComputeMethod( LineOfSight::METHOD_ELEVATION );
+    radial->getEngine()->setSampleSpacing( spacing );
+    radial->setTerrainOnly( true );
+    radial->setRadius( radius );
+    radial->setNumSpokes( numSpokes );
+
+    // page in the terrain under the radial, looking straight down at it:
+    osg::Vec3d center = radial->getCenterWorld();
+    osg::Vec3d up = mapNode->getMapSRS()->isProjected() ? osg::Vec3d(0,0,1) : center;
+    up.normalize();
+    osg::Vec3d north = mapNode->getMapSRS()->isProjected() ? osg::Vec3d(0,1,0) : osg::Vec3d(0,0,1);
+    osg::Matrixd view = osg::Matrixd::lookAt(center + up*(radius*2.0), center, north);
+
+    HeadlessFrameLoop loop(earthNode, 1920, 1080);
+    osg::Timer_t pageStart = osg::Timer::instance()->tick();
+    unsigned idleFrames = 0u;
+    while (idleFrames < 30u && osg::Timer::instance()->delta_s(pageStart, osg::Timer::instance()->tick()) < timeout)
+    {
+        loop.frame(view);
+        idleFrames = loop.idle() ? idleFrames + 1u : 0u;
+        OpenThreads::Thread::microSleep(16000);
+    }
+    std::cout << "Paged terrain in " << osg::Timer::instance()->delta_s(pageStart, osg::Timer::instance()->tick()) << " s"
+        << (idleFrames < 30u ? " (timed out)" : "") << std::endl;
+
+    double intersectTime = 0.0, elevationTime = 0.0;
+    LineOfSightEngine::Viewshed intersected, sampled;
+
+    // the first round warms up the elevation pool and is not timed.
+    for (unsigned r = 0; r <= rounds; ++r)
+    {
+        osg::Timer_t t0 = osg::Timer::instance()->tick();
+        radial->setComputeMethod( LineOfSight::METHOD_INTERSECT );
+        osg::Timer_t t1 = osg::Timer::instance()->tick();
+        intersected = radial->getViewshed();
+
+        osg::Timer_t t2 = osg::Timer::instance()->tick();
+        radial->setComputeMethod( LineOfSight::METHOD_ELEVATION );
+        osg::Timer_t t3 = osg::Timer::instance()->tick();
+        sampled = radial->getViewshed();
+
+        if (r > 0)
+        {
+            intersectTime += osg::Timer::instance()->delta_s(t0, t1);
+            elevationTime += osg::Timer::instance()->delta_s(t2, t3);
+        }
+    }
+
+    unsigned agree = 0u, blockedBoth = 0u;
+    double hitError = 0.0;
+    for (unsigned i = 0; i < intersected.lines.size() && i < sampled.lines.size(); ++i)
+    {
+        const LineOfSightEngine::Line& a = intersected.lines[i];
+        const LineOfSightEngine::Line& b = sampled.lines[i];
+        if (a.hasLOS == b.hasLOS)
+        {
+            ++agree;
+            if (!a.hasLOS)
+            {
+                ++blockedBoth;
+                hitError += (a.hit - b.hit).length();
+            }
+        }
+    }
+
+    unsigned visible = 0u;
+    for (unsigned i = 0; i < sampled.visibility.size(); ++i)
+        visible += sampled.visibility[i];
+
+    rounds = osg::maximum(rounds, 1u);
+    std::cout
+        << "Spokes: " << numSpokes << ", radius: " << radius << " m, spacing: " << spacing << " m" << std::endl
+        << "Intersector: " << (intersectTime / (double)rounds) * 1000.0 << " ms/radial" << std::endl
+        << "Elevation:   " << (elevationTime / (double)rounds) * 1000.0 << " ms/radial" << std::endl
+        << "Speedup:     " << (elevationTime > 0.0 ? intersectTime / elevationTime : 0.0) << "x" << std::endl
+        << "Agreement:   " << agree << "/" << intersected.lines.size() << " spokes"
+        << ", mean hit distance " << (blockedBoth > 0u ? hitError / (double)blockedBoth : 0.0) << " m" << std::endl
+        << "Viewshed:    " << sampled.lines.size() << "x" << sampled.numSamples << " samples, "
+        << (sampled.visibility.empty() ? 0.0 : 100.0 * (double)visible / (double)sampled.visibility.size()) << "% visible" << std::endl;
+
+    if (sampled.clamped)
+    {
+        std::cout << "Warning:     sample count capped at " << radial->getEngine()->getMaxSamples()
+            << "; effective spacing " << sampled.sampleSpacing << " m" << std::endl;
+    }
+
+    return 0;
+}
+
 //class CacheExtentNodeVisitor : public osg::NodeVisitor
 //{
 //public:
@@ -142,6 +350,16 @@ main(int argc, char** argv)
     osgEarth::initialize();
 
     osg::ArgumentParser arguments(&argc,argv);
+
+    // benchmark options are read first so their values aren't taken for file names.
+    bool benchmark = arguments.read("--bench");
+    BenchmarkOptions benchmarkOptions;
+    arguments.read("--spokes", benchmarkOptions.numSpokes);
+    arguments.read("--radius", benchmarkOptions.radius);
+    arguments.read("--rounds", benchmarkOptions.rounds);
+    arguments.read("--spacing", benchmarkOptions.spacing);
+    arguments.read("--timeout", benchmarkOptions.timeout);
+
     osgViewer::Viewer viewer(arguments);
 
     // load the .earth file from the command line.
@@ -161,6 +379,11 @@ main(int argc, char** argv)
         return 1;
     }
 
+    if (benchmark)
+    {
+        return runBenchmark(benchmarkOptions, earthNode.get(), mapNode);
+    }
+
     osgEarth::Util::EarthManipulator* manip = new EarthManipulator();
     viewer.setCameraManipulator( manip );
 
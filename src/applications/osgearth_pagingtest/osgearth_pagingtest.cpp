@@ -21,314 +21,701 @@
 */
 
 #include <osg/Notify>
-#include <osgGA/StateSetManipulator>
 #include <osgViewer/Viewer>
-#include <osgViewer/ViewerEventHandlers>
-#include <osgEarth/Map>
 #include <osgEarth/MapNode>
-#include <osgEarthUtil/ExampleResources>
-#include <osgEarthUtil/EarthManipulator>
-#include <osgEarthAnnotation/FeatureNode>
-#include <osg/PagedLOD>
-#include <osgDB/FileNameUtils>
-#include <osgDB/ReaderWriter>
-#include <osgEarth/SpatialReference>
-#include <osgEarthUtil/SimplePager>
-
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/ExampleResources>
+#include <osgEarth/EarthManipulator>
+#include <osgEarth/SimplePager>
+#include <osgEarth/FeatureNode>
+#include <osgEarth/OGRFeatureSource>
+#include <osgEarth/StyleSheet>
+#include <osgEarth/ResourceLibrary>
+#include <osgEarth/Viewpoint>
+#include <osgEarth/XmlUtils>
+#include <osgEarth/Notify>
+#include <osgEarth/Memory>
+#include <osgEarth/GDAL>
+#include <osgEarth/MBTiles>
+#include <osgDB/DatabasePager>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/UpdateVisitor>
+#include <osgUtil/RenderStage>
+#include <osgUtil/StateGraph>
+#include <osg/ArgumentParser>
 #include <osg/ShapeDrawable>
+#include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 
-#include <osgEarthSymbology/Style>
-#include <osgEarthSymbology/Query>
-#include <osgEarthFeatures/ConvertTypeFilter>
-
-#include <osgEarthDrivers/gdal/GDALOptions>
-#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
-#include <osgEarthDrivers/agglite/AGGLiteOptions>
-#include <osgEarthDrivers/model_feature_geom/FeatureGeomModelOptions>
-
-#include <osgEarthDrivers/feature_mapnikvectortiles/MVTFeatureOptions>
-
-#include <osgDB/WriteFile>
+#define LC "[pagingtest] "
 
 using namespace osgEarth;
-using namespace osgEarth::Features;
-using namespace osgEarth::Drivers;
-using namespace osgEarth::Symbology;
-using namespace osgEarth::Annotation;
 using namespace osgEarth::Util;
 
-osg::Vec4
-randomColor()
+int
+usage(const char* name, const std::string& error)
 {
-    float r = (float)rand() / (float)RAND_MAX;
-    float g = (float)rand() / (float)RAND_MAX;
-    float b = (float)rand() / (float)RAND_MAX;
-    return osg::Vec4(r,g,b,1.0f);
+    OE_NOTICE
+        << "Pages test content over a map in a viewer, or, with --path, replays a camera"
+        << "\npath against the terrain without a graphics context and writes a JSON report"
+        << "\nof tile throughput, load latency, merge queue depth, memory use and the time"
+        << "\nthe terrain takes to reach full resolution at each stop."
+        << "\nError: " << error
+        << "\nUsage:"
+        << "\n" << name
+        << "\n  <earthfile>              ; earth file to load"
+        << "\n  [--spheres]              ; page bounding spheres (default)"
+        << "\n  [--boxes]                ; page colored boxes"
+        << "\n  [--features <file>]      ; page features from an OGR source, extruded at LOD 14"
+        << "\n  [--additive]             ; use additive LODs"
+        << "\nBenchmark mode:"
+        << "\n  --path <file.xml>        ; <viewpoints> file describing the camera path"
+        << "\n  [--prefetch]             ; enable terrain tile prefetching along the path"
+        << "\n  [--leg-seconds <s>]      ; time to fly between stops (default 5)"
+        << "\n  [--timeout <s>]          ; maximum time to wait at each stop (default 60)"
+        << "\n  [--settle-frames <n>]    ; idle frames that mean \"fully loaded\" (default 30)"
+        << "\n  [--size <w> <h>]         ; virtual viewport size (default 1920 1080)"
+        << "\n  [--out <file.json>]      ; write the report here instead of stdout"
+        << "\n  [--allow-any-source]     ; allow layers other than local GDAL/MBTiles"
+        << std::endl;
+
+    return -1;
 }
 
-class BoxSimplePager : public SimplePager
+namespace
 {
-public:
-    BoxSimplePager(const osgEarth::Profile* profile):
-      SimplePager( profile )
+    osg::Vec4 randomColor()
     {
+        float r = (float)rand() / (float)RAND_MAX;
+        float g = (float)rand() / (float)RAND_MAX;
+        float b = (float)rand() / (float)RAND_MAX;
+        return osg::Vec4(r,g,b,1.0f);
     }
 
-    virtual osg::Node* createNode(const TileKey& key, ProgressCallback*)
-    {        
-        osg::BoundingSphere bounds = getBounds( key );
-
-        osg::MatrixTransform* mt = new osg::MatrixTransform;
-        mt->setMatrix(osg::Matrixd::translate( bounds.center() ) );
-        osg::Geode* geode = new osg::Geode;
-        osg::ShapeDrawable* sd = new osg::ShapeDrawable( new osg::Box(osg::Vec3f(0,0,0), bounds.radius(), bounds.radius(), bounds.radius()) );
-        sd->setColor( randomColor() );
-        geode->addDrawable( sd );
-        mt->addChild(geode);
-        return mt;
-    }
-};
-
-class FeaturePager : public SimplePager
-{
-public:
-    FeaturePager( FeatureSource* features, const Style& style, MapNode* mapNode):
-      SimplePager( features->getFeatureProfile()->getProfile() ),
-          _features( features ),
-          _style( style ),
-          _mapNode( mapNode )
-      {
-          setMinLevel( features->getFeatureProfile()->getFirstLevel());
-          setMaxLevel( features->getFeatureProfile()->getMaxLevel());
-      }
-      
-      virtual osg::Node* createNode(const TileKey& key, ProgressCallback* progress)
-      {
-          // Get features for this key
-          osgEarth::Symbology::Query query;
-          query.tileKey() = key;          
-
-          osg::ref_ptr< FeatureCursor > cursor = _features->createFeatureCursor( query );
-          if (cursor)
-          {              
-              FeatureList features;
-              cursor->fill( features );
-
-              Style style = _style;
-
-              // See if we have a style for a given lod, otherwise use the default style
-              StyleLODMap::iterator itr = _styleMap.find( key.getLevelOfDetail() );
-              if (itr != _styleMap.end())
-              {
-                  style = itr->second;
-              }
-
-              FeatureNode* featureNode = new FeatureNode(_mapNode.get(), features, style, GeometryCompilerOptions(), _styleSheet.get() );
-              return featureNode;
-          }
-          else
-          {
-              // We got nothing, so return nothing.
-              return 0;
-          }
-      }
-
-
-      // Set a style per lod
-      void setLODStyle(unsigned int lod, const Style& style)
-      {
-          _styleMap[lod] = style;
-      }
-
-      StyleSheet* getStyleSheet() const
-      {
-          return _styleSheet.get();
-      }
-
-      void setStyleSheet(StyleSheet* styleSheet)
-      {
-          _styleSheet = styleSheet;
-      }
-
-      typedef std::map<unsigned int, Style > StyleLODMap;
-      StyleLODMap _styleMap;
-
-      osg::ref_ptr < FeatureSource > _features;
-      osg::ref_ptr < StyleSheet > _styleSheet;
-      Style _style;
-      osg::ref_ptr< MapNode > _mapNode;
-};
-
-Style getStyle(const osg::Vec4& color, double extrusionHeight)
-{
-    Style style;
-    style.getOrCreate<PolygonSymbol>()->fill()->color() = color;
-    style.getOrCreate<AltitudeSymbol>()->clamping() = AltitudeSymbol::CLAMP_TO_TERRAIN;
-    style.getOrCreate<AltitudeSymbol>()->technique() = AltitudeSymbol::TECHNIQUE_DRAPE;
-    /*
-    if (extrusionHeight > 0)
+    class BoxSimplePager : public SimplePager
     {
-        style.getOrCreate<ExtrusionSymbol>()->height() = extrusionHeight;
-    }
-    */
-    return style;
-}
+    public:
+        BoxSimplePager(const osgEarth::Profile* profile) :
+            SimplePager(profile)
+        {
+        }
 
-//
-// NOTE: run this sample from the repo/tests directory.
-//
-int main(int argc, char** argv)
-{
-    osg::ArgumentParser arguments(&argc,argv);
+        virtual osg::Node* createNode(const TileKey& key, ProgressCallback*)
+        {
+            osg::BoundingSphere bounds = getBounds(key);
+
+            osg::MatrixTransform* mt = new osg::MatrixTransform;
+            mt->setMatrix(osg::Matrixd::translate(bounds.center()));
+            osg::Geode* geode = new osg::Geode;
+            osg::ShapeDrawable* sd = new osg::ShapeDrawable(new osg::Box(osg::Vec3f(0,0,0), bounds.radius(), bounds.radius(), bounds.radius()));
+            sd->setColor(randomColor());
+            geode->addDrawable(sd);
+            mt->addChild(geode);
+            return mt;
+        }
+    };
 
-    osgViewer::Viewer viewer(arguments);
+    class FeaturePager : public SimplePager
+    {
+    public:
+        FeaturePager(FeatureSource* features, const Style& style, const Profile* profile) :
+            SimplePager(profile),
+            _features(features),
+            _style(style)
+        {
+            const FeatureProfile* fp = features->getFeatureProfile();
+            if (fp->isTiled())
+            {
+                setMinLevel(fp->getFirstLevel());
+                setMaxLevel(fp->getMaxLevel());
+            }
+            else
+            {
+                setMaxLevel(14u);
+            }
+        }
 
-    // Tell the database pager to not modify the unref settings
-    viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy( false, false );
+        virtual osg::Node* createNode(const TileKey& key, ProgressCallback* progress)
+        {
+            // Get features for this key
+            osg::ref_ptr<FeatureCursor> cursor = _features->createFeatureCursor(key, progress);
+            if (!cursor.valid())
+                return 0L;
+
+            FeatureList features;
+            cursor->fill(features);
+
+            // See if we have a style for a given lod, otherwise use the default style
+            Style style = _style;
+            StyleLODMap::iterator itr = _styleMap.find(key.getLevelOfDetail());
+            if (itr != _styleMap.end())
+            {
+                style = itr->second;
+            }
 
-    // install our default manipulator (do this before calling load)
-    viewer.setCameraManipulator( new EarthManipulator(arguments) );
+            return new FeatureNode(features, style, GeometryCompilerOptions(), _styleSheet.get());
+        }
 
-    osg::Group* root = new osg::Group;
+        // Set a style per lod
+        void setLODStyle(unsigned int lod, const Style& style)
+        {
+            _styleMap[lod] = style;
+        }
 
-    osg::Node* node = MapNodeHelper().load( arguments, &viewer );
-    root->addChild( node );
+        void setStyleSheet(StyleSheet* styleSheet)
+        {
+            _styleSheet = styleSheet;
+        }
 
-    MapNode* mapNode = MapNode::findMapNode( node );
+        typedef std::map<unsigned int, Style> StyleLODMap;
+        StyleLODMap _styleMap;
 
-    bool additive = false;
-    if (arguments.read("--additive"))
+        osg::ref_ptr<FeatureSource> _features;
+        osg::ref_ptr<StyleSheet> _styleSheet;
+        Style _style;
+    };
+
+    Style getStyle(const osg::Vec4& color)
     {
-        additive = true;
+        Style style;
+        style.getOrCreate<PolygonSymbol>()->fill()->color() = color;
+        style.getOrCreate<AltitudeSymbol>()->clamping() = AltitudeSymbol::CLAMP_TO_TERRAIN;
+        style.getOrCreate<AltitudeSymbol>()->technique() = AltitudeSymbol::TECHNIQUE_DRAPE;
+        return style;
     }
 
-    bool spheres = false;
-    if (arguments.read("--spheres"))
+    StyleSheet* createBuildingStyleSheet(Style& buildingStyle)
     {
-        spheres = true;
+        // Style 14 is where the full resolution data comes in, so use a fancy
+        // textured and extruded style for the building data:
+        buildingStyle.setName("buildings");
+
+        // Extrude the shapes into 3D buildings.
+        ExtrusionSymbol* extrusion = buildingStyle.getOrCreate<ExtrusionSymbol>();
+        extrusion->heightExpression() = 50.0;
+        extrusion->flatten() = true;
+        extrusion->wallStyleName() = "building-wall";
+        extrusion->roofStyleName() = "building-roof";
+
+        // a style for the wall textures:
+        Style wallStyle;
+        wallStyle.setName("building-wall");
+        SkinSymbol* wallSkin = wallStyle.getOrCreate<SkinSymbol>();
+        wallSkin->library() = "us_resources";
+        wallSkin->addTag("building");
+        wallSkin->randomSeed() = 1;
+
+        // a style for the rooftop textures:
+        Style roofStyle;
+        roofStyle.setName("building-roof");
+        SkinSymbol* roofSkin = roofStyle.getOrCreate<SkinSymbol>();
+        roofSkin->library() = "us_resources";
+        roofSkin->addTag("rooftop");
+        roofSkin->randomSeed() = 1;
+        roofSkin->isTiled() = true;
+
+        // assemble a stylesheet and add our styles to it:
+        StyleSheet* styleSheet = new StyleSheet();
+        styleSheet->addStyle(buildingStyle);
+        styleSheet->addStyle(wallStyle);
+        styleSheet->addStyle(roofStyle);
+
+        // load a resource library that contains the building textures.
+        ResourceLibrary* reslib = new ResourceLibrary("us_resources", "../data/resources/textures_us/catalog.xml");
+        styleSheet->addResourceLibrary(reslib);
+
+        return styleSheet;
     }
 
-    bool boxes = false;
-    if (arguments.read("--boxes"))
+    // Reads a list of viewpoints from an XML file.
+    bool readPath(const std::string& location, std::vector<Viewpoint>& path)
     {
-        boxes = true;
+        osg::ref_ptr<XmlDocument> xml = XmlDocument::load(location);
+        if (!xml.valid())
+            return false;
+
+        Config conf = xml->getConfig();
+        if (conf.key() != "viewpoints")
+            conf = conf.child("viewpoints");
+
+        const ConfigSet& children = conf.children("viewpoint");
+        for (ConfigSet::const_iterator i = children.begin(); i != children.end(); ++i)
+        {
+            Viewpoint vp(*i);
+            if (vp.focalPoint().isSet())
+                path.push_back(vp);
+        }
+        return !path.empty();
     }
 
-    bool features = false;
-    if (arguments.read("--features"))
+    // Linear interpolation between two viewpoints.
+    Viewpoint interpolate(const Viewpoint& a, const Viewpoint& b, double t)
     {
-        features = true;
+        const GeoPoint& p0 = a.focalPoint().get();
+        GeoPoint p1 = b.focalPoint()->transform(p0.getSRS());
+
+        double h0 = a.heading()->as(Units::DEGREES);
+        double h1 = b.heading()->as(Units::DEGREES);
+        double dh = h1 - h0;
+        if (dh > 180.0) dh -= 360.0;
+        else if (dh < -180.0) dh += 360.0;
+
+        Viewpoint vp;
+        vp.focalPoint() = GeoPoint(
+            p0.getSRS(),
+            p0.x() + (p1.x() - p0.x())*t,
+            p0.y() + (p1.y() - p0.y())*t,
+            p0.z() + (p1.z() - p0.z())*t,
+            ALTMODE_ABSOLUTE);
+        vp.heading() = Angle(h0 + dh*t, Units::DEGREES);
+        vp.pitch() = Angle(
+            a.pitch()->as(Units::DEGREES) + (b.pitch()->as(Units::DEGREES) - a.pitch()->as(Units::DEGREES))*t,
+            Units::DEGREES);
+        vp.range() = Distance(
+            a.range()->as(Units::METERS) + (b.range()->as(Units::METERS) - a.range()->as(Units::METERS))*t,
+            Units::METERS);
+        return vp;
     }
 
-    if (!spheres && !boxes && !features)
+    // View matrix looking at a viewpoint's focal point.
+    osg::Matrixd computeViewMatrix(const Viewpoint& vp)
     {
-        spheres = true;
+        osg::Matrixd local2world;
+        vp.focalPoint()->createLocalToWorld(local2world);
+
+        double h = osg::DegreesToRadians(vp.heading()->as(Units::DEGREES));
+        double p = osg::DegreesToRadians(vp.pitch()->as(Units::DEGREES));
+        double r = vp.range()->as(Units::METERS);
+
+        // look vector and up vector in the local tangent plane (ENU)
+        osg::Vec3d look(sin(h)*cos(p), cos(h)*cos(p), sin(p));
+        osg::Vec3d up(-sin(h)*sin(p), -cos(h)*sin(p), cos(p));
+
+        osg::Vec3d eye = (-look * r) * local2world;
+        osg::Vec3d center = osg::Vec3d(0,0,0) * local2world;
+        osg::Vec3d upWorld = osg::Matrixd::transform3x3(up, local2world);
+        upWorld.normalize();
+
+        return osg::Matrixd::lookAt(eye, center, upWorld);
     }
 
-    SimplePager* pager = 0;
+    // Only local GDAL and MBTiles sources give reproducible results.
+    bool checkSources(const Map* map, std::string& badLayer)
+    {
+        TileLayerVector layers;
+        map->getLayers(layers);
+        for (TileLayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+        {
+            const TileLayer* layer = i->get();
+            if (dynamic_cast<const GDALImageLayer*>(layer) == 0L &&
+                dynamic_cast<const GDALElevationLayer*>(layer) == 0L &&
+                dynamic_cast<const MBTilesImageLayer*>(layer) == 0L &&
+                dynamic_cast<const MBTilesElevationLayer*>(layer) == 0L)
+            {
+                badLayer = layer->getName();
+                return false;
+            }
+        }
+        return true;
+    }
 
-    if (spheres)
+    double percentile(std::vector<double> values, double p)
     {
-        pager = new SimplePager( mapNode->getMap()->getProfile() );
-        pager->setAdditive( additive );    
-        pager->build();    
-        root->addChild( pager );
+        if (values.empty())
+            return 0.0;
+        std::vector<double>::iterator i = values.begin() + (std::size_t)((values.size() - 1) * p);
+        std::nth_element(values.begin(), i, values.end());
+        return *i;
+    }
 
+    std::string quote(const std::string& in)
+    {
+        std::stringstream buf;
+        buf << '"';
+        for (std::string::const_iterator c = in.begin(); c != in.end(); ++c)
+        {
+            if (*c == '"' || *c == '\\') buf << '\\';
+            buf << *c;
+        }
+        buf << '"';
+        return buf.str();
     }
-    else if (boxes)
+
+    // Runs the update and cull traversals without a graphics context,
+    // so the terrain pages exactly as it would in a viewer.
+    struct HeadlessFrameLoop
     {
-        pager = new BoxSimplePager( mapNode->getMap()->getProfile() );
-        pager->setAdditive( additive );    
-        pager->build();    
-        root->addChild( pager );
+        osg::ref_ptr<osg::Node> _root;
+        osg::ref_ptr<osg::Camera> _camera;
+        osg::ref_ptr<osgDB::DatabasePager> _pager;
+        osg::ref_ptr<osg::FrameStamp> _frameStamp;
+        osg::ref_ptr<osgUtil::UpdateVisitor> _update;
+        osg::ref_ptr<osgUtil::CullVisitor> _cull;
+        osg::ref_ptr<osgUtil::StateGraph> _stateGraph;
+        osg::ref_ptr<osgUtil::RenderStage> _renderStage;
+        osg::ref_ptr<osg::State> _state;
+        osg::Timer_t _start;
+
+        HeadlessFrameLoop(osg::Node* root, int width, int height) :
+            _root(root)
+        {
+            _camera = new osg::Camera();
+            _camera->setViewport(0, 0, width, height);
+            _camera->setProjectionMatrixAsPerspective(30.0, (double)width/(double)height, 1.0, 1e7);
+
+            _pager = osgDB::DatabasePager::create();
+            _pager->setDoPreCompile(false);
+            _pager->setUnrefImageDataAfterApplyPolicy(false, false);
+
+            _frameStamp = new osg::FrameStamp();
+            _update = new osgUtil::UpdateVisitor();
+            _cull = new osgUtil::CullVisitor();
+            _stateGraph = new osgUtil::StateGraph();
+            _renderStage = new osgUtil::RenderStage();
+            _state = new osg::State();
+
+            _start = osg::Timer::instance()->tick();
+        }
+
+        ~HeadlessFrameLoop()
+        {
+            _pager->cancel();
+        }
+
+        double now() const
+        {
+            return osg::Timer::instance()->delta_s(_start, osg::Timer::instance()->tick());
+        }
+
+        void frame(const osg::Matrixd& viewMatrix)
+        {
+            unsigned fn = _frameStamp->getFrameNumber() + 1;
+            double t = now();
+            _frameStamp->setFrameNumber(fn);
+            _frameStamp->setReferenceTime(t);
+            _frameStamp->setSimulationTime(t);
+
+            _pager->signalBeginFrame(_frameStamp.get());
+            _pager->updateSceneGraph(*_frameStamp);
+
+            _update->reset();
+            _update->setFrameStamp(_frameStamp.get());
+            _update->setTraversalNumber(fn);
+            _root->accept(*_update);
+
+            _camera->setViewMatrix(viewMatrix);
+
+            _cull->reset();
+            _stateGraph->clean();
+            _renderStage->reset();
+            _renderStage->setCamera(_camera.get());
+            _renderStage->setViewport(_camera->getViewport());
+
+            _cull->setFrameStamp(_frameStamp.get());
+            _cull->setTraversalNumber(fn);
+            _cull->setDatabaseRequestHandler(_pager.get());
+            _cull->setState(_state.get());
+            _cull->setStateGraph(_stateGraph.get());
+            _cull->setRenderStage(_renderStage.get());
+
+            _cull->pushViewport(_camera->getViewport());
+            _cull->pushProjectionMatrix(new osg::RefMatrix(_camera->getProjectionMatrix()));
+            _cull->pushModelViewMatrix(new osg::RefMatrix(viewMatrix), osg::Transform::ABSOLUTE_RF);
+            _root->accept(*_cull);
+            _cull->popModelViewMatrix();
+            _cull->popProjectionMatrix();
+            _cull->popViewport();
+
+            _pager->signalEndFrame();
+        }
+
+        bool idle() const
+        {
+            return !_pager->getRequestsInProgress();
+        }
+    };
+}
+
+int
+runBenchmark(osg::ArgumentParser& arguments, char** argv)
+{
+    std::string pathFile;
+    if (!arguments.read("--path", pathFile))
+        return usage(argv[0], "Missing --path");
+
+    bool prefetch = arguments.read("--prefetch");
+
+    double legSeconds = 5.0;
+    arguments.read("--leg-seconds", legSeconds);
 
+    double timeout = 60.0;
+    arguments.read("--timeout", timeout);
+
+    unsigned settleFrames = 30u;
+    arguments.read("--settle-frames", settleFrames);
+
+    int width = 1920, height = 1080;
+    arguments.read("--size", width, height);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    bool allowAnySource = arguments.read("--allow-any-source");
+
+    std::vector<Viewpoint> path;
+    if (!readPath(pathFile, path))
+        return usage(argv[0], "Failed to read viewpoints from " + pathFile);
+
+    std::string earthFile;
+    for (int i = 1; i < arguments.argc(); ++i)
+    {
+        if (!arguments.isOption(i))
+        {
+            earthFile = arguments[i];
+            break;
+        }
     }
-    else if (features)
+
+    osg::ref_ptr<MapNode> mapNode = MapNode::load(arguments);
+    if (!mapNode.valid())
+        return usage(argv[0], "Failed to load an earth file");
+
+    // Terrain options must be set before the map node opens.
+    mapNode->getTerrainOptions().setPrefetch(prefetch);
+    if (!mapNode->open())
+        return usage(argv[0], "Failed to open the map");
+
+    std::string badLayer;
+    if (!allowAnySource && !checkSources(mapNode->getMap(), badLayer))
+        return usage(argv[0], "Layer \"" + badLayer + "\" is not a GDAL or MBTiles layer");
+
+    TerrainEngineNode* engine = mapNode->getTerrainEngine();
+    if (prefetch)
     {
-        std::vector< std::string > filenames;
-        for(int pos=1;pos<arguments.argc();++pos)
+        engine->setPrefetchPath(path);
+    }
+
+    HeadlessFrameLoop loop(mapNode.get(), width, height);
+
+    const double frameTime = 1.0/60.0;
+    std::vector<double> timeToFullRes;
+    std::vector<double> frameTimes;
+    size_t peakResidentBytes = 0u;
+    double runStart = loop.now();
+
+    for (unsigned i = 0; i < path.size(); ++i)
+    {
+        // Fly the leg from the previous stop at a steady frame rate.
+        if (i > 0)
         {
-            if (!arguments.isOption(pos))
+            double legStart = loop.now();
+            double t;
+            while ((t = (loop.now() - legStart) / legSeconds) < 1.0)
             {
-                std::string filename = arguments[ pos ];
-                if (osgDB::getFileExtension( filename ) == "mbtiles")
-                {
-                    filenames.push_back( filename );                
-                }
+                double frameStart = loop.now();
+                loop.frame(computeViewMatrix(interpolate(path[i-1], path[i], t)));
+                frameTimes.push_back(loop.now() - frameStart);
+                peakResidentBytes = osg::maximum(peakResidentBytes, Memory::getProcessPhysicalUsage());
+
+                double remaining = frameTime - (loop.now() - frameStart);
+                if (remaining > 0.0)
+                    OpenThreads::Thread::microSleep((unsigned)(remaining * 1e6));
             }
         }
 
-        for (unsigned int i = 0; i < filenames.size(); i++)
+        // Hold at the stop until the pager stays idle.
+        osg::Matrixd view = computeViewMatrix(path[i]);
+        double arrival = loop.now();
+        double idleSince = arrival;
+        unsigned idleFrames = 0u;
+
+        while (loop.now() - arrival < timeout)
         {
-            OE_NOTICE << "Loading " << filenames[i] << std::endl;
+            double frameStart = loop.now();
+            loop.frame(view);
+            frameTimes.push_back(loop.now() - frameStart);
+            peakResidentBytes = osg::maximum(peakResidentBytes, Memory::getProcessPhysicalUsage());
 
+            if (loop.idle())
+            {
+                if (idleFrames++ == 0u)
+                    idleSince = frameStart;
+                if (idleFrames >= settleFrames)
+                    break;
+            }
+            else
+            {
+                idleFrames = 0u;
+            }
+
+            double remaining = frameTime - (loop.now() - frameStart);
+            if (remaining > 0.0)
+                OpenThreads::Thread::microSleep((unsigned)(remaining * 1e6));
+        }
 
-            MVTFeatureOptions featureOpt;
-            featureOpt.url() = filenames[i];
+        double ttfr = idleFrames >= settleFrames ? idleSince - arrival : -1.0;
+        timeToFullRes.push_back(ttfr);
 
-            osg::ref_ptr< FeatureSource > features = FeatureSourceFactory::create( featureOpt );
-            Status s = features->open();
-            if (s.isError()) {
-                OE_WARN << s.message() << "\n";
-                return -1;
-            }
+        OE_INFO << LC << path[i].name().getOrUse("") << ": "
+            << (ttfr >= 0.0 ? std::string(Stringify() << ttfr << " s") : std::string("timed out"))
+            << std::endl;
+    }
 
-            FeaturePager* featurePager = new FeaturePager(features.get(), getStyle(randomColor(), 0.0), mapNode);
-
-            // Style 13 is where the full resolution data comes, in so use a fancy textured and extruded style
-            // a style for the building data:
-            Style buildingStyle;
-            buildingStyle.setName( "buildings" );
-
-            // Extrude the shapes into 3D buildings.
-            ExtrusionSymbol* extrusion = buildingStyle.getOrCreate<ExtrusionSymbol>();
-            extrusion->heightExpression() = 50.0;
-            extrusion->flatten() = true;
-            extrusion->wallStyleName() = "building-wall";
-            extrusion->roofStyleName() = "building-roof";
-
-            // a style for the wall textures:
-            Style wallStyle;
-            wallStyle.setName( "building-wall" );
-            SkinSymbol* wallSkin = wallStyle.getOrCreate<SkinSymbol>();
-            wallSkin->library() = "us_resources";
-            wallSkin->addTag( "building" );
-            wallSkin->randomSeed() = 1;
-
-            // a style for the rooftop textures:
-            Style roofStyle;
-            roofStyle.setName( "building-roof" );
-            SkinSymbol* roofSkin = roofStyle.getOrCreate<SkinSymbol>();
-            roofSkin->library() = "us_resources";
-            roofSkin->addTag( "rooftop" );
-            roofSkin->randomSeed() = 1;
-            roofSkin->isTiled() = true;
-
-            // assemble a stylesheet and add our styles to it:
-            StyleSheet* styleSheet = new StyleSheet();
-            styleSheet->addStyle( buildingStyle );
-            styleSheet->addStyle( wallStyle );
-            styleSheet->addStyle( roofStyle );
-
-            // load a resource library that contains the building textures.
-            ResourceLibrary* reslib = new ResourceLibrary( "us_resources", "../data/resources/textures_us/catalog.xml" );
-            styleSheet->addResourceLibrary( reslib );
-
-
-            // Give the FeaturePager it's overall stylesheet.
-            featurePager->setStyleSheet( styleSheet );
-
-            featurePager->setLODStyle(14, buildingStyle );
-
-            featurePager->setAdditive( additive );    
-            featurePager->build();    
-            root->addChild( featurePager );
+    double elapsed = loop.now() - runStart;
+    Config stats = engine->getStatistics();
+    unsigned merged = stats.value<unsigned>("merged", 0u);
+
+    // Assemble the report.
+    std::stringstream buf;
+    buf << std::fixed << std::setprecision(3)
+        << "{\n"
+        << "  \"earth_file\": " << quote(earthFile) << ",\n"
+        << "  \"path\": " << quote(pathFile) << ",\n"
+        << "  \"prefetch\": " << (prefetch ? "true" : "false") << ",\n"
+        << "  \"frames\": " << frameTimes.size() << ",\n"
+        << "  \"elapsed_s\": " << elapsed << ",\n"
+        << "  \"tiles_merged\": " << merged << ",\n"
+        << "  \"tiles_per_second\": " << (elapsed > 0.0 ? (double)merged / elapsed : 0.0) << ",\n"
+        << "  \"time_to_load_ms\": { \"p50\": " << stats.value<double>("load_latency_p50_ms", 0.0)
+        << ", \"p99\": " << stats.value<double>("load_latency_p99_ms", 0.0) << " },\n"
+        << "  \"merge_queue_depth\": { \"mean\": " << stats.value<double>("merge_queue_mean", 0.0)
+        << ", \"peak\": " << stats.value<unsigned>("merge_queue_peak", 0u) << " },\n"
+        << "  \"frame_time_ms\": { \"p50\": " << percentile(frameTimes, 0.5) * 1000.0
+        << ", \"p99\": " << percentile(frameTimes, 0.99) * 1000.0 << " },\n"
+        << "  \"peak_resident_bytes\": " << peakResidentBytes << ",\n"
+        << "  \"stops\": [\n";
+
+    for (unsigned i = 0; i < path.size(); ++i)
+    {
+        buf << "    { \"name\": " << quote(path[i].name().getOrUse(""))
+            << ", \"time_to_full_resolution_s\": ";
+        if (timeToFullRes[i] >= 0.0)
+            buf << timeToFullRes[i];
+        else
+            buf << "null";
+        buf << " }" << (i + 1 < path.size() ? "," : "") << "\n";
+    }
 
+    buf << "  ],\n"
+        << "  \"engine\": {";
+
+    const ConfigSet& values = stats.children();
+    for (ConfigSet::const_iterator i = values.begin(); i != values.end(); ++i)
+    {
+        buf << (i == values.begin() ? "\n" : ",\n")
+            << "    " << quote(i->key()) << ": "
+            << (i->isNumber() ? i->value() : quote(i->value()));
+    }
+
+    buf << "\n  }\n"
+        << "}\n";
+
+    if (outFile.empty())
+    {
+        std::cout << buf.str();
+    }
+    else
+    {
+        std::ofstream out(outFile.c_str());
+        if (!out.is_open())
+        {
+            OE_WARN << LC << "Failed to open " << outFile << std::endl;
+            return -1;
         }
+        out << buf.str();
     }
 
-    viewer.setSceneData( root );
-       
-    
+    return 0;
+}
+
+int
+runViewer(osg::ArgumentParser& arguments, char** argv)
+{
+    osgViewer::Viewer viewer(arguments);
+
+    // Tell the database pager to not modify the unref settings
+    viewer.getDatabasePager()->setUnrefImageDataAfterApplyPolicy(false, false);
+
+    // install our default manipulator (do this before calling load)
+    viewer.setCameraManipulator(new EarthManipulator(arguments));
+
+    bool additive = arguments.read("--additive");
+    arguments.read("--spheres"); // the default
+    bool boxes = arguments.read("--boxes");
+
+    std::string featuresFile;
+    arguments.read("--features", featuresFile);
+
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+
+    osg::Node* node = MapNodeHelper().load(arguments, &viewer);
+    MapNode* mapNode = MapNode::get(node);
+    if (!mapNode)
+        return usage(argv[0], "Failed to load an earth file");
+
+    root->addChild(node);
+
+    SimplePager* pager = 0L;
+
+    if (!featuresFile.empty())
+    {
+        OE_NOTICE << LC << "Loading " << featuresFile << std::endl;
+
+        osg::ref_ptr<OGRFeatureSource> features = new OGRFeatureSource();
+        features->setURL(featuresFile);
+        Status s = features->open();
+        if (s.isError())
+            return usage(argv[0], s.message());
+
+        const FeatureProfile* fp = features->getFeatureProfile();
+        if (!fp)
+            return usage(argv[0], "No feature profile in " + featuresFile);
+
+        const Profile* profile = fp->isTiled() ?
+            fp->getTilingProfile() :
+            mapNode->getMap()->getProfile();
+
+        FeaturePager* featurePager = new FeaturePager(features.get(), getStyle(randomColor()), profile);
+
+        Style buildingStyle;
+        featurePager->setStyleSheet(createBuildingStyleSheet(buildingStyle));
+        featurePager->setLODStyle(14, buildingStyle);
+        pager = featurePager;
+    }
+    else if (boxes)
+    {
+        pager = new BoxSimplePager(mapNode->getMap()->getProfile());
+    }
+    else
+    {
+        pager = new SimplePager(mapNode->getMap()->getProfile());
+    }
+
+    pager->setAdditive(additive);
+    pager->build();
+    root->addChild(pager);
+
+    viewer.setSceneData(root.get());
     return viewer.run();
 }
+
+//
+// NOTE: run this sample from the repo/tests directory.
+//
+int
+main(int argc, char** argv)
+{
+    osgEarth::initialize();
+
+    osg::ArgumentParser arguments(&argc, argv);
+
+    if (arguments.find("--path") >= 0)
+        return runBenchmark(arguments, argv);
+    else
+        return runViewer(arguments, argv);
+}
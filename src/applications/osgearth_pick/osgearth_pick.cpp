@@ -28,6 +28,7 @@
 #include <osgEarth/ExampleResources>
 #include <osgEarth/Controls>
 #include <osgEarth/RTTPicker>
+#include <osgEarth/SoftwarePicker>
 #include <osgEarth/Feature>
 #include <osgEarth/FeatureIndex>
 #include <osgEarth/AnnotationNode>
@@ -35,8 +36,11 @@
 #include <osgEarth/IntersectionPicker>
 
 #include <osgViewer/CompositeViewer>
+#include <osgViewer/GraphicsWindow>
 #include <osgGA/TrackballManipulator>
 #include <osg/BlendFunc>
+#include <osg/Timer>
+#include <iostream>
 
 #define LC "[rttpicker] "
 
@@ -269,12 +273,172 @@ struct TogglePicker : public ui::ControlEventHandler
 
 //-----------------------------------------------------------------------
 
+struct BenchmarkOptions
+{
+    BenchmarkOptions() : objects(100), picks(1000), size(1024) { }
+    int objects; // boxes per side of the grid
+    int picks;
+    int size;    // ID buffer size
+};
+
+// Grid of boxes, one row of boxes per geometry, each box tagged with its
+// own ObjectID the way the feature compiler tags merged geometry.
+osg::Node*
+createBenchmarkScene(int n, std::vector< osg::ref_ptr<osg::Referenced> >& objects)
+{
+    ObjectIndex* index = Registry::objectIndex();
+    osg::Geode* geode = new osg::Geode();
+
+    const GLuint faces[36] = {
+        0,2,1, 0,3,2, 4,5,6, 4,6,7, 0,1,5, 0,5,4,
+        1,2,6, 1,6,5, 2,3,7, 2,7,6, 3,0,4, 3,4,7 };
+
+    unsigned seed = 1u;
+    for (int row = 0; row < n; ++row)
+    {
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseVertexBufferObjects(true);
+        geom->setUseDisplayList(false);
+
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        osg::DrawElementsUInt* tris = new osg::DrawElementsUInt(GL_TRIANGLES);
+        geom->setVertexArray(verts);
+        geom->addPrimitiveSet(tris);
+
+        for (int col = 0; col < n; ++col)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            float height = 1.0f + (float)((seed >> 8) % 1000) / 100.0f;
+            float x = (float)col*2.0f, y = (float)row*2.0f;
+
+            unsigned first = verts->size();
+            for (int k = 0; k < 8; ++k)
+                verts->push_back(osg::Vec3(x + (k==1||k==2||k==5||k==6 ? 1.5f : 0.0f), y + (k==2||k==3||k==6||k==7 ? 1.5f : 0.0f), k < 4 ? 0.0f : height));
+            for (int k = 0; k < 36; ++k)
+                tris->push_back(first + faces[k]);
+
+            osg::ref_ptr<osg::Referenced> object = new osg::Referenced();
+            objects.push_back(object);
+            index->tagRange(geom, index->insert(object.get()), first, 8u);
+        }
+
+        geode->addDrawable(geom);
+    }
+
+    return geode;
+}
+
+// Compares the IntersectionPicker and the SoftwarePicker on the same
+// synthetic scene without a window.
+int
+runBenchmark(const BenchmarkOptions& options)
+{
+    std::vector< osg::ref_ptr<osg::Referenced> > objects;
+    osg::ref_ptr<osg::Group> root = new osg::Group();
+    root->addChild(createBenchmarkScene(options.objects, objects));
+
+    // a window-less view looking across the grid at an angle. The embedded
+    // window stands in for a real one so event coordinates map to the viewport.
+    const int width = 1024, height = 1024;
+    osg::ref_ptr<osgViewer::View> view = new osgViewer::View();
+    osg::ref_ptr<osgViewer::GraphicsWindowEmbedded> window = new osgViewer::GraphicsWindowEmbedded(0, 0, width, height);
+    view->getCamera()->setGraphicsContext(window.get());
+    view->getCamera()->setViewport(0, 0, width, height);
+    view->getCamera()->setProjectionMatrixAsPerspective(45.0, (double)width/(double)height, 1.0, 10000.0);
+    view->getEventQueue()->getCurrentEventState()->setGraphicsContext(window.get());
+    view->getEventQueue()->getCurrentEventState()->setMouseYOrientation(osgGA::GUIEventAdapter::Y_INCREASING_UPWARDS);
+    view->setSceneData(root.get());
+
+    double extent = (double)options.objects * 2.0;
+    osg::Vec3d center(extent*0.5, extent*0.5, 0.0);
+    view->getCamera()->setViewMatrixAsLookAt(center + osg::Vec3d(0.0, -extent, extent*0.6), center, osg::Vec3d(0,0,1));
+
+    IntersectionPicker intersectionPicker(view.get(), root.get(), ~0u, 2.0f, IntersectionPicker::LIMIT_NEAREST);
+
+    osg::ref_ptr<SoftwarePicker> softwarePicker = new SoftwarePicker(options.size);
+    softwarePicker->addChild(root.get());
+
+    struct Result : public Picker::Callback
+    {
+        Result() : id(0u) { }
+        void onHit(ObjectID value) { id = value; }
+        void onMiss() { id = 0u; }
+        ObjectID id;
+    };
+    osg::ref_ptr<Result> result = new Result();
+
+    // the same pixels for both pickers
+    std::vector<osg::Vec2f> pixels;
+    unsigned seed = 7u;
+    for (int i = 0; i < options.picks; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        float x = (float)((seed >> 8) % width);
+        seed = seed * 1664525u + 1013904223u;
+        float y = (float)((seed >> 8) % height);
+        pixels.push_back(osg::Vec2f(x, y));
+    }
+
+    std::vector<ObjectID> intersected(pixels.size(), 0u), rasterized(pixels.size(), 0u);
+
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < pixels.size(); ++i)
+    {
+        IntersectionPicker::Hits hits;
+        std::set<ObjectID> ids;
+        if (intersectionPicker.pick(pixels[i].x(), pixels[i].y(), hits) &&
+            intersectionPicker.getObjectIDs(hits, ids) && !ids.empty())
+        {
+            intersected[i] = *ids.begin();
+        }
+    }
+
+    // the first pick renders the ID buffer; the rest read it
+    osg::Timer_t t1 = osg::Timer::instance()->tick();
+    for (unsigned i = 0; i < pixels.size(); ++i)
+    {
+        softwarePicker->pick(view.get(), pixels[i].x(), pixels[i].y(), result.get());
+        rasterized[i] = result->id;
+    }
+    osg::Timer_t t2 = osg::Timer::instance()->tick();
+
+    const SoftwarePicker::Stats& stats = softwarePicker->getStats();
+
+    unsigned agree = 0u, hits = 0u;
+    for (unsigned i = 0; i < pixels.size(); ++i)
+    {
+        if (intersected[i] == rasterized[i]) ++agree;
+        if (rasterized[i] > 0u) ++hits;
+    }
+
+    double intersectTime = osg::Timer::instance()->delta_s(t0, t1);
+    double softwareTime = osg::Timer::instance()->delta_s(t1, t2);
+    double picks = (double)osg::maximum((int)pixels.size(), 1);
+
+    std::cout
+        << "Objects:      " << objects.size() << ", picks: " << pixels.size() << ", ID buffer: " << options.size << "x" << options.size << std::endl
+        << "Intersection: " << intersectTime * 1000.0 / picks << " ms/pick, " << intersectTime << " s total" << std::endl
+        << "Software:     " << stats.seconds * 1000.0 << " ms to render (" << stats.drawables << " drawables, " << stats.triangles << " triangles), "
+        << (softwareTime - stats.seconds) * 1000.0 / picks << " ms/pick, " << softwareTime << " s total" << std::endl
+        << "Speedup:      " << (softwareTime > 0.0 ? intersectTime / softwareTime : 0.0) << "x" << std::endl
+        << "Agreement:    " << agree << "/" << pixels.size() << " picks (" << hits << " hits)" << std::endl;
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------
+
 int
 usage(const char* name)
 {
     OE_NOTICE
         << "\nUsage: " << name << " file.earth" << std::endl
-        << MapNodeHelper().usage() << std::endl;
+        << MapNodeHelper().usage() << std::endl
+        << "\nBenchmark the software picker against the intersection picker (no window):" << std::endl
+        << "  " << name << " --bench [--objects <n>] [--picks <n>] [--size <n>]" << std::endl
+        << "    --objects <n> : n x n grid of tagged boxes (default 100)" << std::endl
+        << "    --picks <n>   : number of random picks (default 1000)" << std::endl
+        << "    --size <n>    : software ID buffer size in pixels (default 1024)" << std::endl;
     return 0;
 }
 
@@ -287,6 +451,15 @@ main(int argc, char** argv)
     if ( arguments.read("--help") )
         return usage(argv[0]);
 
+    if ( arguments.read("--bench") )
+    {
+        BenchmarkOptions options;
+        arguments.read("--objects", options.objects);
+        arguments.read("--picks", options.picks);
+        arguments.read("--size", options.size);
+        return runBenchmark(options);
+    }
+
     App app(arguments);
 
     app.mainView = new osgViewer::View();
@@ -40,6 +40,7 @@
 #include <osgText/Text>
 #include <osgText/Font>
 #include <osg/io_utils>
+#include <osg/Timer>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -348,6 +349,10 @@ main(int argc, char** argv)
     osgEarth::initialize();
 
     osg::ArgumentParser arguments(&argc,argv);
+
+    // sample the elevation pool instead of intersecting the terrain:
+    bool useElevation = arguments.read("--elevation");
+
     osgViewer::Viewer viewer(arguments);
 
     // load the .earth file from the command line.
@@ -387,6 +392,15 @@ main(int argc, char** argv)
         GeoPoint(mapNode->getMapSRS(), -75.1, 39.2)
         );
 
+    if (useElevation)
+    {
+        osg::Timer_t t0 = osg::Timer::instance()->tick();
+        calculator->setComputeMethod( TerrainProfileCalculator::METHOD_ELEVATION );
+        OE_NOTICE << "Computed " << calculator->getProfile().getNumElevations() << " samples over "
+            << calculator->getProfile().getTotalDistance() / 1000.0 << " km in "
+            << osg::Timer::instance()->delta_m(t0, osg::Timer::instance()->tick()) << " ms" << std::endl;
+    }
+
     osg::Group* profileNode = new TerrainProfileGraph( calculator.get(), graphWidth, graphHeight );
     hud->addChild( profileNode );
 
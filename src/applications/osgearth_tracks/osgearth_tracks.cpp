@@ -32,6 +32,7 @@
 #include <osgEarth/MGRSFormatter>
 #include <osgEarth/Controls>
 #include <osgEarth/TrackNode>
+#include <osgEarth/TrackNodeBatch>
 #include <osgEarth/Color>
 
 #include <osgViewer/Viewer>
@@ -196,6 +197,61 @@ createTrackNodes(const SpatialReference* mapSRS, osg::Group* parent, const Track
 }
 
 
+/**
+ * Headless benchmark of TrackNodeBatch: moves every track and updates its
+ * position label once per round, and reports updates per second. Needs no
+ * window or GPU.
+ */
+int
+runBenchmark(unsigned rounds, const TrackNodeFieldSchema& schema)
+{
+    osg::ref_ptr<MapNode> mapNode = new MapNode(new Map());
+    const SpatialReference* geoSRS = mapNode->getMapSRS()->getGeographicSRS();
+
+    osg::ref_ptr<TrackNodeBatch> batch = new TrackNodeBatch(mapNode.get());
+
+    Random prng;
+    TrackNodeBatch::UpdateList updates(g_numTracks);
+    for( unsigned i=0; i<g_numTracks; ++i )
+    {
+        GeoPoint pos(geoSRS, -180.0 + prng.next() * 360.0, -80.0 + prng.next() * 160.0, 10000.0, ALTMODE_ABSOLUTE);
+        TrackNode* track = new TrackNode(pos, (osg::Image*)0L, schema);
+        track->setFieldValue( FIELD_NAME, Stringify() << "Track:" << i );
+        batch->addTrack( i, track );
+
+        updates[i].id = i;
+        updates[i].position = pos;
+        updates[i].fields.push_back( std::make_pair(std::string(FIELD_POSITION), std::string()) );
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    for( unsigned r=0; r<rounds; ++r )
+    {
+        for( unsigned i=0; i<g_numTracks; ++i )
+        {
+            TrackNodeBatch::Update& u = updates[i];
+            u.position.x() = fmod(u.position.x() + 180.01, 360.0) - 180.0;
+            u.heading = fmod(r * 5.0, 360.0);
+            u.fields[0].second = s_format(u.position);
+        }
+        batch->update( updates );
+    }
+
+    double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+    const TrackNodeBatch::Stats& stats = batch->getStats();
+
+    std::cout
+        << rounds << " rounds of " << g_numTracks << " tracks in " << seconds << " s ("
+        << (unsigned)((double)(rounds*g_numTracks) / osg::maximum(seconds, 1e-6)) << " updates/s)\n"
+        << "  SRS transform calls: " << stats.transforms << "\n"
+        << "  positions written as matrices: " << stats.matrices << " of " << stats.positions << "\n"
+        << "  labels updated: " << stats.labels << ", unchanged: " << stats.labelsSkipped << std::endl;
+
+    return 0;
+}
+
+
 /** creates some UI controls for adjusting the decluttering parameters. */
 Container*
 createControls( osgViewer::View* view )
@@ -288,6 +344,18 @@ main(int argc, char** argv)
 
     osg::ArgumentParser arguments(&argc,argv);
 
+    // count on the cmd line?
+    arguments.read("--count", g_numTracks);
+
+    // headless batch update benchmark?
+    unsigned benchRounds = 0u;
+    if ( arguments.read("--bench", benchRounds) )
+    {
+        TrackNodeFieldSchema schema;
+        createFieldSchema( schema );
+        return runBenchmark( benchRounds, schema );
+    }
+
     // initialize a viewer.
     osgViewer::Viewer viewer( arguments );
     viewer.setCameraManipulator( new EarthManipulator );
@@ -299,9 +367,6 @@ main(int argc, char** argv)
     if ( !mapNode )
         return usage("Missing required .earth file" );
 
-    // count on the cmd line?
-    arguments.read("--count", g_numTracks);
-
     viewer.setSceneData( earth );
 
     // build a track field schema.
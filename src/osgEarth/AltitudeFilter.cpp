@@ -17,9 +17,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/AltitudeFilter>
-#include <osgEarth/ElevationQuery>
+#include <osgEarth/ElevationPool>
 #include <osgEarth/GeoData>
+#include <osgEarth/Map>
 #include <osgEarth/Metrics>
+#include <osgEarth/ThreadingUtils>
+#include <osgUtil/LineSegmentIntersector>
+#include <osgSim/LineOfSight>
 
 #define LC "[AltitudeFilter] "
 
@@ -28,6 +32,208 @@ using namespace osgEarth::Util;
 
 //---------------------------------------------------------------------------
 
+namespace
+{
+    // number of points sampled by one envelope before handing off
+    const unsigned SAMPLE_CHUNK_SIZE = 1024u;
+
+    /**
+     * Samples the terrain elevation under a batch of points. The points are
+     * transformed into the map profile's SRS in one pass, then sampled in
+     * chunks across a thread pool. Envelopes are not thread-safe, so each
+     * chunk gets its own; they share tile data through the ElevationPool.
+     * Terrain patch layers are intersected first, as ElevationQuery does.
+     */
+    struct ElevationBatch : public osg::Referenced, public Threading::ParallelFor::Job
+    {
+        // input points, in the feature SRS
+        std::vector<osg::Vec3d> _points;
+
+        // output elevations, one per input point
+        std::vector<float> _elevations;
+
+        ElevationBatch() : _numChunks(0u), _lod(23u) { }
+
+        void sample(const Map* map, const SpatialReference* pointSRS, double maxRes, FilterContext& cx)
+        {
+            OE_PROFILING_ZONE;
+
+            _elevations.assign(_points.size(), NO_DATA_VALUE);
+            if (_points.empty())
+                return;
+
+            osg::Timer_t stageStart = osg::Timer::instance()->tick();
+
+            _pool = map->getElevationPool();
+            _sampleSRS = map->getProfile()->getSRS();
+
+            _patchLayers.clear();
+            LayerVector layers;
+            map->getLayers(layers);
+            for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+            {
+                if (i->get()->options().terrainPatch() == true && i->get()->getNode())
+                    _patchLayers.push_back(i->get());
+            }
+            if (!_patchLayers.empty())
+                _readCallback = new osgSim::DatabaseCacheReadCallback();
+
+            // attempt to map the requested resolution to an LOD:
+            if (maxRes > 0.0)
+            {
+                int level = map->getProfile()->getLevelOfDetailForHorizResolution(maxRes, 257);
+                if (level > 0)
+                    _lod = level;
+            }
+
+            _mapPoints = _points;
+            if (!pointSRS->transform(_mapPoints, _sampleSRS.get()))
+            {
+                // at least one point failed; redo them one at a time so the
+                // failures don't spoil the rest of the batch.
+                _skip.assign(_points.size(), 0);
+                for (unsigned i = 0; i < _points.size(); ++i)
+                {
+                    if (!pointSRS->transform(_points[i], _sampleSRS.get(), _mapPoints[i]))
+                        _skip[i] = 1;
+                }
+            }
+
+            osg::Timer_t now = osg::Timer::instance()->tick();
+            cx.addStageTime("altitude.transform", osg::Timer::instance()->delta_s(stageStart, now));
+            stageStart = now;
+
+            _numChunks = (_points.size() + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE;
+
+            osg::ref_ptr<Threading::ThreadPool> threads = Threading::ThreadPool::get(cx.getDBOptions());
+            Threading::ParallelFor::run(*this, _numChunks, threads.get());
+
+            // match the old ElevationQuery behavior of treating missing data as zero
+            for (std::vector<float>::iterator i = _elevations.begin(); i != _elevations.end(); ++i)
+            {
+                if (*i == NO_DATA_VALUE)
+                    *i = 0.0f;
+            }
+
+            cx.addStageTime("altitude.sample", osg::Timer::instance()->delta_s(stageStart, osg::Timer::instance()->tick()));
+        }
+
+        // samples one chunk of points
+        void operator()(unsigned chunk, unsigned)
+        {
+            unsigned begin = chunk * SAMPLE_CHUNK_SIZE;
+            unsigned end = osg::minimum(begin + SAMPLE_CHUNK_SIZE, (unsigned)_mapPoints.size());
+
+            // patches take precedence over the elevation layers
+            std::vector<char> patched;
+            if (!_patchLayers.empty())
+                samplePatches(begin, end, patched);
+
+            osg::ref_ptr<ElevationEnvelope> envelope = _pool->createEnvelope(_sampleSRS.get(), _lod);
+            if (envelope.valid())
+            {
+                ElevationEnvelope::Context context;
+                for (unsigned i = begin; i < end; ++i)
+                {
+                    if ((_skip.empty() || _skip[i] == 0) && (patched.empty() || patched[i-begin] == 0))
+                    {
+                        _elevations[i] = envelope->getElevation(_mapPoints[i].x(), _mapPoints[i].y(), context);
+                    }
+                }
+            }
+        }
+
+    private:
+        // intersects one chunk of points with the terrain patch layers,
+        // marking the ones that hit
+        void samplePatches(unsigned begin, unsigned end, std::vector<char>& patched)
+        {
+            patched.assign(end - begin, 0);
+
+            osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi = new osgUtil::LineSegmentIntersector(osg::Vec3d(), osg::Vec3d());
+            lsi->setIntersectionLimit(lsi->LIMIT_NEAREST);
+
+            osgUtil::IntersectionVisitor iv;
+            iv.setReadCallback(_readCallback.get());
+
+            for (unsigned i = begin; i < end; ++i)
+            {
+                if (!_skip.empty() && _skip[i] != 0)
+                    continue;
+
+                GeoPoint point(_sampleSRS.get(), _mapPoints[i].x(), _mapPoints[i].y(), 0.0, ALTMODE_ABSOLUTE);
+                osg::Vec3d surface, up;
+                point.toWorld(surface);
+                point.createWorldUpVector(up);
+
+                for (LayerVector::const_iterator layer = _patchLayers.begin(); layer != _patchLayers.end(); ++layer)
+                {
+                    osg::Node* node = layer->get()->getNode();
+                    if (!node || !node->getBound().contains(surface))
+                        continue;
+
+                    lsi->reset();
+                    lsi->setStart(surface + up*5e5);
+                    lsi->setEnd(surface - up*5e5);
+                    iv.setIntersector(lsi.get());
+                    node->accept(iv);
+
+                    if (lsi->containsIntersections())
+                    {
+                        GeoPoint output;
+                        output.fromWorld(_sampleSRS.get(), lsi->getIntersections().begin()->getWorldIntersectPoint());
+                        _elevations[i] = (float)output.z();
+                        patched[i-begin] = 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::vector<osg::Vec3d> _mapPoints;
+        std::vector<char> _skip;
+        unsigned _numChunks;
+        unsigned _lod;
+        osg::ref_ptr<ElevationPool> _pool;
+        osg::ref_ptr<const SpatialReference> _sampleSRS;
+        LayerVector _patchLayers;
+        osg::ref_ptr<osgUtil::IntersectionVisitor::ReadCallback> _readCallback;
+    };
+
+    /**
+     * Vertical datum shift, from the map's datum to the feature's, for each
+     * point in a batch. Datum conversions only move Z by an amount that
+     * depends on the horizontal position, so one bulk transform of the
+     * points at Z=0 gives the shift to add to any height at that position.
+     */
+    void computeDatumShifts(
+        const SpatialReference* featureSRSwithMapVertDatum,
+        const SpatialReference* featureSRS,
+        std::vector<osg::Vec3d>& points,
+        std::vector<double>&     out_shifts)
+    {
+        for (std::vector<osg::Vec3d>::iterator i = points.begin(); i != points.end(); ++i)
+            i->z() = 0.0;
+
+        std::vector<osg::Vec3d> shifted(points);
+        if (!featureSRSwithMapVertDatum->transform(shifted, featureSRS))
+        {
+            // redo them one at a time so a failure only loses its own point
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                if (!featureSRSwithMapVertDatum->transform(points[i], featureSRS, shifted[i]))
+                    shifted[i].z() = 0.0;
+            }
+        }
+
+        out_shifts.resize(points.size());
+        for (unsigned i = 0; i < points.size(); ++i)
+            out_shifts[i] = shifted[i].z();
+    }
+}
+
+//---------------------------------------------------------------------------
+
 AltitudeFilter::AltitudeFilter() :
 _maxRes ( 0.0f )
 {
@@ -164,9 +370,6 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     const SpatialReference* mapSRS = map->getSRS();
     osg::ref_ptr<const SpatialReference> featureSRS = cx.profile()->getSRS();
 
-    // establish an elevation query interface based on the features' SRS.
-    ElevationQuery eq(map.get());
-
     NumericExpression scaleExpr;
     if ( _altitude->verticalScale().isSet() )
         scaleExpr = *_altitude->verticalScale();
@@ -188,6 +391,31 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     bool vertEquiv =
         featureSRS->isVertEquivalentTo( mapSRS );
 
+    osg::ref_ptr<const SpatialReference> featureSRSwithMapVertDatum = !vertEquiv ?
+        SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString()) : 0L;
+
+    // Pass 1: evaluate the per-feature expressions and gather every point
+    // we need to sample (each vertex, or each feature centroid) into a
+    // single list so we can transform and sample them in bulk.
+    osg::Timer_t stageStart = osg::Timer::instance()->tick();
+
+    struct FeatureSamples
+    {
+        Feature* feature;
+        double   scaleZ;
+        double   offsetZ;
+        unsigned first;
+        unsigned firstVertex;
+    };
+    std::vector<FeatureSamples> batch;
+    batch.reserve(features.size());
+
+    osg::ref_ptr<ElevationBatch> samples = new ElevationBatch();
+
+    // every vertex, when the datums differ and Z's need shifting
+    std::vector<osg::Vec3d> datumPoints;
+    std::vector<double> datumShifts;
+
     for( FeatureList::iterator i = features.begin(); i != features.end(); ++i )
     {
         Feature* feature = i->get();
@@ -201,36 +429,86 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
         if (feature->getGeometry() == 0L)
             continue;
 
-        double maxTerrainZ  = -DBL_MAX;
-        double minTerrainZ  =  DBL_MAX;
-        double minHAT       =  DBL_MAX;
-        double maxHAT       = -DBL_MAX;
+        FeatureSamples fs;
+        fs.feature = feature;
+        fs.first = samples->_points.size();
+        fs.firstVertex = datumPoints.size();
 
-        double scaleZ = 1.0;
+        fs.scaleZ = 1.0;
         if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-            scaleZ = feature->eval( scaleExpr, &cx );
+            fs.scaleZ = feature->eval( scaleExpr, &cx );
 
-        double offsetZ = 0.0;
+        fs.offsetZ = 0.0;
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-            offsetZ = feature->eval( offsetExpr, &cx );
+            fs.offsetZ = feature->eval( offsetExpr, &cx );
 
-        osgEarth::Bounds bounds = feature->getGeometry()->getBounds();
-        const osg::Vec2d& center = bounds.center2d();
-        GeoPoint centroid(featureSRS.get(), center.x(), center.y());
-        double   centroidElevation = 0.0;
+        if (perVertex)
+        {
+            ConstGeometryIterator gi( feature->getGeometry() );
+            while( gi.hasMore() )
+            {
+                const Geometry* geom = gi.next();
+                samples->_points.insert(samples->_points.end(), geom->begin(), geom->end());
+            }
+        }
+        else
+        {
+            // Clamp to the centroid of the whole feature so that multipolygons
+            // are clamped as a unit and not per polygon.
+            osgEarth::Bounds bounds = feature->getGeometry()->getBounds();
+            const osg::Vec2d& center = bounds.center2d();
+            samples->_points.push_back(osg::Vec3d(center.x(), center.y(), 0.0));
+        }
 
-        // If we aren't doing per vertex clamping go ahead and get the centroid.
-        // We do this now instead of within the geometry iterator to ensure that multipolygons
-        // are clamped to the whole multipolygon and not per polygon.
-        if (!perVertex)
+        if (!vertEquiv)
         {
-            centroidElevation = eq.getElevation( centroid, _maxRes );
-            // Check for NO_DATA_VALUE and use zero instead.
-            if (centroidElevation == NO_DATA_VALUE)
+            ConstGeometryIterator gi( feature->getGeometry() );
+            while( gi.hasMore() )
             {
-                centroidElevation = 0.0;
+                const Geometry* geom = gi.next();
+                datumPoints.insert(datumPoints.end(), geom->begin(), geom->end());
             }
         }
+
+        batch.push_back(fs);
+    }
+
+    cx.addStageTime("altitude.collect", osg::Timer::instance()->delta_s(stageStart, osg::Timer::instance()->tick()));
+
+    // Pass 2: sample the terrain under all points at once.
+    samples->sample(map.get(), featureSRS.get(), _maxRes, cx);
+
+    // ... and work out the datum shift under every vertex at once.
+    if (!vertEquiv)
+    {
+        stageStart = osg::Timer::instance()->tick();
+        computeDatumShifts(featureSRSwithMapVertDatum.get(), featureSRS.get(), datumPoints, datumShifts);
+        cx.addStageTime("altitude.datum", osg::Timer::instance()->delta_s(stageStart, osg::Timer::instance()->tick()));
+    }
+
+    // Pass 3: apply the elevations to the geometry.
+    stageStart = osg::Timer::instance()->tick();
+
+    const std::vector<float>& allElevations = samples->_elevations;
+
+    for( std::vector<FeatureSamples>::iterator f = batch.begin(); f != batch.end(); ++f )
+    {
+        Feature* feature = f->feature;
+        const double scaleZ = f->scaleZ;
+        const double offsetZ = f->offsetZ;
+
+        double maxTerrainZ  = -DBL_MAX;
+        double minTerrainZ  =  DBL_MAX;
+        double minHAT       =  DBL_MAX;
+        double maxHAT       = -DBL_MAX;
+
+        double centroidElevation = perVertex ? 0.0 : allElevations[f->first];
+
+        // index into the sampled elevations for per-vertex clamping:
+        const float* elevations = perVertex && !allElevations.empty() ? &allElevations[f->first] : 0L;
+
+        // map-to-feature datum shift under each vertex:
+        const double* shifts = !datumShifts.empty() ? &datumShifts[f->firstVertex] : 0L;
         
         GeometryIterator gi( feature->getGeometry() );
         while( gi.hasMore() )
@@ -245,41 +523,29 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             {
                 if ( perVertex )
                 {
-                    std::vector<float> elevations;
-
-                    if ( eq.getElevations( geom->asVector(), featureSRS.get(), elevations, _maxRes ) )
+                    for( unsigned i=0; i<geom->size(); ++i )
                     {
-                        for( unsigned i=0; i<geom->size(); ++i )
-                        {
-                            osg::Vec3d& p = (*geom)[i];
-
-                            if (elevations[i] != NO_DATA_VALUE)
-                            {
-                                p.z() *= scaleZ;
-                                p.z() += offsetZ;
-
-                                double z = p.z();
-
-                                if ( !vertEquiv )
-                                {
-                                    osg::Vec3d tempgeo;
-                                    if ( !featureSRS->transform(p, mapSRS->getGeographicSRS(), tempgeo) )
-                                        z = tempgeo.z();
-                                }
-
-                                double hat = z - elevations[i];
-
-                                if ( hat > maxHAT )
-                                    maxHAT = hat;
-                                if ( hat < minHAT )
-                                    minHAT = hat;
-
-                                if ( elevations[i] > maxTerrainZ )
-                                    maxTerrainZ = elevations[i];
-                                if ( elevations[i] < minTerrainZ )
-                                    minTerrainZ = elevations[i];
-                            }
-                        }
+                        osg::Vec3d& p = (*geom)[i];
+
+                        p.z() *= scaleZ;
+                        p.z() += offsetZ;
+
+                        // Z in the map's vertical datum
+                        double z = p.z();
+                        if ( shifts )
+                            z -= shifts[i];
+
+                        double hat = z - elevations[i];
+
+                        if ( hat > maxHAT )
+                            maxHAT = hat;
+                        if ( hat < minHAT )
+                            minHAT = hat;
+
+                        if ( elevations[i] > maxTerrainZ )
+                            maxTerrainZ = elevations[i];
+                        if ( elevations[i] < minTerrainZ )
+                            minTerrainZ = elevations[i];
                     }
                 }
                 else // per centroid
@@ -291,12 +557,8 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
                         p.z() += offsetZ;
 
                         double z = p.z();
-                        if ( !vertEquiv )
-                        {
-                            osg::Vec3d tempgeo;
-                            if ( !featureSRS->transform(p, mapSRS->getGeographicSRS(), tempgeo) )
-                                z = tempgeo.z();
-                        }
+                        if ( shifts )
+                            z -= shifts[i];
 
                         double hat = z - centroidElevation;
 
@@ -317,46 +579,32 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             // and record HATs along the way.
             else if ( _altitude->clamping() == AltitudeSymbol::CLAMP_RELATIVE_TO_TERRAIN )
             {
-                osg::ref_ptr<const SpatialReference> featureSRSwithMapVertDatum = !vertEquiv ?
-                    SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString()) : 0L;
-
                 if ( perVertex )
                 {
-                    std::vector<float> elevations;
-                    elevations.reserve( geom->size() );
-                    
-                    if ( eq.getElevations( geom->asVector(), featureSRS.get(), elevations, _maxRes ) )
+                    for( unsigned i=0; i<geom->size(); ++i )
                     {
-                        for( unsigned i=0; i<geom->size(); ++i )
-                        {
-                            osg::Vec3d& p = (*geom)[i];
-
-                            if (elevations[i] != NO_DATA_VALUE)
-                            {
-                                p.z() *= scaleZ;
-                                p.z() += offsetZ;
-
-                                double hat = p.z();
-                                p.z() = elevations[i] + p.z();
-
-                                // if necessary, convert the Z value (which is now in the map's SRS) back to
-                                // the feature's SRS.
-                                if ( !vertEquiv )
-                                {
-                                    featureSRSwithMapVertDatum->transform(p, featureSRS.get(), p);
-                                }
-
-                                if ( hat > maxHAT )
-                                    maxHAT = hat;
-                                if ( hat < minHAT )
-                                    minHAT = hat;
-
-                                if ( elevations[i] > maxTerrainZ )
-                                    maxTerrainZ = elevations[i];
-                                if ( elevations[i] < minTerrainZ )
-                                    minTerrainZ = elevations[i];
-                            }
-                        }
+                        osg::Vec3d& p = (*geom)[i];
+
+                        p.z() *= scaleZ;
+                        p.z() += offsetZ;
+
+                        double hat = p.z();
+                        p.z() = elevations[i] + p.z();
+
+                        // if necessary, convert the Z value (which is now in the map's SRS) back to
+                        // the feature's SRS.
+                        if ( shifts )
+                            p.z() += shifts[i];
+
+                        if ( hat > maxHAT )
+                            maxHAT = hat;
+                        if ( hat < minHAT )
+                            minHAT = hat;
+
+                        if ( elevations[i] > maxTerrainZ )
+                            maxTerrainZ = elevations[i];
+                        if ( elevations[i] < minTerrainZ )
+                            minTerrainZ = elevations[i];
                     }
                 }
                 else // per-centroid
@@ -372,10 +620,8 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
 
                         // if necessary, convert the Z value (which is now in the map's SRS) back to
                         // the feature's SRS.
-                        if ( !vertEquiv )
-                        {
-                            featureSRSwithMapVertDatum->transform(p, featureSRS.get(), p);
-                        }
+                        if ( shifts )
+                            p.z() += shifts[i];
 
                         if ( hat > maxHAT )
                             maxHAT = hat;
@@ -393,40 +639,15 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             // Clamp - replace the geometry's Z with the terrain height.
             else // CLAMP_TO_TERRAIN
             {
-                if ( perVertex )
+                for( unsigned i=0; i<geom->size(); ++i )
                 {
-                    eq.getElevations( geom->asVector(), featureSRS.get(), true, _maxRes );
-                    
+                    osg::Vec3d& p = (*geom)[i];
+                    p.z() = perVertex ? elevations[i] : centroidElevation;
+
                     // if necessary, transform the Z values (which are now in the map SRS) back
                     // into the feature's SRS.
-                    if ( !vertEquiv )
-                    {
-                        osg::ref_ptr<const SpatialReference> featureSRSwithMapVertDatum =
-                            SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString());
-
-                        osg::Vec3d tempgeo;
-                        for( unsigned i=0; i<geom->size(); ++i )
-                        {
-                            osg::Vec3d& p = (*geom)[i];
-                            featureSRSwithMapVertDatum->transform(p, featureSRS.get(), p);
-                        }
-                    }
-                }
-                else // per-centroid
-                {
-                    osg::ref_ptr<const SpatialReference> featureSRSWithMapVertDatum;
-                    if ( !vertEquiv )
-                        featureSRSWithMapVertDatum = SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString());
-
-                    for( unsigned i=0; i<geom->size(); ++i )
-                    {
-                        osg::Vec3d& p = (*geom)[i];
-                        p.z() = centroidElevation;
-                        if ( !vertEquiv )
-                        {
-                            featureSRSWithMapVertDatum->transform(p, featureSRS.get(), p);
-                        }
-                    }
+                    if ( shifts )
+                        p.z() += shifts[i];
                 }
             }
 
@@ -438,6 +659,16 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
                     i->z() += offsetZ;
                 }
             }
+
+            if ( perVertex )
+            {
+                elevations += geom->size();
+            }
+
+            if ( shifts )
+            {
+                shifts += geom->size();
+            }
         }
 
         if ( minHAT != DBL_MAX )
@@ -453,6 +684,8 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
         }
     }
 
+    cx.addStageTime("altitude.apply", osg::Timer::instance()->delta_s(stageStart, osg::Timer::instance()->tick()));
+
     double t = OE_GET_TIMER(pushAndClamp);
     OE_DEBUG << LC << "pushAndClamp: tpp = " << (t / (double)total)*1000000.0 << " us\n";
 }
@@ -32,6 +32,7 @@
 #include <osgEarth/ClampableNode>
 #include <osgEarth/GLUtils>
 #include <osgEarth/Text>
+#include <osgEarth/TextCache>
 
 #include <osgText/Text>
 #include <osg/Depth>
@@ -65,7 +66,19 @@ AnnotationUtils::createTextDrawable(const std::string& text,
                                     const BBoxSymbol* bbox,
                                     const osg::BoundingBox& box)
 {
-    osgText::Text* drawable = new osgEarth::Text();
+    // Styled text is expensive to lay out, and labels tend to repeat;
+    // copy it from a shared prototype when we can.
+    TextCache* cache = Registry::instance()->getTextCache();
+    std::string key;
+    if (cache)
+    {
+        key = TextCache::makeKey(text, symbol, bbox, box);
+        osgText::Text* cached = cache->createText(key);
+        if (cached)
+            return cached;
+    }
+
+    osgEarth::Text* drawable = new osgEarth::Text();
 
     osgText::String::Encoding text_encoding = osgText::String::ENCODING_UNDEFINED;
     if ( symbol && symbol->encoding().isSet() )
@@ -96,6 +109,11 @@ AnnotationUtils::createTextDrawable(const std::string& text,
         }
         drawable->setDrawMode(mask);
     }
+
+    if (cache)
+    {
+        cache->insert(key, drawable);
+    }
     
     return drawable;
 }
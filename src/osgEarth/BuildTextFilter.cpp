@@ -21,6 +21,9 @@
 #include <osgEarth/TextSymbol>
 #include <osgEarth/PlaceNode>
 #include <osgEarth/FeatureIndex>
+#include <osgEarth/TextBatch>
+#include <osgEarth/AnnotationUtils>
+#include <osg/MatrixTransform>
 
 #define LC "[BuildTextFilter] "
 
@@ -75,6 +78,47 @@ namespace
         return node;
     }
 
+    /**
+    * Adds a feature's label to a shared TextBatch instead of making a
+    * PlaceNode for it. Returns false if the text can't be batched.
+    */
+    bool addToBatch(
+        Feature*                 feature,
+        const Style&             style,
+        osg::ref_ptr<TextBatch>& batch,
+        osg::Group*              group )
+    {
+        const TextSymbol* symbol = style.get<TextSymbol>();
+
+        // same text PlaceNode would make when it has no icon
+        osg::ref_ptr<osg::Drawable> drawable = AnnotationUtils::createTextDrawable(
+            symbol->content()->eval(),
+            symbol,
+            0L,
+            osg::BoundingBox() );
+
+        osgEarth::Text* text = dynamic_cast<osgEarth::Text*>(drawable.get());
+        if ( !text )
+            return false;
+
+        osg::Vec3d center = feature->getGeometry()->getBounds().center();
+        osg::Vec3d world;
+        if ( !GeoPoint(feature->getSRS(), center, ALTMODE_ABSOLUTE).toWorld(world) )
+            return false;
+
+        // anchors are stored relative to the first one to keep float precision
+        if ( !batch.valid() )
+        {
+            batch = new TextBatch();
+            osg::MatrixTransform* xform = new osg::MatrixTransform(osg::Matrix::translate(world));
+            xform->addChild( batch.get() );
+            group->addChild( xform );
+        }
+
+        const osg::MatrixTransform* xform = static_cast<const osg::MatrixTransform*>(batch->getParent(0));
+        return batch->addText( text, world - xform->getMatrix().getTrans() );
+    }
+
     /**
     * Creates a complete set of positioned label nodes from a feature list.
     */
@@ -104,6 +148,24 @@ namespace
         NumericExpression iconHeadingExpr ( icon ? *icon->heading()  : NumericExpression() );
         NumericExpression vertOffsetExpr  ( alt  ? *alt->verticalOffset() : NumericExpression() );
 
+        // Text-only labels that opt out of decluttering and sit at absolute,
+        // map-clamped positions don't need a PlaceNode each; draw them from
+        // one TextBatch instead.
+        bool useBatch =
+            text != 0L &&
+            icon == 0L &&
+            styleCopy.get<BBoxSymbol>() == 0L &&
+            text->declutter().isSetTo(false) &&
+            !text->onScreenRotation().isSet() &&
+            !text->geographicCourse().isSet() &&
+            !text->pixelOffset().isSet() &&
+            context.featureIndex() == 0L &&
+            alt != 0L &&
+            alt->clamping() != alt->CLAMP_NONE &&
+            alt->technique().isSetTo(alt->TECHNIQUE_MAP);
+
+        osg::ref_ptr<TextBatch> batch;
+
         for( FeatureList::const_iterator i = input.begin(); i != input.end(); ++i )
         {
             Feature* feature = i->get();
@@ -161,6 +223,9 @@ namespace
                     tempStyle.get<IconSymbol>()->heading()->setLiteral( feature->eval(iconHeadingExpr, &context) );
             }
 
+            if ( useBatch && addToBatch(feature, tempStyle, batch, group) )
+                continue;
+
             PlaceNode* node = makePlaceNode(
                 context,
                 feature,
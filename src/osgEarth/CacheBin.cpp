@@ -247,11 +247,9 @@ namespace
 }
 
 
-bool
-CacheBin::writeNode(const std::string&    key,
-                    osg::Node*            node,
-                    const Config&         metadata,
-                    const osgDB::Options* writeOptions)
+void
+CacheBin::prepareNode(osg::Node*            node,
+                      const osgDB::Options* writeOptions)
 {
     // Preparation step - removes things like UserDataContainers
     PrepareForCaching prep;
@@ -260,6 +258,15 @@ CacheBin::writeNode(const std::string&    key,
     // Write external refs (like texture images) to the cache bin
     WriteExternalReferencesToCache writeRefs(this, writeOptions);
     node->accept( writeRefs );
+}
+
+bool
+CacheBin::writeNode(const std::string&    key,
+                    osg::Node*            node,
+                    const Config&         metadata,
+                    const osgDB::Options* writeOptions)
+{
+    prepareNode(node, writeOptions);
 
     // finally, write the graph to the bin:
     write(key, node, metadata, writeOptions);
@@ -1,9 +1,6 @@
 #include <osgEarth/ClusterNode>
 
-#include <osgEarth/kdbush.hpp>
-
-typedef std::pair<int, int> TPoint;
-typedef std::vector< std::size_t > TIds;
+#include <cstdlib>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
@@ -15,7 +12,8 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
     _enabled(true),
     _dirty(true),
     _defaultImage(defaultImage),
-    _dirtyIndex(true)
+    _dirtyIndex(true),
+    _stamp(0u)
 {
     setCullingActive(false);
     
@@ -118,6 +116,23 @@ namespace
 
         return bsI.center().x() < bsJ.center().x();
     }
+
+    // Installed on each index group. Moving a node dirties the bounds of
+    // its parents, so a recomputed group bound means the cached centers of
+    // that group's nodes are out of date.
+    struct IndexBoundCallback : public osg::Node::ComputeBoundingSphereCallback
+    {
+        IndexBoundCallback(unsigned first) : _first(first), _stale(true) { }
+
+        osg::BoundingSphere computeBound(const osg::Node& node) const
+        {
+            _stale = true;
+            return node.computeBound();
+        }
+
+        unsigned _first; // offset of the group's first node in _nodes
+        mutable bool _stale;
+    };
 }
 void ClusterNode::buildIndex()
 {
@@ -136,34 +151,54 @@ void ClusterNode::buildIndex()
             if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
             {
                 currentGroup = new osg::Group;
+                currentGroup->setComputeBoundingSphereCallback(new IndexBoundCallback(i));
                 _clusterIndex.push_back(currentGroup);
             }
             currentGroup->addChild(_nodes[i]);                      
         }
+
+        // filled in by getClusters as each group's callback reports it stale
+        _centerX.resize(_nodes.size());
+        _centerY.resize(_nodes.size());
+        _centerZ.resize(_nodes.size());
     }
     _dirtyIndex = false;
 }
 
 
-void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
+bool ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 {
-    _nextLabel = 0;
-
     osg::Camera* camera = cv->getCurrentCamera();
 
     osg::Viewport* viewport = camera->getViewport();
     if (!viewport)
     {
-        return;
+        out.clear();
+        _clusterSeeds.clear();
+        _clusterSizes.clear();
+        return true;
     }
 
-    osg::Matrixd mvpw = camera->getViewMatrix() *
+    const osg::Matrixd mvpw = camera->getViewMatrix() *
         camera->getProjectionMatrix() *
         camera->getViewport()->computeWindowMatrix();
 
-    std::vector<TPoint> points;
-
-    osg::NodeList validPlaces;
+    // Bin the points into a screen-space grid whose cells are at least as large
+    // as the radius, so each range search only needs to visit the 3x3 cells
+    // around a point.
+    const int radius = (int)_radius;
+    int cellSize = osg::maximum(radius, 1);
+    cellSize = osg::maximum(cellSize, (int)ceil(osg::maximum(viewport->width(), viewport->height()) / 256.0));
+    const int cols = (int)viewport->width() / cellSize + 1;
+    const int rows = (int)viewport->height() / cellSize + 1;
+    const double width = viewport->width();
+    const double height = viewport->height();
+
+    _places.clear();
+    _pointX.clear();
+    _pointY.clear();
+    _pointCell.clear();
+    _cellStart.assign(cols*rows + 1, 0u);
 
     buildIndex();
 
@@ -175,92 +210,220 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
             continue;
         }
 
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
-        {
-            osg::Node* node = index->getChild(i);
-            osg::Vec3d world = node->getBound().center();
+        IndexBoundCallback* indexBound = static_cast<IndexBoundCallback*>(index->getComputeBoundingSphereCallback());
+        const unsigned first = indexBound->_first;
+        const unsigned last = first + index->getNumChildren();
 
-            if (cv->isCulled(*node))
+        if (indexBound->_stale)
+        {
+            for (unsigned int i = first; i < last; i++)
             {
-                continue;
+                const osg::Vec3d center = _nodes[i]->getBound().center();
+                _centerX[i] = center.x();
+                _centerY[i] = center.y();
+                _centerZ[i] = center.z();
             }
+            indexBound->_stale = false;
+        }
 
-            if (!_horizon->isVisible(world))
-            {
+        // Project straight from the cached centers. A center inside the
+        // viewport and depth range is inside the frustum, so this also
+        // stands in for culling each node.
+        for (unsigned int i = first; i < last; i++)
+        {
+            const double x = _centerX[i], y = _centerY[i], z = _centerZ[i];
+
+            const double w = x*mvpw(0,3) + y*mvpw(1,3) + z*mvpw(2,3) + mvpw(3,3);
+            if (w <= 0.0)
                 continue;
-            }
 
-            osg::Vec3d screen = world * mvpw;
+            const double sx = (x*mvpw(0,0) + y*mvpw(1,0) + z*mvpw(2,0) + mvpw(3,0)) / w;
+            if (sx < 0.0 || sx > width)
+                continue;
+
+            const double sy = (x*mvpw(0,1) + y*mvpw(1,1) + z*mvpw(2,1) + mvpw(3,1)) / w;
+            if (sy < 0.0 || sy > height)
+                continue;
+
+            const double sz = (x*mvpw(0,2) + y*mvpw(1,2) + z*mvpw(2,2) + mvpw(3,2)) / w;
+            if (sz < 0.0 || sz > 1.0)
+                continue;
+
+            if (!_horizon->isVisible(osg::Vec3d(x, y, z)))
+                continue;
 
-            if (screen.x() >= 0 && screen.x() <= viewport->width() &&
-                screen.y() >= 0 && screen.y() <= viewport->height())
+            const int px = (int)sx, py = (int)sy;
+            const unsigned int cell = (py / cellSize)*cols + px / cellSize;
+            _places.push_back(_nodes[i].get());
+            _pointX.push_back(px);
+            _pointY.push_back(py);
+            _pointCell.push_back(cell);
+            ++_cellStart[cell + 1];
+        }
+    }
+
+    const unsigned int numPlaces = _places.size();
+
+    // If the same places are visible and have all moved together by (nearly)
+    // the same screen offset since the clusters were computed, the clusters
+    // are still valid. The markers are geo-positioned so they follow along.
+    if (!_dirty && numPlaces == _clusterPlaces.size())
+    {
+        bool coherent = true;
+        if (numPlaces > 0)
+        {
+            int dx = _pointX[0] - _clusterPointX[0];
+            int dy = _pointY[0] - _clusterPointY[0];
+            for (unsigned int i = 0; i < numPlaces && coherent; i++)
             {
-                validPlaces.push_back(node);
-                points.push_back(TPoint(screen.x(), screen.y()));
+                coherent =
+                    _places[i] == _clusterPlaces[i] &&
+                    abs(_pointX[i] - _clusterPointX[i] - dx) <= 1 &&
+                    abs(_pointY[i] - _clusterPointY[i] - dy) <= 1;
             }
         }
+        if (coherent)
+        {
+            return false;
+        }
     }
 
-    if (validPlaces.size() == 0) return;
+    _nextLabel = 0;
+    unsigned int numClusters = 0;
+    _clusterSeeds.clear();
+    _clusterSizes.clear();
 
-    kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
+    // Only a style callback looks at the cluster's node list; filling it
+    // costs a reference count round trip per node.
+    const bool fillNodes = _styleCallback.valid();
 
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
+    if (numPlaces > 0)
     {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
-
-        // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
+        // counting sort of the points by cell. The unclustered points in cell c
+        // are at [_cellStart[c] .. _cellEnd[c]) of _cellItems, with their screen
+        // coordinates alongside in _cellX/_cellY so the searches read memory in order.
+        for (unsigned int c = 1; c < _cellStart.size(); c++)
         {
-            continue;
+            _cellStart[c] += _cellStart[c-1];
+        }
+        _cellEnd.assign(_cellStart.begin(), _cellStart.end() - 1);
+        _cellItems.resize(numPlaces);
+        _cellX.resize(numPlaces);
+        _cellY.resize(numPlaces);
+        for (unsigned int i = 0; i < numPlaces; i++)
+        {
+            unsigned int k = _cellEnd[_pointCell[i]]++;
+            _cellItems[k] = i;
+            _cellX[k] = _pointX[i];
+            _cellY[k] = _pointY[i];
         }
 
-        osg::Vec3d world = node->getBound().center();
+        if (_clusteredStamp.size() < numPlaces)
+        {
+            _clusteredStamp.resize(numPlaces, _stamp);
+        }
+        if (++_stamp == 0u)
+        {
+            std::fill(_clusteredStamp.begin(), _clusteredStamp.end(), 0u);
+            _stamp = 1u;
+        }
 
-        // Get any matching indices that are part of this cluster.
-        TIds indices;
+        for (unsigned int i = 0; i < numPlaces; i++)
+        {
+            // If this thing is already part of a cluster then just continue.
+            if (_clusteredStamp[i] == _stamp)
+            {
+                continue;
+            }
 
-        index.range(screen.first - _radius, screen.second - _radius, screen.first + _radius, screen.second + _radius, indices);
+            const int x = _pointX[i];
+            const int y = _pointY[i];
+            osg::Node* node = _places[i];
 
-        // Create a new cluster.
-        Cluster cluster;
+            // Reuse the cluster records (and their node lists) from the last pass.
+            if (numClusters == out.size())
+            {
+                out.push_back(Cluster());
+            }
+            Cluster& cluster = out[numClusters++];
+            cluster.nodes.clear();
+            unsigned int size = 0;
 
-        unsigned int actualCount = 0;
+            // Add all of the points within the radius to the cluster.
+            int c0 = osg::maximum(x - radius, 0) / cellSize;
+            int c1 = osg::minimum((x + radius) / cellSize, cols - 1);
+            int r0 = osg::maximum(y - radius, 0) / cellSize;
+            int r1 = osg::minimum((y + radius) / cellSize, rows - 1);
 
-        // Add all of the points to the cluster.
-        for (unsigned int j = 0; j < indices.size(); j++)
-        {
-            if (clustered.find(indices[j]) == clustered.end())
+            for (int r = r0; r <= r1; r++)
             {
-                if (_canClusterCallback.valid())
+                for (int c = c0; c <= c1; c++)
                 {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
-                    if (!canCluster) {
-                        continue;
+                    unsigned int cell = r*cols + c;
+                    unsigned int end = _cellEnd[cell];
+                    for (unsigned int k = _cellStart[cell]; k < end; )
+                    {
+                        unsigned int j = _cellItems[k];
+                        if (abs(_cellX[k] - x) <= radius &&
+                            abs(_cellY[k] - y) <= radius &&
+                            (!_canClusterCallback.valid() || (*_canClusterCallback)(node, _places[j])))
+                        {
+                            if (fillNodes)
+                                cluster.nodes.push_back(_places[j]);
+                            _clusteredStamp[j] = _stamp;
+                            ++size;
+
+                            // drop clustered points from the cell so later searches skip them
+                            --end;
+                            _cellItems[k] = _cellItems[end];
+                            _cellX[k] = _cellX[end];
+                            _cellY[k] = _cellY[end];
+                        }
+                        else
+                        {
+                            ++k;
+                        }
                     }
+                    _cellEnd[cell] = end;
                 }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
             }
-        }
 
-        std::stringstream buf;
-        buf << actualCount << std::endl;
+            // A lone node draws itself, so it only needs a marker if a style
+            // callback might want one.
+            if (size > 1 || fillNodes)
+            {
+                std::stringstream buf;
+                buf << size << std::endl;
+                std::string text = buf.str();
+
+                PlaceNode* marker = getOrCreateLabel();
+                GeoPoint markerPos;
+                markerPos.fromWorld(_mapNode->getMapSRS(), node->getBound().center());
+                marker->setPosition(markerPos);
+                if (marker->getText() != text)
+                {
+                    marker->setText(text);
+                }
+                cluster.marker = marker;
+            }
+            else
+            {
+                cluster.marker = 0L;
+            }
+
+            _clusterSeeds.push_back(node);
+            _clusterSizes.push_back(size);
+            _clusteredStamp[i] = _stamp;
+        }
+    }
 
-        PlaceNode* marker = getOrCreateLabel();
-        GeoPoint markerPos;
-        markerPos.fromWorld(_mapNode->getMapSRS(), world);
-        marker->setPosition(markerPos);
-        marker->setText(buf.str());
+    out.resize(numClusters);
 
-        cluster.marker = marker;
-        out.push_back(cluster);
+    _clusterPlaces = _places;
+    _clusterPointX = _pointX;
+    _clusterPointY = _pointY;
 
-        clustered.insert(i);
-    }
+    return true;
 }
 
 void ClusterNode::traverse(osg::NodeVisitor& nv)
@@ -289,11 +452,8 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
 
                     _horizon->setEye(eye);
 
-                    _clusters.clear();
-                    getClusters(cv, _clusters);
-
                     // Style the clusters if need be
-                    if (_styleCallback)
+                    if (getClusters(cv, _clusters) && _styleCallback)
                     {
                         for (ClusterList::iterator itr = _clusters.begin(); itr != _clusters.end(); ++itr)
                         {
@@ -303,19 +463,17 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
                     }
                 }
 
-                for (ClusterList::iterator itr = _clusters.begin(); itr != _clusters.end(); ++itr)
+                for (unsigned int i = 0; i < _clusters.size(); i++)
                 {
-                    Cluster& cluster = *itr;
-
                     // If we have more than 1 place, traverse the representative marker
-                    if (cluster.nodes.size() > 1)
+                    if (_clusterSizes[i] > 1)
                     {
-                        itr->marker->accept(nv);
+                        _clusters[i].marker->accept(nv);
                     }
                     else
                     {
-                        // Otherwise just traverse the first node
-                        cluster.nodes[0]->accept(nv);
+                        // Otherwise just traverse the node itself
+                        _clusterSeeds[i]->accept(nv);
                     }
                 }
                 _dirty = false;
@@ -452,6 +452,112 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
 }
 
 
+osg::Node*
+DrawInstanced::createInstancedNode(osg::Node* node, const InstanceList& instances)
+{
+    if ( !Registry::capabilities().supportsDrawInstanced() )
+        return 0L;
+
+    return createInstancedNode( node, instances, Registry::capabilities().getMaxTextureBufferSize() );
+}
+
+
+osg::Node*
+DrawInstanced::createInstancedNode(osg::Node* node, const InstanceList& instances, int maxTBOSize)
+{
+    if ( !node || instances.empty() )
+        return 0L;
+
+    // As in convertGraphToUseDrawInstanced, the max TBO size is treated as bytes.
+    int instanceSize = 3 * 4 * sizeof(float); // 3 vec4's.
+    unsigned maxTBOInstances = maxTBOSize / instanceSize;
+
+    unsigned numInstances = instances.size();
+    if ( numInstances > maxTBOInstances )
+    {
+        OE_WARN << LC << "Number of Instances: " << numInstances << " exceeds Number of instances TBO can store: " << maxTBOInstances << std::endl;
+        OE_WARN << LC << "Storing maximum possible instances in TBO, and skipping the rest" << std::endl;
+        numInstances = maxTBOInstances;
+    }
+
+    // calculate the overall bounding box for the model:
+    osg::ComputeBoundsVisitor cbv;
+    node->accept( cbv );
+    const osg::BoundingBox& nodeBox = cbv.getBoundingBox();
+
+    osg::Image* image = new osg::Image();
+    image->setName("osgearth.drawinstanced.packed");
+    image->allocateImage( numInstances*3, 1, 1, GL_RGBA, GL_FLOAT );
+
+    osg::BoundingBox bbox;
+    GLfloat* ptr = reinterpret_cast<GLfloat*>( image->data() );
+    for(unsigned m=0; m<numInstances; ++m)
+    {
+        const Instance& i = instances[m];
+
+        // position, and the low 16 bits of the ObjectID (exact as a float)
+        *ptr++ = i.position.x();
+        *ptr++ = i.position.y();
+        *ptr++ = i.position.z();
+        *ptr++ = (float)(i.objectID & 0xffff);
+
+        *ptr++ = i.rotation.x();
+        *ptr++ = i.rotation.y();
+        *ptr++ = i.rotation.z();
+        *ptr++ = i.rotation.w();
+
+        // scale, and the high 16 bits of the ObjectID
+        *ptr++ = i.scale.x();
+        *ptr++ = i.scale.y();
+        *ptr++ = i.scale.z();
+        *ptr++ = (float)((i.objectID >> 16) & 0xffff);
+
+        osg::Matrixf mat =
+            osg::Matrixf::scale(i.scale) *
+            osg::Matrixf::rotate(i.rotation) *
+            osg::Matrixf::translate(i.position);
+
+        for(unsigned c=0; c<8; ++c)
+            bbox.expandBy(nodeBox.corner(c) * mat);
+    }
+
+    // so the TBO will serialize properly.
+    image->setWriteHint(osg::Image::STORE_INLINE);
+
+    osg::TextureBuffer* tbo = new osg::TextureBuffer;
+    tbo->setImage(image);
+    tbo->setInternalFormat( GL_RGBA32F_ARB );
+    tbo->setUnRefImageDataAfterApply( true );
+
+    // Flatten any transforms in the node graph:
+    MakeTransformsStatic makeStatic;
+    node->accept(makeStatic);
+    osgUtil::Optimizer::FlattenStaticTransformsDuplicatingSharedSubgraphsVisitor flatten;
+    node->accept(flatten);
+
+    // convert the primitive sets and install the static bounds:
+    ConvertToDrawInstanced cdi(numInstances, bbox, true, tbo, 0);
+    node->accept( cdi );
+
+    osg::Group* instanceGroup = new osg::Group();
+
+    osg::StateSet* stateset = instanceGroup->getOrCreateStateSet();
+    stateset->setTextureAttribute(cdi.getTextureImageUnit(), tbo);
+    stateset->getOrCreateUniform("oe_di_packed_TBO", osg::Uniform::SAMPLER_BUFFER)->set(cdi.getTextureImageUnit());
+
+    // Tell the SG to skip the positioning TBO.
+    ShaderGenerator::setIgnoreHint(tbo, true);
+
+    VirtualProgram* vp = VirtualProgram::getOrCreate(stateset);
+    vp->setName("DrawInstanced packed");
+    osgEarth::Shaders pkg;
+    pkg.load( vp, pkg.InstancingPacked );
+
+    instanceGroup->addChild( node );
+    return instanceGroup;
+}
+
+
 const DrawInstanced::MatrixRefVector*
 DrawInstanced::getMatrixVector(osg::Node* node)
 {
@@ -644,43 +644,14 @@ namespace
     //typedef std::pair<RefElevationLayer, TileKey> LayerAndKey;
     typedef std::vector<LayerData>              LayerDataVector;
 
-    //! Gets the normal vector for elevation data at column s, row t.
-    osg::Vec3 getNormal(const GeoExtent& extent, const osg::HeightField* hf, int s, int t)
-    {
-        int w = hf->getNumColumns();
-        int h = hf->getNumRows();
-
-        osg::Vec2d res(
-            extent.width() / (double)(w-1),
-            extent.height() / (double)(h-1));
-
-        float e = hf->getHeight(s, t);
-
-        double dx = res.x(), dy = res.y();
-
-        if (extent.getSRS()->isGeographic())
-        {
-            double R = extent.getSRS()->getEllipsoid()->getRadiusEquator();
-            double mPerDegAtEquator = (2.0 * osg::PI * R) / 360.0;
-            dy = dy * mPerDegAtEquator;
-            double lat = extent.yMin() + res.y()*(double)t;
-            dx = dx * mPerDegAtEquator * cos(osg::DegreesToRadians(lat));
-        }
-
-        osg::Vec3d west(0, 0, e), east(0, 0, e), south(0, 0, e), north(0, 0, e);
-
-        if (s > 0)     west.set (-dx, 0, hf->getHeight(s-1, t));
-        if (s < w - 1) east.set ( dx, 0, hf->getHeight(s+1, t));
-        if (t > 0)     south.set(0, -dy, hf->getHeight(s, t-1));
-        if (t < h - 1) north.set(0,  dy, hf->getHeight(s, t+1));
-
-        osg::Vec3d normal = (east - west) ^ (north - south);
-        return normal;
-    }
-
     //! Creates a normal map for heightfield "hf" and stores it in the
     //! pre-allocated NormalMap.
     //!
+    //! If "hf" is larger than the normal map by exactly one sample on each side,
+    //! the outer ring is treated as a border: it is not written to the normal map
+    //! but it supplies the neighbors for the edge texels, so that adjacent tiles
+    //! compute identical normals along their shared edge.
+    //!
     //! "deltaLOD" holds the difference in LODs between the heightfield itself and the LOD
     //! from which the elevation value came. This will be positive when we had to "fall back" on
     //! lower LOD data to fetch an elevation value. When this happens we need to interpolate
@@ -694,73 +665,220 @@ namespace
     //! normals) in order to maintain terrain correlation. Maybe someday.
     void createNormalMap(const GeoExtent& extent, const osg::HeightField* hf, const osg::ShortArray* deltaLOD, NormalMap* normalMap)
     {
-        int w = hf->getNumColumns();
-        int h = hf->getNumRows();
+        OE_PROFILING_ZONE;
+
+        const int w = hf->getNumColumns();
+        const int h = hf->getNumRows();
+
+        const int border =
+            (w == (int)normalMap->s() + 2 && h == (int)normalMap->t() + 2) ? 1 : 0;
+
+        const int nw = w - 2*border;
+        const int nh = h - 2*border;
+
+        // sample spacing in the tile's SRS:
+        double xres = extent.width() / (double)(nw-1);
+        double yres = extent.height() / (double)(nh-1);
+
+        double mPerDegAtEquator = 1.0;
+        bool geographic = extent.getSRS()->isGeographic();
+        if (geographic)
+        {
+            double R = extent.getSRS()->getEllipsoid()->getRadiusEquator();
+            mPerDegAtEquator = (2.0 * osg::PI * R) / 360.0;
+        }
+
+        const float* heights = &hf->getFloatArray()->front();
+
+        // First pass: un-normalized central-difference normal at every sample,
+        // including the border ring. The cross product of the east-west vector
+        // (2dx, 0, dh_x) and the north-south vector (0, 2dy, dh_y) reduces to
+        // (-dh_x*2dy, -2dx*dh_y, 4dxdy), so each row is a straight-line loop
+        // over contiguous floats that the compiler can vectorize.
+        std::vector<osg::Vec3f> raw(w*h);
+
+        for (int t = 0; t < h; ++t)
+        {
+            float dy = (float)(geographic ? yres * mPerDegAtEquator : yres);
+            double lat = extent.yMin() + yres*(double)(t - border);
+            float dx = (float)(geographic ? xres * mPerDegAtEquator * cos(osg::DegreesToRadians(lat)) : xres);
+
+            const float* row = heights + t*w;
+            const float* rowS = t > 0 ? row - w : row;
+            const float* rowN = t < h-1 ? row + w : row;
+            float spanY = (t > 0 && t < h-1) ? 2.0f*dy : dy;
+
+            osg::Vec3f* out = &raw[t*w];
+
+            for (int s = 0; s < w; ++s)
+            {
+                int sW = s > 0 ? s-1 : s;
+                int sE = s < w-1 ? s+1 : s;
+                float spanX = (float)(sE - sW) * dx;
 
-        for (int t = 0; t < (int)hf->getNumRows(); ++t)
+                float dhx = row[sE] - row[sW];
+                float dhy = rowN[s] - rowS[s];
+
+                out[s].set(-dhx*spanY, -spanX*dhy, spanX*spanY);
+            }
+        }
+
+        // Second pass: resolve each output texel (interpolating across fallback
+        // data as necessary), normalize, and encode directly into the image.
+        bool direct =
+            normalMap->getPixelFormat() == GL_RGBA &&
+            normalMap->getDataType() == GL_UNSIGNED_BYTE;
+
+        unsigned char* pixels = normalMap->data();
+
+        for (int t = 0; t < nh; ++t)
         {
-            for (int s = 0; s<(int)hf->getNumColumns(); ++s)
+            int ht = t + border;
+
+            for (int s = 0; s < nw; ++s)
             {
-                int step = 1 << (*deltaLOD)[t*h + s];
+                int hs = s + border;
 
-                osg::Vec3 normal;
+                int step = deltaLOD ? 1 << (*deltaLOD)[ht*w + hs] : 1;
 
-                // four corners:
-                int s0=s, s1=s, t0=t, t1=t;
+                osg::Vec3f normal;
 
                 if (step == 1)
                 {
                     // Same LOD, simple query
-                    normal = getNormal(extent, hf, s, t);
+                    normal = raw[ht*w + hs];
                 }
                 else
                 {
-                    int s0 = osg::maximum(s - (s % step), 0);
+                    // snap to the fallback grid in tile coordinates (the
+                    // border is not part of that grid), then re-apply the border.
+                    int s0 = s - (s % step) + border;
                     int s1 = (s%step == 0)? s0 : osg::minimum(s0+step, w-1);
-                    int t0 = osg::maximum(t - (t % step), 0);
+                    int t0 = t - (t % step) + border;
                     int t1 = (t%step == 0)? t0 : osg::minimum(t0+step, h-1);
 
                     if (s0 == s1 && t0 == t1)
                     {
                         // on-pixel, simple query
-                        normal = getNormal(extent, hf, s0, t0);
+                        normal = raw[t0*w + s0];
                     }
                     else if (s0 == s1)
                     {
                         // same column; linear interpolate along row
-                        osg::Vec3 S = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 N = getNormal(extent, hf, s0, t1);
-                        normal = S*(double)(t1 - t) + N*(double)(t - t0);
+                        normal = raw[t0*w + s0]*(float)(t1 - ht) + raw[t1*w + s0]*(float)(ht - t0);
                     }
                     else if (t0 == t1)
                     {
                         // same row; linear interpolate along column
-                        osg::Vec3 W = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 E = getNormal(extent, hf, s1, t0);
-                        normal = W*(double)(s1 - s) + E*(double)(s - s0);
+                        normal = raw[t0*w + s0]*(float)(s1 - hs) + raw[t0*w + s1]*(float)(hs - s0);
                     }
                     else
                     {
                         // bilinear interpolate
-                        osg::Vec3 SW = getNormal(extent, hf, s0, t0);
-                        osg::Vec3 SE = getNormal(extent, hf, s1, t0);
-                        osg::Vec3 NW = getNormal(extent, hf, s0, t1);
-                        osg::Vec3 NE = getNormal(extent, hf, s1, t1);
-
-                        osg::Vec3 S = SW*(double)(s1 - s) + SE*(double)(s - s0);
-                        osg::Vec3 N = NW*(double)(s1 - s) + NE*(double)(s - s0);
-                        normal = S*(double)(t1 - t) + N*(double)(t - t0);
+                        osg::Vec3f S = raw[t0*w + s0]*(float)(s1 - hs) + raw[t0*w + s1]*(float)(hs - s0);
+                        osg::Vec3f N = raw[t1*w + s0]*(float)(s1 - hs) + raw[t1*w + s1]*(float)(hs - s0);
+                        normal = S*(float)(t1 - ht) + N*(float)(ht - t0);
                     }
                 }
 
                 normal.normalize();
 
-                normalMap->set(s, t, normal, 0.0f);
+                if (direct)
+                {
+                    // GL_RGBA/GL_UNSIGNED_BYTE encoding; see NormalMap::set
+                    unsigned char* p = pixels + 4*(t*nw + s);
+                    p[0] = (unsigned char)(255.0f * 0.5f*(normal.x()+1.0f) + 0.5f);
+                    p[1] = (unsigned char)(255.0f * 0.5f*(normal.y()+1.0f) + 0.5f);
+                    p[2] = (unsigned char)(255.0f * 0.5f*(normal.z()+1.0f) + 0.5f);
+                    p[3] = (unsigned char)(255.0f * 0.5f + 0.5f);
+                }
+                else
+                {
+                    normalMap->set(s, t, normal, 0.0f);
+                }
             }
         }
 
         normalMap->generateCurvatures();
     }
+
+    //! Reads a border sample of a bordered heightfield from the same-LOD
+    //! neighbor that covers it. (c, r) are bordered sample indices and "n" is
+    //! the unbordered tile size; adjacent tiles share their edge samples.
+    bool getNeighborHeight(
+        const HeightFieldNeighborhood& hood,
+        int c, int r, int border, int n,
+        float& out_elevation)
+    {
+        int ci = c - border, ri = r - border;
+        int xoffset = ci < 0 ? -1 : ci >= n ? 1 : 0;
+        int yoffset = ri < 0 ? 1 : ri >= n ? -1 : 0; // +y is south
+
+        const osg::HeightField* neighbor = hood.getNeighbor(xoffset, yoffset);
+        if (!neighbor ||
+            (int)neighbor->getNumColumns() != n ||
+            (int)neighbor->getNumRows() != n)
+        {
+            return false;
+        }
+
+        int nc = ci - xoffset*(n-1);
+        int nr = ri + yoffset*(n-1);
+        if (nc < 0 || nc >= n || nr < 0 || nr >= n)
+            return false;
+
+        out_elevation = neighbor->getHeight(nc, nr);
+        return out_elevation != NO_DATA_VALUE;
+    }
+
+    //! Samples a layer just outside a tile, for border samples no finished
+    //! neighbor covers. Reads the layer's tile at the same LOD the tile
+    //! itself uses for that layer (falling back to ancestors like the main
+    //! sampling loop does), so both sides of an edge see the same data.
+    struct BorderSampler
+    {
+        typedef std::pair<int, TileKey> CacheKey;
+        std::map<CacheKey, GeoHeightField> _cache;
+
+        bool getElevation(
+            ElevationLayer*         layer,
+            int                     layerIndex,
+            const Profile*          profile,
+            unsigned                lod,
+            double                  x,
+            double                  y,
+            RasterInterpolation     interp,
+            ProgressCallback*       progress,
+            float&                  out_elevation)
+        {
+            TileKey sampleKey = profile->createTileKey(x, y, lod);
+            if (!sampleKey.valid())
+                return false;
+
+            CacheKey ck(layerIndex, sampleKey);
+            std::map<CacheKey, GeoHeightField>::iterator i = _cache.find(ck);
+            if (i == _cache.end())
+            {
+                GeoHeightField geohf;
+                TileKey actualKey = sampleKey;
+                while (!geohf.valid() && actualKey.valid() && layer->isKeyInLegalRange(actualKey))
+                {
+                    geohf = layer->createHeightField(actualKey, progress);
+                    if (!geohf.valid())
+                        actualKey = actualKey.createParentKey();
+                }
+                i = _cache.insert(std::make_pair(ck, geohf)).first;
+            }
+
+            if (!i->second.valid())
+                return false;
+
+            const SpatialReference* srs = profile->getSRS();
+            return
+                i->second.getElevation(srs, x, y, interp, srs, out_elevation) &&
+                out_elevation != NO_DATA_VALUE;
+        }
+    };
 }
 
 bool
@@ -769,7 +887,8 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
                                                       const TileKey&         key,
                                                       const Profile*         haeProfile,
                                                       RasterInterpolation interpolation,
-                                                      ProgressCallback*      progress ) const
+                                                      ProgressCallback*      progress,
+                                                      const HeightFieldNeighborhood* neighbors) const
 {
     // heightfield must already exist.
     if ( !hf )
@@ -787,6 +906,17 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
         keyToUse = TileKey(key.getLOD(), key.getTileX(), key.getTileY(), haeProfile );
     }
 
+    // If the caller supplied a heightfield one sample larger on each side than
+    // the normal map, fill in that border ring as well so the normals along the
+    // tile edges are computed from real neighboring data.
+    unsigned border = 0u;
+    if (normalMap &&
+        hf->getNumColumns() == normalMap->s() + 2u &&
+        hf->getNumRows() == normalMap->t() + 2u)
+    {
+        border = 1u;
+    }
+
     // Collect the valid layers for this tile.
     LayerDataVector contenders;
     LayerDataVector offsets;
@@ -815,7 +945,7 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
         {
             // calculate the resolution-mapped key (adjusted for tile resolution differential).
             TileKey mappedKey = keyToUse.mapResolution(
-                hf->getNumColumns(),
+                hf->getNumColumns() - 2u*border,
                 layer->getTileSize() );
 
             bool useLayer = true;
@@ -897,10 +1027,10 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
     // Sample the layers into our target.
     unsigned numColumns = hf->getNumColumns();
     unsigned numRows    = hf->getNumRows();
-    double   xmin       = key.getExtent().xMin();
-    double   ymin       = key.getExtent().yMin();
-    double   dx         = key.getExtent().width() / (double)(numColumns-1);
-    double   dy         = key.getExtent().height() / (double)(numRows-1);
+    double   dx         = key.getExtent().width() / (double)(numColumns-1-2*border);
+    double   dy         = key.getExtent().height() / (double)(numRows-1-2*border);
+    double   xmin       = key.getExtent().xMin() - dx*(double)border;
+    double   ymin       = key.getExtent().yMin() - dy*(double)border;
 
     // We will load the actual heightfields on demand. We might not need them all.
     GeoHeightFieldVector heightFields(contenders.size());
@@ -930,10 +1060,15 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
 
     TileKey scratchKey; // Storage if a new key needs to be constructed
 
+    // Border samples that fall outside every contender's heightfield;
+    // these get resolved from neighboring tiles after the main pass.
+    std::vector<std::pair<unsigned, unsigned> > unresolvedBorder;
+
     bool requiresResample = true;
 
     // If we only have a single contender layer, and the tile is the same size as the requested
-    // heightfield then we just use it directly and avoid having to resample it
+    // heightfield (less any border) then we just use it directly and avoid having to resample it.
+    // The border samples lie outside that tile, so they go to the border pass below.
     if (contenders.size() == 1 && offsets.empty())
     {
         ElevationLayer* layer = contenders[0].layer.get();
@@ -942,19 +1077,37 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
         GeoHeightField layerHF = layer->createHeightField(contenderKey, 0);
         if (layerHF.valid())
         {
-            if (layerHF.getHeightField()->getNumColumns() == hf->getNumColumns() &&
-                layerHF.getHeightField()->getNumRows() == hf->getNumRows())
+            const osg::HeightField* src = layerHF.getHeightField();
+            unsigned srcColumns = numColumns - 2u*border;
+            unsigned srcRows = numRows - 2u*border;
+
+            if (src->getNumColumns() == srcColumns &&
+                src->getNumRows() == srcRows)
             {
                 requiresResample = false;
-                memcpy(hf->getFloatArray()->asVector().data(),
-                    layerHF.getHeightField()->getFloatArray()->asVector().data(),
-                    sizeof(float) * hf->getFloatArray()->size()
-                );
+                const float* srcData = src->getFloatArray()->asVector().data();
+                float* dstData = hf->getFloatArray()->asVector().data();
+                for (unsigned r = 0; r < srcRows; ++r)
+                {
+                    memcpy(
+                        dstData + (r+border)*numColumns + border,
+                        srcData + r*srcColumns,
+                        sizeof(float) * srcColumns);
+                }
                 if (deltaLOD.valid())
                 {
                     deltaLOD->resize(hf->getFloatArray()->size(), 0);
                 }
                 realData = true;
+
+                for (unsigned r = 0; r < numRows; ++r)
+                {
+                    for (unsigned c = 0; c < numColumns; ++c)
+                    {
+                        if (c < border || c >= numColumns-border || r < border || r >= numRows-border)
+                            unresolvedBorder.push_back(std::make_pair(c, r));
+                    }
+                }
             }
         }
     }
@@ -1084,6 +1237,13 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
                     }
                 }
 
+                if (resolvedIndex < 0 && border > 0u &&
+                    (c < border || c >= numColumns-border || r < border || r >= numRows-border))
+                {
+                    unresolvedBorder.push_back(std::make_pair(c, r));
+                    continue;
+                }
+
                 for (int i = offsets.size() - 1; i >= 0; --i)
                 {
                     // Only apply an offset layer if it sits on top of the resolved layer
@@ -1131,6 +1291,84 @@ ElevationLayerVector::populateHeightFieldAndNormalMap(osg::HeightField*      hf,
         }
     }
 
+    if (!unresolvedBorder.empty())
+    {
+        const Profile* profile = keyToUse.getProfile();
+        BorderSampler sampler;
+
+        for (unsigned k = 0; k < unresolvedBorder.size(); ++k)
+        {
+            unsigned c = unresolvedBorder[k].first;
+            unsigned r = unresolvedBorder[k].second;
+
+            int ci = osg::clampBetween((int)c, (int)border, (int)(numColumns-1-border));
+            int ri = osg::clampBetween((int)r, (int)border, (int)(numRows-1-border));
+
+            // A finished neighbor is the cheapest source, and its offsets
+            // are already applied.
+            float elevation;
+            if (neighbors &&
+                getNeighborHeight(*neighbors, c, r, border, numColumns-2*border, elevation))
+            {
+                hf->setHeight(c, r, elevation);
+
+                if (deltaLOD.valid())
+                {
+                    (*deltaLOD)[r*numColumns + c] = (*deltaLOD)[ri*numColumns + ci];
+                }
+                continue;
+            }
+
+            // Otherwise compute the sample from the layers' neighboring tiles,
+            // exactly as the neighbor will when it's built.
+            double x = xmin + (dx * (double)c);
+            double y = ymin + (dy * (double)r);
+
+            int resolvedIndex = -1;
+
+            for (int i = 0; i < contenders.size() && resolvedIndex < 0; ++i)
+            {
+                if (sampler.getElevation(
+                    contenders[i].layer.get(), i, profile, contenders[i].key.getLOD(),
+                    x, y, interpolation, progress, elevation))
+                {
+                    resolvedIndex = contenders[i].index;
+                    hf->setHeight(c, r, elevation);
+                }
+            }
+
+            if (resolvedIndex >= 0)
+            {
+                for (int i = offsets.size() - 1; i >= 0; --i)
+                {
+                    if (offsets[i].index < resolvedIndex)
+                        continue;
+
+                    if (sampler.getElevation(
+                        offsets[i].layer.get(), contenders.size() + i, profile, offsets[i].key.getLOD(),
+                        x, y, interpolation, progress, elevation))
+                    {
+                        hf->getHeight(c, r) += elevation;
+                    }
+                }
+            }
+            else
+            {
+                // No data past the edge (e.g., at the edge of the profile),
+                // so extrapolate linearly from the interior; this yields the
+                // same one-sided normal as an unbordered edge.
+                int co = osg::clampBetween(2*ci - (int)c, 0, (int)numColumns-1);
+                int ro = osg::clampBetween(2*ri - (int)r, 0, (int)numRows-1);
+                hf->setHeight(c, r, 2.0f*hf->getHeight(ci, ri) - hf->getHeight(co, ro));
+            }
+
+            if (deltaLOD.valid())
+            {
+                (*deltaLOD)[r*numColumns + c] = (*deltaLOD)[ri*numColumns + ci];
+            }
+        }
+    }
+
     if (normalMap)
     {
         // periodically check for cancelation
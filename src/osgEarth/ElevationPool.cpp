@@ -455,8 +455,9 @@ ElevationEnvelope::sample(
 
     GeoPoint p(_inputSRS.get(), x, y, 0.0f, ALTMODE_ABSOLUTE);
 
-
-    if (p.transformInPlace(_mapProfile->getSRS()))
+    // skip the transform when the caller already supplies map coordinates
+    if (_inputSRS.get() == _mapProfile->getSRS() ||
+        p.transformInPlace(_mapProfile->getSRS()))
     {
         unsigned lodToUse = _lod;
 
@@ -31,6 +31,8 @@
 #include <osgEarth/LineDrawable>
 #include <osgEarth/StateSetCache>
 #include <osgEarth/Registry>
+#include <osgEarth/Containers>
+#include <osgEarth/StringUtils>
 
 #include <osg/Geode>
 #include <osg/Geometry>
@@ -73,14 +75,189 @@ namespace
 
         return atan2( p2.x()-p1.x(), p2.y()-p1.y() );
     }
+
+    void accumulateStats(const osg::Geometry* geom, ExtrudeGeometryFilter::Stats& stats)
+    {
+        if (!geom || !geom->getVertexArray())
+            return;
+
+        unsigned numVerts = geom->getVertexArray()->getNumElements();
+        stats.corners += numVerts;
+        stats.vertices += numVerts;
+        for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+            stats.indices += geom->getPrimitiveSet(i)->getNumIndices();
+    }
 }
 
+/**
+ * Vertex and index buffers for one structure in the indexed output mode.
+ * Vertices with identical attributes are welded so adjacent faces share them.
+ */
+struct ExtrudeGeometryFilter::IndexedGeometry
+{
+    IndexedGeometry(bool useColors, bool useTexCoords, bool useAnchors) :
+        _geom(new osg::Geometry()),
+        _verts(new osg::Vec3Array()),
+        _normals(new osg::Vec3Array(osg::Array::BIND_PER_VERTEX)),
+        _colors(useColors ? new osg::Vec4Array(osg::Array::BIND_PER_VERTEX) : 0L),
+        _tex(useTexCoords ? new osg::Vec3Array() : 0L),
+        _anchors(useAnchors ? new osg::Vec4Array(osg::Array::BIND_PER_VERTEX) : 0L),
+        _corners(0u)
+    {
+        // installed up front so the feature index can tag ranges as we go
+        _geom->setVertexArray(_verts.get());
+    }
+
+    // number of vertices in the buffers so far
+    unsigned numVerts() const { return _verts->size(); }
+
+    // starts a new structure. Welding stays within a structure, so each
+    // structure's vertices form one contiguous range.
+    void beginStructure() { _welds.clear(); }
+
+    // whether another set of vertices with this layout can go into these buffers
+    bool isCompatible(bool useColors, bool useTexCoords, bool useAnchors) const
+    {
+        return
+            _colors.valid() == useColors &&
+            _tex.valid() == useTexCoords &&
+            _anchors.valid() == useAnchors;
+    }
+
+    // appends a vertex without welding and returns its index
+    unsigned append(const osg::Vec3& v, const osg::Vec3& n, const osg::Vec4& c, const osg::Vec3& t, const osg::Vec4& a)
+    {
+        _verts->push_back(v);
+        _normals->push_back(n);
+        if (_colors.valid()) _colors->push_back(c);
+        if (_tex.valid()) _tex->push_back(t);
+        if (_anchors.valid()) _anchors->push_back(a);
+        ++_corners;
+        return _verts->size() - 1;
+    }
+
+    // returns the index of a matching vertex, adding one if necessary
+    unsigned weld(const osg::Vec3& v, const osg::Vec3& n, const osg::Vec4& c, const osg::Vec3& t, const osg::Vec4& a)
+    {
+        unsigned h = hashBytes(v.ptr(), sizeof(osg::Vec3));
+        h = hashBytes(n.ptr(), sizeof(osg::Vec3), h);
+        if (_colors.valid()) h = hashBytes(c.ptr(), sizeof(osg::Vec4), h);
+        if (_tex.valid()) h = hashBytes(t.ptr(), sizeof(osg::Vec3), h);
+        if (_anchors.valid()) h = hashBytes(a.ptr(), sizeof(osg::Vec4), h);
+
+        flat_hash_map<unsigned, unsigned>::iterator i = _welds.find(h);
+        if (i != _welds.end())
+        {
+            unsigned k = i->second;
+            if ((*_verts)[k] == v && (*_normals)[k] == n &&
+                (!_colors.valid() || (*_colors)[k] == c) &&
+                (!_tex.valid() || (*_tex)[k] == t) &&
+                (!_anchors.valid() || (*_anchors)[k] == a))
+            {
+                ++_corners;
+                return k;
+            }
+
+            // hash collision; keep the vertex unwelded.
+            return append(v, n, c, t, a);
+        }
+
+        unsigned k = append(v, n, c, t, a);
+        _welds[h] = k;
+        return k;
+    }
+
+    // installs the buffers and a single triangle set in the geometry and
+    // hands it over to the caller; returns NULL if there is nothing to draw
+    osg::Geometry* finish(Stats& stats)
+    {
+        _welds.clear();
+
+        if (_indices.empty())
+            return 0L;
+
+        _geom->setUseVertexBufferObjects(true);
+        _geom->setVertexArray(_verts.get());
+        _geom->setNormalArray(_normals.get());
+
+        if (_colors.valid())
+            _geom->setColorArray(_colors.get());
+
+        if (_tex.valid())
+            _geom->setTexCoordArray(0, _tex.get());
+
+        if (_anchors.valid())
+        {
+            _anchors->setNormalize(false);
+            _geom->setVertexAttribArray(Clamping::AnchorAttrLocation, _anchors.get());
+        }
+
+        osg::DrawElements* de =
+            _verts->size() > 0xFFFF ? (osg::DrawElements*) new osg::DrawElementsUInt  ( GL_TRIANGLES ) :
+                                      (osg::DrawElements*) new osg::DrawElementsUShort( GL_TRIANGLES );
+
+        de->reserveElements(_indices.size());
+        for (std::vector<unsigned>::const_iterator i = _indices.begin(); i != _indices.end(); ++i)
+            de->addElement(*i);
+
+        _geom->addPrimitiveSet(de);
+
+        stats.corners  += _corners;
+        stats.vertices += _verts->size();
+        stats.indices  += _indices.size();
+
+        return _geom.release();
+    }
+
+    osg::ref_ptr<osg::StateSet>  _stateSet;
+    osg::ref_ptr<osg::Geometry>  _geom;
+    osg::ref_ptr<osg::Vec3Array> _verts;
+    osg::ref_ptr<osg::Vec3Array> _normals;
+    osg::ref_ptr<osg::Vec4Array> _colors;
+    osg::ref_ptr<osg::Vec3Array> _tex;
+    osg::ref_ptr<osg::Vec4Array> _anchors;
+    std::vector<unsigned>        _indices;
+    unsigned                     _corners;
+    flat_hash_map<unsigned, unsigned> _welds;
+};
+
+/**
+ * Indexed buffers keyed by state set and vertex layout. When merging, all
+ * the structures with the same key share one set of buffers.
+ */
+struct ExtrudeGeometryFilter::IndexedBatches
+{
+    typedef std::pair<osg::StateSet*, unsigned> Key;
+    typedef std::map<Key, IndexedGeometry*> Map;
+    Map _map;
+
+    ~IndexedBatches()
+    {
+        for (Map::iterator i = _map.begin(); i != _map.end(); ++i)
+            delete i->second;
+    }
+
+    IndexedGeometry& get(osg::StateSet* stateSet, bool useColors, bool useTexCoords, bool useAnchors)
+    {
+        Key key(stateSet, (useColors ? 1u : 0u) | (useTexCoords ? 2u : 0u) | (useAnchors ? 4u : 0u));
+        IndexedGeometry*& batch = _map[key];
+        if (!batch)
+        {
+            batch = new IndexedGeometry(useColors, useTexCoords, useAnchors);
+            batch->_stateSet = stateSet;
+        }
+        return *batch;
+    }
+};
+
 #define AS_VEC4(V3, X) osg::Vec4f( (V3).x(), (V3).y(), (V3).z(), X )
 
 //------------------------------------------------------------------------
 
 ExtrudeGeometryFilter::ExtrudeGeometryFilter() :
 _mergeGeometry         ( true ),
+_indexedGeometry       ( false ),
+_useOSGTessellator     ( false ),
 _wallAngleThresh_deg   ( 60.0 ),
 _styleDirty            ( true ),
 _makeStencilVolume     ( false ),
@@ -101,6 +278,7 @@ ExtrudeGeometryFilter::reset( const FilterContext& context )
 {
     _cosWallAngleThresh = cos( _wallAngleThresh_deg );
     _geodes.clear();
+    _stats = Stats();
     
     if ( _styleDirty )
     {
@@ -784,10 +962,11 @@ ExtrudeGeometryFilter::buildRoofGeometry(const Structure&     structure,
 
     // Tessellate the roof lines into polygons.
     osgEarth::Tessellator oeTess;
-    if (!oeTess.tessellateGeometry(*roof))
+    if (_useOSGTessellator || !oeTess.tessellateGeometry(*roof))
     {
         //fallback to osg tessellator
-        OE_DEBUG << LC << "Falling back on OSG tessellator (" << roof->getName() << ")" << std::endl;
+        if (!_useOSGTessellator)
+            OE_DEBUG << LC << "Falling back on OSG tessellator (" << roof->getName() << ")" << std::endl;
 
         osgUtil::Tessellator tess;
         tess.setTessellationType( osgUtil::Tessellator::TESS_TYPE_GEOMETRY );
@@ -945,6 +1124,224 @@ ExtrudeGeometryFilter::buildOutlineGeometry(const Structure& structure)
     return lines->empty() ? 0L : lines.release();
 }
 
+void
+ExtrudeGeometryFilter::buildIndexedWallGeometry(const Structure&     structure,
+                                                IndexedGeometry&     walls,
+                                                const osg::Vec4&     wallColor,
+                                                const osg::Vec4&     wallBaseColor,
+                                                const SkinResource*  wallSkin)
+{
+    double texWidthM     = wallSkin ? *wallSkin->imageWidth() : 1.0;
+    bool   tex_repeats_y = wallSkin && wallSkin->isTiled() == true;
+
+    osg::Vec2f scale, bias;
+    float layer = 0.0f;
+    if ( wallSkin )
+    {
+        bias.set (wallSkin->imageBiasS().get(),  wallSkin->imageBiasT().get());
+        scale.set(wallSkin->imageScaleS().get(), wallSkin->imageScaleT().get());
+        layer = (float)wallSkin->imageLayer().get();
+    }
+
+    bool flatten =
+        _style.has<ExtrusionSymbol>() &&
+        _style.get<ExtrusionSymbol>()->flatten() == true;
+
+    // Walls are faceted, like the non-indexed path. Adjacent faces only share
+    // a smoothed normal (and therefore their corner vertices) when the style
+    // sets a max crease angle and the faces meet at less than that.
+    const RenderSymbol* render = _style.get<RenderSymbol>();
+    const bool smooth =
+        render &&
+        render->maxCreaseAngle().isSet() &&
+        render->maxCreaseAngle()->as(Units::RADIANS) > 0.0;
+    const float cosCrease = smooth ? cos(render->maxCreaseAngle()->as(Units::RADIANS)) : 2.0f;
+
+    float x = structure.baseCentroid.x(), y = structure.baseCentroid.y(), vo = structure.verticalOffset;
+    osg::Vec4f baseAnchor(x, y, vo, Clamping::ClampToGround);
+
+    std::vector<osg::Vec3f> faceNormals;
+
+    for(Elevations::const_iterator elev = structure.elevations.begin(); elev != structure.elevations.end(); ++elev)
+    {
+        const Faces& faces = elev->faces;
+        unsigned numFaces = faces.size();
+        if ( numFaces == 0 )
+            continue;
+
+        faceNormals.resize(numFaces);
+        for(unsigned i = 0; i < numFaces; ++i)
+        {
+            const Face& f = faces[i];
+            osg::Vec3d along = f.right.base - f.left.base;
+            if ( along.length2() == 0.0 )
+                along = f.right.roof - f.left.roof;
+            osg::Vec3d up = f.left.roof - f.left.base;
+            if ( up.length2() == 0.0 )
+                up = f.right.roof - f.right.base;
+            osg::Vec3d n = along ^ up;
+            n.normalize();
+            faceNormals[i] = n;
+        }
+
+        // a polygon's last face joins back up with its first.
+        bool closed = structure.isPolygon && numFaces > 1;
+
+        for(unsigned i = 0; i < numFaces; ++i)
+        {
+            const Face& f = faces[i];
+            const osg::Vec3f& fn = faceNormals[i];
+
+            osg::Vec3f nL = fn, nR = fn;
+
+            if ( i > 0 || closed )
+            {
+                const osg::Vec3f& prev = faceNormals[i > 0 ? i-1 : numFaces-1];
+                if ( prev * fn >= cosCrease )
+                {
+                    nL = prev + fn;
+                    nL.normalize();
+                }
+            }
+
+            if ( i+1 < numFaces || closed )
+            {
+                const osg::Vec3f& next = faceNormals[i+1 < numFaces ? i+1 : 0];
+                if ( next * fn >= cosCrease )
+                {
+                    nR = fn + next;
+                    nR.normalize();
+                }
+            }
+
+            osg::Vec4f roofAnchorL, roofAnchorR;
+            if ( flatten )
+            {
+                roofAnchorL.set( x, y, vo, Clamping::ClampToAnchor );
+                roofAnchorR.set( x, y, vo, Clamping::ClampToAnchor );
+            }
+            else
+            {
+                roofAnchorL.set( x, y, vo + f.left.height,  Clamping::ClampToGround );
+                roofAnchorR.set( x, y, vo + f.right.height, Clamping::ClampToGround );
+            }
+
+            osg::Vec3f texRoofL, texBaseL, texBaseR, texRoofR;
+            if ( wallSkin )
+            {
+                // same texture mapping as buildWallGeometry
+                double hL = tex_repeats_y ? (f.left.roof - f.left.base).length()   : elev->texHeightAdjustedM;
+                double hR = tex_repeats_y ? (f.right.roof - f.right.base).length() : elev->texHeightAdjustedM;
+
+                float uL = fmod( f.left.offsetX, texWidthM ) / texWidthM;
+                float uR = fmod( f.right.offsetX, texWidthM ) / texWidthM;
+
+                if ( uR < uL || (uL == 0.0 && uR == 0.0))
+                    uR = 1.0f;
+
+                osg::Vec2f tBL = bias + osg::componentMultiply(osg::Vec2f(uL, 0.0f), scale);
+                osg::Vec2f tBR = bias + osg::componentMultiply(osg::Vec2f(uR, 0.0f), scale);
+                osg::Vec2f tRL = bias + osg::componentMultiply(osg::Vec2f(uL, hL/elev->texHeightAdjustedM), scale);
+                osg::Vec2f tRR = bias + osg::componentMultiply(osg::Vec2f(uR, hR/elev->texHeightAdjustedM), scale);
+
+                texRoofL.set( tRL.x(), tRL.y(), layer );
+                texBaseL.set( tBL.x(), tBL.y(), layer );
+                texBaseR.set( tBR.x(), tBR.y(), layer );
+                texRoofR.set( tRR.x(), tRR.y(), layer );
+            }
+
+            // Faceted faces never share a vertex with their neighbors, so
+            // only smoothed ones are worth the welding lookups.
+            unsigned roofL, baseL, baseR, roofR;
+            if ( smooth )
+            {
+                roofL = walls.weld( f.left.roof,  nL, wallColor,     texRoofL, roofAnchorL );
+                baseL = walls.weld( f.left.base,  nL, wallBaseColor, texBaseL, baseAnchor );
+                baseR = walls.weld( f.right.base, nR, wallBaseColor, texBaseR, baseAnchor );
+                roofR = walls.weld( f.right.roof, nR, wallColor,     texRoofR, roofAnchorR );
+            }
+            else
+            {
+                roofL = walls.append( f.left.roof,  nL, wallColor,     texRoofL, roofAnchorL );
+                baseL = walls.append( f.left.base,  nL, wallBaseColor, texBaseL, baseAnchor );
+                baseR = walls.append( f.right.base, nR, wallBaseColor, texBaseR, baseAnchor );
+                roofR = walls.append( f.right.roof, nR, wallColor,     texRoofR, roofAnchorR );
+            }
+
+            // without indexing, each face costs 6 vertices.
+            walls._corners += 2;
+
+            walls._indices.push_back( roofL );
+            walls._indices.push_back( baseL );
+            walls._indices.push_back( baseR );
+            walls._indices.push_back( baseR );
+            walls._indices.push_back( roofR );
+            walls._indices.push_back( roofL );
+        }
+    }
+}
+
+
+bool
+ExtrudeGeometryFilter::buildIndexedRoofGeometry(const Structure&     structure,
+                                                IndexedGeometry&     roof,
+                                                const osg::Vec4&     roofColor,
+                                                const SkinResource*  roofSkin)
+{
+    bool flatten =
+        _style.has<ExtrusionSymbol>() &&
+        _style.get<ExtrusionSymbol>()->flatten() == true;
+
+    float x = structure.baseCentroid.x(), y = structure.baseCentroid.y(), vo = structure.verticalOffset;
+    const osg::Vec3f up(0,0,1);
+
+    unsigned first = roof._verts->size();
+    unsigned firstIndex = roof._indices.size();
+    unsigned firstCorners = roof._corners;
+    std::vector<unsigned> ringSizes;
+
+    // Write the roof rings straight into the shared buffers. Like buildRoofGeometry,
+    // only source verts are used; the inserted ones are co-linear anyway.
+    for(Elevations::const_iterator e = structure.elevations.begin(); e != structure.elevations.end(); ++e)
+    {
+        unsigned ringSize = 0u;
+        for(Faces::const_iterator f = e->faces.begin(); f != e->faces.end(); ++f)
+        {
+            if ( f->left.isFromSource )
+            {
+                osg::Vec3f tex;
+                if ( roofSkin )
+                    tex.set( f->left.roofTexU, f->left.roofTexV, 0.0f );
+
+                osg::Vec4f anchor = flatten ?
+                    osg::Vec4f(x, y, vo, Clamping::ClampToAnchor) :
+                    osg::Vec4f(x, y, vo + f->left.height, Clamping::ClampToGround);
+
+                roof.append( f->left.roof, up, roofColor, tex, anchor );
+                ++ringSize;
+            }
+        }
+        ringSizes.push_back(ringSize);
+    }
+
+    osgEarth::Tessellator oeTess;
+    if ( !oeTess.tessellateRings(*roof._verts, first, ringSizes, roof._indices) )
+    {
+        // roll back so the caller can fall back on the non-indexed path.
+        roof._verts->resize(first);
+        roof._normals->resize(first);
+        if (roof._colors.valid()) roof._colors->resize(first);
+        if (roof._tex.valid()) roof._tex->resize(first);
+        if (roof._anchors.valid()) roof._anchors->resize(first);
+        roof._indices.resize(firstIndex);
+        roof._corners = firstCorners;
+        return false;
+    }
+
+    return true;
+}
+
+
 void
 ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
                                    osg::StateSet*       stateSet,
@@ -993,9 +1390,39 @@ ExtrudeGeometryFilter::addDrawable(osg::Drawable*       drawable,
     }
 }
 
+void
+ExtrudeGeometryFilter::flushIndexedBatches(IndexedBatches&      batches,
+                                           unsigned             minVerts,
+                                           const std::string&   name,
+                                           Feature*             feature,
+                                           FeatureIndexBuilder* index)
+{
+    for (IndexedBatches::Map::iterator i = batches._map.begin(); i != batches._map.end(); )
+    {
+        IndexedGeometry* batch = i->second;
+        if (batch->numVerts() >= minVerts)
+        {
+            osg::ref_ptr<osg::StateSet> stateSet = batch->_stateSet.get();
+            osg::ref_ptr<osg::Geometry> geom = batch->finish(_stats);
+            if (geom.valid())
+                addDrawable(geom.get(), stateSet.get(), name, feature, index);
+            delete batch;
+            batches._map.erase(i++);
+        }
+        else ++i;
+    }
+}
+
 bool
 ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
 {
+    // When merging, structures with the same state and vertex layout go into
+    // shared indexed buffers as they are built, and each feature tags only its
+    // own range of vertices instead of a geometry of its own.
+    bool batchIndexed = _indexedGeometry && _mergeGeometry && _featureNameExpr.empty();
+    unsigned maxBatchVerts = Registry::instance()->getMaxNumberOfVertsPerDrawable();
+    IndexedBatches batches;
+
     for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -1122,49 +1549,132 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                 structure,
                 context);
 
-            // Create the walls.
-            if ( walls.valid() )
+            osg::Vec4f wallColor(1,1,1,1), wallBaseColor(1,1,1,1);
+
+            if ( _wallPolygonSymbol.valid() )
             {
-                osg::Vec4f wallColor(1,1,1,1), wallBaseColor(1,1,1,1);
+                wallColor = _wallPolygonSymbol->fill()->color();
+            }
 
-                if ( _wallPolygonSymbol.valid() )
-                {
-                    wallColor = _wallPolygonSymbol->fill()->color();
-                }
+            if ( _extrusionSymbol->wallGradientPercentage().isSet() )
+            {
+                wallBaseColor = Color(wallColor).brightness( 1.0 - *_extrusionSymbol->wallGradientPercentage() );
+            }
+            else
+            {
+                wallBaseColor = wallColor;
+            }
 
-                if ( _extrusionSymbol->wallGradientPercentage().isSet() )
+            osg::Vec4f roofColor(1,1,1,1);
+            if ( _roofPolygonSymbol.valid() )
+            {
+                roofColor = _roofPolygonSymbol->fill()->color();
+            }
+
+            if ( wallSkin )
+            {
+                // Get a stateset for the individual wall stateset
+                context.resourceCache()->getOrCreateStateSet(wallSkin, wallStateSet, context.getDBOptions());
+            }
+
+            if ( roofSkin && rooflines.valid() )
+            {
+                // Get a stateset for the individual roof skin
+                context.resourceCache()->getOrCreateStateSet(roofSkin, roofStateSet, context.getDBOptions());
+            }
+
+            // Set up for feature naming and feature indexing:
+            std::string name;
+            if ( !_featureNameExpr.empty() )
+                name = input->eval( _featureNameExpr, &context );
+
+            FeatureIndexBuilder* index = context.featureIndex();
+
+            if ( _indexedGeometry )
+            {
+                bool wallColors = (!wallSkin || wallSkin->texEnvMode() != osg::TexEnv::DECAL) && !_makeStencilVolume;
+
+                IndexedGeometry& indexedWalls = batches.get(wallStateSet.get(), wallColors, wallSkin != 0L, _gpuClamping);
+                indexedWalls.beginStructure();
+                unsigned wallsFirst = indexedWalls.numVerts();
+                buildIndexedWallGeometry(structure, indexedWalls, wallColor, wallBaseColor, wallSkin);
+
+                IndexedGeometry* indexedRoof = 0L;
+                unsigned roofFirst = 0u;
+
+                if ( rooflines.valid() )
                 {
-                    wallBaseColor = Color(wallColor).brightness( 1.0 - *_extrusionSymbol->wallGradientPercentage() );
+                    bool roofDone = false;
+
+                    // The OSG tessellator works on whole geometries, so with it
+                    // the roof goes through buildRoofGeometry below. Otherwise a
+                    // roof with the same state and vertex layout as the walls
+                    // shares their buffers.
+                    if ( _useOSGTessellator )
+                    {
+                        roofDone = false;
+                    }
+                    else if (wallStateSet.get() == roofStateSet.get() &&
+                        indexedWalls.isCompatible(true, roofSkin != 0L, _gpuClamping))
+                    {
+                        roofDone = buildIndexedRoofGeometry(structure, indexedWalls, roofColor, roofSkin);
+                    }
+                    else
+                    {
+                        indexedRoof = &batches.get(roofStateSet.get(), true, roofSkin != 0L, _gpuClamping);
+                        indexedRoof->beginStructure();
+                        roofFirst = indexedRoof->numVerts();
+                        roofDone = buildIndexedRoofGeometry(structure, *indexedRoof, roofColor, roofSkin);
+                    }
+
+                    // fall back on the tessellators that buildRoofGeometry uses.
+                    if ( roofDone )
+                    {
+                        rooflines = 0L;
+                    }
+                    else
+                    {
+                        buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
+                        accumulateStats(rooflines.get(), _stats);
+                    }
                 }
-                else
+
+                // the batches draw the walls (and roof).
+                walls = 0L;
+
+                if ( batchIndexed )
                 {
-                    wallBaseColor = wallColor;
-                }
+                    if ( index )
+                    {
+                        if ( indexedWalls.numVerts() > wallsFirst )
+                            index->tagRange( indexedWalls._geom.get(), input, wallsFirst, indexedWalls.numVerts() - wallsFirst );
 
-                buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin);
+                        if ( indexedRoof && indexedRoof->numVerts() > roofFirst )
+                            index->tagRange( indexedRoof->_geom.get(), input, roofFirst, indexedRoof->numVerts() - roofFirst );
+                    }
 
-                if ( wallSkin )
+                    flushIndexedBatches( batches, maxBatchVerts, std::string(), 0L, 0L );
+                }
+                else
                 {
-                    // Get a stateset for the individual wall stateset
-                    context.resourceCache()->getOrCreateStateSet(wallSkin, wallStateSet, context.getDBOptions());
+                    flushIndexedBatches( batches, 0u, name, input, index );
                 }
             }
 
-            // tessellate and add the roofs if necessary:
-            if ( rooflines.valid() )
+            else
             {
-                osg::Vec4f roofColor(1,1,1,1);
-                if ( _roofPolygonSymbol.valid() )
+                // Create the walls.
+                if ( walls.valid() )
                 {
-                    roofColor = _roofPolygonSymbol->fill()->color();
+                    buildWallGeometry(structure, walls.get(), wallColor, wallBaseColor, wallSkin);
+                    accumulateStats(walls.get(), _stats);
                 }
 
-                buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
-
-                if ( roofSkin )
+                // tessellate the roofs if necessary:
+                if ( rooflines.valid() )
                 {
-                    // Get a stateset for the individual roof skin
-                    context.resourceCache()->getOrCreateStateSet(roofSkin, roofStateSet, context.getDBOptions());
+                    buildRoofGeometry(structure, rooflines.get(), roofColor, roofSkin);
+                    accumulateStats(rooflines.get(), _stats);
                 }
             }
 
@@ -1181,13 +1691,6 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
                 tess.retessellatePolygons( *(baselines.get()) );
             }
 
-            // Set up for feature naming and feature indexing:
-            std::string name;
-            if ( !_featureNameExpr.empty() )
-                name = input->eval( _featureNameExpr, &context );
-
-            FeatureIndexBuilder* index = context.featureIndex();
-
             if ( walls.valid() && walls->getVertexArray() && walls->getVertexArray()->getNumElements() > 0 )
             {
                 addDrawable( walls.get(), wallStateSet.get(), name, input, index );
@@ -1210,6 +1713,8 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
         }
     }
 
+    flushIndexedBatches( batches, 0u, std::string(), 0L, 0L );
+
     return true;
 }
 
@@ -1263,6 +1768,10 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     // push all the features through the extruder.
     bool ok = process( input, context );
 
+    OE_DEBUG << LC << input.size() << " features: "
+        << _stats.vertices << " vertices (" << _stats.corners << " face corners), "
+        << _stats.indices << " indices" << std::endl;
+
     // parent geometry with a delocalizer (if necessary)
     osg::Group* group = createDelocalizeGroup();
     
@@ -20,6 +20,7 @@
 #include <osgEarth/FeatureModelGraph>
 #include <osgEarth/CropFilter>
 #include <osgEarth/FeatureSourceIndexNode>
+#include <osgEarth/FeatureTileCodec>
 #include <osgEarth/FilterContext>
 
 #include <osgEarth/MapInfo>
@@ -72,6 +73,15 @@ using namespace osgEarth::Util;
 
 namespace
 {
+    // orders interned style names by value rather than by address
+    struct LessDeref
+    {
+        bool operator()(const std::string* lhs, const std::string* rhs) const
+        {
+            return *lhs < *rhs;
+        }
+    };
+
     // callback to force features onto the high-latency queue.
     struct HighLatencyFileLocationCallback : public osgDB::FileLocationCallback
     {
@@ -427,6 +437,12 @@ FeatureModelGraph::setOwnerName(const std::string& value)
     _ownerName = value;
 }
 
+const FeatureIndex*
+FeatureModelGraph::getFeatureIndex() const
+{
+    return _featureIndex.get();
+}
+
 Status
 FeatureModelGraph::open()
 {
@@ -435,6 +451,11 @@ FeatureModelGraph::open()
 
     _nodeCachingImageCache = new osgDB::ObjectCache();
 
+    if (_options.nodeCaching() == true)
+    {
+        _cacheWriteQueue = new CacheWriteQueue();
+    }
+
     // an FLC that queues feature data on the high-latency thread.
     _defaultFileLocationCallback = new HighLatencyFileLocationCallback();
 
@@ -1105,20 +1126,96 @@ namespace
 {
     std::string makeCacheKey(const FeatureLevel& level,
         const GeoExtent& extent,
-        const TileKey* key)
+        const TileKey* key,
+        const std::string& contentHash)
     {
         if (key)
         {
-            return Cache::makeCacheKey(key->str(), "fmg");
+            return Cache::makeCacheKey(key->str() + contentHash, "fmg");
         }
         else
         {
-            std::string b = Stringify() << extent.toString() << level.styleName().get();
+            std::string b = Stringify() << extent.toString() << level.styleName().get() << contentHash;
             return Cache::makeCacheKey(b, "fmg");
         }
     }
+
+    // Pending writes beyond this many bytes are written synchronously, so a
+    // slow disk throttles tile building instead of piling up memory.
+    const unsigned long long MAX_PENDING_CACHE_WRITE_BYTES = 64u * 1024u * 1024u;
 }
 
+/**
+ * Single background thread that writes encoded tiles to the cache bin,
+ * so tile delivery never waits on the disk.
+ */
+struct FeatureModelGraph::CacheWriteQueue : public osg::Referenced
+{
+    struct WriteOperation : public osg::Operation
+    {
+        WriteOperation(CacheWriteQueue* queue, CacheBin* bin, const std::string& key, StringObject* data, const osgDB::Options* options) :
+            osg::Operation("FeatureModelGraph cache write", false),
+            _queue(queue), _bin(bin), _key(key), _data(data), _options(options) { }
+
+        void operator()(osg::Object*)
+        {
+            _bin->write(_key, _data.get(), Config(), _options.get());
+            _queue->release(_data->getString().size());
+        }
+
+        CacheWriteQueue* _queue;
+        osg::ref_ptr<CacheBin> _bin;
+        std::string _key;
+        osg::ref_ptr<StringObject> _data;
+        osg::ref_ptr<const osgDB::Options> _options;
+    };
+
+    CacheWriteQueue() :
+        _pendingBytes(0u),
+        _pendingWrites(0u)
+    {
+        _idle.set();
+        _pool = new Threading::ThreadPool(1u);
+    }
+
+    ~CacheWriteQueue()
+    {
+        // let queued writes land before the thread stops
+        _idle.wait();
+    }
+
+    void write(CacheBin* bin, const std::string& key, StringObject* data, const osgDB::Options* options)
+    {
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_pendingBytes + data->getString().size() <= MAX_PENDING_CACHE_WRITE_BYTES)
+            {
+                _pendingBytes += data->getString().size();
+                if (_pendingWrites++ == 0u)
+                    _idle.reset();
+                _pool->getQueue()->add(new WriteOperation(this, bin, key, data, options));
+                return;
+            }
+        }
+        bin->write(key, data, Config(), options);
+    }
+
+    void release(unsigned long long bytes)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _pendingBytes -= bytes;
+        if (--_pendingWrites == 0u)
+            _idle.set();
+    }
+
+    mutable Threading::Mutex _mutex;
+    unsigned long long _pendingBytes;
+    unsigned _pendingWrites;
+    Threading::Event _idle; // set when no writes are pending
+    // declared last so the thread stops before the counters go away
+    osg::ref_ptr<Threading::ThreadPool> _pool;
+};
+
 osg::Group*
 FeatureModelGraph::readTileFromCache(const std::string&    cacheKey,
     const osgDB::Options* readOptions)
@@ -1154,7 +1251,21 @@ FeatureModelGraph::readTileFromCache(const std::string&    cacheKey,
 
         if (rr.succeeded())
         {
-            group = dynamic_cast<osg::Group*>(rr.getNode());
+            // tiles are stored in the compact tile encoding; older caches hold osgb nodes.
+            StringObject* so = dynamic_cast<StringObject*>(rr.getObject());
+            if (so && FeatureTileCodec::isEncoded(so->getString()))
+            {
+#if OSG_VERSION_GREATER_OR_EQUAL(3,6,3)
+                osg::ref_ptr<osg::Node> node = FeatureTileCodec::decode(so->getString(), localOptions.get());
+#else
+                osg::ref_ptr<osg::Node> node = FeatureTileCodec::decode(so->getString(), readOptions);
+#endif
+                group = dynamic_cast<osg::Group*>(node.get());
+            }
+            else
+            {
+                group = dynamic_cast<osg::Group*>(rr.getNode());
+            }
             OE_DEBUG << LC << "Loaded from the cache (key = " << cacheKey << ")\n";
             ++_cacheHits;
 
@@ -1207,8 +1318,23 @@ FeatureModelGraph::writeTileToCache(const std::string&    cacheKey,
 
     if (cacheBin && policy->isCacheWriteable())
     {
-        cacheBin->writeNode(cacheKey, node, Config(), writeOptions);
-        OE_DEBUG << LC << "Wrote " << cacheKey << " to cache\n";
+        // Prepare and encode now, while we still own the tile; only the
+        // disk write happens in the background.
+        cacheBin->prepareNode(node, writeOptions);
+
+        std::string buffer;
+        if (!FeatureTileCodec::encode(node, writeOptions, buffer))
+        {
+            OE_WARN << LC << "Failed to encode " << cacheKey << " for the cache\n";
+            return false;
+        }
+
+        osg::ref_ptr<StringObject> data = new StringObject(buffer);
+        if (_cacheWriteQueue.valid())
+            _cacheWriteQueue->write(cacheBin.get(), cacheKey, data.get(), writeOptions);
+        else
+            cacheBin->write(cacheKey, data.get(), Config(), writeOptions);
+        OE_DEBUG << LC << "Queued " << cacheKey << " for the cache\n";
     }
     return true;
 }
@@ -1233,7 +1359,7 @@ FeatureModelGraph::buildTile(const FeatureLevel& level,
     osg::ref_ptr<osg::Group> group;
 
     // Try to read it from a cache:
-    std::string cacheKey = makeCacheKey(level, extent, key);
+    std::string cacheKey = makeCacheKey(level, extent, key, _contentHash);
 
     if (_options.nodeCaching() == true)
     {
@@ -1590,6 +1716,21 @@ FeatureModelGraph::buildStyleGroups(const StyleSelector*  selector,
 }
 
 
+unsigned
+FeatureModelGraph::internStyleName(const std::string& name, const std::string*& out_name)
+{
+    Threading::ScopedMutexLock lock(_styleNamesMutex);
+    StyleNameTable::iterator i = _styleNames.find(name);
+    if (i == _styleNames.end())
+    {
+        unsigned index = _styleNames.size();
+        i = _styleNames.insert(std::make_pair(name, index)).first;
+    }
+    // map keys never move, so the caller can hold on to this.
+    out_name = &i->first;
+    return i->second;
+}
+
 /**
  * Querys the feature source;
  * Visits each feature and uses the Style Expression to resolve its style class;
@@ -1625,7 +1766,18 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
     StringExpression styleExprCopy(styleExpr);
 
     // visit each feature and run the expression to sort it into a bin.
-    std::map<std::string, FeatureList> styleBins;
+    // Bins are keyed by the graph's interned style index, so no style
+    // string is copied per tile. Neighboring features usually resolve to
+    // the same style, so remember the last bin and only look up the
+    // interned name when the string changes.
+    struct StyleBin
+    {
+        const std::string* name;
+        FeatureList        features;
+    };
+    typedef std::map<unsigned, StyleBin> StyleBins;
+    StyleBins styleBins;
+    StyleBins::iterator lastBin = styleBins.end();
     while (cursor->hasMore())
     {
         osg::ref_ptr<Feature> feature = cursor->nextFeature();
@@ -1634,7 +1786,18 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
             const std::string& styleString = feature->eval(styleExprCopy, &context);
             if (!styleString.empty() && styleString != "null")
             {
-                styleBins[styleString].push_back(feature.get());
+                if (lastBin == styleBins.end() || *lastBin->second.name != styleString)
+                {
+                    const std::string* name;
+                    unsigned index = internStyleName(styleString, name);
+                    lastBin = styleBins.find(index);
+                    if (lastBin == styleBins.end())
+                    {
+                        lastBin = styleBins.insert(std::make_pair(index, StyleBin())).first;
+                        lastBin->second.name = name;
+                    }
+                }
+                lastBin->second.features.push_back(feature.get());
             }
         }
 
@@ -1642,11 +1805,17 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
             return;
     }
 
+    // create the style groups in style name order, as before interning.
+    typedef std::map<const std::string*, StyleBin*, LessDeref> OrderedBins;
+    OrderedBins orderedBins;
+    for (StyleBins::iterator i = styleBins.begin(); i != styleBins.end(); ++i)
+        orderedBins[i->second.name] = &i->second;
+
     // next create a style group per bin.
-    for (std::map<std::string, FeatureList>::iterator i = styleBins.begin(); i != styleBins.end(); ++i)
+    for (OrderedBins::iterator i = orderedBins.begin(); i != orderedBins.end(); ++i)
     {
-        const std::string& styleString = i->first;
-        FeatureList&       workingSet = i->second;
+        const std::string& styleString = *i->first;
+        FeatureList&       workingSet = i->second->features;
 
         // resolve the style:
         Style combinedStyle;
@@ -1654,10 +1823,7 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
         // if the style string begins with an open bracket, it's an inline style definition.
         if (styleString.length() > 0 && styleString[0] == '{')
         {
-            Config conf("style", styleString);
-            conf.setReferrer(styleExpr.uriContext().referrer());
-            conf.set("type", "text/css");
-            combinedStyle = Style(conf);
+            combinedStyle = _session->getInlineStyle(styleString, styleExpr.uriContext().referrer());
         }
 
         // otherwise, look up the style in the stylesheet. Do NOT fall back on a default
@@ -1879,6 +2045,18 @@ FeatureModelGraph::redraw()
     // clear it out
     removeChildren(0, getNumChildren());
 
+    // anything that changes the compiled output must change the node cache key.
+    if (_options.nodeCaching() == true)
+    {
+        std::stringstream buf;
+        if (_session->styles())
+            buf << _session->styles()->getConfig().toJSON();
+        if (_session->getFeatureSource())
+            buf << _session->getFeatureSource()->getConfig().toJSON() << _session->getFeatureSource()->getRevision();
+        buf << _options.getConfig().toJSON();
+        _contentHash = hashToString(buf.str());
+    }
+
     // initialize the index if necessary.
     if (_options.featureIndexing()->enabled() == true)
     {
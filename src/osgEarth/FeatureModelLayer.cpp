@@ -177,6 +177,15 @@ FeatureModelLayer::getNode() const
     return _root.get();
 }
 
+const FeatureIndex*
+FeatureModelLayer::getFeatureIndex() const
+{
+    const FeatureModelGraph* fmg = _root.valid() && _root->getNumChildren() > 0 ?
+        dynamic_cast<const FeatureModelGraph*>(_root->getChild(0)) : 0L;
+
+    return fmg ? fmg->getFeatureIndex() : 0L;
+}
+
 Status
 FeatureModelLayer::openImplementation()
 {
@@ -80,6 +80,10 @@ osg::Group(rhs, copy)
 {
     _index = rhs._index.get();
     _fids  = rhs._fids;
+
+    // the copy holds its own references to the index entries.
+    if ( _index.valid() )
+        _index->addFIDs( KeyIter<FIDMap>(_fids.begin()), KeyIter<FIDMap>(_fids.end()) );
 }
 
 FeatureSourceIndexNode::FeatureSourceIndexNode(FeatureSourceIndex* index) :
@@ -92,13 +96,9 @@ FeatureSourceIndexNode::~FeatureSourceIndexNode()
 {
     if ( _index.valid() )
     {
-        // must copy and clear the original list first to dereference the RefIDPair instances.
-        std::set<FeatureID> fidsToRemove;
-        fidsToRemove.insert(KeyIter<FIDMap>(_fids.begin()), KeyIter<FIDMap>(_fids.end()));
+        OE_DEBUG << LC << "Removing " << _fids.size() << " fids\n";
+        _index->removeFIDs( KeyIter<FIDMap>(_fids.begin()), KeyIter<FIDMap>(_fids.end()) );
         _fids.clear();
-
-        OE_DEBUG << LC << "Removing " << fidsToRemove.size() << " fids\n";
-        _index->removeFIDs( fidsToRemove.begin(), fidsToRemove.end() );
     }
 }
 
@@ -106,27 +106,40 @@ ObjectID
 FeatureSourceIndexNode::tagDrawable(osg::Drawable* drawable, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagDrawable( drawable, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = _fids.find( feature->getFID() ) == _fids.end();
+    ObjectID oid = _index->tagDrawable( drawable, feature, isNew );
+    if ( isNew && oid != OSGEARTH_OBJECTID_EMPTY ) _fids[ feature->getFID() ] = oid;
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagAllDrawables(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagAllDrawables( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = _fids.find( feature->getFID() ) == _fids.end();
+    ObjectID oid = _index->tagAllDrawables( node, feature, isNew );
+    if ( isNew && oid != OSGEARTH_OBJECTID_EMPTY ) _fids[ feature->getFID() ] = oid;
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagNode( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = _fids.find( feature->getFID() ) == _fids.end();
+    ObjectID oid = _index->tagNode( node, feature, isNew );
+    if ( isNew && oid != OSGEARTH_OBJECTID_EMPTY ) _fids[ feature->getFID() ] = oid;
+    return oid;
+}
+
+ObjectID
+FeatureSourceIndexNode::tagRange(osg::Drawable* drawable, Feature* feature, unsigned first, unsigned count)
+{
+    if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
+    bool isNew = _fids.find( feature->getFID() ) == _fids.end();
+    ObjectID oid = _index->tagRange( drawable, feature, first, count, isNew );
+    if ( isNew && oid != OSGEARTH_OBJECTID_EMPTY ) _fids[ feature->getFID() ] = oid;
+    return oid;
 }
 
 bool
@@ -142,6 +155,36 @@ FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
     return true;
 }
 
+void
+FeatureSourceIndexNode::insert(const FeatureList& features, std::vector<ObjectID>& out_oids)
+{
+    out_oids.assign( features.size(), OSGEARTH_OBJECTID_EMPTY );
+    if ( !_index.valid() ) return;
+
+    // Only FIDs this node hasn't seen yet take a reference. Reserve their
+    // slots now so a FID repeated in the list is only counted once.
+    std::vector<char> addRefs( features.size(), 0 );
+    _fids.reserve( _fids.size() + features.size() );
+    unsigned i = 0;
+    for(FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++i)
+    {
+        if ( f->valid() && _fids.find( f->get()->getFID() ) == _fids.end() )
+        {
+            _fids[ f->get()->getFID() ] = OSGEARTH_OBJECTID_EMPTY;
+            addRefs[i] = 1;
+        }
+    }
+
+    _index->insert( features, addRefs, out_oids );
+
+    i = 0;
+    for(FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++i)
+    {
+        if ( addRefs[i] )
+            _fids[ f->get()->getFID() ] = out_oids[i];
+    }
+}
+
 void
 FeatureSourceIndexNode::setFIDMap(const FeatureSourceIndexNode::FIDMap& fids)
 {
@@ -155,7 +198,7 @@ namespace
     struct Reconstitute : public osg::NodeVisitor
     {
         FeatureSourceIndex* _index;
-        std::map<ObjectID,ObjectID> _oldToNew;
+        ObjectIDRemap _oldToNew;
 
         Reconstitute(FeatureSourceIndex* index) :
             _index(index)
@@ -177,15 +220,15 @@ namespace
         }
     };
 
-    /** Visitor that re-indexes objects after deserialization. */
+    /** Visitor that replaces serialized object IDs with live ones after deserialization. */
     struct ReIndex : public osg::NodeVisitor
     {
-        FeatureSourceIndexNode*        _indexNode;
-        FeatureSourceIndexNode::FIDMap _newFIDMap;
-        std::map<ObjectID,ObjectID>&   _oldToNew;
+        ObjectIndex*                 _masterIndex;
+        osg::Referenced*             _object;
+        ObjectIDRemap&               _oldToNew;
 
-        ReIndex(FeatureSourceIndexNode* indexNode, std::map<ObjectID,ObjectID>& oldToNew) :
-            _indexNode(indexNode), _oldToNew(oldToNew)
+        ReIndex(ObjectIndex* masterIndex, osg::Referenced* object, ObjectIDRemap& oldToNew) :
+            _masterIndex(masterIndex), _object(object), _oldToNew(oldToNew)
         {
             setTraversalMode(TRAVERSE_ALL_CHILDREN);
             setNodeMaskOverride(~0);
@@ -193,16 +236,16 @@ namespace
 
         void apply(osg::Node& node)
         {
-            _indexNode->reIndexNode(&node, _oldToNew, _newFIDMap);
+            _masterIndex->updateObjectID(&node, _oldToNew, _object);
             traverse(node);
         }
 
         void apply(osg::Geode& geode)
         {
-            _indexNode->reIndexNode(&geode, _oldToNew, _newFIDMap);
+            _masterIndex->updateObjectID(&geode, _oldToNew, _object);
             for (unsigned i = 0; i < geode.getNumDrawables(); ++i)
             {
-                _indexNode->reIndexDrawable(geode.getDrawable(i), _oldToNew, _newFIDMap);
+                _masterIndex->updateObjectIDs(geode.getDrawable(i), _oldToNew, _object);
             }
             traverse(geode);
         }
@@ -223,28 +266,17 @@ FeatureSourceIndexNode::reconstitute(osg::Node* graph, FeatureSourceIndex* index
 }
 
 void
-FeatureSourceIndexNode::reIndex(std::map<ObjectID,ObjectID>& oidmappings)
+FeatureSourceIndexNode::reIndex(ObjectIDRemap& oidmappings)
 {
-    ReIndex visitor(this, oidmappings);
-    this->accept(visitor);
-    _fids = visitor._newFIDMap;
-    //OE_INFO << LC << "Reindexed " << _fids.size() << " mappings\n";
-}
+    if ( !_index.valid() || !_index->_masterIndex.valid() ) return;
 
-void
-FeatureSourceIndexNode::reIndexDrawable(osg::Drawable* drawable, std::map<ObjectID,ObjectID>& oldNew, FIDMap& newFIDMap)
-{
-    if ( !drawable || !_index.valid() ) return;
-
-    _index->update(drawable, oldNew, _fids, newFIDMap);
-}
-
-void
-FeatureSourceIndexNode::reIndexNode(osg::Node* node, std::map<ObjectID,ObjectID>& oldNew, FIDMap& newFIDMap)
-{
-    if (!node || !_index.valid()) return;
+    // Register all our FIDs at once; this fills in the new OID for each
+    // serialized OID so the visitor only has to rewrite the tags.
+    _index->reIndex(_fids, oidmappings);
 
-    _index->update(node, oldNew, _fids, newFIDMap);
+    ReIndex visitor(_index->_masterIndex.get(), _index.get(), oidmappings);
+    this->accept(visitor);
+    //OE_INFO << LC << "Reindexed " << _fids.size() << " mappings\n";
 }
 
 FeatureSourceIndexNode* FeatureSourceIndexNode::get(osg::Node* graph)
@@ -280,8 +312,7 @@ namespace osgEarth { namespace Serializers { namespace FeatureSourceIndexNodeCla
         {
             for (FeatureSourceIndexNode::FIDMap::const_iterator i = fids.begin(); i != fids.end(); ++i)
             {
-                const RefIDPair* idPair = i->second.get();
-                os << (double)idPair->_fid << idPair->_oid;
+                os << (double)i->first << i->second;
             }
         }
         os << os.END_BRACKET << std::endl;
@@ -297,12 +328,13 @@ namespace osgEarth { namespace Serializers { namespace FeatureSourceIndexNodeCla
         ObjectID oid;
 
         unsigned size = is.readSize();
+        fids.reserve(size);
         is >> is.BEGIN_BRACKET;
         {
             for (unsigned i=0; i<size; ++i)
             {
                 is >> fid >> oid;
-                fids[fid] = new RefIDPair(fid, oid);
+                fids[(FeatureID)fid] = oid;
             }
         }
         is >> is.END_BRACKET;
@@ -350,109 +382,184 @@ FeatureSourceIndex::~FeatureSourceIndex()
 
     _oids.clear();
     _fids.clear();
-    _embeddedFeatures.clear();
+    _entries.clear();
+    _freeEntries.clear();
 }
 
-RefIDPair*
-FeatureSourceIndex::tagDrawable(osg::Drawable* drawable, Feature* feature)
+unsigned
+FeatureSourceIndex::addEntry(FeatureID fid, ObjectID oid, Feature* feature)
 {
-    if ( !feature ) return 0L;
+    // internal: assume mutex is locked
+    unsigned e;
+    if ( !_freeEntries.empty() )
+    {
+        e = _freeEntries.back();
+        _freeEntries.pop_back();
+    }
+    else
+    {
+        e = _entries.size();
+        _entries.resize( e+1 );
+    }
 
-    Threading::ScopedMutexLock lock(_mutex);
+    Entry& entry = _entries[e];
+    entry._fid  = fid;
+    entry._oid  = oid;
+    entry._refs = 0u;
+    entry._feature = _embed ? feature : 0L;
+
+    _fids[fid] = e;
+    _oids[oid] = e;
+    return e;
+}
+
+void
+FeatureSourceIndex::removeEntry(unsigned e)
+{
+    // internal: assume mutex is locked
+    Entry& entry = _entries[e];
+    _fids.erase( entry._fid );
+    _oids.erase( entry._oid );
+    entry._feature = 0L;
+    _freeEntries.push_back( e );
+}
+
+ObjectID
+FeatureSourceIndex::tagDrawable(osg::Drawable* drawable, Feature* feature, bool addRef)
+{
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
 
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
+    Threading::ScopedMutexLock lock(_mutex);
 
-    FIDMap::const_iterator f = _fids.find( fid );
+    unsigned e;
+    EntryMap::const_iterator f = _fids.find( feature->getFID() );
     if ( f != _fids.end() )
     {
-        ObjectID oid = f->second->_oid;
-        _masterIndex->tagDrawable( drawable, oid );
-        p = f->second.get();
+        e = f->second;
+        _masterIndex->tagDrawable( drawable, _entries[e]._oid );
     }
     else
     {
         ObjectID oid = _masterIndex->tagDrawable( drawable, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-
-        if ( _embed )
-        {
-            _embeddedFeatures[fid] = feature;
-        }
+        e = addEntry( feature->getFID(), oid, feature );
     }
 
-    return p;
+    if ( addRef )
+        ++_entries[e]._refs;
+
+    return _entries[e]._oid;
 }
 
-RefIDPair*
-FeatureSourceIndex::tagAllDrawables(osg::Node* node, Feature* feature)
+ObjectID
+FeatureSourceIndex::tagAllDrawables(osg::Node* node, Feature* feature, bool addRef)
 {
-    if ( !feature ) return 0L;
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
 
     Threading::ScopedMutexLock lock(_mutex);
 
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
-
-    FIDMap::const_iterator f = _fids.find( fid );
+    unsigned e;
+    EntryMap::const_iterator f = _fids.find( feature->getFID() );
     if ( f != _fids.end() )
     {
-        ObjectID oid = f->second->_oid;
-        _masterIndex->tagAllDrawables( node, oid );
-        p = f->second.get();
+        e = f->second;
+        _masterIndex->tagAllDrawables( node, _entries[e]._oid );
     }
     else
     {
         ObjectID oid = _masterIndex->tagAllDrawables( node, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-
-        if ( _embed )
-        {
-            _embeddedFeatures[fid] = feature;
-        }
+        e = addEntry( feature->getFID(), oid, feature );
     }
 
-    return p;
+    if ( addRef )
+        ++_entries[e]._refs;
+
+    return _entries[e]._oid;
 }
 
-RefIDPair*
-FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature)
+ObjectID
+FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature, bool addRef)
 {
-    if ( !feature ) return 0L;
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
 
     Threading::ScopedMutexLock lock(_mutex);
 
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
-    ObjectID oid;
-
-    FIDMap::const_iterator f = _fids.find( fid );
+    unsigned e;
+    EntryMap::const_iterator f = _fids.find( feature->getFID() );
     if ( f != _fids.end() )
     {
-        oid = f->second->_oid;
-        _masterIndex->tagNode( node, oid );
-        p = f->second.get();
+        e = f->second;
+        _masterIndex->tagNode( node, _entries[e]._oid );
     }
     else
     {
-        oid = _masterIndex->tagNode( node, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
+        ObjectID oid = _masterIndex->tagNode( node, this );
+        e = addEntry( feature->getFID(), oid, feature );
+    }
 
-        if ( _embed )
-        {
-            _embeddedFeatures[fid] = feature;
-        }
+    if ( addRef )
+        ++_entries[e]._refs;
+
+    OE_DEBUG << LC << "Tagging feature ID = " << feature->getFID() << " => " << _entries[e]._oid << " (" << feature->getString("name") << ")\n";
+
+    return _entries[e]._oid;
+}
+
+ObjectID
+FeatureSourceIndex::tagRange(osg::Drawable* drawable, Feature* feature, unsigned first, unsigned count, bool addRef)
+{
+    if ( !feature ) return OSGEARTH_OBJECTID_EMPTY;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    unsigned e;
+    EntryMap::const_iterator f = _fids.find( feature->getFID() );
+    if ( f != _fids.end() )
+    {
+        e = f->second;
+        _masterIndex->tagRange( drawable, _entries[e]._oid, first, count );
+    }
+    else
+    {
+        ObjectID oid = _masterIndex->tagRange( drawable, this, first, count );
+        e = addEntry( feature->getFID(), oid, feature );
     }
 
-    OE_DEBUG << LC << "Tagging feature ID = " << fid << " => " << oid << " (" << feature->getString("name") << ")\n";
+    if ( addRef )
+        ++_entries[e]._refs;
+
+    return _entries[e]._oid;
+}
+
+void
+FeatureSourceIndex::insert(const FeatureList& features, const std::vector<char>& addRefs, std::vector<ObjectID>& out_oids)
+{
+    out_oids.assign( features.size(), OSGEARTH_OBJECTID_EMPTY );
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    _entries.reserve( _entries.size() + features.size() );
+    _fids.reserve( _fids.size() + features.size() );
+    _oids.reserve( _oids.size() + features.size() );
+
+    unsigned i = 0;
+    for(FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++i)
+    {
+        Feature* feature = f->get();
+        if ( !feature )
+            continue;
+
+        unsigned e;
+        EntryMap::const_iterator k = _fids.find( feature->getFID() );
+        if ( k != _fids.end() )
+            e = k->second;
+        else
+            e = addEntry( feature->getFID(), _masterIndex->insert( this ), feature );
+
+        if ( addRefs[i] )
+            ++_entries[e]._refs;
 
-    return p;
+        out_oids[i] = _entries[e]._oid;
+    }
 }
 
 Feature*
@@ -463,16 +570,15 @@ FeatureSourceIndex::getFeature(ObjectID oid) const
     OIDMap::const_iterator i = _oids.find( oid );
     if ( i != _oids.end() )
     {
-        FeatureID fid = i->second;
+        const Entry& entry = _entries[i->second];
 
         if ( _embed )
         {
-            FeatureMap::const_iterator j = _embeddedFeatures.find( fid );
-            feature = j != _embeddedFeatures.end() ? j->second.get() : 0L;
+            feature = entry._feature.get();
         }
         else if ( _featureSource.valid() && _featureSource->supportsGetFeature() )
         {
-            feature = _featureSource->getFeature( fid );
+            feature = _featureSource->getFeature( entry._fid );
         }
     }
     return feature;
@@ -482,69 +588,75 @@ ObjectID
 FeatureSourceIndex::getObjectID(FeatureID fid) const
 {
     Threading::ScopedMutexLock lock(_mutex);
-    FIDMap::const_iterator i = _fids.find(fid);
+    EntryMap::const_iterator i = _fids.find(fid);
     if ( i != _fids.end() )
-        return i->second->_oid;
+        return _entries[i->second]._oid;
     else
         return OSGEARTH_OBJECTID_EMPTY;
 }
 
-// When Feature index data is deserialized, the old serialized ObjectIDs are
-// no longer valid. This method will re-install the mappings in the master index
-// and write new local mappings with new ObjectIDs.
-void
-FeatureSourceIndex::update(osg::Drawable* drawable, std::map<ObjectID,ObjectID>& oldToNew, const FIDMap& oldFIDMap, FIDMap& newFIDMap)
+int
+FeatureSourceIndex::size() const
 {
-    unsigned count = 0;
-    if (_masterIndex->updateObjectIDs(drawable, oldToNew, this))
-    {
-        for (std::map<ObjectID, ObjectID>::const_iterator i = oldToNew.begin(); i != oldToNew.end(); ++i)
-        {
-            const ObjectID& oldoid = i->first;
-            const ObjectID& newoid = i->second;
+    Threading::ScopedMutexLock lock(_mutex);
+    return _fids.size();
+}
 
-            for (FIDMap::const_iterator j = oldFIDMap.begin(); j != oldFIDMap.end(); ++j)
-            {
-                const RefIDPair* rip = j->second.get();
-                if (rip && rip->_oid == oldoid)
-                {
-                    RefIDPair* newrip = new RefIDPair(rip->_fid, newoid);
-                    _oids[newoid] = rip->_fid;
-                    _fids[rip->_fid] = newrip;
-                    newFIDMap[rip->_fid] = newrip;
-                    ++count;
-                }
-            }
-        }
-    }
+std::size_t
+FeatureSourceIndex::getMemoryUsage() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return
+        sizeof(*this) +
+        _entries.capacity() * sizeof(Entry) +
+        _freeEntries.capacity() * sizeof(unsigned) +
+        _fids.getMemoryUsage() +
+        _oids.getMemoryUsage();
 }
 
 // When Feature index data is deserialized, the old serialized ObjectIDs are
 // no longer valid. This method will re-install the mappings in the master index
-// and write new local mappings with new ObjectIDs.
+// and write new local mappings with new ObjectIDs. FIDs already in the index
+// keep their existing ObjectIDs.
 void
-FeatureSourceIndex::update(osg::Node* node, std::map<ObjectID,ObjectID>& oldToNew, const FIDMap& oldFIDMap, FIDMap& newFIDMap)
+FeatureSourceIndex::reIndex(FIDMap& fids, ObjectIDRemap& oldToNew)
 {
-    unsigned count = 0;
-    if (_masterIndex->updateObjectID(node, oldToNew, this))
+    Threading::ScopedMutexLock lock(_mutex);
+
+    _fids.reserve( _fids.size() + fids.size() );
+    _oids.reserve( _oids.size() + fids.size() );
+
+    // Each FID carries its own serialized OID, so the lookups below never need
+    // the mappings made in this pass; record them afterwards in one batch.
+    std::vector< std::pair<ObjectID,ObjectID> > mappings;
+    mappings.reserve( fids.size() );
+
+    for (FIDMap::iterator i = fids.begin(); i != fids.end(); ++i)
     {
-        for (std::map<ObjectID, ObjectID>::const_iterator i = oldToNew.begin(); i != oldToNew.end(); ++i)
-        {
-            const ObjectID& oldoid = i->first;
-            const ObjectID& newoid = i->second;
+        const FeatureID& fid = i->first;
+        ObjectID oldoid = i->second;
 
-            for (FIDMap::const_iterator j = oldFIDMap.begin(); j != oldFIDMap.end(); ++j)
-            {
-                const RefIDPair* rip = j->second.get();
-                if (rip && rip->_oid == oldoid)
-                {
-                    RefIDPair* newrip = new RefIDPair(rip->_fid, newoid);
-                    _oids[newoid] = rip->_fid;
-                    _fids[rip->_fid] = newrip;
-                    newFIDMap[rip->_fid] = newrip;
-                    ++count;
-                }
-            }
+        unsigned e;
+        EntryMap::const_iterator f = _fids.find( fid );
+        if ( f != _fids.end() )
+        {
+            e = f->second;
+        }
+        else
+        {
+            ObjectID newoid;
+            if ( !oldToNew.find( oldoid, newoid ) )
+                newoid = _masterIndex->insert( this );
+            e = addEntry( fid, newoid, 0L );
         }
+
+        ++_entries[e]._refs;
+        mappings.push_back( std::make_pair(oldoid, _entries[e]._oid) );
+        i->second = _entries[e]._oid;
+    }
+
+    for (unsigned i = 0; i < mappings.size(); ++i)
+    {
+        oldToNew.add( mappings[i].first, mappings[i].second );
     }
 }
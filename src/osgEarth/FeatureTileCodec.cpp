@@ -0,0 +1,588 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/FeatureTileCodec>
+#include <osgEarth/Notify>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#define LC "[FeatureTileCodec] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const char     MAGIC[4] = { 'O', 'E', 'F', 'T' };
+    const unsigned VERSION  = 1u;
+
+    enum Encoding      { ENCODING_COMPACT = 0, ENCODING_OSGB = 1 };
+    enum NodeType      { NODE_GROUP = 1, NODE_MATRIX_TRANSFORM = 2, NODE_GEODE = 3 };
+    enum ArrayType     { ARRAY_NONE = 0, ARRAY_FLOAT = 1, ARRAY_VEC2 = 2, ARRAY_VEC3 = 3, ARRAY_VEC4 = 4 };
+    enum PrimitiveType { PRIM_ARRAYS = 1, PRIM_UBYTE = 2, PRIM_USHORT = 3, PRIM_UINT = 4 };
+
+    osgDB::ReaderWriter* getOSGB()
+    {
+        return osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    }
+
+    // true if the object is exactly the named core OSG class (not a subclass)
+    bool isExactly(const osg::Object* object, const char* className)
+    {
+        return
+            strcmp(object->libraryName(), "osg") == 0 &&
+            strcmp(object->className(), className) == 0;
+    }
+
+    // Values are written in native byte order; a cache is only read on
+    // the kind of machine that wrote it.
+    struct Writer
+    {
+        std::ostringstream _out;
+
+        template<typename T> void write(const T& value) {
+            _out.write((const char*)&value, sizeof(T));
+        }
+
+        void writeBytes(const void* data, unsigned size) {
+            if (size > 0)
+                _out.write((const char*)data, size);
+        }
+
+        void writeString(const std::string& value) {
+            write((unsigned)value.size());
+            writeBytes(value.data(), value.size());
+        }
+    };
+
+    struct Reader
+    {
+        Reader(const std::string& buffer) : _buffer(buffer), _pos(0), _ok(true) { }
+
+        const std::string& _buffer;
+        std::string::size_type _pos;
+        bool _ok;
+
+        bool readBytes(void* data, unsigned size) {
+            if (!_ok || _pos + size > _buffer.size()) {
+                _ok = false;
+                return false;
+            }
+            if (size > 0)
+                memcpy(data, _buffer.data() + _pos, size);
+            _pos += size;
+            return true;
+        }
+
+        template<typename T> T read() {
+            T value = T();
+            readBytes(&value, sizeof(T));
+            return value;
+        }
+
+        std::string readString() {
+            unsigned size = read<unsigned>();
+            if (!_ok || _pos + size > _buffer.size()) {
+                _ok = false;
+                return std::string();
+            }
+            std::string value(_buffer, _pos, size);
+            _pos += size;
+            return value;
+        }
+    };
+
+    struct Encoder
+    {
+        Encoder(osgDB::ReaderWriter* rw, const osgDB::Options* options) : _rw(rw), _options(options) { }
+
+        osgDB::ReaderWriter* _rw;
+        const osgDB::Options* _options;
+        Writer _table;
+        Writer _graph;
+        std::vector<const osg::StateSet*> _stateSets;
+        std::map<const osg::StateSet*, int> _stateSetIndex;
+
+        int getStateSetRef(const osg::StateSet* stateSet)
+        {
+            if (!stateSet)
+                return -1;
+
+            std::map<const osg::StateSet*, int>::const_iterator i = _stateSetIndex.find(stateSet);
+            if (i != _stateSetIndex.end())
+                return i->second;
+
+            int index = _stateSets.size();
+            _stateSets.push_back(stateSet);
+            _stateSetIndex[stateSet] = index;
+            return index;
+        }
+
+        bool encodeStateSets()
+        {
+            _table.write((unsigned)_stateSets.size());
+            for (unsigned i = 0; i < _stateSets.size(); ++i)
+            {
+                std::stringstream buf;
+                if (!_rw->writeObject(*_stateSets[i], buf, _options).success())
+                    return false;
+                _table.writeString(buf.str());
+            }
+            return true;
+        }
+
+        bool encodeNode(const osg::Node* node)
+        {
+            if (node->getUpdateCallback() || node->getEventCallback() || node->getCullCallback())
+                return false;
+
+            if (isExactly(node, "Geode"))
+            {
+                const osg::Geode* geode = static_cast<const osg::Geode*>(node);
+                _graph.write((char)NODE_GEODE);
+                encodeCommon(node);
+                _graph.write(geode->getNumDrawables());
+                for (unsigned i = 0; i < geode->getNumDrawables(); ++i)
+                {
+                    if (!encodeGeometry(geode->getDrawable(i)))
+                        return false;
+                }
+                return true;
+            }
+            else if (isExactly(node, "MatrixTransform"))
+            {
+                const osg::MatrixTransform* xform = static_cast<const osg::MatrixTransform*>(node);
+                _graph.write((char)NODE_MATRIX_TRANSFORM);
+                encodeCommon(node);
+                _graph.write((int)xform->getReferenceFrame());
+                // always stored as doubles, even under OSG_USE_FLOAT_MATRIX
+                osg::Matrixd matrix(xform->getMatrix());
+                _graph.writeBytes(matrix.ptr(), 16 * sizeof(double));
+                return encodeChildren(xform);
+            }
+            else if (isExactly(node, "Group"))
+            {
+                _graph.write((char)NODE_GROUP);
+                encodeCommon(node);
+                return encodeChildren(node->asGroup());
+            }
+
+            return false;
+        }
+
+        void encodeCommon(const osg::Node* node)
+        {
+            _graph.writeString(node->getName());
+            _graph.write(node->getNodeMask());
+            _graph.write(getStateSetRef(node->getStateSet()));
+        }
+
+        bool encodeChildren(const osg::Group* group)
+        {
+            _graph.write(group->getNumChildren());
+            for (unsigned i = 0; i < group->getNumChildren(); ++i)
+            {
+                if (!encodeNode(group->getChild(i)))
+                    return false;
+            }
+            return true;
+        }
+
+        bool encodeArray(const osg::Array* array)
+        {
+            if (!array)
+            {
+                _graph.write((char)ARRAY_NONE);
+                return true;
+            }
+
+            char type;
+            switch (array->getType())
+            {
+            case osg::Array::FloatArrayType: type = ARRAY_FLOAT; break;
+            case osg::Array::Vec2ArrayType:  type = ARRAY_VEC2; break;
+            case osg::Array::Vec3ArrayType:  type = ARRAY_VEC3; break;
+            case osg::Array::Vec4ArrayType:  type = ARRAY_VEC4; break;
+            default: return false;
+            }
+
+            _graph.write(type);
+            _graph.write((int)array->getBinding());
+            _graph.write((char)(array->getNormalize() ? 1 : 0));
+            _graph.write(array->getNumElements());
+            _graph.writeBytes(array->getDataPointer(), array->getTotalDataSize());
+            return true;
+        }
+
+        bool encodeGeometry(const osg::Drawable* drawable)
+        {
+            if (!isExactly(drawable, "Geometry"))
+                return false;
+
+            if (drawable->getUpdateCallback() || drawable->getEventCallback() || 
+                drawable->getCullCallback() || drawable->getDrawCallback())
+                return false;
+
+            const osg::Geometry* geom = static_cast<const osg::Geometry*>(drawable);
+
+            if (geom->getSecondaryColorArray() || geom->getFogCoordArray())
+                return false;
+
+            if (geom->getVertexArray() && geom->getVertexArray()->getType() != osg::Array::Vec3ArrayType)
+                return false;
+
+            _graph.writeString(geom->getName());
+            _graph.write(getStateSetRef(geom->getStateSet()));
+            _graph.write((char)(geom->getUseVertexBufferObjects() ? 1 : 0));
+            _graph.write((char)(geom->getUseDisplayList() ? 1 : 0));
+
+            if (!encodeArray(geom->getVertexArray()) ||
+                !encodeArray(geom->getNormalArray()) ||
+                !encodeArray(geom->getColorArray()))
+                return false;
+
+            _graph.write(geom->getNumTexCoordArrays());
+            for (unsigned i = 0; i < geom->getNumTexCoordArrays(); ++i)
+            {
+                if (!encodeArray(geom->getTexCoordArray(i)))
+                    return false;
+            }
+
+            _graph.write(geom->getNumVertexAttribArrays());
+            for (unsigned i = 0; i < geom->getNumVertexAttribArrays(); ++i)
+            {
+                if (!encodeArray(geom->getVertexAttribArray(i)))
+                    return false;
+            }
+
+            _graph.write(geom->getNumPrimitiveSets());
+            for (unsigned i = 0; i < geom->getNumPrimitiveSets(); ++i)
+            {
+                const osg::PrimitiveSet* prim = geom->getPrimitiveSet(i);
+                if (prim->getNumInstances() > 0)
+                    return false;
+
+                switch (prim->getType())
+                {
+                case osg::PrimitiveSet::DrawArraysPrimitiveType:
+                {
+                    const osg::DrawArrays* da = static_cast<const osg::DrawArrays*>(prim);
+                    _graph.write((char)PRIM_ARRAYS);
+                    _graph.write((unsigned)da->getMode());
+                    _graph.write(da->getFirst());
+                    _graph.write(da->getCount());
+                    break;
+                }
+                case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+                case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+                case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:
+                {
+                    char type =
+                        prim->getType() == osg::PrimitiveSet::DrawElementsUBytePrimitiveType ? PRIM_UBYTE :
+                        prim->getType() == osg::PrimitiveSet::DrawElementsUShortPrimitiveType ? PRIM_USHORT :
+                        PRIM_UINT;
+                    _graph.write(type);
+                    _graph.write((unsigned)prim->getMode());
+                    _graph.write(prim->getNumIndices());
+                    _graph.writeBytes(prim->getDataPointer(), prim->getTotalDataSize());
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    struct Decoder
+    {
+        Decoder(Reader& reader, osgDB::ReaderWriter* rw, const osgDB::Options* options) : _in(reader), _rw(rw), _options(options) { }
+
+        Reader& _in;
+        osgDB::ReaderWriter* _rw;
+        const osgDB::Options* _options;
+        std::vector< osg::ref_ptr<osg::StateSet> > _stateSets;
+
+        bool decodeStateSets()
+        {
+            unsigned count = _in.read<unsigned>();
+            for (unsigned i = 0; i < count && _in._ok; ++i)
+            {
+                std::istringstream buf(_in.readString());
+                osgDB::ReaderWriter::ReadResult rr = _rw->readObject(buf, _options);
+                osg::ref_ptr<osg::StateSet> stateSet = dynamic_cast<osg::StateSet*>(rr.getObject());
+                if (!stateSet.valid())
+                    return false;
+                _stateSets.push_back(stateSet.get());
+            }
+            return _in._ok;
+        }
+
+        osg::StateSet* getStateSet(int index)
+        {
+            return index >= 0 && index < (int)_stateSets.size() ? _stateSets[index].get() : 0L;
+        }
+
+        osg::Node* decodeNode()
+        {
+            char type = _in.read<char>();
+            if (!_in._ok)
+                return 0L;
+
+            osg::ref_ptr<osg::Node> node;
+
+            if (type == NODE_GEODE)
+            {
+                osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+                decodeCommon(geode.get());
+                unsigned count = _in.read<unsigned>();
+                for (unsigned i = 0; i < count && _in._ok; ++i)
+                {
+                    osg::Geometry* geom = decodeGeometry();
+                    if (!geom)
+                        return 0L;
+                    geode->addDrawable(geom);
+                }
+                node = geode.get();
+            }
+            else if (type == NODE_MATRIX_TRANSFORM)
+            {
+                osg::ref_ptr<osg::MatrixTransform> xform = new osg::MatrixTransform();
+                decodeCommon(xform.get());
+                xform->setReferenceFrame((osg::Transform::ReferenceFrame)_in.read<int>());
+                osg::Matrixd matrix;
+                _in.readBytes(matrix.ptr(), 16 * sizeof(double));
+                xform->setMatrix(matrix);
+                if (!decodeChildren(xform.get()))
+                    return 0L;
+                node = xform.get();
+            }
+            else if (type == NODE_GROUP)
+            {
+                osg::ref_ptr<osg::Group> group = new osg::Group();
+                decodeCommon(group.get());
+                if (!decodeChildren(group.get()))
+                    return 0L;
+                node = group.get();
+            }
+
+            return _in._ok ? node.release() : 0L;
+        }
+
+        void decodeCommon(osg::Node* node)
+        {
+            node->setName(_in.readString());
+            node->setNodeMask(_in.read<osg::Node::NodeMask>());
+            node->setStateSet(getStateSet(_in.read<int>()));
+        }
+
+        bool decodeChildren(osg::Group* group)
+        {
+            unsigned count = _in.read<unsigned>();
+            for (unsigned i = 0; i < count && _in._ok; ++i)
+            {
+                osg::Node* child = decodeNode();
+                if (!child)
+                    return false;
+                group->addChild(child);
+            }
+            return _in._ok;
+        }
+
+        osg::Array* decodeArray()
+        {
+            char type = _in.read<char>();
+            if (type == ARRAY_NONE || !_in._ok)
+                return 0L;
+
+            int binding = _in.read<int>();
+            char normalize = _in.read<char>();
+            unsigned count = _in.read<unsigned>();
+            if (!_in._ok)
+                return 0L;
+
+            osg::ref_ptr<osg::Array> array;
+            switch (type)
+            {
+            case ARRAY_FLOAT: array = new osg::FloatArray(count); break;
+            case ARRAY_VEC2:  array = new osg::Vec2Array(count); break;
+            case ARRAY_VEC3:  array = new osg::Vec3Array(count); break;
+            case ARRAY_VEC4:  array = new osg::Vec4Array(count); break;
+            default:
+                _in._ok = false;
+                return 0L;
+            }
+
+            array->setBinding((osg::Array::Binding)binding);
+            array->setNormalize(normalize != 0);
+            if (count > 0 && !_in.readBytes(const_cast<GLvoid*>(array->getDataPointer()), array->getTotalDataSize()))
+                return 0L;
+
+            return array.release();
+        }
+
+        osg::Geometry* decodeGeometry()
+        {
+            osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+            geom->setName(_in.readString());
+            geom->setStateSet(getStateSet(_in.read<int>()));
+            geom->setUseVertexBufferObjects(_in.read<char>() != 0);
+            geom->setUseDisplayList(_in.read<char>() != 0);
+
+            geom->setVertexArray(decodeArray());
+            geom->setNormalArray(decodeArray());
+            geom->setColorArray(decodeArray());
+
+            unsigned numTexCoords = _in.read<unsigned>();
+            for (unsigned i = 0; i < numTexCoords && _in._ok; ++i)
+            {
+                osg::Array* array = decodeArray();
+                if (array)
+                    geom->setTexCoordArray(i, array);
+            }
+
+            unsigned numAttribs = _in.read<unsigned>();
+            for (unsigned i = 0; i < numAttribs && _in._ok; ++i)
+            {
+                osg::Array* array = decodeArray();
+                if (array)
+                    geom->setVertexAttribArray(i, array);
+            }
+
+            unsigned numPrims = _in.read<unsigned>();
+            for (unsigned i = 0; i < numPrims && _in._ok; ++i)
+            {
+                char type = _in.read<char>();
+                GLenum mode = _in.read<unsigned>();
+
+                if (type == PRIM_ARRAYS)
+                {
+                    GLint first = _in.read<GLint>();
+                    GLsizei count = _in.read<GLsizei>();
+                    geom->addPrimitiveSet(new osg::DrawArrays(mode, first, count));
+                }
+                else
+                {
+                    unsigned count = _in.read<unsigned>();
+                    if (!_in._ok)
+                        break;
+
+                    osg::ref_ptr<osg::DrawElements> de;
+                    if (type == PRIM_UBYTE)       de = new osg::DrawElementsUByte(mode, count);
+                    else if (type == PRIM_USHORT) de = new osg::DrawElementsUShort(mode, count);
+                    else if (type == PRIM_UINT)   de = new osg::DrawElementsUInt(mode, count);
+                    else {
+                        _in._ok = false;
+                        break;
+                    }
+
+                    if (count > 0)
+                        _in.readBytes(const_cast<GLvoid*>(de->getDataPointer()), de->getTotalDataSize());
+
+                    geom->addPrimitiveSet(de.get());
+                }
+            }
+
+            return _in._ok ? geom.release() : 0L;
+        }
+    };
+}
+
+bool
+FeatureTileCodec::encode(const osg::Node*      node,
+                         const osgDB::Options* writeOptions,
+                         std::string&          out_buffer)
+{
+    if (!node)
+        return false;
+
+    osgDB::ReaderWriter* rw = getOSGB();
+    if (!rw)
+    {
+        OE_WARN << LC << "No osgb plugin available" << std::endl;
+        return false;
+    }
+
+    Writer header;
+    header.writeBytes(MAGIC, 4);
+    header.write(VERSION);
+
+    Encoder encoder(rw, writeOptions);
+    if (encoder.encodeNode(node) && encoder.encodeStateSets())
+    {
+        header.write((char)ENCODING_COMPACT);
+        out_buffer = header._out.str() + encoder._table._out.str() + encoder._graph._out.str();
+        return true;
+    }
+
+    // not a plain geometry graph; embed it as osgb instead.
+    std::stringstream buf;
+    if (!rw->writeNode(*node, buf, writeOptions).success())
+        return false;
+
+    header.write((char)ENCODING_OSGB);
+    out_buffer = header._out.str() + buf.str();
+    return true;
+}
+
+bool
+FeatureTileCodec::isEncoded(const std::string& buffer)
+{
+    return buffer.size() >= 4 && memcmp(buffer.data(), MAGIC, 4) == 0;
+}
+
+osg::Node*
+FeatureTileCodec::decode(const std::string&    buffer,
+                         const osgDB::Options* readOptions)
+{
+    if (!isEncoded(buffer))
+        return 0L;
+
+    osgDB::ReaderWriter* rw = getOSGB();
+    if (!rw)
+        return 0L;
+
+    Reader in(buffer);
+    in._pos = 4;
+    unsigned version = in.read<unsigned>();
+    char encoding = in.read<char>();
+    if (!in._ok || version != VERSION)
+        return 0L;
+
+    if (encoding == ENCODING_OSGB)
+    {
+        std::istringstream buf(buffer.substr(in._pos));
+        osgDB::ReaderWriter::ReadResult rr = rw->readNode(buf, readOptions);
+        return rr.success() ? rr.takeNode() : 0L;
+    }
+
+    Decoder decoder(in, rw, readOptions);
+    if (!decoder.decodeStateSets())
+        return 0L;
+
+    return decoder.decodeNode();
+}
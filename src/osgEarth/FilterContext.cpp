@@ -90,7 +90,8 @@ _resourceCache        ( rhs._resourceCache.get() ),
 _index                ( rhs._index ),
 _shaderPolicy         ( rhs._shaderPolicy ),
 _history              ( rhs._history ),
-_outputSRS            ( rhs._outputSRS.get() )
+_outputSRS            ( rhs._outputSRS.get() ),
+_stageTimes           ( rhs._stageTimes )
 {
     //nop
 }
@@ -165,6 +165,13 @@ GeoTransform::setPosition(const GeoPoint& position)
     return true;
 }
 
+void
+GeoTransform::setPosition(const GeoPoint& position, const osg::Matrixd& local2world)
+{
+    _position = position;
+    this->setMatrix( local2world );
+}
+
 void
 GeoTransform::onTileUpdate(const TileKey&          key,
                           osg::Node*              node,
@@ -36,6 +36,8 @@
 #include <osgEarth/ShaderUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/Metrics>
+#include <osgEarth/FeatureIndex>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/MatrixTransform>
 #include <osg/Timer>
@@ -54,6 +56,105 @@ using namespace osgEarth::Util;
 
 //-----------------------------------------------------------------------
 
+namespace
+{
+    // Serializes access to the caller's feature index so that chunks
+    // compiling in parallel can tag their drawables safely.
+    struct SerializedIndexBuilder : public FeatureIndexBuilder
+    {
+        SerializedIndexBuilder(FeatureIndexBuilder* index) : _index(index) { }
+
+        ObjectID tagDrawable(osg::Drawable* drawable, Feature* feature)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return _index->tagDrawable(drawable, feature);
+        }
+
+        ObjectID tagAllDrawables(osg::Node* node, Feature* feature)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return _index->tagAllDrawables(node, feature);
+        }
+
+        ObjectID tagNode(osg::Node* node, Feature* feature)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return _index->tagNode(node, feature);
+        }
+
+        ObjectID tagRange(osg::Drawable* drawable, Feature* feature, unsigned first, unsigned count)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            return _index->tagRange(drawable, feature, first, count);
+        }
+
+        FeatureIndexBuilder* _index;
+        Threading::Mutex _mutex;
+    };
+}
+
+/**
+ * Shared state for one parallel compile. Each chunk writes only to its own
+ * output slot, and the caller merges the slots in order.
+ */
+struct GeometryCompiler::ParallelCompile : public Threading::ParallelFor::Job
+{
+    ParallelCompile(const GeometryCompiler* compiler, const Style& style, const FilterContext& cx) :
+        _compiler(compiler),
+        _style(style),
+        _cx(cx),
+        _index(cx.featureIndex() ? new SerializedIndexBuilder(const_cast<FeatureIndexBuilder*>(cx.featureIndex())) : 0L)
+    {
+        if (_index)
+            _cx.setFeatureIndex(_index);
+    }
+
+    ~ParallelCompile()
+    {
+        delete _index;
+    }
+
+    void run(Threading::ThreadPool* threads)
+    {
+        _results.resize(_chunks.size());
+        _stageTimes.resize(_chunks.size());
+        Threading::ParallelFor::run(*this, _chunks.size(), threads);
+    }
+
+    void operator()(unsigned chunk, unsigned)
+    {
+        FilterContext cx(_cx);
+        std::vector<std::string> history;
+        _results[chunk] = new osg::Group();
+        _compiler->compileFilters(_chunks[chunk], _style, cx, _results[chunk].get(), history);
+        _stageTimes[chunk] = cx.getStageTimes();
+    }
+
+    // adds the time each chunk spent in each stage to the caller's context.
+    void mergeStageTimes(FilterContext& context) const
+    {
+        const std::map<std::string, double>& base = _cx.getStageTimes();
+        for (unsigned c = 0; c < _stageTimes.size(); ++c)
+        {
+            for (std::map<std::string, double>::const_iterator i = _stageTimes[c].begin(); i != _stageTimes[c].end(); ++i)
+            {
+                std::map<std::string, double>::const_iterator b = base.find(i->first);
+                context.addStageTime(i->first, i->second - (b != base.end() ? b->second : 0.0));
+            }
+        }
+    }
+
+    const GeometryCompiler* _compiler;
+    Style _style;
+    FilterContext _cx;
+    SerializedIndexBuilder* _index;
+    std::vector<FeatureList> _chunks;
+    std::vector<osg::ref_ptr<osg::Group> > _results;
+    std::vector<std::map<std::string, double> > _stageTimes;
+};
+
+//-----------------------------------------------------------------------
+
 GeometryCompilerOptions GeometryCompilerOptions::s_defaults(true);
 
 void
@@ -76,7 +177,9 @@ _optimize              ( false ),
 _optimizeVertexOrdering( true ),
 _validate              ( false ),
 _maxPolyTilingAngle    ( 45.0f ),
-_useOSGTessellator     ( false )
+_useOSGTessellator     ( false ),
+_indexedExtrusion      ( false ),
+_parallelChunkSize     ( 0u )
 {
     //nop
 }
@@ -96,7 +199,9 @@ _optimize              ( s_defaults.optimize().value() ),
 _optimizeVertexOrdering( s_defaults.optimizeVertexOrdering().value() ),
 _validate              ( s_defaults.validate().value() ),
 _maxPolyTilingAngle    ( s_defaults.maxPolygonTilingAngle().value() ),
-_useOSGTessellator     (s_defaults.useOSGTessellator().value())
+_useOSGTessellator     (s_defaults.useOSGTessellator().value()),
+_indexedExtrusion      ( s_defaults.indexedExtrusion().value() ),
+_parallelChunkSize     ( s_defaults.parallelChunkSize().value() )
 {
     fromConfig(conf.getConfig());
 }
@@ -118,6 +223,8 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.get( "validate", _validate );
     conf.get( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.get( "use_osg_tessellator", _useOSGTessellator);
+    conf.get( "indexed_extrusion", _indexedExtrusion );
+    conf.get( "parallel_chunk_size", _parallelChunkSize );
 
     conf.get( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.get( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
@@ -142,6 +249,8 @@ GeometryCompilerOptions::getConfig() const
     conf.set( "validate", _validate );
     conf.set( "max_polygon_tiling_angle", _maxPolyTilingAngle );
     conf.set( "use_osg_tessellator", _useOSGTessellator);
+    conf.set( "indexed_extrusion", _indexedExtrusion );
+    conf.set( "parallel_chunk_size", _parallelChunkSize );
 
     conf.set( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.set( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
@@ -243,6 +352,132 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         sharedCX.extent() = sharedCX.profile()->getExtent();
     }
 
+    if ( canCompileInParallel(workingSet, style) )
+    {
+        compileInParallel( workingSet, style, sharedCX, resultGroup.get() );
+        if ( trackHistory ) history.push_back( "parallel" );
+    }
+    else
+    {
+        compileFilters( workingSet, style, sharedCX, resultGroup.get(), history );
+    }
+
+    if (Registry::capabilities().supportsGLSL())
+    {
+        ShaderPolicy shaderPolicy = _options.shaderPolicy().get();
+
+        if (shaderPolicy == SHADERPOLICY_GENERATE)
+        {
+            // no ss cache because we will optimize later.
+            Registry::shaderGenerator().run( 
+                resultGroup.get(),
+                "GeometryCompiler shadergen" );
+        }
+        else if (shaderPolicy == SHADERPOLICY_DISABLE )
+        {
+            resultGroup->getOrCreateStateSet()->setAttributeAndModes(
+                new osg::Program(),
+                osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
+        
+            if ( trackHistory ) history.push_back( "no shaders" );
+        }
+    }
+
+    // Optimize stateset sharing.
+    if ( _options.optimizeStateSharing() == true )
+    {
+        // Common state set cache?
+        osg::ref_ptr<StateSetCache> sscache;
+        if ( sharedCX.getSession() )
+        {
+            // with a shared cache, don't combine statesets. They may be
+            // in the live graph
+            sscache = sharedCX.getSession()->getStateSetCache();
+            sscache->consolidateStateAttributes( resultGroup.get() );
+        }
+        else 
+        {
+            // isolated: perform full optimization
+            sscache = new StateSetCache();
+            sscache->optimize( resultGroup.get() );
+        }
+        
+        if ( trackHistory ) history.push_back( "share state" );
+    }
+
+    if ( _options.optimize() == true )
+    {
+        OE_DEBUG << LC << "optimize begin" << std::endl;
+
+        // Run the optimizer on the resulting graph
+        int optimizations =
+            osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS |
+            osgUtil::Optimizer::REMOVE_REDUNDANT_NODES |
+            osgUtil::Optimizer::COMBINE_ADJACENT_LODS |
+            osgUtil::Optimizer::SHARE_DUPLICATE_STATE |
+            //osgUtil::Optimizer::MERGE_GEOMETRY |
+            osgUtil::Optimizer::CHECK_GEOMETRY |
+            osgUtil::Optimizer::MERGE_GEODES |
+            osgUtil::Optimizer::STATIC_OBJECT_DETECTION;
+
+        osgUtil::Optimizer opt;
+        opt.optimize(resultGroup.get(), optimizations);
+
+        osgUtil::Optimizer::MergeGeometryVisitor mg;
+        mg.setTargetMaximumNumberOfVertices(Registry::instance()->getMaxNumberOfVertsPerDrawable());
+        resultGroup->accept(mg);
+
+        OE_DEBUG << LC << "optimize complete" << std::endl;
+
+        if ( trackHistory ) history.push_back( "optimize" );
+    }
+    
+
+    //test: dump the tile to disk
+    //OE_WARN << "Writing GC node file to out.osgt..." << std::endl;
+    //osgDB::writeNodeFile( *(resultGroup.get()), "out.osgt" );
+
+#ifdef PROFILING
+    static double totalTime = 0.0;
+    static Threading::Mutex totalTimeMutex;
+    osg::Timer_t p_end = osg::Timer::instance()->tick();
+    double t = osg::Timer::instance()->delta_s(p_start, p_end);
+    totalTimeMutex.lock();
+    totalTime += t;
+    totalTimeMutex.unlock();
+    OE_INFO << LC
+        << "features = " << p_features
+        << ", time = " << t << " s.  cummulative = " 
+        << totalTime << " s."
+        << std::endl;
+#endif
+
+
+    if ( _options.validate() == true )
+    {
+        OE_NOTICE << LC << "-- Start Debugging --\n";
+        std::stringstream buf;
+        buf << "HISTORY ";
+        for(std::vector<std::string>::iterator h = history.begin(); h != history.end(); ++h)
+            buf << ".. " << *h;
+        OE_NOTICE << LC << buf.str() << "\n";
+        osgEarth::GeometryValidator validator;
+        resultGroup->accept(validator);
+        OE_NOTICE << LC << "-- End Debugging --\n";
+    }
+
+    return resultGroup.release();
+}
+
+void
+GeometryCompiler::compileFilters(FeatureList&              workingSet,
+                                 const Style&              style,
+                                 FilterContext&            sharedCX,
+                                 osg::Group*               resultGroup,
+                                 std::vector<std::string>& history) const
+{
+    bool trackHistory = (_options.validate() == true);
+
     // ref_ptr's to hold defaults in case we need them.
     osg::ref_ptr<PointSymbol>   defaultPoint;
     osg::ref_ptr<LineSymbol>    defaultLine;
@@ -412,6 +647,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.mergeGeometry().isSet() )
             extrude.setMergeGeometry( *_options.mergeGeometry() );
 
+        if ( _options.indexedExtrusion().isSet() )
+            extrude.setUseIndexedGeometry( *_options.indexedExtrusion() );
+
+        extrude.setUseOSGTessellator( *_options.useOSGTessellator() );
+
         osg::Node* node = extrude.push( workingSet, sharedCX );
         if ( node )
         {
@@ -485,110 +725,82 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             resultGroup->addChild( node );
         }
     }
+}
 
-    if (Registry::capabilities().supportsGLSL())
-    {
-        ShaderPolicy shaderPolicy = _options.shaderPolicy().get();
+bool
+GeometryCompiler::canCompileInParallel(const FeatureList& workingSet,
+                                       const Style&       style) const
+{
+    unsigned chunkSize = _options.parallelChunkSize().get();
+    if ( chunkSize == 0u || workingSet.size() <= chunkSize )
+        return false;
+
+    // model substitution clusters and instances across the whole feature
+    // set, so chunking would change its output.
+    if ( style.has<ModelSymbol>() )
+        return false;
+
+    // an empty style picks defaults from the first feature, which would
+    // differ from chunk to chunk.
+    return
+        style.has<PointSymbol>()     ||
+        style.has<LineSymbol>()      ||
+        style.has<PolygonSymbol>()   ||
+        style.has<ExtrusionSymbol>() ||
+        style.has<TextSymbol>()      ||
+        style.has<IconSymbol>();
+}
 
-        if (shaderPolicy == SHADERPOLICY_GENERATE)
-        {
-            // no ss cache because we will optimize later.
-            Registry::shaderGenerator().run( 
-                resultGroup.get(),
-                "GeometryCompiler shadergen" );
-        }
-        else if (shaderPolicy == SHADERPOLICY_DISABLE )
-        {
-            resultGroup->getOrCreateStateSet()->setAttributeAndModes(
-                new osg::Program(),
-                osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE );
-        
-            if ( trackHistory ) history.push_back( "no shaders" );
-        }
+void
+GeometryCompiler::compileInParallel(FeatureList&   workingSet,
+                                    const Style&   style,
+                                    FilterContext& context,
+                                    osg::Group*    resultGroup) const
+{
+    OE_PROFILING_ZONE;
+
+    // register every feature with the index in input order first, so the
+    // ObjectIDs do not depend on which chunk happens to tag first. The chunks'
+    // own tagging then reuses these IDs.
+    FeatureIndexBuilder* index = context.featureIndex();
+    if ( index )
+    {
+        for( FeatureList::const_iterator f = workingSet.begin(); f != workingSet.end(); ++f )
+            index->tagNode( 0L, f->get() );
     }
 
-    // Optimize stateset sharing.
-    if ( _options.optimizeStateSharing() == true )
+    ParallelCompile pc(this, style, context);
+
+    // split into contiguous chunks so the merged output keeps feature order.
+    unsigned chunkSize = _options.parallelChunkSize().get();
+    FeatureList::iterator i = workingSet.begin();
+    while ( i != workingSet.end() )
     {
-        // Common state set cache?
-        osg::ref_ptr<StateSetCache> sscache;
-        if ( sharedCX.getSession() )
+        pc._chunks.push_back( FeatureList() );
+        FeatureList& chunk = pc._chunks.back();
+        for( unsigned n = 0; n < chunkSize && i != workingSet.end(); ++n )
         {
-            // with a shared cache, don't combine statesets. They may be
-            // in the live graph
-            sscache = sharedCX.getSession()->getStateSetCache();
-            sscache->consolidateStateAttributes( resultGroup.get() );
+            chunk.push_back( *i );
+            i = workingSet.erase( i );
         }
-        else 
-        {
-            // isolated: perform full optimization
-            sscache = new StateSetCache();
-            sscache->optimize( resultGroup.get() );
-        }
-        
-        if ( trackHistory ) history.push_back( "share state" );
     }
 
-    if ( _options.optimize() == true )
-    {
-        OE_DEBUG << LC << "optimize begin" << std::endl;
+    osg::ref_ptr<Threading::ThreadPool> threads = Threading::ThreadPool::get( context.getDBOptions() );
+    pc.run( threads.get() );
 
-        // Run the optimizer on the resulting graph
-        int optimizations =
-            osgUtil::Optimizer::FLATTEN_STATIC_TRANSFORMS |
-            osgUtil::Optimizer::REMOVE_REDUNDANT_NODES |
-            osgUtil::Optimizer::COMBINE_ADJACENT_LODS |
-            osgUtil::Optimizer::SHARE_DUPLICATE_STATE |
-            //osgUtil::Optimizer::MERGE_GEOMETRY |
-            osgUtil::Optimizer::CHECK_GEOMETRY |
-            osgUtil::Optimizer::MERGE_GEODES |
-            osgUtil::Optimizer::STATIC_OBJECT_DETECTION;
-
-        osgUtil::Optimizer opt;
-        opt.optimize(resultGroup.get(), optimizations);
-
-        osgUtil::Optimizer::MergeGeometryVisitor mg;
-        mg.setTargetMaximumNumberOfVertices(Registry::instance()->getMaxNumberOfVertsPerDrawable());
-        resultGroup->accept(mg);
-
-        OE_DEBUG << LC << "optimize complete" << std::endl;
+    // merge the chunk outputs in order and hand the features back.
+    for( unsigned c = 0; c < pc._chunks.size(); ++c )
+    {
+        osg::Group* chunkGroup = pc._results[c].get();
+        for( unsigned k = 0; k < chunkGroup->getNumChildren(); ++k )
+        {
+            resultGroup->addChild( chunkGroup->getChild(k) );
+        }
 
-        if ( trackHistory ) history.push_back( "optimize" );
+        workingSet.splice( workingSet.end(), pc._chunks[c] );
     }
-    
 
-    //test: dump the tile to disk
-    //OE_WARN << "Writing GC node file to out.osgt..." << std::endl;
-    //osgDB::writeNodeFile( *(resultGroup.get()), "out.osgt" );
-
-#ifdef PROFILING
-    static double totalTime = 0.0;
-    static Threading::Mutex totalTimeMutex;
-    osg::Timer_t p_end = osg::Timer::instance()->tick();
-    double t = osg::Timer::instance()->delta_s(p_start, p_end);
-    totalTimeMutex.lock();
-    totalTime += t;
-    totalTimeMutex.unlock();
-    OE_INFO << LC
-        << "features = " << p_features
-        << ", time = " << t << " s.  cummulative = " 
-        << totalTime << " s."
-        << std::endl;
-#endif
-
-
-    if ( _options.validate() == true )
-    {
-        OE_NOTICE << LC << "-- Start Debugging --\n";
-        std::stringstream buf;
-        buf << "HISTORY ";
-        for(std::vector<std::string>::iterator h = history.begin(); h != history.end(); ++h)
-            buf << ".. " << *h;
-        OE_NOTICE << LC << buf.str() << "\n";
-        osgEarth::GeometryValidator validator;
-        resultGroup->accept(validator);
-        OE_NOTICE << LC << "-- End Debugging --\n";
-    }
+    pc.mergeStageTimes( context );
 
-    return resultGroup.release();
+    pc._results.clear();
 }
@@ -0,0 +1,40 @@
+#version $GLSL_VERSION_STR
+$GLSL_DEFAULT_PRECISION_FLOAT
+
+#extension GL_EXT_gpu_shader4 : enable
+#extension GL_ARB_draw_instanced: enable
+
+#pragma vp_entryPoint oe_di_setPackedInstancePosition
+#pragma vp_location   vertex_model
+#pragma vp_order      0.0
+
+uniform samplerBuffer oe_di_packed_TBO;
+
+// Stage-global containing object ID
+uint oe_index_objectid;
+vec3 vp_Normal;
+
+// rotates a vector by a unit quaternion
+vec3 oe_di_rotate(in vec4 q, in vec3 v)
+{
+    return v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+}
+
+void oe_di_setPackedInstancePosition(inout vec4 VertexMODEL)
+{
+    int index = 3 * gl_InstanceID;
+
+    // three texels per instance:
+    // (position, ObjectID low 16 bits), (rotation quaternion), (scale, ObjectID high 16 bits)
+    vec4 t0 = texelFetch(oe_di_packed_TBO, index);
+    vec4 q  = texelFetch(oe_di_packed_TBO, index+1);
+    vec4 t2 = texelFetch(oe_di_packed_TBO, index+2);
+
+    oe_index_objectid = uint(t0.w) + (uint(t2.w) << 16u);
+
+    // scale, then rotate, then translate:
+    VertexMODEL.xyz = oe_di_rotate(q, VertexMODEL.xyz * t2.xyz) + t0.xyz * VertexMODEL.w;
+
+    // normals take the inverse scale:
+    vp_Normal = normalize(oe_di_rotate(q, vp_Normal / t2.xyz));
+}
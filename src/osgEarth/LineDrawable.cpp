@@ -27,6 +27,7 @@
 #include <osg/LineStipple>
 #include <osg/LineWidth>
 #include <osgUtil/Optimizer>
+#include <algorithm>
 
 #include <osgDB/ObjectWrapper>
 
@@ -606,6 +607,47 @@ LineDrawable::setColor(unsigned vi, const osg::Vec4& color)
     }
 }
 
+void
+LineDrawable::setColors(unsigned first, const osg::Vec4* colors, unsigned n)
+{
+    initialize();
+
+    unsigned numVerts = getNumVerts();
+    if (colors == 0L || first >= numVerts)
+        return;
+
+    unsigned last = osg::minimum(first + n, numVerts);
+    osg::Vec4Array& c = *_colors;
+
+    // same real-vertex mapping as setColor(i), but dirties the array once
+    if (_useGPU && (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP))
+    {
+        for (unsigned vi = first; vi < last; ++vi)
+        {
+            const osg::Vec4& color = colors[vi - first];
+            if (vi == 0)
+            {
+                c[0] = c[1] = color;
+                c[c.size()-2] = c[c.size()-1] = color;
+            }
+            else
+            {
+                std::fill(c.begin() + (vi*4-2), c.begin() + (vi*4+2), color);
+            }
+        }
+    }
+    else
+    {
+        unsigned k = actualVertsPerVirtualVert(0);
+        for (unsigned vi = first; vi < last; ++vi)
+        {
+            std::fill(c.begin() + vi*k, c.begin() + (vi+1)*k, colors[vi - first]);
+        }
+    }
+
+    _colors->dirty();
+}
+
 void
 LineDrawable::setFirst(unsigned value)
 {
@@ -967,53 +1009,168 @@ LineDrawable::getRealIndex(unsigned index) const
 
 void
 LineDrawable::importVertexArray(const osg::Vec3Array* verts)
+{
+    if (verts && verts->size() > 0)
+        setVertices(&verts->front(), verts->size());
+    else
+        setVertices(0L, 0u);
+}
+
+void
+LineDrawable::allocate(unsigned numVerts)
 {
     initialize();
 
-    _current->clear();
-    _colors->clear();
-    if (verts && verts->size() > 0)
+    unsigned num = getNumVerts();
+    if (numVerts >= num)
     {
-        if (_useGPU)
-        {
-            _previous->clear();
-            _next->clear();
-        }
+        std::vector<osg::Vec3> zeros(numVerts - num);
+        if (!zeros.empty())
+            appendVertices(&zeros.front(), zeros.size());
+    }
+    else
+    {
+        clear();
+        std::vector<osg::Vec3> zeros(numVerts);
+        if (!zeros.empty())
+            appendVertices(&zeros.front(), zeros.size());
+    }
 
-        reserve(verts->size());
+    dirty();
+}
 
-        for (osg::Vec3Array::const_iterator i = verts->begin(); i != verts->end(); ++i)
-        {
-            pushVertex(*i);
-        }
+void
+LineDrawable::setVertices(const osg::Vec3* verts, unsigned n)
+{
+    initialize();
+
+    _current->clear();
+    _colors->clear();
+    if (_useGPU)
+    {
+        _previous->clear();
+        _next->clear();
     }
 
+    appendVertices(verts, n);
+
     dirty();
 }
 
 void
-LineDrawable::allocate(unsigned numVerts)
+LineDrawable::appendVertices(const osg::Vec3* verts, unsigned n)
 {
     initialize();
 
+    if (verts == 0L || n == 0u)
+        return;
+
     unsigned num = getNumVerts();
-    if (numVerts >= num)
+    unsigned k = actualVertsPerVirtualVert(0);
+    unsigned oldSize = _current->size();
+    unsigned newSize = oldSize + n*k;
+
+    // grow every array once, then fill the expanded vertices in one pass
+    _current->resize(newSize);
+    for (unsigned i = 0; i < n; ++i)
     {
-        for (unsigned i = num; i < numVerts; ++i)
+        std::fill(_current->begin() + (oldSize + i*k), _current->begin() + (oldSize + (i+1)*k), verts[i]);
+    }
+    _colors->resize(newSize, _color);
+
+    if (_useGPU)
+    {
+        _previous->resize(newSize);
+        _next->resize(newSize);
+
+        // the old last vertex gets a new neighbor; so does the first one in a loop.
+        updateAdjacency(num > 0u ? num-1u : 0u, num+n);
+        if (_mode == GL_LINE_LOOP && num > 0u)
+            updateAdjacency(0u, 1u);
+
+        _previous->dirty();
+        _next->dirty();
+    }
+
+    _current->dirty();
+    _colors->dirty();
+    dirtyBound();
+}
+
+void
+LineDrawable::setVertices(unsigned first, const osg::Vec3* verts, unsigned n)
+{
+    initialize();
+
+    unsigned numVerts = getNumVerts();
+    if (verts == 0L || first >= numVerts)
+        return;
+
+    // if we've already called dirty() that means we are editing a completed
+    // drawable and therefore need dynamic variance.
+    if (getNumPrimitiveSets() > 0u && getDataVariance() != DYNAMIC)
+    {
+        setDataVariance(DYNAMIC);
+    }
+
+    unsigned last = osg::minimum(first + n, numVerts);
+    unsigned k = actualVertsPerVirtualVert(0);
+
+    for (unsigned vi = first; vi < last; ++vi)
+    {
+        std::fill(_current->begin() + vi*k, _current->begin() + (vi+1)*k, verts[vi - first]);
+    }
+    _current->dirty();
+
+    if (_useGPU)
+    {
+        // neighbors on either side of the range refer to the changed vertices:
+        updateAdjacency(first > 0u ? first-1u : 0u, osg::minimum(last+1u, numVerts));
+        if (_mode == GL_LINE_LOOP)
         {
-            pushVertex(osg::Vec3(0,0,0));
+            updateAdjacency(0u, 1u);
+            updateAdjacency(numVerts-1u, numVerts);
         }
+
+        _previous->dirty();
+        _next->dirty();
     }
-    else
+
+    dirtyBound();
+}
+
+// Recomputes the "previous" and "next" arrays for the virtual
+// vertices [first, last) from the current vertices.
+void
+LineDrawable::updateAdjacency(unsigned first, unsigned last)
+{
+    unsigned numVerts = getNumVerts();
+    last = osg::minimum(last, numVerts);
+
+    if (_mode == GL_LINE_STRIP || _mode == GL_LINE_LOOP)
     {
-        clear();
-        for (unsigned i = 0; i < numVerts; ++i)
+        bool loop = (_mode == GL_LINE_LOOP);
+        for (unsigned vi = first; vi < last; ++vi)
         {
-            pushVertex(osg::Vec3(0,0,0));
+            unsigned pi = vi > 0u ? vi-1u : (loop ? numVerts-1u : 0u);
+            unsigned ni = vi+1u < numVerts ? vi+1u : (loop ? 0u : vi);
+            std::fill(_previous->begin() + vi*4, _previous->begin() + (vi+1)*4, (*_current)[pi*4]);
+            std::fill(_next->begin() + vi*4, _next->begin() + (vi+1)*4, (*_current)[ni*4]);
         }
     }
 
-    dirty();
+    else if (_mode == GL_LINES)
+    {
+        // both ends of a segment see the segment's two vertices; an
+        // unpaired final vertex sees only itself.
+        for (unsigned vi = first; vi < last; ++vi)
+        {
+            unsigned a = vi & ~1u;
+            unsigned b = a+1u < numVerts ? a+1u : a;
+            (*_previous)[vi*2] = (*_previous)[vi*2+1] = (*_current)[a*2];
+            (*_next)[vi*2] = (*_next)[vi*2+1] = (*_current)[b*2];
+        }
+    }
 }
 
 // Calculates the "virtual" number of vertices in this drawable.
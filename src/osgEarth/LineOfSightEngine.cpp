@@ -0,0 +1,336 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/LineOfSightEngine>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Metrics>
+#include <cfloat>
+#include <cmath>
+
+#define LC "[LineOfSightEngine] "
+
+using namespace osgEarth;
+using namespace osgEarth::Contrib;
+
+namespace
+{
+    // Samples lines against the elevation pool. Holds its own envelope
+    // and scratch space, so use one per thread.
+    struct LineSampler
+    {
+        LineSampler(const Map* map, unsigned lod) :
+            _mapSRS(map->getSRS()),
+            _worldSRS(map->getWorldSRS()),
+            _geocentric(map->getSRS()->isGeographic())
+        {
+            _envelope = map->getElevationPool()->createEnvelope(_mapSRS.get(), lod);
+        }
+
+        // Samples the segment start->end at numSamples+1 evenly spaced points
+        // (including both ends), finds the first point at which the terrain
+        // rises above the segment, and optionally sweeps the terrain outward
+        // from the start point to fill one row of a visibility raster.
+        void trace(
+            const osg::Vec3d& start,
+            const osg::Vec3d& end,
+            unsigned numSamples,
+            double targetHeight,
+            LineOfSightEngine::Line& out_line,
+            unsigned char* out_row)
+        {
+            const osg::Vec3d delta = end - start;
+
+            // world samples along the segment, then all of them into map coordinates
+            // in one bulk transform:
+            _world.resize(numSamples + 1);
+            for (unsigned k = 0; k <= numSamples; ++k)
+                _world[k] = start + delta*((double)k / (double)numSamples);
+
+            _map = _world;
+            if (_geocentric)
+                _worldSRS->transform(_map, _mapSRS.get());
+
+            _envelope->getElevations(_map, _elevations);
+
+            out_line.start = start;
+            out_line.end = end;
+            out_line.hasLOS = true;
+
+            // first blockage: the first sample where the terrain is above the segment.
+            // The observer's own sample only seeds the interpolation.
+            double prevClearance = 0.0;
+            int prevK = -1;
+            if (_elevations[0] != NO_DATA_VALUE)
+            {
+                prevClearance = osg::maximum(_map[0].z() - (double)_elevations[0], 0.0);
+                prevK = 0;
+            }
+
+            for (unsigned k = 1; k <= numSamples; ++k)
+            {
+                if (_elevations[k] == NO_DATA_VALUE)
+                    continue;
+
+                double clearance = _map[k].z() - (double)_elevations[k];
+                if (clearance < 0.0)
+                {
+                    double t = (double)k;
+                    if (prevK >= 0)
+                    {
+                        double f = prevClearance / (prevClearance - clearance);
+                        t = (double)prevK + f*(double)(k - prevK);
+                    }
+                    out_line.hasLOS = false;
+                    out_line.hit = start + delta*(t / (double)numSamples);
+                    break;
+                }
+
+                prevClearance = clearance;
+                prevK = (int)k;
+            }
+
+            if (out_row)
+            {
+                sweep(start, numSamples, targetHeight, out_row);
+            }
+        }
+
+        // Max-angle sweep: a terrain sample is visible if its elevation angle
+        // as seen from the observer is at least the largest angle of any
+        // terrain sample closer to the observer.
+        void sweep(
+            const osg::Vec3d& observer,
+            unsigned numSamples,
+            double targetHeight,
+            unsigned char* out_row)
+        {
+            osg::Vec3d up = _geocentric ? observer : osg::Vec3d(0, 0, 1);
+            up.normalize();
+
+            // terrain surface under each sample, back into world coordinates:
+            _ground.resize(numSamples + 1);
+            for (unsigned k = 0; k <= numSamples; ++k)
+            {
+                double z = _elevations[k] != NO_DATA_VALUE ? (double)_elevations[k] : 0.0;
+                _ground[k].set(_map[k].x(), _map[k].y(), z);
+            }
+
+            if (_geocentric)
+                _mapSRS->transform(_ground, _worldSRS.get());
+
+            double maxSlope = -DBL_MAX;
+
+            for (unsigned k = 1; k <= numSamples; ++k)
+            {
+                unsigned char& visible = out_row[k - 1];
+
+                if (_elevations[k] == NO_DATA_VALUE)
+                {
+                    visible = 0;
+                    continue;
+                }
+
+                osg::Vec3d d = _ground[k] - observer;
+                double height = d * up;
+                double range = (d - up*height).length();
+                if (range <= 0.0)
+                {
+                    visible = 1;
+                    continue;
+                }
+
+                double slope = height / range;
+                double targetSlope = (height + targetHeight) / range;
+
+                visible = targetSlope >= maxSlope ? 1 : 0;
+
+                if (slope > maxSlope)
+                    maxSlope = slope;
+            }
+        }
+
+        osg::ref_ptr<const SpatialReference> _mapSRS;
+        osg::ref_ptr<const SpatialReference> _worldSRS;
+        bool _geocentric;
+        osg::ref_ptr<ElevationEnvelope> _envelope;
+        std::vector<osg::Vec3d> _world;
+        std::vector<osg::Vec3d> _map;
+        std::vector<osg::Vec3d> _ground;
+        std::vector<float> _elevations;
+    };
+
+    // Distributes the lines of a radial computation across the calling
+    // thread and the shared pool.
+    struct RadialJob : public Threading::ParallelFor::Job
+    {
+        RadialJob(
+            const Map* map,
+            unsigned lod,
+            const osg::Vec3d& center,
+            const std::vector<osg::Vec3d>& ends,
+            unsigned numSamples,
+            double targetHeight,
+            LineOfSightEngine::Viewshed& out) :
+            _map(map),
+            _lod(lod),
+            _center(center),
+            _ends(ends),
+            _numSamples(numSamples),
+            _targetHeight(targetHeight),
+            _out(out),
+            _samplers(Threading::ParallelFor::getNumWorkers(ends.size()))
+        {
+            //nop
+        }
+
+        ~RadialJob()
+        {
+            for (unsigned i = 0; i < _samplers.size(); ++i)
+                delete _samplers[i];
+        }
+
+        void operator()(unsigned line, unsigned worker)
+        {
+            // one sampler (and envelope) per worker
+            LineSampler*& sampler = _samplers[worker];
+            if (!sampler)
+                sampler = new LineSampler(_map, _lod);
+
+            sampler->trace(
+                _center, _ends[line], _numSamples, _targetHeight,
+                _out.lines[line],
+                &_out.visibility[line*_numSamples]);
+        }
+
+        const Map* _map;
+        unsigned _lod;
+        osg::Vec3d _center;
+        const std::vector<osg::Vec3d>& _ends;
+        unsigned _numSamples;
+        double _targetHeight;
+        LineOfSightEngine::Viewshed& _out;
+        std::vector<LineSampler*> _samplers;
+    };
+}
+
+//------------------------------------------------------------------------
+
+LineOfSightEngine::LineOfSightEngine(const Map* map) :
+_map(map),
+_spacing(10.0),
+_maxSamples(4096u),
+_targetHeight(0.0)
+{
+    //nop
+}
+
+unsigned
+LineOfSightEngine::getNumSamples(double length) const
+{
+    double spacing = osg::maximum(_spacing, 0.01);
+    double maxSamples = (double)osg::maximum(_maxSamples, 2u);
+    double n = ceil(length / spacing);
+    if (n > maxSamples)
+    {
+        OE_DEBUG << LC << "Line of " << length << "m needs " << n << " samples; capped at "
+            << maxSamples << " (spacing " << (length / maxSamples) << "m)" << std::endl;
+    }
+    return (unsigned)osg::clampBetween(n, 2.0, maxSamples);
+}
+
+unsigned
+LineOfSightEngine::getQueryLOD(const Map* map, const osg::Vec3d& centerWorld) const
+{
+    if (_lod.isSet())
+        return _lod.get();
+
+    const Profile* profile = map->getProfile();
+    double latitude = 0.0;
+    if (map->getSRS()->isGeographic())
+    {
+        osg::Vec3d centerMap;
+        map->getWorldSRS()->transform(centerWorld, map->getSRS(), centerMap);
+        latitude = centerMap.y();
+    }
+
+    double resolution = SpatialReference::transformUnits(
+        Distance(_spacing, Units::METERS),
+        profile->getSRS(),
+        latitude);
+
+    return profile->getLevelOfDetailForHorizResolution(
+        resolution,
+        map->getElevationPool()->getTileSize());
+}
+
+bool
+LineOfSightEngine::computeLine(const osg::Vec3d& startWorld,
+                               const osg::Vec3d& endWorld,
+                               Line& out_line) const
+{
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || !map->getProfile())
+        return false;
+
+    LineSampler sampler(map.get(), getQueryLOD(map.get(), startWorld));
+    sampler.trace(startWorld, endWorld, getNumSamples((endWorld - startWorld).length()), _targetHeight, out_line, 0L);
+    return true;
+}
+
+bool
+LineOfSightEngine::computeRadial(const osg::Vec3d& centerWorld,
+                                 const std::vector<osg::Vec3d>& endsWorld,
+                                 Viewshed& out) const
+{
+    OE_PROFILING_ZONE;
+
+    osg::ref_ptr<const Map> map;
+    if (!_map.lock(map) || !map->getProfile())
+        return false;
+
+    // every radial gets the same number of samples so the raster is regular.
+    double maxLength = 0.0;
+    for (std::vector<osg::Vec3d>::const_iterator i = endsWorld.begin(); i != endsWorld.end(); ++i)
+        maxLength = osg::maximum(maxLength, (*i - centerWorld).length());
+
+    out.numSamples = getNumSamples(maxLength);
+    out.sampleSpacing = maxLength / (double)out.numSamples;
+    out.clamped = out.numSamples == osg::maximum(_maxSamples, 2u) && out.sampleSpacing > _spacing;
+    out.lines.assign(endsWorld.size(), Line());
+    out.visibility.assign(endsWorld.size() * out.numSamples, 0u);
+
+    if (endsWorld.empty())
+        return true;
+
+    RadialJob job(
+        map.get(),
+        getQueryLOD(map.get(), centerWorld),
+        centerWorld,
+        endsWorld,
+        out.numSamples,
+        _targetHeight,
+        out);
+
+    Threading::ParallelFor::run(job, endsWorld.size());
+
+    return true;
+}
@@ -80,7 +80,8 @@ _hasLOS( true ),
 _goodColor(0.0f, 1.0f, 0.0f, 1.0f),
 _badColor(1.0f, 0.0f, 0.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
-_terrainOnly( false )
+_terrainOnly( false ),
+_computeMethod( LineOfSight::METHOD_INTERSECT )
 {
     compute(getNode());
     subscribeToTerrain();    
@@ -98,7 +99,8 @@ _hasLOS( true ),
 _goodColor(0.0f, 1.0f, 0.0f, 1.0f),
 _badColor(1.0f, 0.0f, 0.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
-_terrainOnly( false )
+_terrainOnly( false ),
+_computeMethod( LineOfSight::METHOD_INTERSECT )
 {
     compute(getNode());    
     subscribeToTerrain();    
@@ -134,6 +136,7 @@ LinearLineOfSightNode::setMapNode( MapNode* mapNode )
         }
 
         _mapNode = mapNode;
+        _engine = 0L;
 
         if ( _mapNode.valid() && _terrainChangedCallback.valid() )
         {
@@ -147,6 +150,10 @@ LinearLineOfSightNode::setMapNode( MapNode* mapNode )
 void
 LinearLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
+    // the elevation method samples the map directly, so paging doesn't change it
+    if (_computeMethod == LineOfSight::METHOD_ELEVATION)
+        return;
+
     compute( getNode() );
 }
 
@@ -251,21 +258,35 @@ LinearLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
       }
 
 
-      osgUtil::LineSegmentIntersector* lsi = new osgUtil::LineSegmentIntersector(_startWorld, _endWorld);
-      osgUtil::IntersectionVisitor iv( lsi );
-
-      node->accept( iv );
-
-      osgUtil::LineSegmentIntersector::Intersections& hits = lsi->getIntersections();
-      if ( hits.size() > 0 )
+      if (_computeMethod == LineOfSight::METHOD_ELEVATION)
       {
-          _hasLOS = false;
-          _hitWorld = hits.begin()->getWorldIntersectPoint();
-          _hit.fromWorld( mapSRS, _hitWorld );
+          LineOfSightEngine::Line line;
+          getEngine()->computeLine( _startWorld, _endWorld, line );
+          _hasLOS = line.hasLOS;
+          if ( !_hasLOS )
+          {
+              _hitWorld = line.hit;
+              _hit.fromWorld( mapSRS, _hitWorld );
+          }
       }
       else
       {
-          _hasLOS = true;
+          osgUtil::LineSegmentIntersector* lsi = new osgUtil::LineSegmentIntersector(_startWorld, _endWorld);
+          osgUtil::IntersectionVisitor iv( lsi );
+
+          node->accept( iv );
+
+          osgUtil::LineSegmentIntersector::Intersections& hits = lsi->getIntersections();
+          if ( hits.size() > 0 )
+          {
+              _hasLOS = false;
+              _hitWorld = hits.begin()->getWorldIntersectPoint();
+              _hit.fromWorld( mapSRS, _hitWorld );
+          }
+          else
+          {
+              _hasLOS = true;
+          }
       }
     }
 
@@ -410,6 +431,32 @@ LinearLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+LineOfSight::ComputeMethod
+LinearLineOfSightNode::getComputeMethod() const
+{
+    return _computeMethod;
+}
+
+void
+LinearLineOfSightNode::setComputeMethod( LineOfSight::ComputeMethod method )
+{
+    if (_computeMethod != method)
+    {
+        _computeMethod = method;
+        compute(getNode());
+    }
+}
+
+LineOfSightEngine*
+LinearLineOfSightNode::getEngine()
+{
+    if ( !_engine.valid() && _mapNode.valid() )
+    {
+        _engine = new LineOfSightEngine( _mapNode->getMap() );
+    }
+    return _engine.get();
+}
+
 osg::Node*
 LinearLineOfSightNode::getNode()
 {
@@ -311,6 +311,11 @@ namespace osgEarth { namespace MVT
     }
 
     bool readTile(std::istream& in, const TileKey& key, FeatureList& features)
+    {
+        return readTile(in, key, Query::ALL, features);
+    }
+
+    bool readTile(std::istream& in, const TileKey& key, const Query& query, FeatureList& features)
     {
         features.clear();
 
@@ -335,6 +340,9 @@ namespace osgEarth { namespace MVT
 
         if (tile.ParseFromString(value))
         {
+            bool readGeometry = (query.includeGeometry() == true);
+            bool project = !query.attributes().empty();
+
             for (int i = 0; i < tile.layers().size(); i++)
             {
                 const mapnik::vector::tile_layer &layer = tile.layers().Get(i);
@@ -352,6 +360,14 @@ namespace osgEarth { namespace MVT
                     for (int k = 0; k < feature.tags().size(); k+=2)
                     {
                         std::string key = layer.keys().Get(feature.tags().Get(k));
+
+                        // skip attributes outside the query's projection:
+                        if (project && !query.includesAttribute(key) &&
+                            !(key == "other_tags" && query.includesAttribute("height")))
+                        {
+                            continue;
+                        }
+
                         mapnik::vector::tile_value value = layer.values().Get(feature.tags().Get(k+1));
 
                         if (value.has_bool_value())
@@ -412,6 +428,15 @@ namespace osgEarth { namespace MVT
                     osg::ref_ptr< osgEarth::Geometry > geometry;
 
                     eGeomType geomType = static_cast<eGeomType>(feature.type());
+
+                    // Attribute-only query: skip decoding the geometry. Points are
+                    // cheap and still decoded so they can be tested against the extent.
+                    if (!readGeometry && geomType != MVT::Point)
+                    {
+                        features.push_back(oeFeature.get());
+                        continue;
+                    }
+
                     if (geomType == MVT::Polygon)
                     {
                         geometry = decodePolygon(feature, key, layer.extent());
@@ -442,7 +467,8 @@ namespace osgEarth { namespace MVT
 
                     if (geometry)
                     {
-                        oeFeature->setGeometry( geometry.get() );
+                        if (readGeometry)
+                            oeFeature->setGeometry( geometry.get() );
                         features.push_back(oeFeature.get());
                     }
 
@@ -567,7 +593,13 @@ MVTFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
         int dataLen = sqlite3_column_bytes(select, 0);
         std::string dataBuffer(data, dataLen);
         std::stringstream in(dataBuffer);
-        MVT::readTile(in, key, features);
+
+        // keep the FID attribute even if the query's projection omits it:
+        Query readQuery(query);
+        if (options().fidAttribute().isSet() && !readQuery.attributes().empty())
+            readQuery.attributes().push_back(options().fidAttribute().get());
+
+        MVT::readTile(in, key, readQuery, features);
     }
     else
     {
@@ -24,7 +24,11 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/StringUtils>
+#include <osgEarth/FileUtils>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
 #include <list>
+#include <algorithm>
 #include <cpl_error.h>
 #include <ogr_api.h>
 #include <queue>
@@ -82,10 +86,95 @@ namespace osgEarth { namespace OGR
         }
         return true;
     }
+
+    /**
+     * Whether a driver supports concurrent reads through separate datasource
+     * handles. Cursors on these drivers get a handle of their own and read
+     * without holding the global GDAL lock.
+     */
+    inline bool isThreadSafeDriver(const std::string& driverName)
+    {
+        return
+            driverName == "ESRI Shapefile" ||
+            driverName == "GPKG" ||
+            driverName == "SQLite" ||
+            driverName == "GeoJSON" ||
+            driverName == "FlatGeobuf" ||
+            driverName == "MapInfo File";
+    }
+
+    //! Holds the global GDAL lock, but only if asked to.
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _locked(lock) {
+            if (_locked) getGDALMutex().lock();
+        }
+        ~OptionalGDALLock() {
+            if (_locked) getGDALMutex().unlock();
+        }
+        bool _locked;
+    };
 } }
 
 //........................................................................
 
+/**
+ * Reads the next chunk of features in the background while the caller
+ * works through the current one. Whoever claims it first does the read:
+ * a worker thread, or the cursor itself if it needs the chunk before a
+ * worker gets to it.
+ */
+struct OGR::OGRFeatureCursor::Prefetch : public osg::Operation
+{
+    Prefetch(OGRFeatureCursor* cursor) :
+        osg::Operation("OGRFeatureCursor prefetch", false),
+        _cursor(cursor),
+        _claimed(false) { }
+
+    void operator()(osg::Object*)
+    {
+        if (claim())
+            run();
+    }
+
+    //! Returns once the chunk is in _features.
+    void finish()
+    {
+        if (claim())
+            run();
+        else
+            _done.wait();
+    }
+
+    //! Makes sure the read never touches the cursor again.
+    void cancel()
+    {
+        if (!claim())
+            _done.wait();
+    }
+
+    bool claim()
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        if (_claimed)
+            return false;
+        _claimed = true;
+        return true;
+    }
+
+    void run()
+    {
+        _cursor->readChunk(_features);
+        _done.set();
+    }
+
+    OGRFeatureCursor* _cursor;
+    FeatureList       _features;
+    Threading::Mutex  _mutex;
+    bool              _claimed;
+    Threading::Event  _done;
+};
+
 OGR::OGRFeatureCursor::OGRFeatureCursor(OGRDataSourceH              dsHandle,
                                         OGRLayerH                   layerHandle,
                                         const FeatureSource*        source,
@@ -93,7 +182,9 @@ OGR::OGRFeatureCursor::OGRFeatureCursor(OGRDataSourceH              dsHandle,
                                         const Query&                query,
                                         const FeatureFilterChain*   filters,
                                         ProgressCallback*           progress,
-                                        bool                        rewindPolygons
+                                        bool                        rewindPolygons,
+                                        bool                        privateHandle,
+                                        const std::vector<FeatureID>* fids
                                         ) :
 FeatureCursor     ( progress ),
 _source           ( source ),
@@ -107,10 +198,21 @@ _nextHandleToQueue( 0L ),
 _resultSetEndReached(false),
 _profile          ( profile ),
 _filters          ( filters ),
-_rewindPolygons   (rewindPolygons)
+_rewindPolygons   (rewindPolygons),
+_privateHandle    (privateHandle),
+_nextFid          (0u)
 {
+    if ( fids )
     {
-        OGR_SCOPED_LOCK;
+        // The features were already selected (by a spatial index), so
+        // read them straight from the layer by FID.
+        _fids = *fids;
+        _resultSetHandle = _layerHandle;
+    }
+    else
+    {
+        // a private handle on a thread-safe driver needs no global lock
+        OGR::OptionalGDALLock lock(!_privateHandle);
 
         std::string expr;
         std::string from = OGR_FD_GetName( OGR_L_GetLayerDefn( _layerHandle ));        
@@ -138,7 +240,7 @@ _rewindPolygons   (rewindPolygons)
             if ( temp.find( "select" ) != 0 )
             {
                 std::stringstream buf;
-                buf << "SELECT * FROM " << from << " WHERE " << expr;
+                buf << "SELECT " << getSelectList() << " FROM " << from << " WHERE " << expr;
                 std::string bufStr;
                 bufStr = buf.str();
                 expr = bufStr;
@@ -147,7 +249,7 @@ _rewindPolygons   (rewindPolygons)
         else
         {
             std::stringstream buf;
-            buf << "SELECT * FROM " << from;
+            buf << "SELECT " << getSelectList() << " FROM " << from;
             expr = buf.str();
         }
 
@@ -201,7 +303,14 @@ _rewindPolygons   (rewindPolygons)
         }
     }
 
-    readChunk();
+    // a result set belongs to this cursor, but the layer itself may be shared.
+    if ( _resultSetHandle && (_privateHandle || _resultSetHandle != _layerHandle) )
+    {
+        OGR::OptionalGDALLock lock(!_privateHandle);
+        ignoreUnusedFields();
+    }
+
+    fetchNextChunk();
 }
 
 OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const FeatureProfile* profile) :
@@ -213,20 +322,32 @@ OGR::OGRFeatureCursor::OGRFeatureCursor(OGRLayerH resultSetHandle, const Feature
     _spatialFilter(0L),
     _chunkSize(500),
     _nextHandleToQueue(0L),
-    _resultSetEndReached(false)
+    _resultSetEndReached(false),
+    _rewindPolygons(true),
+    _privateHandle(false),
+    _nextFid(0u)
 {
-    OGR_SCOPED_LOCK;
-
-    if (_resultSetHandle)
     {
-        OGR_L_ResetReading(_resultSetHandle);
+        OGR_SCOPED_LOCK;
+
+        if (_resultSetHandle)
+        {
+            OGR_L_ResetReading(_resultSetHandle);
+        }
     }
 
-    readChunk();
+    fetchNextChunk();
 }
 
 OGR::OGRFeatureCursor::~OGRFeatureCursor()
 {
+    // stop any read-ahead before releasing the handles it uses.
+    if ( _prefetch.valid() )
+    {
+        _prefetch->cancel();
+        _prefetch = 0L;
+    }
+
     OGR_SCOPED_LOCK;
 
     if ( _nextHandleToQueue )
@@ -242,6 +363,115 @@ OGR::OGRFeatureCursor::~OGRFeatureCursor()
         OGRReleaseDataSource( _dsHandle );
 }
 
+// Whether the query needs a field: either it asks for it, or the WHERE or
+// ORDER BY clause refers to it (so it must still be read, even if not returned).
+bool
+OGR::OGRFeatureCursor::needsField(const std::string& name) const
+{
+    if ( _query.includesAttribute(name) )
+        return true;
+
+    std::string sql = osgEarth::toLower(
+        _query.expression().getOrUse("") + " " + _query.orderby().getOrUse(""));
+
+    return sql.find(osgEarth::toLower(name)) != std::string::npos;
+}
+
+// Column list for the SELECT we build. With an attribute projection this names
+// only the needed fields, so SQL drivers and OGR's own SQL engine skip the rest.
+// Drivers that run the SQL natively (GPKG, SQLite, PostgreSQL...) expose the
+// FID and geometry as named columns; those must be selected explicitly too, or
+// the result loses its geometry and numbers its features from scratch.
+std::string
+OGR::OGRFeatureCursor::getSelectList() const
+{
+    if ( _query.attributes().empty() )
+        return "*";
+
+    std::stringstream buf;
+
+    std::string fidColumn = OGR_L_GetFIDColumn( _layerHandle );
+    if ( !fidColumn.empty() )
+    {
+        buf << "\"" << osgEarth::replaceIn(fidColumn, "\"", "\"\"") << "\"";
+    }
+
+    std::string geomColumn = OGR_L_GetGeometryColumn( _layerHandle );
+    if ( !geomColumn.empty() )
+    {
+        if ( buf.tellp() > 0 )
+            buf << ", ";
+        buf << "\"" << osgEarth::replaceIn(geomColumn, "\"", "\"\"") << "\"";
+    }
+
+    std::streampos namedColumns = buf.tellp();
+
+    OGRFeatureDefnH defn = OGR_L_GetLayerDefn( _layerHandle );
+    int numFields = OGR_FD_GetFieldCount( defn );
+    for(int i = 0; i < numFields; ++i)
+    {
+        std::string name = OGR_Fld_GetNameRef( OGR_FD_GetFieldDefn(defn, i) );
+        if ( needsField(name) )
+        {
+            if ( buf.tellp() > 0 )
+                buf << ", ";
+            buf << "\"" << osgEarth::replaceIn(name, "\"", "\"\"") << "\"";
+        }
+    }
+
+    // nothing matched; let the decoder do the filtering.
+    if ( buf.tellp() == namedColumns )
+        return "*";
+
+    return buf.str();
+}
+
+// For attribute-only or projected queries, tells OGR not to read the geometry
+// and fields the query does not need on the layer we read from. Drivers that
+// don't support it just decode everything and OgrUtils drops the extra data.
+void
+OGR::OGRFeatureCursor::ignoreUnusedFields()
+{
+    // a spatial filter needs the geometry to do its job:
+    bool ignoreGeometry = (_query.includeGeometry() == false) && (_spatialFilter == 0L);
+
+    if ( !ignoreGeometry && _query.attributes().empty() )
+        return;
+
+    std::vector<std::string> ignored;
+    if ( ignoreGeometry )
+    {
+        ignored.push_back( "OGR_GEOMETRY" );
+    }
+
+    if ( !_query.attributes().empty() )
+    {
+        OGRFeatureDefnH defn = OGR_L_GetLayerDefn( _resultSetHandle );
+        int numFields = OGR_FD_GetFieldCount( defn );
+        for(int i = 0; i < numFields; ++i)
+        {
+            std::string name = OGR_Fld_GetNameRef( OGR_FD_GetFieldDefn(defn, i) );
+            if ( !needsField(name) )
+            {
+                ignored.push_back( name );
+            }
+        }
+    }
+
+    if ( !ignored.empty() )
+    {
+        std::vector<const char*> names;
+        for(std::vector<std::string>::const_iterator i = ignored.begin(); i != ignored.end(); ++i)
+            names.push_back( i->c_str() );
+        names.push_back( 0L );
+
+        if ( OGR_L_SetIgnoredFields( _resultSetHandle, &names[0] ) != OGRERR_NONE )
+        {
+            OE_DEBUG << LC << "Driver cannot ignore fields; decoding only the requested data" << std::endl;
+        }
+    }
+}
+
 bool
 OGR::OGRFeatureCursor::hasMore() const
 {
@@ -255,7 +485,7 @@ OGR::OGRFeatureCursor::nextFeature()
         return 0L;
 
     if ( _queue.size() == 1u )
-        readChunk();
+        fetchNextChunk();
 
     // do this in order to hold a reference to the feature we return, so the caller
     // doesn't have to. This lets us avoid requiring the caller to use a ref_ptr when 
@@ -266,63 +496,122 @@ OGR::OGRFeatureCursor::nextFeature()
     return _lastFeatureReturned.get();
 }
 
+// Queues the next chunk of features, and starts reading the one after
+// that in the background.
+void
+OGR::OGRFeatureCursor::fetchNextChunk()
+{
+    if ( !_resultSetHandle )
+        return;
+
+    FeatureList features;
+
+    if ( _prefetch.valid() )
+    {
+        _prefetch->finish();
+        features.swap( _prefetch->_features );
+        _prefetch = 0L;
+    }
+    else
+    {
+        readChunk( features );
+    }
+
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        _queue.push( i->get() );
+    }
+
+    if ( !_resultSetEndReached )
+    {
+        _prefetch = new Prefetch( this );
+        Threading::ThreadPool::getShared()->getQueue()->add( _prefetch.get() );
+    }
+}
+
 // reads a chunk of features into a memory cache; do this for performance
-// and to avoid needing the OGR Mutex every time
+// and to avoid needing the OGR Mutex every time. Only the raw reads happen
+// under the lock (and only for shared handles); converting and filtering
+// the features does not.
 void
-OGR::OGRFeatureCursor::readChunk()
+OGR::OGRFeatureCursor::readChunk(FeatureList& output)
 {
     if ( !_resultSetHandle )
         return;
-    
-    OGR_SCOPED_LOCK;
 
-    while( _queue.size() < _chunkSize && !_resultSetEndReached )
+    std::vector<OGRFeatureH> handles;
+    handles.reserve( _chunkSize );
+
+    while( output.size() < _chunkSize && !_resultSetEndReached )
     {
-        FeatureList filterList;
-        while( filterList.size() < _chunkSize && !_resultSetEndReached )
+        handles.clear();
         {
-            OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
-            if ( handle )
+            OGR::OptionalGDALLock lock(!_privateHandle);
+
+            while( handles.size() < _chunkSize && !_resultSetEndReached )
             {
-                /*
-                // Crop the geometry by the spatial filter.  Could be useful for tiling.
-                if (_spatialFilter)
+                if ( _resultSetHandle == _layerHandle && _layerHandle )
+                {
+                    // reading a preselected list of FIDs:
+                    if ( _nextFid < _fids.size() )
+                    {
+                        OGRFeatureH handle = OGR_L_GetFeature( _layerHandle, _fids[_nextFid++] );
+                        if ( handle )
+                            handles.push_back( handle );
+                    }
+                    else
+                    {
+                        _resultSetEndReached = true;
+                    }
+                }
+                else
                 {
-                    OGRGeometryH geomRef = OGR_F_GetGeometryRef(handle);
-                    OGRGeometryH intersection = OGR_G_Intersection(geomRef, _spatialFilter);
-                    OGR_F_SetGeometry(handle, intersection);
+                    OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
+                    if ( handle )
+                        handles.push_back( handle );
+                    else
+                        _resultSetEndReached = true;
                 }
-                */
-                osg::ref_ptr<Feature> feature = OgrUtils::createFeature( handle, _profile.get(), _rewindPolygons);
+            }
+        }
+
+        FeatureList filterList;
+        for(std::vector<OGRFeatureH>::const_iterator h = handles.begin(); h != handles.end(); ++h)
+        {
+            /*
+            // Crop the geometry by the spatial filter.  Could be useful for tiling.
+            if (_spatialFilter)
+            {
+                OGRGeometryH geomRef = OGR_F_GetGeometryRef(handle);
+                OGRGeometryH intersection = OGR_G_Intersection(geomRef, _spatialFilter);
+                OGR_F_SetGeometry(handle, intersection);
+            }
+            */
+            osg::ref_ptr<Feature> feature = OgrUtils::createFeature( *h, _profile.get(), _rewindPolygons, _query);
 
-                if (feature.valid())
+            if (feature.valid())
+            {
+                if (_source == NULL || !_source->isBlacklisted(feature->getFID()))
                 {
-                    if (_source == NULL || !_source->isBlacklisted(feature->getFID()))
+                    if (_query.includeGeometry() == false || validateGeometry( feature->getGeometry() ))
                     {
-                        if (validateGeometry( feature->getGeometry() ))
-                        {
-                            filterList.push_back( feature.release() );
-                        }
-                        else
-                        {
-                            OE_DEBUG << LC << "Invalid geometry found at feature " << feature->getFID() << std::endl;
-                        }
+                        filterList.push_back( feature.release() );
                     }
                     else
                     {
-                        OE_DEBUG << LC << "Blacklisted feature " << feature->getFID() << " skipped" << std::endl;
+                        OE_DEBUG << LC << "Invalid geometry found at feature " << feature->getFID() << std::endl;
                     }
                 }
                 else
                 {
-                    OE_DEBUG << LC << "Skipping NULL feature" << std::endl;
+                    OE_DEBUG << LC << "Blacklisted feature " << feature->getFID() << " skipped" << std::endl;
                 }
-                OGR_F_Destroy( handle );
             }
             else
             {
-                _resultSetEndReached = true;
+                OE_DEBUG << LC << "Skipping NULL feature" << std::endl;
             }
+            OGR_F_Destroy( *h );
         }
 
         // preprocess the features using the filter list:
@@ -346,10 +635,7 @@ OGR::OGRFeatureCursor::readChunk()
             }
         }
 
-        for(FeatureList::const_iterator i = filterList.begin(); i != filterList.end(); ++i)
-        {
-            _queue.push( i->get() );
-        }
+        output.splice( output.end(), filterList );
     }
 }
 
@@ -437,6 +723,8 @@ OGRFeatureSource::closeImplementation()
         _dsHandle = 0L;
     }
 
+    _sidecarIndex = 0L;
+
     init();
 
     return FeatureSource::closeImplementation();
@@ -613,6 +901,21 @@ OGRFeatureSource::openImplementation()
             {
                 OE_INFO << LC << "Use existing spatial index for " << getName() << std::endl;
             }
+
+            // drivers like GeoJSON cannot index themselves; use our own index instead.
+            // The index answers queries with FIDs, so the driver must be able to
+            // fetch a feature by FID without scanning the whole layer.
+            if (OGR_L_TestCapability(_layerHandle, OLCFastSpatialFilter) == 0)
+            {
+                if (OGR_L_TestCapability(_layerHandle, OLCRandomRead) != 0)
+                {
+                    initSidecarIndex(options().forceRebuildSpatialIndex() == true);
+                }
+                else
+                {
+                    OE_INFO << LC << "Driver cannot read features by FID; no spatial index for " << getName() << std::endl;
+                }
+            }
         }
 
 
@@ -773,6 +1076,78 @@ OGRFeatureSource::create(const FeatureProfile* profile,
     return getStatus();
 }
 
+void
+OGRFeatureSource::initSidecarIndex(bool forceRebuild)
+{
+    // internal: assume the GDAL mutex is locked
+
+    // One file can hold several layers, so the sidecar name and its key
+    // include the layer, and the source query if there is one.
+    std::string key = options().layer().isSet() ? options().layer().get() : std::string();
+    if (options().query().isSet())
+        key += "\n" + options().query()->getConfig().toJSON(false);
+
+    std::string suffix;
+    if (options().layer().isSet())
+    {
+        suffix = "." + toLegalFileName(options().layer().get());
+    }
+    if (options().query().isSet())
+    {
+        suffix += "." + hashToString(key);
+    }
+
+    // Only index a local file we can timestamp; otherwise keep the index in memory.
+    TimeStamp sourceTime = osgEarth::getLastModifiedTime(_source);
+    std::string sidecar = sourceTime > 0 ? _source + suffix + ".oeidx" : std::string();
+
+    if (!sidecar.empty() && !forceRebuild)
+    {
+        _sidecarIndex = PackedRTree::read(sidecar, sourceTime, key);
+        if (_sidecarIndex.valid())
+        {
+            OE_INFO << LC << "Loaded spatial index " << sidecar << std::endl;
+            return;
+        }
+    }
+
+    OE_INFO << LC << "Building spatial index for " << getName() << std::endl;
+
+    std::vector<PackedRTree::Item> items;
+    items.reserve(osg::maximum((int)OGR_L_GetFeatureCount(_layerHandle, 0), 0));
+
+    OGR_L_ResetReading(_layerHandle);
+    OGRFeatureH handle;
+    while ((handle = OGR_L_GetNextFeature(_layerHandle)) != 0L)
+    {
+        OGRGeometryH geom = OGR_F_GetGeometryRef(handle);
+        if (geom)
+        {
+            OGREnvelope env;
+            OGR_G_GetEnvelope(geom, &env);
+            PackedRTree::Item item = { env.MinX, env.MinY, env.MaxX, env.MaxY, OGR_F_GetFID(handle) };
+            items.push_back(item);
+        }
+        OGR_F_Destroy(handle);
+    }
+    OGR_L_ResetReading(_layerHandle);
+
+    _sidecarIndex = new PackedRTree();
+    _sidecarIndex->build(items);
+
+    if (!sidecar.empty())
+    {
+        if (_sidecarIndex->write(sidecar, sourceTime, key))
+        {
+            OE_INFO << LC << "Wrote spatial index " << sidecar << std::endl;
+        }
+        else
+        {
+            OE_INFO << LC << "Could not write " << sidecar << "; using the index in memory only" << std::endl;
+        }
+    }
+}
+
 void
 OGRFeatureSource::buildSpatialIndex()
 {
@@ -803,14 +1178,27 @@ OGRFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
     {
         OGRDataSourceH dsHandle = 0L;
         OGRLayerH layerHandle = 0L;
+        bool privateHandle = false;
 
         // open the handles safely:
         {
             OGR_SCOPED_LOCK;
 
             // Each cursor requires its own DS handle so that multi-threaded access will work.
-            // The cursor impl will dispose of the new DS handle.
-            dsHandle = OGROpenShared(_source.c_str(), 0, &_ogrDriverHandle);
+            // The cursor impl will dispose of the new DS handle. Drivers that support
+            // concurrent readers get an unshared handle so the cursor can read without
+            // the global lock.
+            if (_ogrDriverHandle && OGR::isThreadSafeDriver(OGR_Dr_GetName(_ogrDriverHandle)))
+            {
+                dsHandle = OGROpen(_source.c_str(), 0, 0L);
+                privateHandle = (dsHandle != 0L);
+            }
+
+            if (!dsHandle)
+            {
+                dsHandle = OGROpenShared(_source.c_str(), 0, &_ogrDriverHandle);
+            }
+
             if (dsHandle)
             {
                 layerHandle = OGR::openLayer(dsHandle, options().layer().get());
@@ -827,6 +1215,49 @@ OGRFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
 
             OE_DEBUG << newQuery.getConfig().toJSON(true) << std::endl;
 
+            bool randomRead = false;
+            if (_sidecarIndex.valid())
+            {
+                OGR::OptionalGDALLock lock(!privateHandle);
+                randomRead = OGR_L_TestCapability(layerHandle, OLCRandomRead) != 0;
+            }
+
+            // Answer plain spatial queries from our own index when we have one
+            // and can read its results by FID; otherwise use a spatial filter.
+            if (_sidecarIndex.valid() &&
+                randomRead &&
+                !newQuery.expression().isSet() &&
+                !newQuery.orderby().isSet() &&
+                !newQuery.limit().isSet() &&
+                (newQuery.bounds().isSet() || newQuery.tileKey().isSet()))
+            {
+                if (!newQuery.bounds().isSet())
+                {
+                    GeoExtent localEx = newQuery.tileKey()->getExtent().transform(getFeatureProfile()->getSRS());
+                    newQuery.bounds() = localEx.bounds();
+                }
+
+                const Bounds& b = newQuery.bounds().get();
+                std::vector<FeatureID> fids;
+                _sidecarIndex->search(b.xMin(), b.yMin(), b.xMax(), b.yMax(), fids);
+
+                // FID order is usually storage order
+                std::sort(fids.begin(), fids.end());
+
+                return new OGR::OGRFeatureCursor(
+                    dsHandle,
+                    layerHandle,
+                    this,
+                    getFeatureProfile(),
+                    newQuery,
+                    getFilters(),
+                    progress,
+                    *_options->rewindPolygons(),
+                    privateHandle,
+                    &fids
+                    );
+            }
+
             // cursor is responsible for the OGR handles.
             return new OGR::OGRFeatureCursor(
                 dsHandle,
@@ -836,7 +1267,8 @@ OGRFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
                 newQuery,
                 getFilters(),
                 progress,
-                *_options->rewindPolygons()
+                *_options->rewindPolygons(),
+                privateHandle
                 );
         }
         else
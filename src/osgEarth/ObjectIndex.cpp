@@ -23,6 +23,7 @@
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Registry>
 #include <osg/Geometry>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -59,6 +60,100 @@ namespace
         "} \n";
 }
 
+namespace
+{
+    struct LessOldID
+    {
+        bool operator()(const std::pair<ObjectID, ObjectID>& lhs, const std::pair<ObjectID, ObjectID>& rhs) const {
+            return lhs.first < rhs.first;
+        }
+    };
+
+    // Removes duplicate keys from a sorted run, keeping the last mapping for each
+    void dedup(std::vector<std::pair<ObjectID, ObjectID> >& run)
+    {
+        std::size_t out = 0u;
+        for (std::size_t i = 0; i < run.size(); ++i)
+        {
+            if (out > 0u && run[out - 1].first == run[i].first)
+                run[out - 1] = run[i];
+            else
+                run[out++] = run[i];
+        }
+        run.resize(out);
+    }
+}
+
+void
+ObjectIDRemap::add(ObjectID oldID, ObjectID newID)
+{
+    _pending.push_back(Entry(oldID, newID));
+    if (_pending.size() >= 32u)
+        flush(false);
+}
+
+// Sorts the pending mappings into a new run, then merges runs until each is
+// less than half the size of the one before it (or into a single run if
+// "all" is set). Later mappings replace earlier ones for the same old ID.
+void
+ObjectIDRemap::flush(bool all) const
+{
+    if (!_pending.empty())
+    {
+        // stable, so for duplicate keys the most recent mapping comes last
+        std::stable_sort(_pending.begin(), _pending.end(), LessOldID());
+        _runs.push_back(Run());
+        _runs.back().swap(_pending);
+        dedup(_runs.back());
+    }
+
+    while (_runs.size() >= 2u &&
+           (all || _runs[_runs.size()-2].size() < 2u*_runs.back().size()))
+    {
+        Run& older = _runs[_runs.size()-2];
+        Run& newer = _runs.back();
+        std::size_t middle = older.size();
+        older.insert(older.end(), newer.begin(), newer.end());
+        std::inplace_merge(older.begin(), older.begin() + middle, older.end(), LessOldID());
+        dedup(older);
+        _runs.pop_back();
+    }
+}
+
+std::size_t
+ObjectIDRemap::size() const
+{
+    flush(true);
+    return _runs.empty() ? 0u : _runs.front().size();
+}
+
+bool
+ObjectIDRemap::find(ObjectID oldID, ObjectID& out_newID) const
+{
+    // newest mapping wins
+    for (Run::const_reverse_iterator i = _pending.rbegin(); i != _pending.rend(); ++i)
+    {
+        if (i->first == oldID)
+        {
+            out_newID = i->second;
+            return true;
+        }
+    }
+
+    for (std::vector<Run>::const_reverse_iterator run = _runs.rbegin(); run != _runs.rend(); ++run)
+    {
+        Run::const_iterator i = std::lower_bound(run->begin(), run->end(), Entry(oldID, 0u), LessOldID());
+        if (i != run->end() && i->first == oldID)
+        {
+            out_newID = i->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+//........................................................................
+
 ObjectIndex::ObjectIndex() :
 _idGen( STARTING_OBJECT_ID )
 {
@@ -84,7 +179,7 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    if ( size() == 0 )
     {
         _attribLocation = value;
     } 
@@ -97,49 +192,60 @@ ObjectIndex::setObjectIDAtrribLocation(int value)
 ObjectID
 ObjectIndex::insert(osg::Referenced* object)
 {
-    Threading::ScopedMutexLock excl( _mutex );
-    return insertImpl( object );
-}
-
-ObjectID
-ObjectIndex::insertImpl(osg::Referenced* object)
-{
-    // internal: assume mutex is locked
     ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
+    Shard& shard = getShard(id);
+    Threading::ScopedMutexLock excl( shard._mutex );
+    shard._index[id] = object;
+    OE_DEBUG << LC << "Insert " << id << "\n";
     return id;
 }
 
 osg::Referenced*
 ObjectIndex::getImpl(ObjectID id) const
 {
-    // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    // assume the shard is locked
+    const IndexMap& index = getShard(id)._index;
+    IndexMap::const_iterator i = index.find(id);
+    return i != index.end() ? i->second.get() : 0L;
 }
 
 void
 ObjectIndex::remove(ObjectID id)
 {
-    Threading::ScopedMutexLock excl(_mutex);
-    removeImpl(id);
+    Shard& shard = getShard(id);
+    Threading::ScopedMutexLock excl( shard._mutex );
+    shard._index.erase( id );
+    OE_DEBUG << LC << "Remove " << id << "\n";
 }
 
-void
-ObjectIndex::removeImpl(ObjectID id)
+unsigned
+ObjectIndex::size() const
 {
-    // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
+    unsigned count = 0u;
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        count += _shards[i]._index.size();
+    }
+    return count;
+}
 
+std::size_t
+ObjectIndex::getMemoryUsage() const
+{
+    std::size_t bytes = 0u;
+    for (unsigned i = 0; i < NUM_SHARDS; ++i)
+    {
+        Threading::ScopedMutexLock lock( _shards[i]._mutex );
+        bytes += _shards[i]._index.getMemoryUsage();
+    }
+    return bytes;
 }
 
 ObjectID
 ObjectIndex::tagDrawable(osg::Drawable* drawable, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagDrawable(drawable, oid);
     return oid;
 }
@@ -166,6 +272,47 @@ ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id) const
     ids->assign( geom->getVertexArray()->getNumElements(), id );
 }
 
+ObjectID
+ObjectIndex::tagRange(osg::Drawable* drawable, osg::Referenced* object, unsigned first, unsigned count)
+{
+    ObjectID oid = insert(object);
+    tagRange(drawable, oid, first, count);
+    return oid;
+}
+
+void
+ObjectIndex::tagRange(osg::Drawable* drawable, ObjectID id, unsigned first, unsigned count) const
+{
+    if ( drawable == 0L )
+        return;
+
+    osg::Geometry* geom = drawable->asGeometry();
+    if ( !geom || !geom->getVertexArray() )
+        return;
+
+    unsigned numVerts = geom->getVertexArray()->getNumElements();
+    if ( first >= numVerts )
+        return;
+
+    ObjectIDArray* ids = dynamic_cast<ObjectIDArray*>(geom->getVertexAttribArray(_attribLocation));
+    if ( !ids )
+    {
+        ids = new ObjectIDArray();
+        ids->setBinding(osg::Array::BIND_PER_VERTEX);
+        ids->setNormalize(false);
+        geom->setVertexAttribArray(_attribLocation, ids);
+        ids->setPreserveDataType(true);
+    }
+
+    // untagged vertices keep the "empty" ID
+    if ( ids->size() < numVerts )
+        ids->resize( numVerts, OSGEARTH_OBJECTID_EMPTY );
+
+    unsigned last = osg::minimum(first + count, numVerts);
+    std::fill( ids->begin() + first, ids->begin() + last, id );
+    ids->dirty();
+}
+
 namespace
 {
     struct FindAndTagDrawables : public osg::NodeVisitor
@@ -190,8 +337,7 @@ namespace
 ObjectID
 ObjectIndex::tagAllDrawables(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagAllDrawables(node, oid);
     return oid;
 }
@@ -209,8 +355,7 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 ObjectID
 ObjectIndex::tagNode(osg::Node* node, osg::Referenced* object)
 {
-    Threading::ScopedMutexLock lock(_mutex);
-    ObjectID oid = insertImpl(object);
+    ObjectID oid = insert(object);
     tagNode(node, oid);
     return oid;
 }
@@ -260,7 +405,7 @@ ObjectIndex::getObjectID(osg::Node* node, ObjectID& output) const
 
 bool
 ObjectIndex::updateObjectIDs(osg::Drawable* drawable,
-                             std::map<ObjectID, ObjectID>& oldNewMap,
+                             ObjectIDRemap& oldNewMap,
                              osg::Referenced* object)
 {
     // in a drawable, replaces each OIDs in map.first with the corresponding OID in map.second
@@ -273,18 +418,28 @@ ObjectIndex::updateObjectIDs(osg::Drawable* drawable,
     if ( !oids ) return false;
     if (oids->empty()) return false;
     
-    for (ObjectIDArray::iterator i = oids->begin(); i != oids->end(); ++i)
+    // vertices of one object are contiguous, so remap a run at a time
+    ObjectIDArray::iterator i = oids->begin();
+    while (i != oids->end())
     {
-        ObjectID newoid;
-        std::map<ObjectID, ObjectID>::iterator k = oldNewMap.find(*i);
-        if (k != oldNewMap.end()) {
-            newoid = k->second;
-        }
-        else {
-            newoid = insert(object);
-            oldNewMap[*i] = newoid;
+        ObjectID oldoid = *i;
+        ObjectIDArray::iterator j = i + 1;
+        while (j != oids->end() && *j == oldoid)
+            ++j;
+
+        // untagged vertices (see tagRange) stay untagged
+        if (oldoid != OSGEARTH_OBJECTID_EMPTY)
+        {
+            ObjectID newoid;
+            if (!oldNewMap.find(oldoid, newoid)) {
+                newoid = insert(object);
+                oldNewMap.add(oldoid, newoid);
+            }
+
+            std::fill(i, j, newoid);
         }
-        *i = newoid;
+
+        i = j;
     }
 
     oids->dirty();
@@ -294,7 +449,7 @@ ObjectIndex::updateObjectIDs(osg::Drawable* drawable,
 
 bool
 ObjectIndex::updateObjectID(osg::Node* node,
-                            std::map<ObjectID, ObjectID>& oldNewMap,
+                            ObjectIDRemap& oldNewMap,
                             osg::Referenced* object)
 {
     if (!node) return false;
@@ -309,13 +464,9 @@ ObjectIndex::updateObjectID(osg::Node* node,
     uniform->get(oldoid);
 
     ObjectID newoid;
-    std::map<ObjectID, ObjectID>::iterator k = oldNewMap.find(oldoid);
-    if (k != oldNewMap.end()) {
-        newoid = k->second;
-    }
-    else {
+    if (!oldNewMap.find(oldoid, newoid)) {
         newoid = insert(object);
-        oldNewMap[oldoid] = newoid;
+        oldNewMap.add(oldoid, newoid);
     }
 
     uniform->set(newoid);
@@ -497,44 +497,58 @@ OgrUtils::createOgrGeometry(const osgEarth::Geometry* geometry, OGRwkbGeometryTy
 
 Feature*
 OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile, bool rewindPolygons)
+{
+    return createFeature(handle, profile, rewindPolygons, Query::ALL);
+}
+
+Feature*
+OgrUtils::createFeature(OGRFeatureH handle, const FeatureProfile* profile, bool rewindPolygons, const Query& query)
 {
     Feature* f = 0L;
     if ( profile )
     {
-        f = createFeature( handle, profile->getSRS(), rewindPolygons);
+        f = createFeature( handle, profile->getSRS(), rewindPolygons, query);
         if ( f && profile->geoInterp().isSet() )
             f->geoInterp() = profile->geoInterp().get();
     }
     else
     {
-        f = createFeature( handle, (const SpatialReference*)0L, rewindPolygons);
+        f = createFeature( handle, (const SpatialReference*)0L, rewindPolygons, query);
     }
     return f;
 }
 
 Feature*
-OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, bool rewindPolygons)
+OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, bool rewindPolygons, const Query& query)
 {
     FeatureID fid = OGR_F_GetFID( handle );
 
-    OGRGeometryH geomRef = OGR_F_GetGeometryRef( handle );
-
     Geometry* geom = 0;
 
-    if ( geomRef )
+    if ( query.includeGeometry() == true )
     {
-        geom = OgrUtils::createGeometry( geomRef, rewindPolygons);
+        OGRGeometryH geomRef = OGR_F_GetGeometryRef( handle );
+        if ( geomRef )
+        {
+            geom = OgrUtils::createGeometry( geomRef, rewindPolygons);
+        }
     }
 
     Feature* feature = new Feature( geom, srs, Style(), fid );
 
+    bool project = !query.attributes().empty();
+
     int numAttrs = OGR_F_GetFieldCount(handle);
     for (int i = 0; i < numAttrs; ++i)
     {
         OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i );
 
-        // get the field name and convert to lower case:
+        // skip fields outside the query's attribute projection:
         const char* field_name = OGR_Fld_GetNameRef( field_handle_ref );
+        if ( project && !query.includesAttribute(field_name) )
+            continue;
+
+        // get the field name and convert to lower case:
         std::string name = osgEarth::toLower( std::string(field_name) );
 
         // get the field type and set the value appropriately
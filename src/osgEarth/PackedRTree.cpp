@@ -0,0 +1,384 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/PackedRTree>
+#include <osgEarth/Notify>
+#include <osgEarth/StringUtils>
+#include <osg/Math>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#define LC "[PackedRTree] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    const char     MAGIC[8] = { 'O', 'E', 'R', 'T', 'R', 'E', 'E', '1' };
+    const unsigned VERSION  = 3u;
+
+    struct Header
+    {
+        char               magic[8];
+        unsigned           version;
+        unsigned           nodeSize;
+        unsigned long long numItems;
+        unsigned long long numNodes;
+        long long          sourceTime;
+        unsigned long long keyHash;
+    };
+
+    // Position of (x, y) along a 16-bit Hilbert curve.
+    // From "Fast Hilbert curve generation" by rawrunprotected (public domain).
+    unsigned hilbert(unsigned x, unsigned y)
+    {
+        unsigned a = x ^ y;
+        unsigned b = 0xFFFF ^ a;
+        unsigned c = 0xFFFF ^ (x | y);
+        unsigned d = x & (y ^ 0xFFFF);
+
+        unsigned A = a | (b >> 1);
+        unsigned B = (a >> 1) ^ a;
+        unsigned C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+        unsigned D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+        B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+        C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+        D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+        a = A; b = B; c = C; d = D;
+        A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+        B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+        C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+        D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+        a = A; b = B; c = C; d = D;
+        C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+        D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+        a = C ^ (C >> 1);
+        b = D ^ (D >> 1);
+
+        unsigned i0 = x ^ y;
+        unsigned i1 = b | (0xFFFF ^ (i0 | a));
+
+        i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+        i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+        i0 = (i0 | (i0 << 2)) & 0x33333333;
+        i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+        i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+        i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+        i1 = (i1 | (i1 << 2)) & 0x33333333;
+        i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+        return (i1 << 1) | i0;
+    }
+
+    struct SortByHilbert
+    {
+        const std::vector<unsigned>& _values;
+        SortByHilbert(const std::vector<unsigned>& values) : _values(values) { }
+        bool operator()(unsigned a, unsigned b) const { return _values[a] < _values[b]; }
+    };
+
+    inline bool intersects(const PackedRTree::Item& item, double xmin, double ymin, double xmax, double ymax)
+    {
+        return !(item.xmax < xmin || item.xmin > xmax || item.ymax < ymin || item.ymin > ymax);
+    }
+}
+
+// Read-only mapping of a tree file.
+struct PackedRTree::Mapping
+{
+#ifdef _WIN32
+    HANDLE _file;
+    HANDLE _map;
+    Mapping() : _file(INVALID_HANDLE_VALUE), _map(NULL), _data(0L), _size(0) { }
+#else
+    int _fd;
+    Mapping() : _fd(-1), _data(0L), _size(0) { }
+#endif
+    const char* _data;
+    std::size_t _size;
+
+    bool open(const std::string& filename)
+    {
+#ifdef _WIN32
+        _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+            return false;
+        _size = (std::size_t)size.QuadPart;
+        _map = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (_map == NULL)
+            return false;
+        _data = (const char*)MapViewOfFile(_map, FILE_MAP_READ, 0, 0, 0);
+        return _data != 0L;
+#else
+        _fd = ::open(filename.c_str(), O_RDONLY);
+        if (_fd < 0)
+            return false;
+        struct stat buf;
+        if (::fstat(_fd, &buf) != 0 || buf.st_size == 0)
+            return false;
+        _size = (std::size_t)buf.st_size;
+        void* data = ::mmap(0L, _size, PROT_READ, MAP_SHARED, _fd, 0);
+        if (data == MAP_FAILED)
+            return false;
+        _data = (const char*)data;
+        return true;
+#endif
+    }
+
+    ~Mapping()
+    {
+#ifdef _WIN32
+        if (_data) UnmapViewOfFile(_data);
+        if (_map) CloseHandle(_map);
+        if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#else
+        if (_data) ::munmap((void*)_data, _size);
+        if (_fd >= 0) ::close(_fd);
+#endif
+    }
+};
+
+PackedRTree::PackedRTree() :
+    _nodeSize(16u),
+    _numItems(0u),
+    _numNodes(0u),
+    _nodes(0L),
+    _mapping(0L)
+{
+    //nop
+}
+
+PackedRTree::~PackedRTree()
+{
+    delete _mapping;
+}
+
+void
+PackedRTree::initLevels()
+{
+    // leaves come first, then each level of parents, ending with the root.
+    _levelBounds.clear();
+    if (_numItems == 0u)
+    {
+        _numNodes = 0u;
+        return;
+    }
+
+    unsigned long long count = _numItems;
+    unsigned long long numNodes = _numItems;
+    _levelBounds.push_back(numNodes);
+    do
+    {
+        count = (count + _nodeSize - 1) / _nodeSize;
+        numNodes += count;
+        _levelBounds.push_back(numNodes);
+    }
+    while (count != 1u);
+
+    _numNodes = numNodes;
+}
+
+void
+PackedRTree::build(std::vector<Item>& items, unsigned nodeSize)
+{
+    delete _mapping;
+    _mapping = 0L;
+    _storage.clear();
+    _nodes = 0L;
+
+    _nodeSize = osg::clampBetween(nodeSize, 2u, 65535u);
+    _numItems = items.size();
+    initLevels();
+
+    if (_numItems == 0u)
+        return;
+
+    // total extent, for normalizing the Hilbert coordinates
+    double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+    for (std::vector<Item>::const_iterator i = items.begin(); i != items.end(); ++i)
+    {
+        xmin = std::min(xmin, i->xmin);
+        ymin = std::min(ymin, i->ymin);
+        xmax = std::max(xmax, i->xmax);
+        ymax = std::max(ymax, i->ymax);
+    }
+
+    double width = xmax - xmin, height = ymax - ymin;
+    std::vector<unsigned> values(items.size());
+    for (unsigned i = 0; i < items.size(); ++i)
+    {
+        const Item& item = items[i];
+        unsigned x = width > 0.0 ? (unsigned)(65535.0 * (0.5*(item.xmin + item.xmax) - xmin) / width) : 0u;
+        unsigned y = height > 0.0 ? (unsigned)(65535.0 * (0.5*(item.ymin + item.ymax) - ymin) / height) : 0u;
+        values[i] = hilbert(x, y);
+    }
+
+    std::vector<unsigned> order(items.size());
+    for (unsigned i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), SortByHilbert(values));
+
+    _storage.resize(_numNodes);
+    for (unsigned i = 0; i < order.size(); ++i)
+        _storage[i] = items[order[i]];
+
+    // pack each level into parent nodes.
+    unsigned long long pos = 0u, out = _numItems;
+    for (unsigned level = 0; level + 1 < _levelBounds.size(); ++level)
+    {
+        unsigned long long end = _levelBounds[level];
+        while (pos < end)
+        {
+            Item node;
+            node.xmin = DBL_MAX; node.ymin = DBL_MAX;
+            node.xmax = -DBL_MAX; node.ymax = -DBL_MAX;
+            node.id = (long long)pos;
+            for (unsigned k = 0; k < _nodeSize && pos < end; ++k, ++pos)
+            {
+                const Item& child = _storage[pos];
+                node.xmin = std::min(node.xmin, child.xmin);
+                node.ymin = std::min(node.ymin, child.ymin);
+                node.xmax = std::max(node.xmax, child.xmax);
+                node.ymax = std::max(node.ymax, child.ymax);
+            }
+            _storage[out++] = node;
+        }
+    }
+
+    _nodes = &_storage[0];
+}
+
+void
+PackedRTree::search(double xmin, double ymin, double xmax, double ymax,
+                    std::vector<long long>& output) const
+{
+    if (_numNodes == 0u || !_nodes)
+        return;
+
+    // (first node of a group, level of that group)
+    std::vector<std::pair<unsigned long long, unsigned> > stack;
+    stack.push_back(std::make_pair(_numNodes - 1u, (unsigned)_levelBounds.size() - 1u));
+
+    while (!stack.empty())
+    {
+        unsigned long long first = stack.back().first;
+        unsigned level = stack.back().second;
+        stack.pop_back();
+
+        unsigned long long end = std::min(first + _nodeSize, _levelBounds[level]);
+        for (unsigned long long pos = first; pos < end; ++pos)
+        {
+            const Item& node = _nodes[pos];
+            if (!intersects(node, xmin, ymin, xmax, ymax))
+                continue;
+
+            if (first < _numItems)
+                output.push_back(node.id);
+            else
+                stack.push_back(std::make_pair((unsigned long long)node.id, level - 1u));
+        }
+    }
+}
+
+bool
+PackedRTree::write(const std::string& filename, TimeStamp sourceTime, const std::string& key) const
+{
+    std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.nodeSize = _nodeSize;
+    header.numItems = _numItems;
+    header.numNodes = _numNodes;
+    header.sourceTime = (long long)sourceTime;
+    header.keyHash = hashString(key);
+
+    out.write((const char*)&header, sizeof(Header));
+    if (_numNodes > 0u)
+        out.write((const char*)_nodes, _numNodes * sizeof(Item));
+
+    return out.good();
+}
+
+PackedRTree*
+PackedRTree::read(const std::string& filename, TimeStamp sourceTime, const std::string& key)
+{
+    Mapping* mapping = new Mapping();
+    if (!mapping->open(filename) || mapping->_size < sizeof(Header))
+    {
+        delete mapping;
+        return 0L;
+    }
+
+    Header header;
+    memcpy(&header, mapping->_data, sizeof(Header));
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION ||
+        header.nodeSize < 2u ||
+        header.sourceTime != (long long)sourceTime ||
+        header.keyHash != hashString(key) ||
+        mapping->_size != sizeof(Header) + header.numNodes * sizeof(Item))
+    {
+        OE_DEBUG << LC << filename << " is out of date or invalid" << std::endl;
+        delete mapping;
+        return 0L;
+    }
+
+    osg::ref_ptr<PackedRTree> tree = new PackedRTree();
+    tree->_nodeSize = header.nodeSize;
+    tree->_numItems = header.numItems;
+    tree->initLevels();
+
+    if (tree->_numNodes != header.numNodes)
+    {
+        delete mapping;
+        return 0L;
+    }
+
+    tree->_mapping = mapping;
+    tree->_nodes = header.numNodes > 0u ? (const Item*)(mapping->_data + sizeof(Header)) : 0L;
+    return tree.release();
+}
@@ -28,6 +28,7 @@
 #include <osg/Point>
 #include <osgDB/ObjectWrapper>
 #include <osgUtil/Optimizer>
+#include <algorithm>
 
 
 #if defined(OSG_GLES1_AVAILABLE) || defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
@@ -508,47 +509,99 @@ PointDrawable::getVertex(unsigned index) const
 void
 PointDrawable::importVertexArray(const osg::Vec3Array* verts)
 {
-    initialize();
+    if (verts && verts->size() > 0)
+        setVertices(&verts->front(), verts->size());
+    else
+        setVertices(0L, 0u);
+}
 
-    _current->clear();
-    _colors->clear();
+void
+PointDrawable::allocate(unsigned numVerts)
+{
+    initialize();
 
-    if (verts && verts->size() > 0)
+    unsigned num = getNumVerts();
+    if (numVerts < num)
     {
-        reserve(verts->size());
+        clear();
+        num = 0u;
+    }
 
-        for (osg::Vec3Array::const_iterator i = verts->begin(); i != verts->end(); ++i)
-        {
-            pushVertex(*i);
-        }
+    if (numVerts > num)
+    {
+        _current->resize(numVerts, osg::Vec3(0,0,0));
+        _current->dirty();
+        _colors->resize(numVerts, _color);
+        _colors->dirty();
+        dirtyBound();
     }
 
     dirty();
 }
 
 void
-PointDrawable::allocate(unsigned numVerts)
+PointDrawable::setVertices(const osg::Vec3* verts, unsigned n)
 {
     initialize();
 
-    unsigned num = getNumVerts();
-    if (numVerts >= num)
-    {
-        for (unsigned i = num; i < numVerts; ++i)
-        {
-            pushVertex(osg::Vec3(0,0,0));
-        }
-    }
-    else
+    _current->clear();
+    _colors->clear();
+
+    appendVertices(verts, n);
+
+    dirty();
+}
+
+void
+PointDrawable::appendVertices(const osg::Vec3* verts, unsigned n)
+{
+    initialize();
+
+    if (verts == 0L || n == 0u)
+        return;
+
+    _current->insert(_current->end(), verts, verts + n);
+    _current->dirty();
+
+    _colors->resize(_colors->size() + n, _color);
+    _colors->dirty();
+
+    dirtyBound();
+}
+
+void
+PointDrawable::setVertices(unsigned first, const osg::Vec3* verts, unsigned n)
+{
+    initialize();
+
+    if (verts == 0L || first >= _current->size())
+        return;
+
+    // if we've already called dirty() that means we are editing a completed
+    // drawable and therefore need dynamic variance.
+    if (getNumPrimitiveSets() > 0u && getDataVariance() != DYNAMIC)
     {
-        clear();
-        for (unsigned i = 0; i < numVerts; ++i)
-        {
-            pushVertex(osg::Vec3(0,0,0));
-        }
+        setDataVariance(DYNAMIC);
     }
 
-    dirty();
+    n = osg::minimum(n, (unsigned)_current->size() - first);
+    std::copy(verts, verts + n, _current->begin() + first);
+    _current->dirty();
+
+    dirtyBound();
+}
+
+void
+PointDrawable::setColors(unsigned first, const osg::Vec4* colors, unsigned n)
+{
+    initialize();
+
+    if (colors == 0L || first >= _colors->size())
+        return;
+
+    n = osg::minimum(n, (unsigned)_colors->size() - first);
+    std::copy(colors, colors + n, _colors->begin() + first);
+    _colors->dirty();
 }
 
 // Calculates the "virtual" number of vertices in this drawable.
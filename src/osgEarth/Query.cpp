@@ -22,7 +22,8 @@ using namespace osgEarth;
 
 Query Query::ALL;
 
-Query::Query( const Config& conf )
+Query::Query( const Config& conf ) :
+_includeGeometry(true)
 {
     mergeConfig( conf );
 }
@@ -32,7 +33,9 @@ _bounds(rhs._bounds),
 _expression(rhs._expression),
 _orderby(rhs._orderby),
 _tileKey(rhs._tileKey),
-_limit(rhs._limit)
+_limit(rhs._limit),
+_includeGeometry(rhs._includeGeometry),
+_attributes(rhs._attributes)
 {
     //nop
 }
@@ -58,6 +61,14 @@ Query::mergeConfig( const Config& conf )
     }
 
     conf.get("limit", _limit);
+    conf.get("include_geometry", _includeGeometry);
+
+    std::string attrs;
+    if (conf.get("attributes", attrs))
+    {
+        _attributes.clear();
+        StringTokenizer(attrs, _attributes, ",", "", false, true);
+    }
 }
 
 Config
@@ -67,6 +78,9 @@ Query::getConfig() const
     conf.set( "expr", _expression );
     conf.set( "orderby", _orderby);
     conf.set( "limit", _limit);
+    conf.set( "include_geometry", _includeGeometry);
+    if ( !_attributes.empty() )
+        conf.set( "attributes", joinStrings(_attributes, ',') );
     if ( _bounds.isSet() ) {
         Config bc( "extent" );
         bc.add( "xmin", toString(_bounds->xMin()) );
@@ -129,5 +143,41 @@ Query::combineWith( const Query& rhs ) const
         merged.bounds() = *rhs.bounds();
     }
 
+    // skip the geometry if one query explicitly excludes it and the other
+    // does not explicitly ask for it:
+    bool lhsNoGeom = _includeGeometry.isSetTo(false);
+    bool rhsNoGeom = rhs._includeGeometry.isSetTo(false);
+    if ( (lhsNoGeom && !rhs._includeGeometry.isSetTo(true)) ||
+         (rhsNoGeom && !_includeGeometry.isSetTo(true)) )
+    {
+        merged.includeGeometry() = false;
+    }
+
+    // union the attribute projections (an empty projection is unconstrained,
+    // so the union is too):
+    if ( !_attributes.empty() && !rhs._attributes.empty() )
+    {
+        merged.attributes() = _attributes;
+        for(StringVector::const_iterator i = rhs._attributes.begin(); i != rhs._attributes.end(); ++i)
+        {
+            if ( !merged.includesAttribute(*i) )
+                merged.attributes().push_back(*i);
+        }
+    }
+
     return merged;
 }
+
+bool
+Query::includesAttribute(const std::string& name) const
+{
+    if ( _attributes.empty() )
+        return true;
+
+    for(StringVector::const_iterator i = _attributes.begin(); i != _attributes.end(); ++i)
+    {
+        if ( ciEquals(*i, name) )
+            return true;
+    }
+    return false;
+}
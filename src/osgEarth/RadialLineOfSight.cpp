@@ -86,7 +86,8 @@ _outlineColor( 1.0f, 1.0f, 1.0f, 1.0f),
 _displayMode( LineOfSight::MODE_SPLIT ),
 //_altitudeMode( ALTMODE_ABSOLUTE ),
 _fill(false),
-_terrainOnly( false )
+_terrainOnly( false ),
+_computeMethod( LineOfSight::METHOD_INTERSECT )
 {
     //compute(getNode());
     _terrainChangedCallback = new RadialLineOfSightNodeTerrainChangedCallback( this );
@@ -115,6 +116,7 @@ RadialLineOfSightNode::setMapNode( MapNode* mapNode )
         }
 
         _mapNode = mapNode;
+        _engine = 0L;
 
         if ( _mapNode.valid() && _terrainChangedCallback.valid() )
         {
@@ -211,6 +213,32 @@ void RadialLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+LineOfSight::ComputeMethod
+RadialLineOfSightNode::getComputeMethod() const
+{
+    return _computeMethod;
+}
+
+void
+RadialLineOfSightNode::setComputeMethod( LineOfSight::ComputeMethod method )
+{
+    if (_computeMethod != method)
+    {
+        _computeMethod = method;
+        compute(getNode());
+    }
+}
+
+LineOfSightEngine*
+RadialLineOfSightNode::getEngine()
+{
+    if ( !_engine.valid() && getMapNode() )
+    {
+        _engine = new LineOfSightEngine( getMapNode()->getMap() );
+    }
+    return _engine.get();
+}
+
 osg::Node*
 RadialLineOfSightNode::getNode()
 {
@@ -223,25 +251,17 @@ void
 RadialLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "RadialLineOfSightNode::terrainChanged" << std::endl;
+
+    // the elevation method samples the map directly, so paging doesn't change it
+    if (_computeMethod == LineOfSight::METHOD_ELEVATION)
+        return;
+
     compute( getNode() );    
 }
 
 void
 RadialLineOfSightNode::compute(osg::Node* node )
 {
-    if (_fill)
-    {
-        compute_fill( node );
-    }
-    else
-    {
-        compute_line( node );
-    }
-}
-
-void
-RadialLineOfSightNode::compute_line(osg::Node* node)
-{    
     if ( !getMapNode() )
         return;
 
@@ -258,7 +278,70 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
 
     //Get the number of spokes
     double delta = osg::PI * 2.0 / (double)_numSpokes;
-    
+
+    std::vector<osg::Vec3d> ends;
+    ends.reserve( _numSpokes );
+
+    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    {
+        double angle = delta * (double)i;
+        osg::Quat quat(angle, up );
+        osg::Vec3d spoke = quat * (side * _radius);
+        ends.push_back( _centerWorld + spoke );
+    }
+
+    if (_computeMethod == LineOfSight::METHOD_ELEVATION)
+    {
+        getEngine()->computeRadial( _centerWorld, ends, _viewshed );
+    }
+    else
+    {
+        osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
+
+        for (unsigned int i = 0; i < ends.size(); i++)
+        {
+            osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, ends[i] );
+            ivGroup->addIntersector( dplsi.get() );
+        }
+
+        osgUtil::IntersectionVisitor iv;
+        iv.setIntersector( ivGroup.get() );
+
+        node->accept( iv );
+
+        _viewshed.numSamples = 0;
+        _viewshed.visibility.clear();
+        _viewshed.lines.assign( ends.size(), LineOfSightEngine::Line() );
+
+        for (unsigned int i = 0; i < ends.size(); i++)
+        {
+            osgUtil::LineSegmentIntersector* los = static_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
+            osgUtil::LineSegmentIntersector::Intersections& hits = los->getIntersections();
+
+            LineOfSightEngine::Line& line = _viewshed.lines[i];
+            line.start = los->getStart();
+            line.end = los->getEnd();
+            line.hasLOS = hits.empty();
+            if (!line.hasLOS)
+            {
+                line.hit = hits.begin()->getWorldIntersectPoint();
+            }
+        }
+    }
+
+    if (_fill)
+    {
+        compute_fill();
+    }
+    else
+    {
+        compute_line();
+    }
+}
+
+void
+RadialLineOfSightNode::compute_line()
+{    
     osg::Geometry* geometry = new osg::Geometry;
     geometry->setUseVertexBufferObjects(true);
 
@@ -274,40 +357,14 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
     osg::Vec3d previousEnd;
     osg::Vec3d firstEnd;
 
-    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
-
-    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
-    {
-        double angle = delta * (double)i;
-        osg::Quat quat(angle, up );
-        osg::Vec3d spoke = quat * (side * _radius);
-        osg::Vec3d end = _centerWorld + spoke;
-        osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, end );
-        ivGroup->addIntersector( dplsi.get() );
-    }
-
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
-
-    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    for (unsigned int i = 0; i < _viewshed.lines.size(); i++)
     {
-        osgUtil::LineSegmentIntersector* los = dynamic_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        if ( !los )
-            continue;
+        const LineOfSightEngine::Line& line = _viewshed.lines[i];
 
-        osgUtil::LineSegmentIntersector::Intersections& hits = los->getIntersections();
-
-        osg::Vec3d start = los->getStart();
-        osg::Vec3d end = los->getEnd();
-
-        osg::Vec3d hit;
-        bool hasLOS = hits.empty();
-        if (!hasLOS)
-        {
-            hit = hits.begin()->getWorldIntersectPoint();
-        }
+        const osg::Vec3d& start = line.start;
+        const osg::Vec3d& end = line.end;
+        const osg::Vec3d& hit = line.hit;
+        bool hasLOS = line.hasLOS;
 
         if (hasLOS)
         {
@@ -384,26 +441,8 @@ RadialLineOfSightNode::compute_line(osg::Node* node)
 }
 
 void
-RadialLineOfSightNode::compute_fill(osg::Node* node)
+RadialLineOfSightNode::compute_fill()
 {
-    if ( !getMapNode() )
-        return;
-
-    GeoPoint centerMap;
-    _center.transform( getMapNode()->getMapSRS(), centerMap );
-    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
-
-    bool isProjected = getMapNode()->getMapSRS()->isProjected();
-
-    osg::Vec3d up = isProjected ? osg::Vec3d(0,0,1) : osg::Vec3d(_centerWorld);
-    up.normalize();
-
-    //Get the "side" vector
-    osg::Vec3d side = isProjected ? osg::Vec3d(1,0,0) : up ^ osg::Vec3d(0,0,1);
-
-    //Get the number of spokes
-    double delta = osg::PI * 2.0 / (double)_numSpokes;
-    
     osg::Geometry* geometry = new osg::Geometry;
     geometry->setUseVertexBufferObjects(true);
 
@@ -416,46 +455,23 @@ RadialLineOfSightNode::compute_fill(osg::Node* node)
 
     geometry->setColorArray( colors );
 
-    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
-
-    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
-    {
-        double angle = delta * (double)i;
-        osg::Quat quat(angle, up );
-        osg::Vec3d spoke = quat * (side * _radius);
-        osg::Vec3d end = _centerWorld + spoke;        
-        osg::ref_ptr<osgUtil::LineSegmentIntersector> dplsi = new osgUtil::LineSegmentIntersector( _centerWorld, end );
-        if (dplsi)
-            ivGroup->addIntersector( dplsi.get() );
-    }
-
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
-
-    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    for (unsigned int i = 0; i < _viewshed.lines.size(); i++)
     {
         //Get the current hit
-        osgUtil::LineSegmentIntersector* los = dynamic_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        if ( !los )
-            continue;
-
-        osgUtil::LineSegmentIntersector::Intersections& hits = los->getIntersections();
+        const LineOfSightEngine::Line& curr = _viewshed.lines[i];
 
-        osg::Vec3d currEnd = los->getEnd();
-        bool currHasLOS = hits.empty();
-        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : hits.begin()->getWorldIntersectPoint();
+        const osg::Vec3d& currEnd = curr.end;
+        bool currHasLOS = curr.hasLOS;
+        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : curr.hit;
 
         //Get the next hit
         unsigned int nextIndex = i + 1;
-        if (nextIndex == _numSpokes) nextIndex = 0;
-        osgUtil::LineSegmentIntersector* losNext = static_cast<osgUtil::LineSegmentIntersector*>(ivGroup->getIntersectors()[nextIndex].get());
-        osgUtil::LineSegmentIntersector::Intersections& hitsNext = losNext->getIntersections();
+        if (nextIndex == _viewshed.lines.size()) nextIndex = 0;
+        const LineOfSightEngine::Line& next = _viewshed.lines[nextIndex];
 
-        osg::Vec3d nextEnd = losNext->getEnd();
-        bool nextHasLOS = hitsNext.empty();
-        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : hitsNext.begin()->getWorldIntersectPoint();
+        const osg::Vec3d& nextEnd = next.end;
+        bool nextHasLOS = next.hasLOS;
+        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : next.hit;
         
         if (currHasLOS && nextHasLOS)
         {
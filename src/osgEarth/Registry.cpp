@@ -24,6 +24,7 @@
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ObjectIndex>
 #include <osgEarth/Async>
+#include <osgEarth/TextCache>
 
 #include <osgText/Font>
 
@@ -101,6 +102,9 @@ _maxVertsPerDrawable(USHRT_MAX)
     // performance boost
     _stateSetCache = new StateSetCache();
 
+    // shares laid-out label text
+    _textCache = new TextCache();
+
     // Default unref-after apply policy:
     _unRefImageDataAfterApply = true;
 
@@ -237,6 +241,12 @@ Registry::release()
         _stateSetCache->clear();
     }
 
+    // Shared text prototypes
+    if (_textCache.valid())
+    {
+        _textCache->clear();
+    }
+
     // SpatialReference cache
     _srsCache.lock();
     _srsCache.clear();
@@ -659,6 +669,18 @@ Registry::getStateSetCache() const
     return _stateSetCache.get();
 }
 
+void
+Registry::setTextCache( TextCache* cache )
+{
+    _textCache = cache;
+}
+
+TextCache*
+Registry::getTextCache() const
+{
+    return _textCache.get();
+}
+
 ProgramRepo&
 Registry::getProgramRepo()
 {
@@ -131,6 +131,24 @@ Session::getResourceCache()
     return _resourceCache.get();
 }
 
+Style
+Session::getInlineStyle(const std::string& styleString, const std::string& referrer)
+{
+    InlineStyleKey key(styleString, referrer);
+
+    InlineStyleCache::Record record;
+    if (_inlineStyles.get(key, record))
+        return record.value();
+
+    Config conf("style", styleString);
+    conf.setReferrer(referrer);
+    conf.set("type", "text/css");
+    Style style(conf);
+
+    _inlineStyles.insert(key, style);
+    return style;
+}
+
 osg::ref_ptr<const Map>
 Session::getMap() const
 {
@@ -0,0 +1,1200 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/SoftwarePicker>
+#include <osgEarth/Registry>
+#include <osgEarth/LineDrawable>
+#include <osgEarth/PointDrawable>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Metrics>
+#include <osg/PrimitiveSet>
+#include <osg/TextureBuffer>
+#include <osg/Transform>
+#include <osg/Camera>
+#include <osg/Timer>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+#define LC "[SoftwarePicker] "
+
+namespace
+{
+    // Guard band for clipping, in multiples of the viewport. Geometry inside
+    // the band is rasterized without clipping; the rasterizer discards the
+    // pixels outside the buffer.
+    const double GUARD_BAND = 16.0;
+
+    // Screen tile size in pixels. Each tile is rasterized by one thread.
+    const int TILE_SIZE = 64;
+
+    // Largest point size or line width to rasterize, in pixels
+    const float MAX_WIDTH = 32.0f;
+
+    // vertex in buffer coordinates; z is a depth key (smaller is closer)
+    struct RasterVertex
+    {
+        float x, y, z;
+    };
+
+    // A clipped triangle, line segment, or point ready to rasterize.
+    struct Primitive
+    {
+        RasterVertex v[3];
+        unsigned numVerts;
+        float width;
+        ObjectID id;
+    };
+
+    // A drawable in view, with everything needed to set up its primitives.
+    struct DrawableRecord
+    {
+        osg::ref_ptr<osg::Drawable> drawable;
+        osg::Matrixd mvp;
+        ObjectID uniformID;
+        float width;
+    };
+
+    // Maps clip coordinates to the ID buffer. Perspective depth uses -1/w,
+    // which interpolates linearly in screen space and does not depend on
+    // the precision of the near/far planes.
+    struct Viewport
+    {
+        double size;
+        bool perspective;
+
+        RasterVertex toRaster(const osg::Vec4d& c) const
+        {
+            RasterVertex r;
+            r.x = (float)((c.x()/c.w()*0.5 + 0.5) * size);
+            r.y = (float)((c.y()/c.w()*0.5 + 0.5) * size);
+            r.z = (float)(perspective ? -1.0/c.w() : c.z()/c.w());
+            return r;
+        }
+    };
+
+    // signed distances of a clip space vertex to the clip planes:
+    // near, then the guard band left/right/bottom/top
+    inline double planeDistance(const osg::Vec4d& c, unsigned plane)
+    {
+        switch (plane)
+        {
+        case 0: return c.z() + c.w();
+        case 1: return GUARD_BAND*c.w() + c.x();
+        case 2: return GUARD_BAND*c.w() - c.x();
+        case 3: return GUARD_BAND*c.w() + c.y();
+        default: return GUARD_BAND*c.w() - c.y();
+        }
+    }
+
+    const unsigned NUM_CLIP_PLANES = 5u;
+
+    inline bool inside(const osg::Vec4d& c)
+    {
+        return
+            c.z() >= -c.w() &&
+            c.x() >= -GUARD_BAND*c.w() && c.x() <= GUARD_BAND*c.w() &&
+            c.y() >= -GUARD_BAND*c.w() && c.y() <= GUARD_BAND*c.w();
+    }
+
+    // outcode against the near plane and the actual viewport sides,
+    // for trivially rejecting primitives that are out of view.
+    inline unsigned outcode(const osg::Vec4d& c)
+    {
+        unsigned code = 0u;
+        if (c.z() < -c.w()) code |= 1u;
+        if (c.x() < -c.w()) code |= 2u;
+        if (c.x() >  c.w()) code |= 4u;
+        if (c.y() < -c.w()) code |= 8u;
+        if (c.y() >  c.w()) code |= 16u;
+        return code;
+    }
+
+    // Converts the primitives of one drawable to clipped raster primitives.
+    // Works for any drawable that supports the PrimitiveFunctor. Vertex
+    // indices from the functor map to the geometry's ObjectID array.
+    struct PrimitiveCollector : public osg::PrimitiveFunctor
+    {
+        PrimitiveCollector(const Viewport& viewport, std::vector<Primitive>& out) :
+            _viewport(viewport),
+            _out(out),
+            _ids(0L),
+            _numIDs(0u),
+            _uniformID(0u),
+            _width(1.0f),
+            _numArrayVerts(0u),
+            _immediateMode(0u) { }
+
+        void reset(const osg::Matrixd& mvp, ObjectID uniformID, float width)
+        {
+            _mvp = mvp;
+            _uniformID = uniformID;
+            _width = width;
+            _ids = 0L;
+            _numIDs = 0u;
+            _clip.clear();
+            _numArrayVerts = 0u;
+        }
+
+        void setObjectIDs(const ObjectID* ids, unsigned count)
+        {
+            _ids = ids;
+            _numIDs = count;
+        }
+
+        template<typename VEC>
+        void transform2(unsigned count, const VEC* verts)
+        {
+            _clip.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+                _clip[i] = osg::Vec4d(verts[i][0], verts[i][1], 0.0, 1.0) * _mvp;
+            _numArrayVerts = count;
+        }
+
+        template<typename VEC>
+        void transform3(unsigned count, const VEC* verts)
+        {
+            _clip.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+                _clip[i] = osg::Vec4d(verts[i][0], verts[i][1], verts[i][2], 1.0) * _mvp;
+            _numArrayVerts = count;
+        }
+
+        template<typename VEC>
+        void transform4(unsigned count, const VEC* verts)
+        {
+            _clip.resize(count);
+            for (unsigned i = 0; i < count; ++i)
+                _clip[i] = osg::Vec4d(verts[i][0], verts[i][1], verts[i][2], verts[i][3]) * _mvp;
+            _numArrayVerts = count;
+        }
+
+        virtual void setVertexArray(unsigned int count, const osg::Vec2* verts) { transform2(count, verts); }
+        virtual void setVertexArray(unsigned int count, const osg::Vec3* verts) { transform3(count, verts); }
+        virtual void setVertexArray(unsigned int count, const osg::Vec4* verts) { transform4(count, verts); }
+        virtual void setVertexArray(unsigned int count, const osg::Vec2d* verts) { transform2(count, verts); }
+        virtual void setVertexArray(unsigned int count, const osg::Vec3d* verts) { transform3(count, verts); }
+        virtual void setVertexArray(unsigned int count, const osg::Vec4d* verts) { transform4(count, verts); }
+
+        struct Sequential
+        {
+            Sequential(GLint first) : _first(first) { }
+            unsigned operator[](unsigned i) const { return _first + i; }
+            GLint _first;
+        };
+
+        template<typename T>
+        struct Indexed
+        {
+            Indexed(const T* indices) : _indices(indices) { }
+            unsigned operator[](unsigned i) const { return (unsigned)_indices[i]; }
+            const T* _indices;
+        };
+
+        virtual void drawArrays(GLenum mode, GLint first, GLsizei count)
+        {
+            decompose(mode, count, Sequential(first));
+        }
+
+        virtual void drawElements(GLenum mode, GLsizei count, const GLubyte* indices)
+        {
+            decompose(mode, count, Indexed<GLubyte>(indices));
+        }
+
+        virtual void drawElements(GLenum mode, GLsizei count, const GLushort* indices)
+        {
+            decompose(mode, count, Indexed<GLushort>(indices));
+        }
+
+        virtual void drawElements(GLenum mode, GLsizei count, const GLuint* indices)
+        {
+            decompose(mode, count, Indexed<GLuint>(indices));
+        }
+
+        // Immediate mode vertices go after the vertex array and carry no
+        // per-vertex ObjectID.
+        virtual void begin(GLenum mode)
+        {
+            _immediateMode = mode;
+            _clip.resize(_numArrayVerts);
+        }
+
+        virtual void vertex(const osg::Vec2& v) { vertex(v.x(), v.y(), 0.0f, 1.0f); }
+        virtual void vertex(const osg::Vec3& v) { vertex(v.x(), v.y(), v.z(), 1.0f); }
+        virtual void vertex(const osg::Vec4& v) { vertex(v.x(), v.y(), v.z(), v.w()); }
+        virtual void vertex(float x, float y) { vertex(x, y, 0.0f, 1.0f); }
+        virtual void vertex(float x, float y, float z) { vertex(x, y, z, 1.0f); }
+        virtual void vertex(float x, float y, float z, float w)
+        {
+            _clip.push_back(osg::Vec4d(x, y, z, w) * _mvp);
+        }
+
+        virtual void end()
+        {
+            unsigned count = _clip.size() - _numArrayVerts;
+            if (count > 0u)
+                decompose(_immediateMode, count, Sequential(_numArrayVerts));
+        }
+
+        // Breaks a GL primitive set into points, lines, and triangles. The last
+        // argument of each is the provoking vertex, whose ObjectID applies to
+        // the whole primitive (as with the "flat" qualifier in the RTT shader).
+        template<typename INDEX>
+        void decompose(GLenum mode, GLsizei count, const INDEX& index)
+        {
+            if (count <= 0)
+                return;
+
+            unsigned n = (unsigned)count;
+
+            switch (mode)
+            {
+            case GL_POINTS:
+                for (unsigned i = 0; i < n; ++i)
+                    point(index[i]);
+                break;
+
+            case GL_LINES:
+                for (unsigned i = 0; i + 1 < n; i += 2)
+                    line(index[i], index[i+1], index[i+1]);
+                break;
+
+            case GL_LINE_STRIP:
+                for (unsigned i = 0; i + 1 < n; ++i)
+                    line(index[i], index[i+1], index[i+1]);
+                break;
+
+            case GL_LINE_LOOP:
+                for (unsigned i = 0; i + 1 < n; ++i)
+                    line(index[i], index[i+1], index[i+1]);
+                if (n > 2)
+                    line(index[n-1], index[0], index[0]);
+                break;
+
+            case GL_TRIANGLES:
+                for (unsigned i = 0; i + 2 < n; i += 3)
+                    triangle(index[i], index[i+1], index[i+2], index[i+2]);
+                break;
+
+            case GL_TRIANGLE_STRIP:
+                for (unsigned i = 0; i + 2 < n; ++i)
+                    triangle(index[i], index[i+1], index[i+2], index[i+2]);
+                break;
+
+            case GL_TRIANGLE_FAN:
+                for (unsigned i = 1; i + 1 < n; ++i)
+                    triangle(index[0], index[i], index[i+1], index[i+1]);
+                break;
+
+            case GL_QUADS:
+                for (unsigned i = 0; i + 3 < n; i += 4)
+                {
+                    triangle(index[i], index[i+1], index[i+2], index[i+3]);
+                    triangle(index[i], index[i+2], index[i+3], index[i+3]);
+                }
+                break;
+
+            case GL_QUAD_STRIP:
+                for (unsigned i = 0; i + 3 < n; i += 2)
+                {
+                    triangle(index[i], index[i+1], index[i+3], index[i+3]);
+                    triangle(index[i], index[i+3], index[i+2], index[i+3]);
+                }
+                break;
+
+            case GL_POLYGON:
+                for (unsigned i = 1; i + 1 < n; ++i)
+                    triangle(index[0], index[i], index[i+1], index[0]);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        ObjectID getID(unsigned i) const
+        {
+            if (_uniformID > 0u)
+                return _uniformID;
+            if (i < _numArrayVerts && i < _numIDs)
+                return _ids[i];
+            return 0u;
+        }
+
+        bool valid(unsigned i) const
+        {
+            return i < _clip.size();
+        }
+
+        void point(unsigned i)
+        {
+            if (!valid(i))
+                return;
+
+            const osg::Vec4d& c = _clip[i];
+            if (outcode(c) != 0u)
+                return;
+
+            Primitive p;
+            p.numVerts = 1u;
+            p.v[0] = _viewport.toRaster(c);
+            p.width = _width;
+            p.id = getID(i);
+            _out.push_back(p);
+        }
+
+        void line(unsigned i0, unsigned i1, unsigned provoking)
+        {
+            if (!valid(i0) || !valid(i1))
+                return;
+
+            osg::Vec4d c0 = _clip[i0], c1 = _clip[i1];
+            if ((outcode(c0) & outcode(c1)) != 0u)
+                return;
+
+            // parametric clip against each plane
+            if (!inside(c0) || !inside(c1))
+            {
+                double t0 = 0.0, t1 = 1.0;
+                for (unsigned plane = 0; plane < NUM_CLIP_PLANES; ++plane)
+                {
+                    double d0 = planeDistance(c0, plane), d1 = planeDistance(c1, plane);
+                    if (d0 < 0.0 && d1 < 0.0)
+                        return;
+                    if (d0 < 0.0)
+                        t0 = osg::maximum(t0, d0 / (d0 - d1));
+                    else if (d1 < 0.0)
+                        t1 = osg::minimum(t1, d0 / (d0 - d1));
+                }
+                if (t0 >= t1)
+                    return;
+
+                osg::Vec4d delta = c1 - c0;
+                c1 = c0 + delta*t1;
+                c0 = c0 + delta*t0;
+            }
+
+            Primitive p;
+            p.numVerts = 2u;
+            p.v[0] = _viewport.toRaster(c0);
+            p.v[1] = _viewport.toRaster(c1);
+            p.width = _width;
+            p.id = getID(provoking);
+            _out.push_back(p);
+        }
+
+        void triangle(unsigned i0, unsigned i1, unsigned i2, unsigned provoking)
+        {
+            if (!valid(i0) || !valid(i1) || !valid(i2))
+                return;
+
+            const osg::Vec4d& c0 = _clip[i0];
+            const osg::Vec4d& c1 = _clip[i1];
+            const osg::Vec4d& c2 = _clip[i2];
+
+            if ((outcode(c0) & outcode(c1) & outcode(c2)) != 0u)
+                return;
+
+            ObjectID id = getID(provoking);
+
+            if (inside(c0) && inside(c1) && inside(c2))
+            {
+                emit(_viewport.toRaster(c0), _viewport.toRaster(c1), _viewport.toRaster(c2), id);
+                return;
+            }
+
+            // Sutherland-Hodgman; each plane adds at most one vertex.
+            osg::Vec4d poly[3 + NUM_CLIP_PLANES], temp[3 + NUM_CLIP_PLANES];
+            unsigned num = 3u;
+            poly[0] = c0;
+            poly[1] = c1;
+            poly[2] = c2;
+
+            for (unsigned plane = 0; plane < NUM_CLIP_PLANES && num >= 3u; ++plane)
+            {
+                unsigned numOut = 0u;
+                for (unsigned k = 0; k < num; ++k)
+                {
+                    const osg::Vec4d& a = poly[k];
+                    const osg::Vec4d& b = poly[(k+1) % num];
+                    double da = planeDistance(a, plane), db = planeDistance(b, plane);
+                    if (da >= 0.0)
+                        temp[numOut++] = a;
+                    if ((da >= 0.0) != (db >= 0.0))
+                        temp[numOut++] = a + (b - a)*(da / (da - db));
+                }
+                for (unsigned k = 0; k < numOut; ++k)
+                    poly[k] = temp[k];
+                num = numOut;
+            }
+
+            if (num < 3u)
+                return;
+
+            RasterVertex first = _viewport.toRaster(poly[0]);
+            RasterVertex prev = _viewport.toRaster(poly[1]);
+            for (unsigned k = 2; k < num; ++k)
+            {
+                RasterVertex next = _viewport.toRaster(poly[k]);
+                emit(first, prev, next, id);
+                prev = next;
+            }
+        }
+
+        void emit(const RasterVertex& a, const RasterVertex& b, const RasterVertex& c, ObjectID id)
+        {
+            // no face culling, as in the RTT camera, but zero-area triangles
+            // cover no pixels.
+            float area = (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+            if (area == 0.0f)
+                return;
+
+            Primitive p;
+            p.numVerts = 3u;
+            p.v[0] = a;
+            p.v[1] = b;
+            p.v[2] = c;
+            p.width = 1.0f;
+            p.id = id;
+            _out.push_back(p);
+        }
+
+        const Viewport& _viewport;
+        std::vector<Primitive>& _out;
+        osg::Matrixd _mvp;
+        const ObjectID* _ids;
+        unsigned _numIDs;
+        ObjectID _uniformID;
+        float _width;
+        std::vector<osg::Vec4d> _clip;
+        unsigned _numArrayVerts;
+        GLenum _immediateMode;
+    };
+
+    // Sets up one drawable. LineDrawables that draw with the GPU shader
+    // store each vertex several times and expand the line in the shader, so
+    // read their virtual vertices instead of the raw arrays.
+    void setupDrawable(const DrawableRecord& record, PrimitiveCollector& collector)
+    {
+        const int oidLocation = Registry::objectIndex()->getObjectIDAttribLocation();
+
+        collector.reset(record.mvp, record.uniformID, record.width);
+
+        const LineDrawable* line = dynamic_cast<const LineDrawable*>(record.drawable.get());
+        if (line && line->getUseGPU())
+        {
+            unsigned numVerts = line->getNumVerts();
+            unsigned first = osg::minimum(line->getFirst(), numVerts);
+            unsigned count = line->getCount() > 0u ? osg::minimum(line->getCount(), numVerts - first) : numVerts - first;
+            if (count < 2u)
+                return;
+
+            std::vector<osg::Vec3> verts(count);
+            for (unsigned i = 0; i < count; ++i)
+                verts[i] = line->getVertex(first + i);
+
+            std::vector<ObjectID> ids;
+            const ObjectIDArray* oids = dynamic_cast<const ObjectIDArray*>(line->getVertexAttribArray(oidLocation));
+            if (oids && line->getVertexArray() && oids->size() >= line->getVertexArray()->getNumElements())
+            {
+                ids.resize(count);
+                for (unsigned i = 0; i < count; ++i)
+                    ids[i] = line->getVertexAttrib(oids, first + i);
+            }
+
+            collector.setVertexArray(count, &verts.front());
+            if (!ids.empty())
+                collector.setObjectIDs(&ids.front(), ids.size());
+            collector.drawArrays(line->getMode(), 0, count);
+            return;
+        }
+
+        const osg::Geometry* geom = record.drawable->asGeometry();
+        if (geom)
+        {
+            const ObjectIDArray* oids = dynamic_cast<const ObjectIDArray*>(geom->getVertexAttribArray(oidLocation));
+            if (oids && !oids->empty())
+                collector.setObjectIDs(&oids->front(), oids->size());
+        }
+
+        if (record.drawable->supports(collector))
+            record.drawable->accept(collector);
+    }
+
+    // Collects the drawables in view, tracking transforms, LOD ranges and
+    // the ObjectID uniform the way the RTT camera's cull would.
+    struct CollectDrawables : public osg::NodeVisitor
+    {
+        CollectDrawables(
+            const osg::Matrixd& viewMatrix,
+            const osg::Matrixd& projMatrix,
+            osg::Node::NodeMask mask,
+            std::vector<DrawableRecord>& out) :
+            osg::NodeVisitor(TRAVERSE_ACTIVE_CHILDREN),
+            _viewProj(viewMatrix * projMatrix),
+            _instanceDepth(0u),
+            _out(out)
+        {
+            setTraversalMask(mask);
+            setNodeMaskOverride(0);
+
+            _eye = osg::Vec3d(0,0,0) * osg::Matrixd::inverse(viewMatrix);
+            _uniformName = Registry::objectIndex()->getObjectIDUniformName();
+
+            _models.push_back(osg::Matrixd::identity());
+            _ids.push_back(0u);
+
+            // world space planes of the frustum sides and near plane
+            // (w+x, w-x, w+y, w-y, w+z >= 0)
+            const osg::Matrixd& m = _viewProj;
+            for (int p = 0; p < 5; ++p)
+            {
+                int axis = p / 2;
+                double sign = (p % 2 == 0) ? 1.0 : -1.0;
+                osg::Vec4d plane(
+                    m(0,3) + sign*m(0,axis),
+                    m(1,3) + sign*m(1,axis),
+                    m(2,3) + sign*m(2,axis),
+                    m(3,3) + sign*m(3,axis));
+                double len = osg::Vec3d(plane.x(), plane.y(), plane.z()).length();
+                if (len > 0.0)
+                    _frustum.push_back(plane / len);
+            }
+        }
+
+        bool culled(const osg::BoundingSphere& bs) const
+        {
+            if (!bs.valid())
+                return true;
+
+            // instanced drawables carry the bounds of all their instances,
+            // which don't transform per instance; leave those to the clipper.
+            if (_instanceDepth > 0u)
+                return false;
+
+            const osg::Matrixd& m = _models.back();
+            osg::Vec3d center = osg::Vec3d(bs.center()) * m;
+            double scale = sqrt(osg::maximum(
+                osg::Vec3d(m(0,0), m(0,1), m(0,2)).length2(), osg::maximum(
+                osg::Vec3d(m(1,0), m(1,1), m(1,2)).length2(),
+                osg::Vec3d(m(2,0), m(2,1), m(2,2)).length2())));
+            double radius = (double)bs.radius() * scale;
+
+            for (std::vector<osg::Vec4d>::const_iterator p = _frustum.begin(); p != _frustum.end(); ++p)
+            {
+                if (p->x()*center.x() + p->y()*center.y() + p->z()*center.z() + p->w() < -radius)
+                    return true;
+            }
+            return false;
+        }
+
+        // ObjectID uniform in a state set, or the inherited one
+        ObjectID getID(const osg::StateSet* stateSet) const
+        {
+            if (stateSet)
+            {
+                const osg::Uniform* u = stateSet->getUniform(_uniformName);
+                ObjectID id;
+                if (u && u->get(id))
+                    return id;
+            }
+            return _ids.back();
+        }
+
+        // Packed placements installed by DrawInstanced::createInstancedNode
+        // (three RGBA32F texels per instance), or NULL if there are none.
+        const osg::Image* getInstances(const osg::StateSet* stateSet) const
+        {
+            if (!stateSet)
+                return 0L;
+
+            const osg::Uniform* u = stateSet->getUniform("oe_di_packed_TBO");
+            int unit;
+            if (!u || !u->get(unit))
+                return 0L;
+
+            const osg::TextureBuffer* tbo = dynamic_cast<const osg::TextureBuffer*>(
+                stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+
+            return tbo ? tbo->getImage() : 0L;
+        }
+
+        // Traverses an instanced subgraph once per instance, the way the
+        // InstancingPacked shader places it.
+        void applyInstances(osg::Node& node, const osg::Image* image)
+        {
+            // The packed buffer is released once it reaches the GPU, so an
+            // instanced model that has already been drawn can't be picked.
+            if (!image->data())
+                return;
+
+            const float* ptr = reinterpret_cast<const float*>(image->data());
+            unsigned numInstances = image->s() / 3;
+
+            ++_instanceDepth;
+            for (unsigned i = 0; i < numInstances; ++i, ptr += 12)
+            {
+                osg::Matrixd m =
+                    osg::Matrixd::scale(ptr[8], ptr[9], ptr[10]) *
+                    osg::Matrixd::rotate(osg::Quat(ptr[4], ptr[5], ptr[6], ptr[7])) *
+                    osg::Matrixd::translate(ptr[0], ptr[1], ptr[2]) *
+                    _models.back();
+
+                ObjectID id = (ObjectID)ptr[3] | ((ObjectID)ptr[11] << 16);
+
+                _models.push_back(m);
+                _ids.push_back(id > 0u ? id : _ids.back());
+                traverse(node);
+                _ids.pop_back();
+                _models.pop_back();
+            }
+            --_instanceDepth;
+        }
+
+        void apply(osg::Node& node)
+        {
+            if (culled(node.getBound()))
+                return;
+
+            _ids.push_back(getID(node.getStateSet()));
+
+            const osg::Image* instances = getInstances(node.getStateSet());
+            if (instances)
+                applyInstances(node, instances);
+            else
+                traverse(node);
+
+            _ids.pop_back();
+        }
+
+        void apply(osg::Transform& xform)
+        {
+            if (culled(xform.getBound()))
+                return;
+
+            osg::Matrixd m = _models.back();
+            xform.computeLocalToWorldMatrix(m, this);
+
+            _models.push_back(m);
+            _ids.push_back(getID(xform.getStateSet()));
+            traverse(xform);
+            _ids.pop_back();
+            _models.pop_back();
+        }
+
+        void apply(osg::Camera& camera)
+        {
+            // nested cameras render into the same target; others (HUDs,
+            // pre-render passes) don't contribute to the pick.
+            if (camera.getRenderOrder() == osg::Camera::NESTED_RENDER)
+                apply(static_cast<osg::Node&>(camera));
+        }
+
+        void apply(osg::Drawable& drawable)
+        {
+            if (culled(drawable.getBound()))
+                return;
+
+            DrawableRecord record;
+            record.drawable = &drawable;
+            record.mvp = _models.back() * _viewProj;
+            record.uniformID = getID(drawable.getStateSet());
+            record.width = 1.0f;
+
+            if (LineDrawable* line = dynamic_cast<LineDrawable*>(&drawable))
+                record.width = line->getLineWidth();
+            else if (PointDrawable* points = dynamic_cast<PointDrawable*>(&drawable))
+                record.width = points->getPointSize();
+
+            record.width = osg::clampBetween(record.width, 1.0f, MAX_WIDTH);
+
+            _out.push_back(record);
+        }
+
+        // LOD selection uses the distance from the camera
+        osg::Vec3 getEyePoint() const
+        {
+            return _eye * osg::Matrixd::inverse(_models.back());
+        }
+
+        float getDistanceToViewPoint(const osg::Vec3& pos, bool useLODScale) const
+        {
+            return (float)((osg::Vec3d(pos) * _models.back()) - _eye).length();
+        }
+
+        osg::Matrixd _viewProj;
+        osg::Vec3d _eye;
+        std::string _uniformName;
+        std::vector<osg::Vec4d> _frustum;
+        std::vector<osg::Matrixd> _models;
+        std::vector<ObjectID> _ids;
+        unsigned _instanceDepth;
+        std::vector<DrawableRecord>& _out;
+    };
+
+    struct SetupJob : public Threading::ParallelFor::Job
+    {
+        SetupJob(const std::vector<DrawableRecord>& records, const Viewport& viewport) :
+            _records(records), _viewport(viewport), _primitives(records.size()) { }
+
+        void operator()(unsigned i, unsigned)
+        {
+            PrimitiveCollector collector(_viewport, _primitives[i]);
+            setupDrawable(_records[i], collector);
+        }
+
+        const std::vector<DrawableRecord>& _records;
+        const Viewport& _viewport;
+        std::vector< std::vector<Primitive> > _primitives;
+    };
+
+    // depth-tested write of one pixel
+    inline void plot(int x, int y, float z, ObjectID id, int stride, ObjectID* ids, float* depth)
+    {
+        int k = y*stride + x;
+        if (z < depth[k])
+        {
+            depth[k] = z;
+            ids[k] = id;
+        }
+    }
+
+    // Rasterizes primitives into one tile of the ID buffer.
+    struct Tile
+    {
+        int x0, y0, x1, y1; // pixel bounds [x0..x1), [y0..y1)
+        int stride;
+        ObjectID* ids;
+        float* depth;
+
+        // square stamp of width w pixels centered on a point
+        void stamp(float x, float y, float z, float width, ObjectID id)
+        {
+            int r = (int)(width * 0.5f);
+            int cx = (int)floorf(x), cy = (int)floorf(y);
+            int sx0 = osg::maximum(cx - r, x0), sx1 = osg::minimum(cx + r + 1, x1);
+            int sy0 = osg::maximum(cy - r, y0), sy1 = osg::minimum(cy + r + 1, y1);
+            for (int sy = sy0; sy < sy1; ++sy)
+                for (int sx = sx0; sx < sx1; ++sx)
+                    plot(sx, sy, z, id, stride, ids, depth);
+        }
+
+        void point(const Primitive& p)
+        {
+            stamp(p.v[0].x, p.v[0].y, p.v[0].z, p.width, p.id);
+        }
+
+        void line(const Primitive& p)
+        {
+            // clip the segment to the tile, padded by the stamp size
+            double pad = (double)p.width * 0.5 + 1.0;
+            double ax = p.v[0].x, ay = p.v[0].y, az = p.v[0].z;
+            double dx = p.v[1].x - ax, dy = p.v[1].y - ay, dz = p.v[1].z - az;
+            double t0 = 0.0, t1 = 1.0;
+
+            double q[4] = { ax - (x0 - pad), (x1 + pad) - ax, ay - (y0 - pad), (y1 + pad) - ay };
+            double d[4] = { -dx, dx, -dy, dy };
+            for (int k = 0; k < 4; ++k)
+            {
+                if (d[k] == 0.0)
+                {
+                    if (q[k] < 0.0) return;
+                }
+                else
+                {
+                    double t = q[k] / d[k];
+                    if (d[k] < 0.0) t0 = osg::maximum(t0, t);
+                    else t1 = osg::minimum(t1, t);
+                }
+            }
+            if (t0 > t1)
+                return;
+
+            // one step per pixel along the major axis
+            double length = osg::maximum(fabs(dx), fabs(dy)) * (t1 - t0);
+            unsigned steps = (unsigned)ceil(length);
+            for (unsigned s = 0; s <= steps; ++s)
+            {
+                double t = t0 + (t1 - t0) * (steps > 0u ? (double)s / (double)steps : 0.0);
+                stamp((float)(ax + dx*t), (float)(ay + dy*t), (float)(az + dz*t), p.width, p.id);
+            }
+        }
+
+        void triangle(const Primitive& p)
+        {
+            const RasterVertex* v0 = &p.v[0];
+            const RasterVertex* v1 = &p.v[1];
+            const RasterVertex* v2 = &p.v[2];
+
+            double area = ((double)v1->x - v0->x)*((double)v2->y - v0->y) - ((double)v1->y - v0->y)*((double)v2->x - v0->x);
+            if (area < 0.0)
+            {
+                std::swap(v1, v2);
+                area = -area;
+            }
+            if (area == 0.0)
+                return;
+
+            int minX = osg::maximum(x0, (int)floorf(osg::minimum(v0->x, osg::minimum(v1->x, v2->x))));
+            int maxX = osg::minimum(x1 - 1, (int)ceilf(osg::maximum(v0->x, osg::maximum(v1->x, v2->x))));
+            int minY = osg::maximum(y0, (int)floorf(osg::minimum(v0->y, osg::minimum(v1->y, v2->y))));
+            int maxY = osg::minimum(y1 - 1, (int)ceilf(osg::maximum(v0->y, osg::maximum(v1->y, v2->y))));
+            if (minX > maxX || minY > maxY)
+                return;
+
+            // Edge functions, positive inside (counter-clockwise). Pixels exactly
+            // on an edge belong to top and left edges only, so triangles sharing
+            // an edge never both cover a pixel.
+            const RasterVertex* a[3] = { v1, v2, v0 };
+            const RasterVertex* b[3] = { v2, v0, v1 };
+            double stepX[3], stepY[3], row[3];
+            bool topLeft[3];
+            double px = (double)minX + 0.5, py = (double)minY + 0.5;
+            for (int e = 0; e < 3; ++e)
+            {
+                double ex = (double)b[e]->x - a[e]->x;
+                double ey = (double)b[e]->y - a[e]->y;
+                stepX[e] = -ey;
+                stepY[e] = ex;
+                row[e] = ex*(py - a[e]->y) - ey*(px - a[e]->x);
+                topLeft[e] = ey < 0.0 || (ey == 0.0 && ex < 0.0);
+            }
+
+            double invArea = 1.0 / area;
+            double z0 = v0->z, z1 = v1->z, z2 = v2->z;
+
+            for (int y = minY; y <= maxY; ++y)
+            {
+                double w[3] = { row[0], row[1], row[2] };
+                for (int x = minX; x <= maxX; ++x)
+                {
+                    if ((w[0] > 0.0 || (w[0] == 0.0 && topLeft[0])) &&
+                        (w[1] > 0.0 || (w[1] == 0.0 && topLeft[1])) &&
+                        (w[2] > 0.0 || (w[2] == 0.0 && topLeft[2])))
+                    {
+                        float z = (float)((w[0]*z0 + w[1]*z1 + w[2]*z2) * invArea);
+                        plot(x, y, z, p.id, stride, ids, depth);
+                    }
+                    w[0] += stepX[0];
+                    w[1] += stepX[1];
+                    w[2] += stepX[2];
+                }
+                row[0] += stepY[0];
+                row[1] += stepY[1];
+                row[2] += stepY[2];
+            }
+        }
+    };
+
+    struct RasterJob : public Threading::ParallelFor::Job
+    {
+        RasterJob(
+            const std::vector<Primitive>& primitives,
+            const std::vector< std::vector<unsigned> >& bins,
+            int tilesX, int size,
+            ObjectID* ids, float* depth) :
+            _primitives(primitives), _bins(bins), _tilesX(tilesX), _size(size), _ids(ids), _depth(depth) { }
+
+        void operator()(unsigned i, unsigned)
+        {
+            Tile tile;
+            tile.x0 = (int)(i % _tilesX) * TILE_SIZE;
+            tile.y0 = (int)(i / _tilesX) * TILE_SIZE;
+            tile.x1 = osg::minimum(tile.x0 + TILE_SIZE, _size);
+            tile.y1 = osg::minimum(tile.y0 + TILE_SIZE, _size);
+            tile.stride = _size;
+            tile.ids = _ids;
+            tile.depth = _depth;
+
+            // bins hold primitives in submission order, so the first of
+            // two primitives at equal depth wins, as with GL_LESS.
+            const std::vector<unsigned>& bin = _bins[i];
+            for (std::vector<unsigned>::const_iterator k = bin.begin(); k != bin.end(); ++k)
+            {
+                const Primitive& p = _primitives[*k];
+                if (p.numVerts == 3u) tile.triangle(p);
+                else if (p.numVerts == 2u) tile.line(p);
+                else tile.point(p);
+            }
+        }
+
+        const std::vector<Primitive>& _primitives;
+        const std::vector< std::vector<unsigned> >& _bins;
+        int _tilesX, _size;
+        ObjectID* _ids;
+        float* _depth;
+    };
+
+    // Iterates through the pixels in a grid, starting at u,v [0..1] and spiraling out.
+    // It will stop when it reaches the "max ring", which is basically a distance from
+    // the starting point. (Same as in the RTTPicker.)
+    struct SpiralIterator
+    {
+        unsigned _ring;
+        unsigned _maxRing;
+        unsigned _leg;
+        int      _x, _y;
+        int      _w, _h;
+        int      _offsetX, _offsetY;
+        unsigned _count;
+
+        SpiralIterator(int w, int h, int maxDist, float u, float v) :
+            _ring(1), _maxRing(maxDist), _leg(0), _x(0), _y(0), _w(w), _h(h), _count(0)
+        {
+            _offsetX = (int)(u * (float)w);
+            _offsetY = (int)(v * (float)h);
+        }
+
+        bool next()
+        {
+            // first time, just use the start point
+            if (_count == 0)
+            {
+                if (_offsetX < 0 || _offsetX >= _w || _offsetY < 0 || _offsetY >= _h)
+                    return false;
+                else
+                {
+                    _count++;
+                    return true;
+                }
+            }
+
+            // spiral until we get to the next valid in-bounds pixel:
+            do {
+                switch(_leg) {
+                case 0: ++_x; if (  _x == (int)_ring ) ++_leg; break;
+                case 1: ++_y; if (  _y == (int)_ring ) ++_leg; break;
+                case 2: --_x; if ( -_x == (int)_ring ) ++_leg; break;
+                case 3: --_y; if ( -_y == (int)_ring ) { _leg = 0; ++_ring; } break;
+                }
+            }
+            while(_ring <= _maxRing && (_x+_offsetX < 0 || _x+_offsetX >= _w || _y+_offsetY < 0 || _y+_offsetY >= _h));
+
+            return _ring <= _maxRing;
+        }
+
+        int s() const { return _x+_offsetX; }
+
+        int t() const { return _y+_offsetY; }
+    };
+}
+
+//........................................................................
+
+SoftwarePicker::SoftwarePicker(int cameraSize) :
+_size(osg::maximum(cameraSize, 4)),
+_buffer(2),
+_cullMask(~0u),
+_renderFrame(~0u)
+{
+    // group that holds the subgraph to render
+    _group = new osg::Group();
+
+    _ids.assign(_size*_size, 0u);
+    _depth.assign(_size*_size, FLT_MAX);
+}
+
+void
+SoftwarePicker::setCullMask(osg::Node::NodeMask nm)
+{
+    if (_cullMask == nm)
+        return;
+    _cullMask = nm;
+    dirty();
+}
+
+void
+SoftwarePicker::render(const osg::Matrixd& viewMatrix, const osg::Matrixd& projectionMatrix)
+{
+    OE_PROFILING_ZONE;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    _renderView = viewMatrix;
+    _renderProjection = projectionMatrix;
+
+    std::fill(_ids.begin(), _ids.end(), 0u);
+    std::fill(_depth.begin(), _depth.end(), FLT_MAX);
+
+    // "cull": find the drawables in view
+    std::vector<DrawableRecord> records;
+    CollectDrawables collect(viewMatrix, projectionMatrix, _cullMask, records);
+    _group->accept(collect);
+
+    // set up each drawable's primitives in parallel
+    Viewport viewport;
+    viewport.size = (double)_size;
+    viewport.perspective = projectionMatrix(2,3) != 0.0;
+
+    SetupJob setup(records, viewport);
+    Threading::ParallelFor::run(setup, records.size());
+
+    std::vector<Primitive> primitives;
+    unsigned total = 0u;
+    for (unsigned i = 0; i < setup._primitives.size(); ++i)
+        total += setup._primitives[i].size();
+    primitives.reserve(total);
+    for (unsigned i = 0; i < setup._primitives.size(); ++i)
+        primitives.insert(primitives.end(), setup._primitives[i].begin(), setup._primitives[i].end());
+
+    // bin the primitives by the screen tiles they overlap
+    int tilesX = (_size + TILE_SIZE - 1) / TILE_SIZE;
+    std::vector< std::vector<unsigned> > bins(tilesX*tilesX);
+
+    _stats = Stats();
+    _stats.drawables = records.size();
+
+    for (unsigned k = 0; k < primitives.size(); ++k)
+    {
+        const Primitive& p = primitives[k];
+
+        float pad = p.numVerts == 3u ? 1.0f : p.width*0.5f + 1.0f;
+        float minX = p.v[0].x, maxX = p.v[0].x, minY = p.v[0].y, maxY = p.v[0].y;
+        for (unsigned v = 1; v < p.numVerts; ++v)
+        {
+            minX = osg::minimum(minX, p.v[v].x), maxX = osg::maximum(maxX, p.v[v].x);
+            minY = osg::minimum(minY, p.v[v].y), maxY = osg::maximum(maxY, p.v[v].y);
+        }
+
+        int tx0 = osg::maximum((int)floorf((minX - pad) / (float)TILE_SIZE), 0);
+        int tx1 = osg::minimum((int)floorf((maxX + pad) / (float)TILE_SIZE), tilesX - 1);
+        int ty0 = osg::maximum((int)floorf((minY - pad) / (float)TILE_SIZE), 0);
+        int ty1 = osg::minimum((int)floorf((maxY + pad) / (float)TILE_SIZE), tilesX - 1);
+
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx)
+                bins[ty*tilesX + tx].push_back(k);
+
+        if (p.numVerts == 3u) ++_stats.triangles;
+        else if (p.numVerts == 2u) ++_stats.lines;
+        else ++_stats.points;
+    }
+
+    // rasterize the tiles in parallel
+    RasterJob raster(primitives, bins, tilesX, _size, &_ids.front(), &_depth.front());
+    Threading::ParallelFor::run(raster, bins.size());
+
+    _stats.seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+}
+
+ObjectID
+SoftwarePicker::getObjectID(float u, float v) const
+{
+    SpiralIterator iter(_size, _size, osg::maximum(_buffer,1), u, v);
+    while (iter.next())
+    {
+        ObjectID id = _ids[iter.t()*_size + iter.s()];
+        if (id > 0u)
+            return id;
+    }
+    return 0u;
+}
+
+bool
+SoftwarePicker::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa)
+{
+    if ( _defaultCallback.valid() && _defaultCallback->accept(ea, aa) )
+    {
+        pick( aa.asView(), ea.getX(), ea.getY(), _defaultCallback.get() );
+    }
+
+    return false;
+}
+
+bool
+SoftwarePicker::pick(osg::View* view, float mouseX, float mouseY)
+{
+    return pick(view, mouseX, mouseY, 0L);
+}
+
+bool
+SoftwarePicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
+{
+    if ( !view )
+        return false;
+
+    Callback* callbackToUse = callback ? callback : _defaultCallback.get();
+    if ( !callbackToUse )
+        return false;
+
+    osg::Camera* cam = view->getCamera();
+    if ( !cam )
+        return false;
+
+    const osg::Viewport* vp = cam->getViewport();
+    if ( !vp )
+        return false;
+
+    // normalize the input cooridnates [0..1]
+    float u = (mouseX - (float)vp->x())/(float)vp->width();
+    float v = (mouseY - (float)vp->y())/(float)vp->height();
+
+    // check the bounds:
+    if ( u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f )
+        return false;
+
+    // re-render only when the camera moves or the frame advances, so
+    // many picks in one frame share one ID buffer.
+    unsigned frame = view->getFrameStamp() ? view->getFrameStamp()->getFrameNumber() : 0u;
+    if (frame != _renderFrame ||
+        cam->getViewMatrix() != _renderView ||
+        cam->getProjectionMatrix() != _renderProjection)
+    {
+        render(cam->getViewMatrix(), cam->getProjectionMatrix());
+        _renderFrame = frame;
+    }
+
+    ObjectID id = getObjectID(u, v);
+    if (id > 0u)
+        callbackToUse->onHit(id);
+    else
+        callbackToUse->onMiss();
+
+    return true;
+}
+
+bool
+SoftwarePicker::addChild(osg::Node* child)
+{
+    dirty();
+    return _group->addChild( child );
+}
+
+bool
+SoftwarePicker::insertChild(unsigned i, osg::Node* child)
+{
+    dirty();
+    return _group->insertChild( i, child );
+}
+
+bool
+SoftwarePicker::removeChild(osg::Node* child)
+{
+    dirty();
+    return _group->removeChild( child );
+}
+
+bool
+SoftwarePicker::replaceChild(osg::Node* oldChild, osg::Node* newChild)
+{
+    dirty();
+    return _group->replaceChild( oldChild, newChild );
+}
@@ -189,12 +189,18 @@ osgEarth::Util::toLegalFileName(const std::string& input, bool allowSubdirs, con
 /** MurmurHash 2.0 (http://sites.google.com/site/murmurhash/) */
 unsigned
 osgEarth::Util::hashString( const std::string& input )
+{
+    return hashBytes(input.c_str(), input.length());
+}
+
+unsigned
+osgEarth::Util::hashBytes( const void* input, unsigned length, unsigned seed )
 {
     const unsigned int m = 0x5bd1e995;
     const int r = 24;
-    unsigned int len = input.length();
-    const char* data = input.c_str();
-    unsigned int h = m ^ len; // using "m" as the seed.
+    unsigned int len = length;
+    const char* data = (const char*)input;
+    unsigned int h = seed ^ len;
 
     while(len >= 4)
     {
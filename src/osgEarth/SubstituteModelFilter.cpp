@@ -28,6 +28,7 @@
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/DrawInstanced>
 #include <osgEarth/Capabilities>
+#include <osgEarth/Registry>
 #include <osgEarth/ScreenSpaceLayout>
 #include <osgEarth/CullingUtils>
 #include <osgEarth/NodeUtils>
@@ -269,6 +270,18 @@ SubstituteModelFilter::process(const FeatureList&           features,
     const ModelSymbol* modelSymbol = dynamic_cast<const ModelSymbol*>(symbol);
     const IconSymbol*  iconSymbol  = dynamic_cast<const IconSymbol*> (symbol);
 
+    // When drawing instanced, collect each model's placements into a packed
+    // instance buffer instead of building a MatrixTransform per placement.
+    // Icons and clustering still work from the transforms.
+    bool packInstances =
+        _useDrawInstanced &&
+        !_cluster &&
+        !iconSymbol &&
+        Registry::capabilities().supportsDrawInstanced();
+
+    typedef std::map< osg::ref_ptr<osg::Node>, DrawInstanced::InstanceList > InstanceMap;
+    InstanceMap instances;
+
     NumericExpression headingEx;    
     NumericExpression scaleXEx;
     NumericExpression scaleYEx;
@@ -397,6 +410,8 @@ SubstituteModelFilter::process(const FeatureList&           features,
 
         if ( model.valid() )
         {
+            ObjectID featureOID = OSGEARTH_OBJECTID_EMPTY;
+
             GeometryIterator gi( input->getGeometry(), false );
             int pointIdx = 0;
             while( gi.hasMore() )
@@ -451,20 +466,42 @@ SubstituteModelFilter::process(const FeatureList&           features,
                     }
 
                     osg::Vec3d point = (*geom)[i];
+                    osg::Matrixd upRotation;
                     if ( makeECEF )
                     {
                         // the "rotation" element lets us re-orient the instance to ensure it's pointing up. We
                         // could take a shortcut and just use the current extent's local2world matrix for this,
                         // but if the tile is big enough the up vectors won't be quite right.
-                        osg::Matrixd upRotation;
                         ECEF::transformAndGetRotationMatrix( point, context.profile()->getSRS(), point, targetSRS, upRotation );
-                        mat = scaleMatrix * headingRotation * upRotation * osg::Matrixd::translate( point ) * _world2local;
                     }
-                    else
+
+                    if ( packInstances )
                     {
-                        mat = scaleMatrix * headingRotation * osg::Matrixd::translate( point ) * _world2local;
+                        // the same placement as the transform below, split into its parts.
+                        // (the localizer is rigid, so it only adds rotation and translation.)
+                        osg::Matrixd rotation = headingRotation * upRotation * _world2local;
+                        rotation.setTrans( 0.0, 0.0, 0.0 );
+
+                        DrawInstanced::Instance instance;
+                        instance.position = point * _world2local;
+                        instance.rotation = rotation.getRotate();
+                        instance.scale    = scaleVec;
+
+                        if ( context.featureIndex() )
+                        {
+                            // a NULL node registers the feature without tagging anything;
+                            // the ID travels in the instance buffer instead.
+                            if ( featureOID == OSGEARTH_OBJECTID_EMPTY )
+                                featureOID = context.featureIndex()->tagNode( 0L, input );
+                            instance.objectID = featureOID;
+                        }
+
+                        instances[model].push_back( instance );
+                        continue;
                     }
 
+                    mat = scaleMatrix * headingRotation * upRotation * osg::Matrixd::translate( point ) * _world2local;
+
                     osg::MatrixTransform* xform = new osg::MatrixTransform();
                     xform->setMatrix( mat );
                     xform->setDataVariance( osg::Object::STATIC );
@@ -508,8 +545,18 @@ SubstituteModelFilter::process(const FeatureList&           features,
         }
     }
 
+    if ( packInstances )
+    {
+        for( InstanceMap::iterator i = instances.begin(); i != instances.end(); ++i )
+        {
+            osg::Node* node = DrawInstanced::createInstancedNode( i->first.get(), i->second );
+            if ( node )
+                attachPoint->addChild( node );
+        }
+    }
+
     // active DrawInstanced if required:
-    if ( _useDrawInstanced )
+    else if ( _useDrawInstanced )
     {
         DrawInstanced::convertGraphToUseDrawInstanced( attachPoint );
 
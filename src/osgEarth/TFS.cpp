@@ -288,7 +288,12 @@ TFSFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
             else if (options().format().value().compare("gml") == 0) mimeType = "text/xml";
             else if (options().format().value().compare("pbf") == 0) mimeType = "application/x-protobuf";
         }
-        dataOK = getFeatures(buffer, *query.tileKey(), mimeType, features);
+        // keep the FID attribute even if the query's projection omits it:
+        Query readQuery(query);
+        if (options().fidAttribute().isSet() && !readQuery.attributes().empty())
+            readQuery.attributes().push_back(options().fidAttribute().get());
+
+        dataOK = getFeatures(buffer, *query.tileKey(), readQuery, mimeType, features);
     }
 
     if (dataOK)
@@ -327,13 +332,13 @@ TFSFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
 
 
 bool
-TFSFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, const std::string& mimeType, FeatureList& features)
+TFSFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, const Query& query, const std::string& mimeType, FeatureList& features)
 {
     if (mimeType == "application/x-protobuf" || mimeType == "binary/octet-stream")
     {
 #ifdef OSGEARTH_HAVE_MVT
         std::stringstream in(buffer);
-        return MVT::readTile(in, key, features);
+        return MVT::readTile(in, key, query, features);
 #else
         if (getStatus().isOK())
         {
@@ -382,7 +387,7 @@ TFSFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, con
             {
                 if (feat_handle)
                 {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
+                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons(), query);
                     if (f.valid() && !isBlacklisted(f->getFID()))
                     {
                         features.push_back(f.release());
@@ -18,6 +18,7 @@
  */
 
 #include <osgEarth/Terrain>
+#include <osgEarth/TerrainRayIntersector>
 #include <osgViewer/View>
 
 #define LC "[Terrain] "
@@ -75,16 +76,12 @@ Terrain::update()
 }
 
 bool
-Terrain::getHeight(osg::Node*              patch,
-                   const SpatialReference* srs,
-                   double                  x, 
-                   double                  y, 
-                   double*                 out_hamsl,
-                   double*                 out_hae    ) const
+Terrain::getHeightSegment(const SpatialReference* srs,
+                          double                  x,
+                          double                  y,
+                          osg::Vec3d&             out_start,
+                          osg::Vec3d&             out_end) const
 {
-    if ( !_graph.valid() && !patch )
-        return 0L;
-
     // convert to map coordinates:
     if ( srs && !srs->isHorizEquivalentTo(getSRS()) )
     {
@@ -93,7 +90,7 @@ Terrain::getHeight(osg::Node*              patch,
 
     // trivially reject a point that lies outside the terrain:
     if ( !getProfile()->getExtent().contains(x, y) )
-        return 0L;
+        return false;
 
     if (srs && srs->isGeographic())
     {
@@ -111,20 +108,38 @@ Terrain::getHeight(osg::Node*              patch,
     double r = osg::minimum( em->getRadiusEquator(), em->getRadiusPolar() );
 
     // calculate the endpoints for an intersection test:
-    osg::Vec3d start(x, y, r);
-    osg::Vec3d end  (x, y, -r);
+    out_start.set(x, y, r);
+    out_end.set(x, y, -r);
 
     if ( getSRS()->isGeographic() )
     {
         const SpatialReference* ecef = getSRS()->getGeocentricSRS();
-        getSRS()->transform(start, ecef, start);
-        getSRS()->transform(end,   ecef, end);
+        getSRS()->transform(out_start, ecef, out_start);
+        getSRS()->transform(out_end,   ecef, out_end);
     }
 
-    osgUtil::LineSegmentIntersector* lsi = new osgUtil::LineSegmentIntersector( start, end );
+    return true;
+}
+
+bool
+Terrain::getHeight(osg::Node*              patch,
+                   const SpatialReference* srs,
+                   double                  x, 
+                   double                  y, 
+                   double*                 out_hamsl,
+                   double*                 out_hae    ) const
+{
+    if ( !_graph.valid() && !patch )
+        return 0L;
+
+    osg::Vec3d start, end;
+    if ( !getHeightSegment(srs, x, y, start, end) )
+        return 0L;
+
+    osg::ref_ptr<TerrainRayIntersector> lsi = new TerrainRayIntersector( start, end );
     lsi->setIntersectionLimit(osgUtil::Intersector::LIMIT_NEAREST);
 
-    osgUtil::IntersectionVisitor iv( lsi );
+    osgUtil::IntersectionVisitor iv( lsi.get() );
  
     if ( patch )
         patch->accept( iv );
@@ -158,6 +173,80 @@ Terrain::getHeight(const SpatialReference* srs,
 }
 
 
+unsigned
+Terrain::intersect(RayQueries& queries) const
+{
+    osg::ref_ptr<osg::Node> graph;
+    if ( queries.empty() || !_graph.lock(graph) )
+        return 0u;
+
+    // one intersector per segment, all run in the same traversal:
+    osg::ref_ptr<osgUtil::IntersectorGroup> group = new osgUtil::IntersectorGroup();
+    std::vector< osg::ref_ptr<TerrainRayIntersector> > intersectors(queries.size());
+
+    for(unsigned i=0; i<queries.size(); ++i)
+    {
+        intersectors[i] = new TerrainRayIntersector( queries[i].start, queries[i].end );
+        intersectors[i]->setIntersectionLimit( osgUtil::Intersector::LIMIT_NEAREST );
+        group->addIntersector( intersectors[i].get() );
+    }
+
+    osgUtil::IntersectionVisitor iv( group.get() );
+    graph->accept( iv );
+
+    unsigned hits = 0u;
+    for(unsigned i=0; i<queries.size(); ++i)
+    {
+        RayQuery& query = queries[i];
+        osgUtil::LineSegmentIntersector::Intersections& results = intersectors[i]->getIntersections();
+        query.hit = !results.empty();
+        if ( query.hit )
+        {
+            query.point = results.begin()->getWorldIntersectPoint();
+            query.normal = results.begin()->getWorldIntersectNormal();
+            ++hits;
+        }
+    }
+    return hits;
+}
+
+unsigned
+Terrain::getHeights(const SpatialReference*  srs,
+                    std::vector<osg::Vec3d>& points) const
+{
+    RayQueries queries;
+    queries.reserve(points.size());
+
+    // index of the query for each point, or -1 if it's off the terrain
+    std::vector<int> queryIndex(points.size(), -1);
+
+    for(unsigned i=0; i<points.size(); ++i)
+    {
+        osg::Vec3d start, end;
+        if ( getHeightSegment(srs, points[i].x(), points[i].y(), start, end) )
+        {
+            queryIndex[i] = queries.size();
+            queries.push_back( RayQuery(start, end) );
+        }
+    }
+
+    if ( intersect(queries) == 0u )
+        return 0u;
+
+    unsigned count = 0u;
+    for(unsigned i=0; i<points.size(); ++i)
+    {
+        if ( queryIndex[i] >= 0 && queries[queryIndex[i]].hit )
+        {
+            osg::Vec3d hit;
+            getSRS()->transformFromWorld(queries[queryIndex[i]].point, hit);
+            points[i].z() = hit.z();
+            ++count;
+        }
+    }
+    return count;
+}
+
 bool
 Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d& out_coords ) const
 {
@@ -196,8 +285,8 @@ Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d&
     osg::Vec3d startVertex = osg::Vec3d(local_x,local_y,zNear) * inverse;
     osg::Vec3d endVertex = osg::Vec3d(local_x,local_y,zFar) * inverse;
 
-    osg::ref_ptr< osgUtil::LineSegmentIntersector > picker = 
-        new osgUtil::LineSegmentIntersector(osgUtil::Intersector::MODEL, startVertex, endVertex);
+    osg::ref_ptr< TerrainRayIntersector > picker = 
+        new TerrainRayIntersector(osgUtil::Intersector::MODEL, startVertex, endVertex);
 
     // Limit it to one intersection; we only care about the nearest.
     picker->setIntersectionLimit( osgUtil::Intersector::LIMIT_NEAREST );
@@ -292,6 +381,15 @@ Terrain::notifyMapElevationChanged()
     }
 }
 
+void
+Terrain::queueUpdateOperation(osg::Operation* op)
+{
+    if (op)
+    {
+        _updateQueue->add(op);
+    }
+}
+
 void
 Terrain::fireMapElevationChanged()
 {
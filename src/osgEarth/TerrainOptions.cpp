@@ -63,6 +63,11 @@ TerrainOptions::getConfig() const
     conf.set( "morph_imagery", morphImagery() );
     conf.set( "merges_per_frame", mergesPerFrame() );
     conf.set( "priority_scale", priorityScale() );
+    conf.set( "prefetch", prefetch() );
+    conf.set( "prefetch_lookahead", prefetchLookahead() );
+    conf.set( "prefetch_max_requests", prefetchMaxRequests() );
+    conf.set( "prefetch_requests_per_second", prefetchRequestsPerSecond() );
+    conf.set( "prefetch_memory_budget", prefetchMemoryBudget() );
 
     return conf;
 }
@@ -102,6 +107,11 @@ TerrainOptions::fromConfig(const Config& conf)
     morphImagery().init(true);
     mergesPerFrame().init(20u);
     priorityScale().init(1.0f);
+    prefetch().init(false);
+    prefetchLookahead().init(10.0);
+    prefetchMaxRequests().init(2u);
+    prefetchRequestsPerSecond().init(20.0f);
+    prefetchMemoryBudget().init(128u);
 
     conf.get( "tile_size", _tileSize );
     conf.get( "vertical_scale", _verticalScale );
@@ -137,6 +147,11 @@ TerrainOptions::fromConfig(const Config& conf)
     conf.get( "morph_imagery", morphImagery() );
     conf.get( "merges_per_frame", mergesPerFrame() );
     conf.get( "priority_scale", priorityScale());
+    conf.get( "prefetch", prefetch() );
+    conf.get( "prefetch_lookahead", prefetchLookahead() );
+    conf.get( "prefetch_max_requests", prefetchMaxRequests() );
+    conf.get( "prefetch_requests_per_second", prefetchRequestsPerSecond() );
+    conf.get( "prefetch_memory_budget", prefetchMemoryBudget() );
 }
 
 //...................................................................
@@ -179,6 +194,11 @@ OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphTerrain, morphTerrain);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, MorphImagery, morphImagery);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, MergesPerFrame, mergesPerFrame);
 OE_PROPERTY_IMPL(TerrainOptionsAPI, float, PriorityScale, priorityScale);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, bool, Prefetch, prefetch);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, double, PrefetchLookahead, prefetchLookahead);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, PrefetchMaxRequests, prefetchMaxRequests);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, float, PrefetchRequestsPerSecond, prefetchRequestsPerSecond);
+OE_PROPERTY_IMPL(TerrainOptionsAPI, unsigned, PrefetchMemoryBudget, prefetchMemoryBudget);
 
 void
 TerrainOptionsAPI::setDriver(const std::string& value)
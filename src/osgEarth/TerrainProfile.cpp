@@ -20,12 +20,368 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarth/TerrainProfile>
+#include <osgEarth/TerrainProfileImpl>
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/GeoMath>
+#include <osgEarth/ThreadingUtils>
+#include <algorithm>
+#include <cmath>
 
 using namespace osgEarth;
 using namespace osgEarth::Contrib;
 
+namespace
+{
+    // length of the independently refreshed segments of an elevation profile
+    const double SEGMENT_LENGTH = 20000.0;
+
+    // upper bound on the number of samples a profile needs at its finest spacing
+    const double MAX_FULL_RES_SAMPLES = 8192.0;
+
+    struct Sample
+    {
+        double distance;
+        float elevation;
+    };
+
+    struct SortByDistance
+    {
+        bool operator()(const std::pair<double,double>& lhs, const std::pair<double,double>& rhs) const {
+            return lhs.first < rhs.first;
+        }
+    };
+
+    // Records the source tile under each point along with its revision. Called
+    // before the points are queried, so a change that lands during the query
+    // leaves an old revision behind and is picked up next time.
+    void recordSources(const std::vector<osg::Vec3d>& points,
+                       const Profile* profile,
+                       Internal::ProfileElevationSource* source,
+                       unsigned lod,
+                       std::map<TileKey, unsigned>& sources)
+    {
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            TileKey key = profile->createTileKey(points[i].x(), points[i].y(), lod);
+            if (key.valid() && sources.find(key) == sources.end())
+                sources[key] = source->getRevision(key);
+        }
+    }
+
+    // Elevation data from a map's elevation pool. Takes a snapshot of the
+    // map's elevation layers so that it can be used from a worker thread.
+    class MapElevationSource : public Internal::ProfileElevationSource
+    {
+    public:
+        MapElevationSource(const Map* map) :
+            _map(map),
+            _pool(map->getElevationPool())
+        {
+            map->getLayers(_layers);
+        }
+
+        const Profile* getProfile() const
+        {
+            return _map->getProfile();
+        }
+
+        unsigned getTileSize() const
+        {
+            return _pool->getTileSize();
+        }
+
+        // Combines the identity and revision of every elevation layer that
+        // has data for the key, so adding, removing or changing a layer only
+        // changes the revision of the tiles it covers.
+        unsigned getRevision(const TileKey& key) const
+        {
+            unsigned revision = 0u;
+            for (ElevationLayerVector::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+            {
+                const ElevationLayer* layer = i->get();
+                if (!layer->isOpen() || !layer->getEnabled())
+                    continue;
+
+                if (!layer->getBestAvailableTileKey(key).valid())
+                    continue;
+
+                revision = revision * 31u + (unsigned)layer->getUID();
+                revision = revision * 31u + layer->getRevision();
+            }
+            return revision;
+        }
+
+        void getElevations(const std::vector<osg::Vec3d>& points, unsigned lod, std::vector<float>& out)
+        {
+            if (!_envelope.valid() || _envelope->getLOD() != lod)
+                _envelope = _pool->createEnvelope(getProfile()->getSRS(), lod);
+
+            _envelope->getElevations(points, out);
+        }
+
+    private:
+        osg::ref_ptr<const Map> _map;
+        osg::ref_ptr<ElevationPool> _pool;
+        osg::ref_ptr<ElevationEnvelope> _envelope;
+        ElevationLayerVector _layers;
+    };
+}
+
+/***************************************************/
+Internal::ProfileSampler::ProfileSampler() :
+_length(0.0),
+_bearing(0.0),
+_tolerance(1.0),
+_minSpacing(10.0),
+_maxSpacing(500.0)
+{
+}
+
+Internal::ProfileSampler::ProfileSampler(const ProfileSampler& rhs) :
+osg::Referenced(),
+_start(rhs._start),
+_end(rhs._end),
+_srs(rhs._srs),
+_length(rhs._length),
+_bearing(rhs._bearing),
+_tolerance(rhs._tolerance),
+_minSpacing(rhs._minSpacing),
+_maxSpacing(rhs._maxSpacing),
+_segments(rhs._segments)
+{
+}
+
+void
+Internal::ProfileSampler::setPath(const GeoPoint& start, const GeoPoint& end)
+{
+    _start = start.vec3d();
+    _end = end.vec3d();
+    _srs = start.getSRS();
+
+    // a great circle on geographic maps and a straight line on projected maps
+    if (_srs->isGeographic())
+    {
+        double lat1 = osg::DegreesToRadians(_start.y()), lon1 = osg::DegreesToRadians(_start.x());
+        double lat2 = osg::DegreesToRadians(_end.y()), lon2 = osg::DegreesToRadians(_end.x());
+        _length = GeoMath::distance(lat1, lon1, lat2, lon2);
+        _bearing = GeoMath::bearing(lat1, lon1, lat2, lon2);
+    }
+    else
+    {
+        _length = (osg::Vec2d(_end.x(), _end.y()) - osg::Vec2d(_start.x(), _start.y())).length();
+        _bearing = 0.0;
+    }
+
+    unsigned numSegments = (unsigned)osg::maximum(ceil(_length / SEGMENT_LENGTH), 1.0);
+    _segments.assign(numSegments, Segment());
+    for (unsigned i = 0; i < numSegments; ++i)
+    {
+        _segments[i].start = _length * (double)i / (double)numSegments;
+        _segments[i].end = _length * (double)(i + 1) / (double)numSegments;
+    }
+}
+
+osg::Vec3d
+Internal::ProfileSampler::at(double distance) const
+{
+    if (_length <= 0.0)
+        return _start;
+
+    if (_srs->isGeographic())
+    {
+        double lat, lon;
+        GeoMath::destination(
+            osg::DegreesToRadians(_start.y()), osg::DegreesToRadians(_start.x()),
+            _bearing, distance, lat, lon);
+        return osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), 0.0);
+    }
+
+    double t = distance / _length;
+    return osg::Vec3d(_start.x() + (_end.x() - _start.x())*t, _start.y() + (_end.y() - _start.y())*t, 0.0);
+}
+
+unsigned
+Internal::ProfileSampler::update(ProfileElevationSource* source, const std::vector<GeoExtent>* changed)
+{
+    if (!source || !_srs.valid())
+        return 0u;
+
+    // finest spacing, limited so that long paths stay cheap:
+    double resolution = osg::maximum(_minSpacing, _length / MAX_FULL_RES_SAMPLES);
+    double maxSpacing = osg::maximum(_maxSpacing, resolution);
+
+    // query elevations at the level that matches the finest spacing:
+    const Profile* profile = source->getProfile();
+    double profileResolution = SpatialReference::transformUnits(
+        Distance(resolution, Units::METERS),
+        profile->getSRS(),
+        _srs->isGeographic() ? _start.y() : 0.0);
+    unsigned lod = profile->getLevelOfDetailForHorizResolution(profileResolution, source->getTileSize());
+
+    unsigned count = 0u;
+    for (std::vector<Segment>::iterator seg = _segments.begin(); seg != _segments.end(); ++seg)
+    {
+        if (isStale(*seg, source, lod, changed))
+        {
+            sample(*seg, source, lod, resolution, maxSpacing);
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool
+Internal::ProfileSampler::isStale(const Segment& seg,
+                                  ProfileElevationSource* source,
+                                  unsigned lod,
+                                  const std::vector<GeoExtent>* changed) const
+{
+    if (seg.samplings == 0u || seg.lod != lod)
+        return true;
+
+    for (std::map<TileKey, unsigned>::const_iterator i = seg.sources.begin(); i != seg.sources.end(); ++i)
+    {
+        // tiles outside the changed areas can't have changed
+        if (changed)
+        {
+            bool touched = false;
+            for (unsigned c = 0; c < changed->size() && !touched; ++c)
+                touched = (*changed)[c].intersects(i->first.getExtent());
+            if (!touched)
+                continue;
+        }
+
+        if (source->getRevision(i->first) != i->second)
+            return true;
+    }
+    return false;
+}
+
+void
+Internal::ProfileSampler::sample(Segment& seg,
+                                 ProfileElevationSource* source,
+                                 unsigned lod,
+                                 double resolution,
+                                 double maxSpacing)
+{
+    const Profile* profile = source->getProfile();
+
+    seg.samples.clear();
+    seg.sources.clear();
+    seg.extent = GeoExtent(_srs.get());
+    seg.lod = lod;
+    ++seg.samplings;
+
+    std::vector<osg::Vec3d> points;
+    std::vector<float> elevations;
+    std::vector<Sample> mids;
+    std::vector<std::pair<Sample, Sample> > pending, next;
+
+    // coarse pass at the maximum spacing:
+    double length = seg.end - seg.start;
+    unsigned n = (unsigned)osg::maximum(ceil(length / maxSpacing), 1.0);
+
+    for (unsigned k = 0; k <= n; ++k)
+        points.push_back(at(seg.start + length * (double)k / (double)n));
+
+    recordSources(points, profile, source, lod, seg.sources);
+    source->getElevations(points, lod, elevations);
+
+    Sample prev = { 0.0, NO_DATA_VALUE };
+    bool prevValid = false;
+    for (unsigned k = 0; k <= n; ++k)
+    {
+        seg.extent.expandToInclude(points[k].x(), points[k].y());
+
+        Sample s;
+        s.distance = seg.start + length * (double)k / (double)n;
+        s.elevation = elevations[k];
+        bool valid = s.elevation != NO_DATA_VALUE;
+
+        if (valid)
+        {
+            seg.samples.push_back(std::make_pair(s.distance, (double)s.elevation));
+            if (prevValid)
+                pending.push_back(std::make_pair(prev, s));
+        }
+        prev = s;
+        prevValid = valid;
+    }
+
+    // refine: split an interval wherever its midpoint strays from the
+    // straight line between its ends, one level at a time so every pass
+    // is a single bulk query.
+    while (!pending.empty())
+    {
+        points.clear();
+        mids.clear();
+        next.clear();
+
+        for (unsigned i = 0; i < pending.size(); ++i)
+        {
+            const Sample& a = pending[i].first;
+            const Sample& b = pending[i].second;
+            if (b.distance - a.distance < 2.0*resolution)
+                continue;
+
+            Sample m;
+            m.distance = 0.5*(a.distance + b.distance);
+            mids.push_back(m);
+            points.push_back(at(m.distance));
+            next.push_back(pending[i]);
+        }
+
+        if (points.empty())
+            break;
+
+        recordSources(points, profile, source, lod, seg.sources);
+        source->getElevations(points, lod, elevations);
+
+        pending.clear();
+        for (unsigned i = 0; i < mids.size(); ++i)
+        {
+            Sample& m = mids[i];
+            m.elevation = elevations[i];
+            if (m.elevation == NO_DATA_VALUE)
+                continue;
+
+            seg.samples.push_back(std::make_pair(m.distance, (double)m.elevation));
+
+            const Sample& a = next[i].first;
+            const Sample& b = next[i].second;
+            double error = fabs((double)m.elevation - 0.5*((double)a.elevation + (double)b.elevation));
+            if (error > _tolerance)
+            {
+                pending.push_back(std::make_pair(a, m));
+                pending.push_back(std::make_pair(m, b));
+            }
+        }
+    }
+
+    std::sort(seg.samples.begin(), seg.samples.end(), SortByDistance());
+}
+
+void
+Internal::ProfileSampler::getSamples(std::vector< std::pair<double,double> >& out) const
+{
+    // neighboring segments share their boundary sample
+    double last = -DBL_MAX;
+    for (std::vector<Segment>::const_iterator seg = _segments.begin(); seg != _segments.end(); ++seg)
+    {
+        for (unsigned i = 0; i < seg->samples.size(); ++i)
+        {
+            if (seg->samples[i].first > last)
+            {
+                out.push_back(seg->samples[i]);
+                last = seg->samples[i].first;
+            }
+        }
+    }
+}
+
 /***************************************************/
 TerrainProfile::TerrainProfile():
 _spacing( 1.0 )
@@ -93,14 +449,28 @@ TerrainProfile::getElevationRanges(double &min, double &max ) const
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode, const GeoPoint& start, const GeoPoint& end):
 _mapNode( mapNode ),
 _start( start),
-_end( end )
+_end( end ),
+_computeMethod( METHOD_INTERSECT ),
+_tolerance( 1.0 ),
+_minSpacing( 10.0 ),
+_maxSpacing( 500.0 ),
+_changedAll( false ),
+_updating( false ),
+_generation( 0u )
 {        
     _mapNode->getTerrain()->addTerrainCallback( this );        
     recompute();
 }
 
 TerrainProfileCalculator::TerrainProfileCalculator(MapNode* mapNode):
-_mapNode( mapNode )
+_mapNode( mapNode ),
+_computeMethod( METHOD_INTERSECT ),
+_tolerance( 1.0 ),
+_minSpacing( 10.0 ),
+_maxSpacing( 500.0 ),
+_changedAll( false ),
+_updating( false ),
+_generation( 0u )
 {
     _mapNode->getTerrain()->addTerrainCallback( this );
 }
@@ -184,8 +554,56 @@ void TerrainProfileCalculator::setStartEnd(const GeoPoint& start, const GeoPoint
     }
 }
 
+void TerrainProfileCalculator::setComputeMethod(ComputeMethod method)
+{
+    if (_computeMethod != method)
+    {
+        _computeMethod = method;
+        _sampler = 0L;
+        recompute();
+    }
+}
+
+void TerrainProfileCalculator::setTolerance(double meters)
+{
+    if (_tolerance != meters)
+    {
+        _tolerance = osg::maximum(meters, 0.0);
+        if (_computeMethod == METHOD_ELEVATION)
+            recompute();
+    }
+}
+
+void TerrainProfileCalculator::setSampleSpacing(double minMeters, double maxMeters)
+{
+    if (_minSpacing != minMeters || _maxSpacing != maxMeters)
+    {
+        _minSpacing = osg::maximum(minMeters, 0.01);
+        _maxSpacing = osg::maximum(maxMeters, _minSpacing);
+        if (_computeMethod == METHOD_ELEVATION)
+            recompute();
+    }
+}
+
 void TerrainProfileCalculator::onTileUpdate(const osgEarth::TileKey& tileKey, osg::Node* graph, TerrainCallbackContext&)
 {
+    if (_computeMethod == METHOD_ELEVATION)
+    {
+        // Tiles paging in land here as well as real elevation changes, so
+        // just note where the terrain changed; a worker checks the revisions
+        // of the elevation tiles there and resamples what changed.
+        if (_sampler.valid())
+        {
+            if (tileKey.valid())
+                _changedExtents.push_back(tileKey.getExtent());
+            else
+                _changedAll = true; // the map's elevation data changed
+
+            scheduleUpdate();
+        }
+        return;
+    }
+
     if (_start.isValid() && _end.isValid())
     {
         GeoExtent extent( _start.getSRS());
@@ -201,22 +619,157 @@ void TerrainProfileCalculator::onTileUpdate(const osgEarth::TileKey& tileKey, os
 
 void TerrainProfileCalculator::recompute()
 {
-    if (_start.isValid() && _end.isValid())
+    if (_start.isValid() && _end.isValid() && _mapNode.valid())
     {
-        computeTerrainProfile( _mapNode.get(), _start, _end, _profile);
+        if (_computeMethod == METHOD_ELEVATION)
+        {
+            // supersedes any update in flight
+            ++_generation;
+            _changedExtents.clear();
+            _changedAll = false;
 
-        for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+            osg::ref_ptr<MapElevationSource> source = new MapElevationSource(_mapNode->getMap());
+            _sampler = createSampler();
+            _sampler->update(source.get(), 0L);
+            assembleProfile();
+        }
+        else
         {
-            if ( i->get() )
-                i->get()->onChanged(this);
+            computeTerrainProfile( _mapNode.get(), _start, _end, _profile);
         }
+
+        fireChanged();
     }
     else
     {
+        _sampler = 0L;
         _profile.clear();
     }
 }
 
+void TerrainProfileCalculator::fireChanged()
+{
+    for( ChangedCallbackList::iterator i = _changedCallbacks.begin(); i != _changedCallbacks.end(); i++ )
+    {
+        if ( i->get() )
+            i->get()->onChanged(this);
+    }
+}
+
+Internal::ProfileSampler* TerrainProfileCalculator::createSampler() const
+{
+    const SpatialReference* mapSRS = _mapNode->getMap()->getSRS();
+
+    Internal::ProfileSampler* sampler = new Internal::ProfileSampler();
+    sampler->setTolerance(_tolerance);
+    sampler->setSampleSpacing(_minSpacing, _maxSpacing);
+    sampler->setPath(_start.transform(mapSRS), _end.transform(mapSRS));
+    return sampler;
+}
+
+// Resamples a copy of the calculator's segments in a worker thread, then
+// runs again during the terrain's update traversal to hand the copy back.
+struct TerrainProfileCalculator::UpdateSegmentsOperation : public osg::Operation
+{
+    UpdateSegmentsOperation(TerrainProfileCalculator* calculator, Terrain* terrain, Internal::ProfileSampler* sampler, Internal::ProfileElevationSource* source, unsigned generation) :
+        osg::Operation("TerrainProfileCalculator update", false),
+        _calculator(calculator),
+        _terrain(terrain),
+        _sampler(sampler),
+        _source(source),
+        _changedAll(false),
+        _generation(generation),
+        _numSampled(0u),
+        _sampled(false)
+    {
+    }
+
+    void operator()(osg::Object*)
+    {
+        if (!_sampled)
+        {
+            _numSampled = _sampler->update(_source.get(), _changedAll ? 0L : &_changed);
+            _sampled = true;
+
+            osg::ref_ptr<Terrain> terrain;
+            if (_terrain.lock(terrain))
+                terrain->queueUpdateOperation(this);
+        }
+        else
+        {
+            osg::ref_ptr<TerrainProfileCalculator> calculator;
+            if (_calculator.lock(calculator))
+                calculator->installUpdate(_sampler.get(), _generation, _numSampled);
+        }
+    }
+
+    osg::observer_ptr<TerrainProfileCalculator> _calculator;
+    osg::observer_ptr<Terrain> _terrain;
+    osg::ref_ptr<Internal::ProfileSampler> _sampler;
+    osg::ref_ptr<Internal::ProfileElevationSource> _source;
+    std::vector<GeoExtent> _changed;
+    bool _changedAll;
+    unsigned _generation;
+    unsigned _numSampled;
+    bool _sampled;
+};
+
+void TerrainProfileCalculator::scheduleUpdate()
+{
+    // one update at a time; changes that arrive meanwhile wait for the next
+    if (_updating || !_sampler.valid() || !_mapNode.valid())
+        return;
+
+    if (_changedExtents.empty() && !_changedAll)
+        return;
+
+    _updating = true;
+
+    osg::ref_ptr<UpdateSegmentsOperation> op = new UpdateSegmentsOperation(
+        this,
+        _mapNode->getTerrain(),
+        new Internal::ProfileSampler(*_sampler.get()),
+        new MapElevationSource(_mapNode->getMap()),
+        _generation);
+
+    op->_changed.swap(_changedExtents);
+    op->_changedAll = _changedAll;
+    _changedAll = false;
+
+    Threading::ThreadPool::getShared()->getQueue()->add(op.get());
+}
+
+void TerrainProfileCalculator::installUpdate(Internal::ProfileSampler* sampler, unsigned generation, unsigned numSampled)
+{
+    _updating = false;
+
+    // a recompute() since the update started has already replaced the sampler
+    if (generation == _generation && numSampled > 0u)
+    {
+        _sampler = sampler;
+        assembleProfile();
+        fireChanged();
+    }
+
+    // pick up tiles that changed while the worker ran
+    scheduleUpdate();
+}
+
+void TerrainProfileCalculator::assembleProfile()
+{
+    _profile.clear();
+
+    if (_sampler.valid())
+    {
+        std::vector< std::pair<double,double> > samples;
+        _sampler->getSamples(samples);
+        for (unsigned i = 0; i < samples.size(); ++i)
+        {
+            _profile.addElevation(samples[i].first, samples[i].second);
+        }
+    }
+}
+
 void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode, const GeoPoint& start, const GeoPoint& end, TerrainProfile& profile)
 {
     osg::Vec3d startvec, endvec;
@@ -0,0 +1,430 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TerrainRayIntersector>
+#include <osgUtil/IntersectionVisitor>
+#include <algorithm>
+#include <cfloat>
+
+using namespace osgEarth;
+
+#define LC "[TerrainRayIntersector] "
+
+// largest block of grid cells in a BVH leaf, in each direction
+#define LEAF_CELLS 4u
+
+namespace
+{
+    // Clips the segment start + t*dir against a box, and returns the entry
+    // parameter if any part of [0, tmax] lies inside it.
+    inline bool hitBox(const osg::BoundingBoxf& box,
+                       const osg::Vec3d& start,
+                       const osg::Vec3d& invDir,
+                       double tmax,
+                       double& out_enter)
+    {
+        double t0 = 0.0, t1 = tmax;
+        for (int i = 0; i < 3; ++i)
+        {
+            double tn = ((double)box._min[i] - start[i]) * invDir[i];
+            double tf = ((double)box._max[i] - start[i]) * invDir[i];
+            if (tn > tf) std::swap(tn, tf);
+            if (tn > t0) t0 = tn;
+            if (tf < t1) t1 = tf;
+            if (t0 > t1) return false;
+        }
+        out_enter = t0;
+        return true;
+    }
+
+    // Double-sided segment/triangle test (Moller-Trumbore). The hit
+    // parameter goes in out_t, in [0..1] along start + t*dir.
+    inline bool hitTriangle(const osg::Vec3d& start,
+                            const osg::Vec3d& dir,
+                            const osg::Vec3d& v0,
+                            const osg::Vec3d& v1,
+                            const osg::Vec3d& v2,
+                            double& out_t)
+    {
+        osg::Vec3d e1 = v1 - v0;
+        osg::Vec3d e2 = v2 - v0;
+        osg::Vec3d p = dir ^ e2;
+        double det = e1 * p;
+        if (det == 0.0)
+            return false;
+
+        double invDet = 1.0 / det;
+        osg::Vec3d tv = start - v0;
+        double u = (tv * p) * invDet;
+        if (u < 0.0 || u > 1.0)
+            return false;
+
+        osg::Vec3d q = tv ^ e1;
+        double v = (dir * q) * invDet;
+        if (v < 0.0 || u + v > 1.0)
+            return false;
+
+        out_t = (e2 * q) * invDet;
+        return out_t >= 0.0 && out_t <= 1.0;
+    }
+}
+
+//........................................................................
+
+TileMeshBVH::TileMeshBVH() :
+_cols(0u),
+_rows(0u)
+{
+    //nop
+}
+
+TileMeshBVH::TileMeshBVH(const TileMeshBVH& rhs, const osg::CopyOp& copyop) :
+osg::Shape(rhs, copyop),
+_nodes(rhs._nodes),
+_verts(rhs._verts),
+_cols(rhs._cols),
+_rows(rhs._rows)
+{
+    //nop
+}
+
+void
+TileMeshBVH::build(osg::Vec3Array* verts, unsigned cols, unsigned rows)
+{
+    _nodes.clear();
+    _verts = verts;
+    _cols = cols;
+    _rows = rows;
+
+    if (!verts || cols < 2 || rows < 2 || verts->size() < cols*rows || cols > 0xFFFF || rows > 0xFFFF)
+        return;
+
+    unsigned leaves =
+        ((cols - 1 + LEAF_CELLS - 1) / LEAF_CELLS) *
+        ((rows - 1 + LEAF_CELLS - 1) / LEAF_CELLS);
+
+    _nodes.reserve(2u * leaves);
+    buildNode(0u, 0u, cols - 1, rows - 1);
+}
+
+unsigned
+TileMeshBVH::buildNode(unsigned c0, unsigned r0, unsigned c1, unsigned r1)
+{
+    unsigned index = _nodes.size();
+    _nodes.push_back(Node());
+
+    osg::BoundingBoxf box;
+    unsigned right = 0u;
+
+    if (c1 - c0 > LEAF_CELLS || r1 - r0 > LEAF_CELLS)
+    {
+        // split the longer side in half:
+        if (c1 - c0 >= r1 - r0)
+        {
+            unsigned cm = (c0 + c1) / 2;
+            buildNode(c0, r0, cm, r1);
+            right = buildNode(cm, r0, c1, r1);
+        }
+        else
+        {
+            unsigned rm = (r0 + r1) / 2;
+            buildNode(c0, r0, c1, rm);
+            right = buildNode(c0, rm, c1, r1);
+        }
+
+        box.expandBy(_nodes[index + 1].box);
+        box.expandBy(_nodes[right].box);
+    }
+    else
+    {
+        const osg::Vec3Array& verts = *_verts.get();
+        for (unsigned r = r0; r <= r1; ++r)
+            for (unsigned c = c0; c <= c1; ++c)
+                box.expandBy(verts[r*_cols + c]);
+
+        // pad a little so that rounding in the slab test never rejects
+        // a triangle lying in the face of the box
+        float pad = 1e-4f * (box.radius() + 1.0f);
+        box._min -= osg::Vec3f(pad, pad, pad);
+        box._max += osg::Vec3f(pad, pad, pad);
+    }
+
+    // (the vector may have grown during recursion)
+    Node& node = _nodes[index];
+    node.box = box;
+    node.c0 = c0, node.r0 = r0, node.c1 = c1, node.r1 = r1;
+    node.right = right;
+    return index;
+}
+
+bool
+TileMeshBVH::intersectCells(const Node& node,
+                            const osg::Vec3d& start,
+                            const osg::Vec3d& dir,
+                            double& inout_ratio,
+                            osg::Vec3d& out_normal,
+                            unsigned& out_triangle) const
+{
+    const osg::Vec3Array& verts = *_verts.get();
+    bool hit = false;
+    double t;
+
+    for (unsigned r = node.r0; r < node.r1; ++r)
+    {
+        for (unsigned c = node.c0; c < node.c1; ++c)
+        {
+            unsigned i00 = r*_cols + c;
+            unsigned i10 = i00 + 1;
+            unsigned i01 = i00 + _cols;
+            unsigned i11 = i01 + 1;
+            unsigned tri = 2u * (r*(_cols - 1) + c);
+
+            osg::Vec3d v00(verts[i00]), v10(verts[i10]), v01(verts[i01]), v11(verts[i11]);
+
+            if (hitTriangle(start, dir, v00, v10, v01, t) && t < inout_ratio)
+            {
+                inout_ratio = t;
+                out_normal = (v10 - v00) ^ (v01 - v00);
+                out_triangle = tri;
+                hit = true;
+            }
+
+            if (hitTriangle(start, dir, v01, v10, v11, t) && t < inout_ratio)
+            {
+                inout_ratio = t;
+                out_normal = (v10 - v01) ^ (v11 - v01);
+                out_triangle = tri + 1;
+                hit = true;
+            }
+        }
+    }
+    return hit;
+}
+
+bool
+TileMeshBVH::intersect(const osg::Vec3d& start,
+                       const osg::Vec3d& end,
+                       double& out_ratio,
+                       osg::Vec3d& out_normal,
+                       unsigned& out_triangle) const
+{
+    if (_nodes.empty())
+        return false;
+
+    osg::Vec3d dir = end - start;
+    osg::Vec3d invDir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+
+    double best = DBL_MAX;
+    double enter;
+
+    if (!hitBox(_nodes[0].box, start, invDir, 1.0, enter))
+        return false;
+
+    // depth-first, nearer child first, skipping anything that starts
+    // beyond the best hit so far
+    struct Entry { unsigned index; double enter; };
+    Entry stack[64];
+    int top = 0;
+    stack[top].index = 0u, stack[top].enter = enter, ++top;
+
+    bool hit = false;
+
+    while (top > 0)
+    {
+        const Entry entry = stack[--top];
+        if (entry.enter >= best)
+            continue;
+
+        const Node& node = _nodes[entry.index];
+
+        if (node.right == 0u)
+        {
+            if (intersectCells(node, start, dir, best, out_normal, out_triangle))
+                hit = true;
+            continue;
+        }
+
+        unsigned left = entry.index + 1;
+        double tmax = osg::minimum(best, 1.0);
+        double enterLeft = 0.0, enterRight = 0.0;
+        bool hitLeft = hitBox(_nodes[left].box, start, invDir, tmax, enterLeft);
+        bool hitRight = hitBox(_nodes[node.right].box, start, invDir, tmax, enterRight);
+
+        if (hitLeft && hitRight)
+        {
+            // push the farther one first so the nearer one pops first
+            if (enterLeft <= enterRight)
+            {
+                stack[top].index = node.right, stack[top].enter = enterRight, ++top;
+                stack[top].index = left, stack[top].enter = enterLeft, ++top;
+            }
+            else
+            {
+                stack[top].index = left, stack[top].enter = enterLeft, ++top;
+                stack[top].index = node.right, stack[top].enter = enterRight, ++top;
+            }
+        }
+        else if (hitLeft)
+        {
+            stack[top].index = left, stack[top].enter = enterLeft, ++top;
+        }
+        else if (hitRight)
+        {
+            stack[top].index = node.right, stack[top].enter = enterRight, ++top;
+        }
+    }
+
+    if (hit)
+    {
+        out_ratio = best;
+        out_normal.normalize();
+    }
+    return hit;
+}
+
+bool
+TileMeshBVH::intersectBruteForce(const osg::Vec3d& start,
+                                 const osg::Vec3d& end,
+                                 double& out_ratio,
+                                 osg::Vec3d& out_normal,
+                                 unsigned& out_triangle) const
+{
+    if (_nodes.empty())
+        return false;
+
+    Node all;
+    all.c0 = 0, all.r0 = 0, all.c1 = _cols - 1, all.r1 = _rows - 1;
+
+    double best = DBL_MAX;
+    if (!intersectCells(all, start, end - start, best, out_normal, out_triangle))
+        return false;
+
+    out_ratio = best;
+    out_normal.normalize();
+    return true;
+}
+
+//........................................................................
+
+TerrainRayIntersector::TerrainRayIntersector(const osg::Vec3d& start, const osg::Vec3d& end) :
+osgUtil::LineSegmentIntersector(start, end)
+{
+    //nop
+}
+
+TerrainRayIntersector::TerrainRayIntersector(CoordinateFrame cf, const osg::Vec3d& start, const osg::Vec3d& end) :
+osgUtil::LineSegmentIntersector(cf, start, end)
+{
+    //nop
+}
+
+osgUtil::Intersector*
+TerrainRayIntersector::clone(osgUtil::IntersectionVisitor& iv)
+{
+    if (_coordinateFrame == MODEL && iv.getModelMatrix() == 0)
+    {
+        osg::ref_ptr<TerrainRayIntersector> lsi = new TerrainRayIntersector(_start, _end);
+        lsi->_parent = this;
+        lsi->_intersectionLimit = _intersectionLimit;
+        lsi->setPrecisionHint(getPrecisionHint());
+        return lsi.release();
+    }
+
+    // compute the matrix that takes this Intersector from its CoordinateFrame into the local MODEL coordinate frame
+    // that geometry in the scene graph will always be in.
+    osg::Matrix matrix;
+
+    switch (_coordinateFrame)
+    {
+        case(WINDOW):
+            if (iv.getWindowMatrix()) matrix.preMult( *iv.getWindowMatrix() );
+            if (iv.getProjectionMatrix()) matrix.preMult( *iv.getProjectionMatrix() );
+            if (iv.getViewMatrix()) matrix.preMult( *iv.getViewMatrix() );
+            if (iv.getModelMatrix()) matrix.preMult( *iv.getModelMatrix() );
+            break;
+        case(PROJECTION):
+            if (iv.getProjectionMatrix()) matrix.preMult( *iv.getProjectionMatrix() );
+            if (iv.getViewMatrix()) matrix.preMult( *iv.getViewMatrix() );
+            if (iv.getModelMatrix()) matrix.preMult( *iv.getModelMatrix() );
+            break;
+        case(VIEW):
+            if (iv.getViewMatrix()) matrix.preMult( *iv.getViewMatrix() );
+            if (iv.getModelMatrix()) matrix.preMult( *iv.getModelMatrix() );
+            break;
+        case(MODEL):
+            if (iv.getModelMatrix()) matrix = *iv.getModelMatrix();
+            break;
+    }
+
+    osg::Matrix inverse;
+    inverse.invert(matrix);
+
+    osg::ref_ptr<TerrainRayIntersector> lsi = new TerrainRayIntersector(_start * inverse, _end * inverse);
+    lsi->_parent = this;
+    lsi->_intersectionLimit = _intersectionLimit;
+    lsi->setPrecisionHint(getPrecisionHint());
+    return lsi.release();
+}
+
+void
+TerrainRayIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawable* drawable)
+{
+    if (reachedLimit()) return;
+
+    const TileMeshBVH* bvh = iv.getUseKdTreeWhenAvailable() ?
+        dynamic_cast<const TileMeshBVH*>(drawable->getShape()) : 0L;
+
+    if (!bvh || !bvh->valid())
+    {
+        osgUtil::LineSegmentIntersector::intersect(iv, drawable);
+        return;
+    }
+
+    osg::Vec3d s(_start), e(_end);
+    if (!intersectAndClip(s, e, drawable->getBoundingBox())) return;
+
+    if (iv.getDoDummyTraversal()) return;
+
+    double ratio;
+    osg::Vec3d normal;
+    unsigned triangle;
+    if (!bvh->intersect(s, e, ratio, normal, triangle))
+        return;
+
+    // remap ratio into _start, _end range
+    double remap_ratio = ((s - _start).length() + ratio * (e - s).length()) / (_end - _start).length();
+
+    if (_intersectionLimit == LIMIT_NEAREST && !getIntersections().empty())
+    {
+        if (remap_ratio >= getIntersections().begin()->ratio)
+            return;
+        else
+            getIntersections().clear();
+    }
+
+    Intersection hit;
+    hit.ratio = remap_ratio;
+    hit.matrix = iv.getModelMatrix();
+    hit.nodePath = iv.getNodePath();
+    hit.drawable = drawable;
+    hit.primitiveIndex = triangle;
+    hit.localIntersectionPoint = _start*(1.0 - remap_ratio) + _end*remap_ratio;
+    hit.localIntersectionNormal = normal;
+
+    insertIntersection(hit);
+}
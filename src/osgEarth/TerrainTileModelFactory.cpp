@@ -26,6 +26,8 @@
 #include <osg/Texture2D>
 #include <osg/Texture2DArray>
 
+#include <cstring>
+
 #define LC "[TerrainTileModelFactory] "
 
 using namespace osgEarth;
@@ -522,18 +524,63 @@ TerrainTileModelFactory::getOrCreateHeightField(
         return true;
     }
 
+    if (!out_normalMap.valid() && _options.normalMaps() == true)
+    {
+        out_normalMap = new NormalMap(257, 257);
+    }
+
+    // When edge normalization is on, sample a 1-texel border for the normal
+    // map even if the caller didn't ask for one. The normals along each edge
+    // then come from real neighbor data and match the adjacent tile exactly,
+    // so the engine doesn't have to patch them up after the fact.
+    bool borderForNormals =
+        !out_hf.valid() &&
+        out_normalMap.valid() &&
+        border == 0u &&
+        _options.normalizeEdges() == true;
+
     if ( !out_hf.valid() )
     {
         out_hf = HeightFieldUtils::createReferenceHeightField(
             key.getExtent(),
             257, 257,           // base tile size for elevation data
-            border,             // 1 sample border around the data makes it 259x259
+            borderForNormals ? 1u : border, // 1 sample border around the data makes it 259x259
             true);              // initialize to HAE (0.0) heights
     }
 
-    if (!out_normalMap.valid() && _options.normalMaps() == true)
+    // Border samples come from neighbors already in the quick cache when
+    // possible; the rest are sampled from the layers' neighboring tiles.
+    bool bordered = borderForNormals || border > 0u;
+    HeightFieldNeighborhood neighbors;
+    if (bordered && _heightFieldCacheEnabled)
     {
-        out_normalMap = new NormalMap(257, 257);
+        unsigned tilesX, tilesY;
+        key.getProfile()->getNumTiles(key.getLOD(), tilesX, tilesY);
+        bool wrapX = key.getProfile()->getSRS()->isGeographic();
+
+        for (int y = -1; y <= 1; ++y)
+        {
+            // createNeighborKey wraps in y as well; don't sample across a pole.
+            int ty = (int)key.getTileY() + y;
+            if (ty < 0 || ty >= (int)tilesY)
+                continue;
+
+            for (int x = -1; x <= 1; ++x)
+            {
+                int tx = (int)key.getTileX() + x;
+                if ((x == 0 && y == 0) || (!wrapX && (tx < 0 || tx >= (int)tilesX)))
+                    continue;
+
+                HFCacheKey neighborKey(cachekey);
+                neighborKey._key = key.createNeighborKey(x, y);
+
+                HFCache::Record neighborRec;
+                if (neighborKey._key.valid() && _heightFieldCache.get(neighborKey, neighborRec))
+                {
+                    neighbors.setNeighbor(x, y, neighborRec.value()._hf.get());
+                }
+            }
+        }
     }
 
     bool populated = layers.populateHeightFieldAndNormalMap(
@@ -542,7 +589,22 @@ TerrainTileModelFactory::getOrCreateHeightField(
         key,
         map->getProfileNoVDatum(), // convertToHAE,
         interpolation,
-        progress );
+        progress,
+        bordered ? &neighbors : 0L);
+
+    if (borderForNormals)
+    {
+        // strip the border back off; the elevation texture doesn't use it.
+        osg::ref_ptr<osg::HeightField> bordered = out_hf.get();
+        out_hf = HeightFieldUtils::createReferenceHeightField(key.getExtent(), 257, 257, 0u, false);
+        const float* src = &bordered->getFloatArray()->front();
+        float* dst = &out_hf->getFloatArray()->front();
+        unsigned bw = bordered->getNumColumns();
+        for (unsigned r = 0; r < 257; ++r)
+        {
+            ::memcpy(dst + r*257, src + (r+1)*bw + 1, 257*sizeof(float));
+        }
+    }
 
 #ifdef TREAT_ALL_ZEROS_AS_MISSING_TILE
     // check for a real tile with all zeros and treat it the same as non-existant data.
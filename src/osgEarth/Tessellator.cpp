@@ -155,15 +155,15 @@ enum AreaPlane{
     AREA_PLANE_YZ
 };
 
-AreaPlane polygonPlane(osg::Vec3Array& verts) 
+AreaPlane polygonPlane(const osg::Vec3Array& verts, unsigned first, unsigned count)
 {
     double area[3];
 
     area[0] = area[1] = area[2] = 0;
 
     // Calculate value of shoelace formula 
-    int j = verts.size() - 1;
-    for (int i = 0; i < verts.size(); i++)
+    int j = first + count - 1;
+    for (int i = first; i < first + count; i++)
     {
         area[AREA_PLANE_XY] += (verts[j].x() + verts[i].x()) * (verts[j].y() - verts[i].y());
         area[AREA_PLANE_XZ] += (verts[j].x() + verts[i].x()) * (verts[j].z() - verts[i].z());
@@ -185,6 +185,11 @@ AreaPlane polygonPlane(osg::Vec3Array& verts)
     return AREA_PLANE_XY;
 }
 
+AreaPlane polygonPlane(const osg::Vec3Array& verts)
+{
+    return polygonPlane(verts, 0u, verts.size());
+}
+
 }
 
 
@@ -303,6 +308,71 @@ Tessellator::tessellateGeometry(osg::Geometry &geom)
 }
 
 
+bool
+Tessellator::tessellateRings(const osg::Vec3Array& vertices,
+                             unsigned first,
+                             const std::vector<unsigned>& ringSizes,
+                             std::vector<unsigned>& out_indices)
+{
+    unsigned count = 0u;
+    for (unsigned i = 0; i < ringSizes.size(); ++i)
+        count += ringSizes[i];
+
+    if (count < 3 || first + count > vertices.size())
+        return false;
+
+#ifndef USE_EARCUT
+    // the ear clipper handles each ring on its own, like tessellateGeometry.
+    std::vector<unsigned> result;
+    unsigned ringStart = first;
+    for (unsigned i = 0; i < ringSizes.size(); ++i)
+    {
+        if (ringSizes[i] >= 3)
+        {
+            osg::ref_ptr<osg::PrimitiveSet> tris = tessellatePrimitive(
+                ringStart, ringStart + ringSizes[i], const_cast<osg::Vec3Array*>(&vertices));
+
+            if (!tris.valid())
+                return false;
+
+            for (unsigned j = 0; j < tris->getNumIndices(); ++j)
+                result.push_back(tris->index(j));
+        }
+        ringStart += ringSizes[i];
+    }
+    out_indices.insert(out_indices.end(), result.begin(), result.end());
+    return true;
+#else
+    int areaPlane = polygonPlane(vertices, first, count);
+
+    std::vector< std::vector< osg::Vec2 > > polygon(ringSizes.size());
+    unsigned ptr = first;
+    for (unsigned i = 0; i < ringSizes.size(); ++i)
+    {
+        std::vector< osg::Vec2 >& ring = polygon[i];
+        ring.reserve(ringSizes[i]);
+        for (unsigned j = 0; j < ringSizes[i]; ++j, ++ptr)
+        {
+            const osg::Vec3& v = vertices[ptr];
+            switch (areaPlane) {
+                case AREA_PLANE_XY: ring.push_back(osg::Vec2(v.x(), v.y())); break;
+                case AREA_PLANE_XZ: ring.push_back(osg::Vec2(v.x(), v.z())); break;
+                case AREA_PLANE_YZ: ring.push_back(osg::Vec2(v.y(), v.z())); break;
+            }
+        }
+    }
+
+    // earcut indexes the rings as if they were concatenated, so offset them
+    // back into the caller's buffer.
+    std::vector<uint32_t> indices = mapbox::earcut<uint32_t>(polygon);
+    out_indices.reserve(out_indices.size() + indices.size());
+    for (unsigned i = 0; i < indices.size(); ++i)
+        out_indices.push_back(first + indices[i]);
+    return !indices.empty();
+#endif
+}
+
+
 osg::PrimitiveSet*
 Tessellator::tessellatePrimitive(osg::PrimitiveSet* primitive, osg::Vec3Array* vertices)
 {
@@ -47,7 +47,8 @@ REGISTER_OBJECT_WRAPPER( osgEarth_Text,
 //....................................................................
 
 Text::Text() : 
-osgText::Text()
+osgText::Text(),
+_layoutShared(false)
 {
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
     if (osg::DisplaySettings::instance()->getTextShaderTechnique().empty())
@@ -58,7 +59,8 @@ osgText::Text()
 }
 
 Text::Text(const std::string& str) :
-osgText::Text()
+osgText::Text(),
+_layoutShared(false)
 {
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
     if (osg::DisplaySettings::instance()->getTextShaderTechnique().empty())
@@ -71,7 +73,8 @@ osgText::Text()
 }
 
 Text::Text(const Text& rhs, const osg::CopyOp& copy) :
-osgText::Text(rhs, copy)
+osgText::Text(rhs, copy),
+_layoutShared(false)
 {
     //nop
 }
@@ -264,3 +267,130 @@ Text::setFont(osg::ref_ptr<osgText::Font> font)
     osgText::TextBase::setFont(font);
 #endif
 }
+
+bool
+Text::appendGlyphs(osg::Vec3Array& coords,
+                   osg::Vec2Array& texcoords,
+                   osg::Vec4Array& colors,
+                   GlyphIndices& indices) const
+{
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+    // Without shader support the backdrop is drawn from extra copies of
+    // the glyph geometry, which we don't carry over.
+    if (_backdropType != NONE && _shaderTechnique <= osgText::GREYSCALE)
+        return false;
+
+    if (!_coords.valid() || _coords->empty() || !_texcoords.valid())
+        return false;
+
+    // Same transform computeMatrix() uses for OBJECT_COORDS text:
+    osg::Matrix matrix;
+    matrix.makeTranslate(-_offset);
+    matrix.postMultRotate(_rotation);
+    matrix.postMultTranslate(_position);
+
+    GLuint base = coords.size();
+
+    for (unsigned i = 0; i < _coords->size(); ++i)
+    {
+        coords.push_back((*_coords)[i] * matrix);
+        texcoords.push_back(i < _texcoords->size() ? (*_texcoords)[i] : osg::Vec2());
+
+        if (_colorCoords.valid() && i < _colorCoords->size())
+            colors.push_back((*_colorCoords)[i]);
+        else
+            colors.push_back(_color);
+    }
+
+    for (TextureGlyphQuadMap::const_iterator i = _textureGlyphQuadMap.begin();
+        i != _textureGlyphQuadMap.end();
+        ++i)
+    {
+        std::vector<GLuint>& out = indices[i->first];
+
+        const GlyphQuads::Primitives& prims = i->second._primitives;
+        for (unsigned p = 0; p < prims.size(); ++p)
+        {
+            const osg::DrawElements* de = prims[p].get();
+            if (!de)
+                continue;
+
+            if (de->getMode() == GL_TRIANGLES)
+            {
+                for (unsigned j = 0; j < de->getNumIndices(); ++j)
+                    out.push_back(base + de->index(j));
+            }
+            else if (de->getMode() == GL_QUADS)
+            {
+                for (unsigned j = 0; j + 3 < de->getNumIndices(); j += 4)
+                {
+                    out.push_back(base + de->index(j));
+                    out.push_back(base + de->index(j + 1));
+                    out.push_back(base + de->index(j + 2));
+                    out.push_back(base + de->index(j));
+                    out.push_back(base + de->index(j + 2));
+                    out.push_back(base + de->index(j + 3));
+                }
+            }
+        }
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool
+Text::shareLayout(const Text& rhs)
+{
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+    // Decorations and shaderless backdrops are built from extra geometry
+    // alongside the glyphs; we only share the glyphs themselves.
+    if (_drawMode != TEXT || rhs._drawMode != TEXT)
+        return false;
+
+    if (_backdropType != NONE && _shaderTechnique <= osgText::GREYSCALE)
+        return false;
+
+    if (!rhs._coords.valid() || !rhs._texcoords.valid())
+        return false;
+
+    _text = rhs._text;
+
+    _vbo = rhs._vbo;
+    _ebo = rhs._ebo;
+    _coords = rhs._coords;
+    _normals = rhs._normals;
+    _colorCoords = rhs._colorCoords;
+    _texcoords = rhs._texcoords;
+    _textureGlyphQuadMap = rhs._textureGlyphQuadMap;
+
+    _lineCount = rhs._lineCount;
+    _textBB = rhs._textBB;
+    _offset = rhs._offset;
+
+    _layoutShared = true;
+    dirtyBound();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void
+Text::computeGlyphRepresentation()
+{
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+    if (_layoutShared)
+    {
+        // osgText lays out into its existing arrays, and these still
+        // belong to the text we took them from (see shareLayout).
+        _textureGlyphQuadMap.clear();
+        initArraysAndBuffers();
+        _layoutShared = false;
+    }
+#endif
+
+    osgText::Text::computeGlyphRepresentation();
+}
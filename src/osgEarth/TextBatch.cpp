@@ -0,0 +1,131 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2020 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/TextBatch>
+#include <osgEarth/VirtualProgram>
+#include <osg/Depth>
+#include <osgText/Glyph>
+
+using namespace osgEarth;
+
+#define LC "[TextBatch] "
+
+namespace
+{
+    // Moves each glyph vertex from its label's anchor by its pixel offset.
+    const char* textBatchVS =
+        "#version " GLSL_VERSION_STR "\n"
+        GLSL_DEFAULT_PRECISION_FLOAT "\n"
+        "uniform vec3 oe_Camera; // (vp width, vp height, lodscale)\n"
+        "void oe_TextBatch_VS(inout vec4 clip) \n"
+        "{ \n"
+        "    clip.xy += gl_MultiTexCoord1.xy * 2.0 / oe_Camera.xy * clip.w; \n"
+        "} \n";
+}
+
+TextBatch::TextBatch() :
+_numTexts(0u)
+{
+    _anchors = new osg::Vec3Array();
+    _offsets = new osg::Vec3Array();
+    _texcoords = new osg::Vec2Array();
+    _colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
+
+    // one buffer object holds all four arrays
+    _vbo = new osg::VertexBufferObject();
+    _anchors->setVertexBufferObject(_vbo.get());
+    _offsets->setVertexBufferObject(_vbo.get());
+    _texcoords->setVertexBufferObject(_vbo.get());
+    _colors->setVertexBufferObject(_vbo.get());
+
+    osg::StateSet* ss = getOrCreateStateSet();
+    VirtualProgram* vp = VirtualProgram::getOrCreate(ss);
+    vp->setName("osgEarth::TextBatch");
+    vp->setFunction("oe_TextBatch_VS", textBatchVS, ShaderComp::LOCATION_VERTEX_CLIP);
+
+    // labels are read-only in the depth buffer, like osgEarth::Text
+    ss->setAttributeAndModes(new osg::Depth(osg::Depth::LEQUAL, 0.0, 1.0, false));
+
+    // the bound only covers the anchors, not the text around them
+    setCullingActive(false);
+}
+
+osg::Geometry*
+TextBatch::getOrCreateGeometry(osg::StateSet* textStateSet, osgText::GlyphTexture* glyphTexture)
+{
+    osg::ref_ptr<osg::Geometry>& geom = _geometries[GeometryKey(textStateSet, glyphTexture)];
+    if (!geom.valid())
+    {
+        geom = new osg::Geometry();
+        geom->setUseVertexBufferObjects(true);
+        geom->setUseDisplayList(false);
+        geom->setVertexArray(_anchors.get());
+        geom->setTexCoordArray(0, _texcoords.get());
+        geom->setTexCoordArray(1, _offsets.get());
+        geom->setColorArray(_colors.get());
+        geom->addPrimitiveSet(new osg::DrawElementsUInt(GL_TRIANGLES));
+        geom->getOrCreateStateSet()->setTextureAttribute(0, glyphTexture);
+        geom->setCullingActive(false);
+
+        // the font's text StateSet (shaders, defines, blending) is shared
+        // by all the glyph textures that use it
+        osg::ref_ptr<osg::Group>& stateGroup = _stateGroups[textStateSet];
+        if (!stateGroup.valid())
+        {
+            stateGroup = new osg::Group();
+            stateGroup->setStateSet(textStateSet);
+            addChild(stateGroup.get());
+        }
+        stateGroup->addChild(geom.get());
+    }
+    return geom.get();
+}
+
+bool
+TextBatch::addText(const osgEarth::Text* text, const osg::Vec3f& anchor)
+{
+    if (!text)
+        return false;
+
+    unsigned base = _offsets->size();
+
+    Text::GlyphIndices indices;
+    if (!text->appendGlyphs(*_offsets, *_texcoords, *_colors, indices))
+        return false;
+
+    _anchors->insert(_anchors->end(), _offsets->size() - base, anchor);
+
+    osg::StateSet* textStateSet = const_cast<osgEarth::Text*>(text)->getStateSet();
+
+    for (Text::GlyphIndices::const_iterator i = indices.begin(); i != indices.end(); ++i)
+    {
+        osg::Geometry* geom = getOrCreateGeometry(textStateSet, i->first.get());
+        osg::DrawElementsUInt* de = static_cast<osg::DrawElementsUInt*>(geom->getPrimitiveSet(0));
+        de->insert(de->end(), i->second.begin(), i->second.end());
+        de->dirty();
+        geom->dirtyBound();
+    }
+
+    _anchors->dirty();
+    _offsets->dirty();
+    _texcoords->dirty();
+    _colors->dirty();
+
+    ++_numTexts;
+    return true;
+}
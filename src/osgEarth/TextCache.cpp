@@ -0,0 +1,198 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/TextCache>
+#include <osgEarth/TextSymbol>
+#include <osgEarth/BBoxSymbol>
+#include <osgEarth/Registry>
+#include <osgEarth/Notify>
+
+using namespace osgEarth;
+
+#define LC "[TextCache] "
+
+namespace
+{
+    template<typename T>
+    struct CountCharacters : public LRUCache<std::string, T>::Functor
+    {
+        CountCharacters() : _count(0u) { }
+        void operator()(const std::string& key, const T& value) {
+            _count += value.layout->getText().size();
+        }
+        unsigned _count;
+    };
+
+    // appends the raw bytes of a value to a key
+    template<typename T>
+    inline void pack(std::string& key, const T& value)
+    {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // strings are length-prefixed so adjacent fields can't run together
+    inline void pack(std::string& key, const std::string& value)
+    {
+        pack(key, (unsigned)value.size());
+        key.append(value);
+    }
+
+    inline void pack(std::string& key, const optional<Color>& value)
+    {
+        pack(key, value.isSet() ? osg::Vec4f(value.get()) : osg::Vec4f(-1,-1,-1,-1));
+    }
+
+    template<typename T>
+    inline void packOptional(std::string& key, const optional<T>& value)
+    {
+        key.push_back(value.isSet() ? '1' : '0');
+        if (value.isSet())
+            pack(key, (int)value.get());
+    }
+}
+
+TextCache::TextCache(unsigned maxPrototypes) :
+_prototypes(false, maxPrototypes),
+_hits(0u),
+_shared(0u),
+_misses(0u)
+{
+    //nop
+}
+
+std::string
+TextCache::makeKey(const std::string& text,
+                   const TextSymbol* symbol,
+                   const BBoxSymbol* bbox,
+                   const osg::BoundingBox& box)
+{
+    // Only the properties that TextSymbolizer and AnnotationUtils apply to
+    // the drawable go in; things applied per label (priority, declutter,
+    // pixel offset...) must not split the cache.
+    std::string key;
+    key.reserve(text.size() + 128u);
+
+    pack(key, text);
+    pack(key, box.xMin()); pack(key, box.yMin()); pack(key, box.zMin());
+    pack(key, box.xMax()); pack(key, box.yMax()); pack(key, box.zMax());
+    pack(key, Registry::instance()->getDevicePixelRatio());
+
+    if (symbol)
+    {
+        key.push_back('T');
+        pack(key, symbol->content().isSet() ? symbol->content()->expr() : std::string());
+        pack(key, symbol->font().isSet() ? symbol->font().get() : std::string());
+        pack(key, symbol->size().isSet() ? symbol->size()->eval() : -1.0);
+        pack(key, (int)symbol->encoding().get());
+        pack(key, (int)symbol->alignment().get());
+        packOptional(key, symbol->layout());
+        pack(key, symbol->fill().isSet() ? optional<Color>(symbol->fill()->color()) : optional<Color>());
+        pack(key, symbol->halo().isSet() ? optional<Color>(symbol->halo()->color()) : optional<Color>());
+        pack(key, symbol->haloOffset().isSet() ? symbol->haloOffset().get() : -1.0f);
+        packOptional(key, symbol->haloBackdropType());
+        packOptional(key, symbol->haloImplementation());
+    }
+
+    if (bbox)
+    {
+        key.push_back('B');
+        pack(key, bbox->fill().isSet() ? optional<Color>(bbox->fill()->color()) : optional<Color>());
+        key.push_back(bbox->border().isSet() ? '1' : '0');
+    }
+
+    return key;
+}
+
+osgEarth::Text*
+TextCache::createText(const std::string& key)
+{
+    Prototypes::Record rec;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        if (!_prototypes.get(key, rec))
+        {
+            ++_misses;
+            return 0L;
+        }
+        ++_hits;
+    }
+
+    // shallow copies share the font and its stateset (see the class notes).
+    // The style has no text, so copying it lays nothing out.
+    osg::ref_ptr<osgEarth::Text> text = new osgEarth::Text(*rec.value().style.get(), osg::CopyOp::SHALLOW_COPY);
+    if (text->shareLayout(*rec.value().layout.get()))
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        ++_shared;
+        return text.release();
+    }
+
+    // can't share the glyphs, so lay them out once more
+    return new osgEarth::Text(*rec.value().layout.get(), osg::CopyOp::SHALLOW_COPY);
+}
+
+void
+TextCache::insert(const std::string& key, const osgEarth::Text* text)
+{
+    if (!text)
+        return;
+
+    Prototype prototype;
+
+    // the prototypes never enter the scene graph; don't let them carry
+    // anything that belongs to the original.
+    prototype.style = new osgEarth::Text(*text, osg::CopyOp::SHALLOW_COPY);
+    prototype.style->setUserData(0L);
+    prototype.style->setText(std::string());
+
+    prototype.layout = new osgEarth::Text(*prototype.style.get(), osg::CopyOp::SHALLOW_COPY);
+    prototype.layout->setText(text->getText());
+
+    Threading::ScopedMutexLock lock(_mutex);
+    _prototypes.insert(key, prototype);
+}
+
+void
+TextCache::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _prototypes.clear();
+    _hits = 0u;
+    _shared = 0u;
+    _misses = 0u;
+}
+
+TextCache::Stats
+TextCache::getStats() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    CountCharacters<Prototype> counter;
+    _prototypes.iterate(counter);
+
+    Stats stats;
+    stats.prototypes = _prototypes.getStats()._entries;
+    stats.characters = counter._count;
+    stats.hits = _hits;
+    stats.shared = _shared;
+    stats.misses = _misses;
+    return stats;
+}
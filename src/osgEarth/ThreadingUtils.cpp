@@ -21,6 +21,7 @@
 #include <osgDB/ReadFile>
 #include <osgEarth/Utils>
 #include <osgEarth/URI>
+#include <OpenThreads/Atomic>
 
 #ifdef _WIN32
     extern "C" unsigned long __stdcall GetCurrentThreadId();
@@ -283,3 +284,91 @@ ThreadPool::get(const osgDB::Options* options)
     return OptionsData<ThreadPool>::get(options, "osgEarth::ThreadPool");
 }
 
+ThreadPool*
+ThreadPool::getShared()
+{
+    static Mutex s_poolMutex;
+    static osg::ref_ptr<ThreadPool> s_pool;
+
+    ScopedMutexLock lock(s_poolMutex);
+    if (!s_pool.valid())
+    {
+        int num = osg::maximum(OpenThreads::GetNumberOfProcessors() - 1, 1);
+        s_pool = new ThreadPool(num);
+    }
+    return s_pool.get();
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    struct ParallelForState : public osg::Referenced
+    {
+        ParallelForState(ParallelFor::Job& job, unsigned count) : _job(job), _count(count) { }
+
+        bool runNext(unsigned worker)
+        {
+            unsigned i = (++_next) - 1u;
+            if (i >= _count)
+                return false;
+
+            _job(i, worker);
+
+            if (++_finished == _count)
+                _done.set();
+
+            return true;
+        }
+
+        // helpers that start after run() returns only look at _count,
+        // so referencing the caller's job is safe.
+        ParallelFor::Job& _job;
+        unsigned _count;
+        OpenThreads::Atomic _next;
+        OpenThreads::Atomic _finished;
+        Event _done;
+    };
+
+    struct ParallelForHelper : public osg::Operation
+    {
+        ParallelForHelper(ParallelForState* state, unsigned worker) :
+            osg::Operation("ParallelFor", false), _state(state), _worker(worker) { }
+
+        void operator()(osg::Object*) { while (_state->runNext(_worker)); }
+
+        osg::ref_ptr<ParallelForState> _state;
+        unsigned _worker;
+    };
+}
+
+unsigned
+ParallelFor::getNumWorkers(unsigned count)
+{
+    return osg::minimum(count, (unsigned)osg::maximum(OpenThreads::GetNumberOfProcessors(), 1));
+}
+
+void
+ParallelFor::run(Job& job, unsigned count, ThreadPool* pool)
+{
+    if (count == 0u)
+        return;
+
+    osg::ref_ptr<ParallelForState> state = new ParallelForState(job, count);
+
+    unsigned numWorkers = getNumWorkers(count);
+    if (numWorkers > 1u)
+    {
+        if (!pool)
+            pool = ThreadPool::getShared();
+
+        // worker 0 is the calling thread
+        for (unsigned w = 1; w < numWorkers; ++w)
+            pool->getQueue()->add(new ParallelForHelper(state.get(), w));
+    }
+
+    while (state->runNext(0u));
+
+    state->_done.wait();
+}
+
@@ -104,6 +104,9 @@ TrackNode::construct()
     // This class makes its own shaders
     ShaderGenerator::setIgnoreHint(this, true);
 
+    _iconDrawable = 0L;
+    _heading.init(0.0);
+
     _geode = new osg::Geode();
     getPositionAttitudeTransform()->addChild( _geode );
 
@@ -150,6 +153,7 @@ TrackNode::compile()
 {
     // reset by clearing out any existing nodes:
     _geode->removeChildren(0, _geode->getNumChildren());
+    _iconDrawable = 0L;
 
     IconSymbol* icon = _style.get<IconSymbol>();
     osg::Image* image = icon ? icon->getImage() : 0L;
@@ -168,6 +172,7 @@ TrackNode::compile()
         {
             imageGeom->getOrCreateStateSet()->merge(*_imageStateSet.get());
             _geode->addDrawable( imageGeom );
+            _iconDrawable = imageGeom;
 
             ScreenSpaceLayoutData* layout = new ScreenSpaceLayoutData();
             layout->setPriority(getPriority());
@@ -230,6 +235,65 @@ TrackNode::updateLayoutData()
     {
         _geode->getDrawable(i)->setUserData(data.get());
     }
+
+    // a heading needs its own layout data on the icon so the labels don't rotate
+    _iconLayoutData = 0L;
+    if (_iconDrawable && _heading.isSet())
+    {
+        _iconLayoutData = new ScreenSpaceLayoutData();
+        _iconLayoutData->setPriority(getPriority());
+        _iconDrawable->setUserData(_iconLayoutData.get());
+        updateHeading();
+    }
+}
+
+void
+TrackNode::setPosition(const GeoPoint& pos)
+{
+    GeoPositionNode::setPosition(pos);
+
+    if (_iconLayoutData.valid())
+    {
+        updateHeading();
+    }
+}
+
+void
+TrackNode::setPosition(const GeoPoint& pos, const osg::Matrixd& local2world)
+{
+    getGeoTransform()->setPosition(pos, local2world);
+
+    if (_iconLayoutData.valid())
+    {
+        updateHeading();
+    }
+}
+
+void
+TrackNode::setHeading(double degrees)
+{
+    bool first = !_heading.isSet();
+    _heading = degrees;
+
+    if (first)
+        updateLayoutData();
+    else
+        updateHeading();
+}
+
+void
+TrackNode::updateHeading()
+{
+    if (!_iconLayoutData.valid())
+        return;
+
+    // The layout engine rotates the icon so its +X axis points from the anchor
+    // point toward the projection point on screen, so aim that axis 90 degrees
+    // clockwise of the heading in the local tangent plane.
+    const osg::Matrixd& local2world = getGeoTransform()->getMatrix();
+    double h = osg::DegreesToRadians(_heading.get());
+    _iconLayoutData->setAnchorPoint(local2world.getTrans());
+    _iconLayoutData->setProjPoint(osg::Vec3d(cos(h), -sin(h), 0.0) * local2world);
 }
 
 void
@@ -0,0 +1,218 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/TrackNodeBatch>
+
+#define LC "[TrackNodeBatch] "
+
+using namespace osgEarth;
+
+//------------------------------------------------------------------------
+
+TrackNodeBatch::TrackNodeBatch(MapNode* mapNode) :
+_mapNode(mapNode)
+{
+    //nop
+}
+
+void
+TrackNodeBatch::addTrack(TrackID id, TrackNode* track)
+{
+    if (!track)
+        return;
+
+    // re-adding the same node is a no-op
+    flat_hash_map<TrackID, TrackRecord>::iterator i = _tracks.find(id);
+    if (i != _tracks.end() && i->second.track.get() == track)
+        return;
+
+    removeTrack(id);
+
+    TrackRecord& record = _tracks[id];
+    record.track = track;
+    addChild(track);
+}
+
+void
+TrackNodeBatch::removeTrack(TrackID id)
+{
+    flat_hash_map<TrackID, TrackRecord>::iterator i = _tracks.find(id);
+    if (i != _tracks.end())
+    {
+        removeChild(i->second.track.get());
+        _tracks.erase(id);
+    }
+}
+
+TrackNode*
+TrackNodeBatch::getTrack(TrackID id) const
+{
+    flat_hash_map<TrackID, TrackRecord>::const_iterator i = _tracks.find(id);
+    return i != _tracks.end() ? i->second.track.get() : 0L;
+}
+
+unsigned
+TrackNodeBatch::update(const UpdateList& updates)
+{
+    osg::ref_ptr<MapNode> mapNode;
+    _mapNode.lock(mapNode);
+    const SpatialReference* mapSRS = mapNode.valid() ? mapNode->getMapSRS() : 0L;
+
+    // Gather the positions that need reprojecting into one bucket per source SRS.
+    // There is almost always just one (e.g. WGS84 coming off the feed).
+    for (std::vector<Bucket>::iterator b = _buckets.begin(); b != _buckets.end(); ++b)
+    {
+        b->updates.clear();
+        b->points.clear();
+    }
+
+    _positions.resize(updates.size());
+
+    for (unsigned i = 0; i < updates.size(); ++i)
+    {
+        const GeoPoint& p = updates[i].position;
+        _positions[i] = p;
+
+        if (!p.isValid() || !mapSRS || p.getSRS() == mapSRS)
+            continue;
+
+        Bucket* bucket = 0L;
+        for (std::vector<Bucket>::iterator b = _buckets.begin(); b != _buckets.end() && !bucket; ++b)
+        {
+            if (b->srs.get() == p.getSRS())
+                bucket = &(*b);
+        }
+        if (!bucket)
+        {
+            _buckets.push_back(Bucket());
+            bucket = &_buckets.back();
+            bucket->srs = p.getSRS();
+        }
+
+        // like GeoPoint::transform, only absolute Z values are reprojected
+        bucket->updates.push_back(i);
+        bucket->points.push_back(osg::Vec3d(p.x(), p.y(), p.altitudeMode() == ALTMODE_ABSOLUTE ? p.z() : 0.0));
+    }
+
+    for (std::vector<Bucket>::iterator b = _buckets.begin(); b != _buckets.end(); ++b)
+    {
+        if (b->points.empty())
+            continue;
+
+        // on failure, leave the original points alone and let each track
+        // transform its own.
+        ++_stats.transforms;
+        if (b->srs->transform(b->points, mapSRS))
+        {
+            for (unsigned j = 0; j < b->updates.size(); ++j)
+            {
+                const GeoPoint& p = updates[b->updates[j]].position;
+                if (p.altitudeMode() != ALTMODE_ABSOLUTE)
+                    b->points[j].z() = p.z();
+                _positions[b->updates[j]] = GeoPoint(mapSRS, b->points[j], p.altitudeMode());
+            }
+        }
+    }
+
+    // Match the updates to the tracks.
+    unsigned count = 0u;
+    _records.resize(updates.size());
+
+    for (unsigned i = 0; i < updates.size(); ++i)
+    {
+        flat_hash_map<TrackID, TrackRecord>::iterator t = _tracks.find(updates[i].id);
+        if (t == _tracks.end())
+        {
+            _records[i] = 0L;
+            ++_stats.unknownIDs;
+        }
+        else
+        {
+            _records[i] = &t->second;
+            ++count;
+        }
+    }
+
+    // Positions. Absolute points in the map SRS need no terrain, so compute
+    // their local-to-world matrices here and write them straight into the
+    // transforms. Anything else (relative altitudes, or points whose bulk
+    // transform failed) goes through setPosition, which may consult the terrain.
+    osg::Matrixd local2world;
+
+    for (unsigned i = 0; i < updates.size(); ++i)
+    {
+        const GeoPoint& p = _positions[i];
+        if (!_records[i] || !p.isValid())
+            continue;
+
+        TrackNode* track = _records[i]->track.get();
+
+        if (mapSRS && p.getSRS() == mapSRS && p.altitudeMode() == ALTMODE_ABSOLUTE &&
+            mapSRS->createLocalToWorld(p.vec3d(), local2world))
+        {
+            track->setPosition(p, local2world);
+            ++_stats.matrices;
+        }
+        else
+        {
+            track->setPosition(p);
+        }
+        ++_stats.positions;
+    }
+
+    // Headings and labels.
+    for (unsigned i = 0; i < updates.size(); ++i)
+    {
+        if (!_records[i])
+            continue;
+
+        const Update& u = updates[i];
+        TrackRecord& record = *_records[i];
+
+        if (u.heading.isSet())
+        {
+            record.track->setHeading(u.heading.get());
+            ++_stats.headings;
+        }
+
+        for (FieldValues::const_iterator f = u.fields.begin(); f != u.fields.end(); ++f)
+        {
+            UnorderedMap<std::string, std::string>::iterator last = record.fields.find(f->first);
+            if (last != record.fields.end() && last->second == f->second)
+            {
+                ++_stats.labelsSkipped;
+            }
+            else
+            {
+                record.track->setFieldValue(f->first, f->second);
+                record.fields[f->first] = f->second;
+                ++_stats.labels;
+            }
+        }
+    }
+
+    // don't hold references to the caller's SRS objects
+    _positions.clear();
+    _records.clear();
+
+    return count;
+}
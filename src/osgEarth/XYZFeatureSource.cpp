@@ -154,7 +154,12 @@ XYZFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
             else if (options().format().value().compare("pbf") == 0)
                 mimeType = "application/x-protobuf";
         }
-        dataOK = getFeatures(buffer, *query.tileKey(), mimeType, features);
+        // keep the FID attribute even if the query's projection omits it:
+        Query readQuery(query);
+        if (options().fidAttribute().isSet() && !readQuery.attributes().empty())
+            readQuery.attributes().push_back(options().fidAttribute().get());
+
+        dataOK = getFeatures(buffer, *query.tileKey(), readQuery, mimeType, features);
     }
 
     if (dataOK)
@@ -194,13 +199,13 @@ XYZFeatureSource::createFeatureCursorImplementation(const Query& query, Progress
 }
 
 bool
-XYZFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, const std::string& mimeType, FeatureList& features)
+XYZFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, const Query& query, const std::string& mimeType, FeatureList& features)
 {
     if (mimeType == "application/x-protobuf" || mimeType == "binary/octet-stream" || mimeType == "application/octet-stream")
     {
 #ifdef OSGEARTH_HAVE_MVT
         std::stringstream in(buffer);
-        return MVT::readTile(in, key, features);
+        return MVT::readTile(in, key, query, features);
 #else
         if (getStatus().isOK())
         {
@@ -249,7 +254,7 @@ XYZFeatureSource::getFeatures(const std::string& buffer, const TileKey& key, con
             {
                 if (feat_handle)
                 {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons());
+                    osg::ref_ptr<Feature> f = OgrUtils::createFeature(feat_handle, getFeatureProfile(), *_options->rewindPolygons(), query);
                     if (f.valid() && !isBlacklisted(f->getFID()))
                     {
                         features.push_back(f.release());
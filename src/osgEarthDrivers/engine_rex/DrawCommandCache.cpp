@@ -0,0 +1,110 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "DrawCommandCache"
+#include "TileNode"
+#include "SurfaceNode"
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[DrawCommandCache] "
+
+namespace
+{
+    // Drop records for tiles that have not been drawn in this many frames
+    const unsigned MAX_IDLE_FRAMES = 60u;
+}
+
+bool
+DrawCommandCache::Record::isCurrent(TileNode* tile) const
+{
+    if (_tile.get() != tile || _revision != tile->getRevision())
+        return false;
+
+    const RenderingPasses& passes = tile->renderModel()._passes;
+    if (_numPasses != passes.size() || (_numPasses > 0u && _passes != &passes[0]))
+        return false;
+
+    const TileDrawable* drawable = tile->getSurfaceNode()->getDrawable();
+    return
+        _drawable == drawable &&
+        _geom == drawable->_geom.get() &&
+        _elevRaster == tile->getElevationRaster();
+}
+
+void
+DrawCommandCache::Record::reset(TileNode* tile)
+{
+    _tile = tile;
+    _revision = tile->getRevision();
+
+    const RenderingPasses& passes = tile->renderModel()._passes;
+    _numPasses = passes.size();
+    _passes = _numPasses > 0u ? &passes[0] : 0L;
+
+    _drawable = tile->getSurfaceNode()->getDrawable();
+    _geom = _drawable->_geom.get();
+    _elevRaster = tile->getElevationRaster();
+
+    _entries.clear();
+    _orphans = 0u;
+    _blank = Entry();
+    _hasBlank = false;
+}
+
+DrawCommandCache::DrawCommandCache(const osg::Camera* camera) :
+_camera(camera),
+_frame(0u),
+_lastPruneFrame(0u)
+{
+    //nop
+}
+
+void
+DrawCommandCache::begin(const std::vector<int>& layout, unsigned frame)
+{
+    _frame = frame;
+
+    if (layout != _layout)
+    {
+        _records.clear();
+        _layout = layout;
+        _lastPruneFrame = frame;
+    }
+
+    else if (frame >= _lastPruneFrame + MAX_IDLE_FRAMES)
+    {
+        for (Records::iterator i = _records.begin(); i != _records.end(); )
+        {
+            if (i->second._lastFrame + MAX_IDLE_FRAMES < frame || !i->second._tile.valid())
+                i = _records.erase(i);
+            else
+                ++i;
+        }
+        _lastPruneFrame = frame;
+    }
+}
+
+DrawCommandCache::Record&
+DrawCommandCache::get(TileNode* tile)
+{
+    Record& record = _records[tile];
+    record._lastFrame = _frame;
+    return record;
+}
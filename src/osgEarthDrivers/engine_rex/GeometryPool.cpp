@@ -20,6 +20,7 @@
 #include <osgEarth/Locators>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/TopologyGraph>
+#include <osgEarth/Metrics>
 #include <osg/Point>
 #include <osgUtil/MeshOptimizers>
 #include <cstdlib> // for getenv
@@ -33,6 +34,7 @@ using namespace osgEarth::REX;
 
 GeometryPool::GeometryPool(const TerrainOptions& options) :
 _options ( options ),
+_maskedCache( true, 32u ),
 _enabled ( true ),
 _debug   ( false )
 {
@@ -57,45 +59,198 @@ _debug   ( false )
     //}
 }
 
+void
+GeometryPool::prewarm(const Profile* profile,
+                      unsigned       tileSize,
+                      unsigned       firstLOD,
+                      unsigned       maxLOD)
+{
+    if ( !_enabled || !profile )
+        return;
+
+    OE_PROFILING_ZONE;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    // In a geographic profile the geometry varies by row; in a projected
+    // profile one geometry serves the entire LOD.
+    bool geographic = profile->getSRS()->isGeographic();
+
+    // GPU tessellation can be switched on after the engine starts, and the
+    // skirt ratio can be zeroed, so warm every primitive mode and skirt variant.
+    std::vector<float> skirtRatios;
+    skirtRatios.push_back(0.0f);
+    if (_options.heightFieldSkirtRatio().get() > 0.0f)
+        skirtRatios.push_back(_options.heightFieldSkirtRatio().get());
+
+    GeometryMap prewarmed;
+
+    for (unsigned lod = firstLOD; lod <= maxLOD; ++lod)
+    {
+        unsigned tilesWide, tilesHigh;
+        profile->getNumTiles(lod, tilesWide, tilesHigh);
+
+        unsigned rows = geographic ? tilesHigh : 1u;
+        for (unsigned row = 0; row < rows; ++row)
+        {
+            TileKey tileKey(lod, 0, row, profile);
+
+            GeometryKey geomKey;
+            createKeyForTileKey( tileKey, tileSize, geomKey );
+
+            for (unsigned k = 0; k < skirtRatios.size(); ++k)
+            {
+                geomKey.skirtRatio = skirtRatios[k];
+                geomKey.patch = false;
+
+                if ( prewarmed.find(geomKey) != prewarmed.end() )
+                    continue;
+
+                osg::ref_ptr<SharedGeometry> geom = createGeometry( tileKey, geomKey, NULL );
+                if ( !geom.valid() )
+                    continue;
+
+                prewarmed[geomKey] = geom.get();
+
+                // The patch variant differs only in its primitive set,
+                // so it shares the vertex arrays.
+                geomKey.patch = true;
+                SharedGeometry* patches = new SharedGeometry( *geom.get(), osg::CopyOp::SHALLOW_COPY );
+                patches->setDrawElements( getDefaultPrimSet(geomKey) );
+                prewarmed[geomKey] = patches;
+            }
+        }
+    }
+
+    // Publish the table. Nothing writes to it after this point, so
+    // getPooledGeometry can read it without taking a lock.
+    _prewarmedMap.swap(prewarmed);
+
+    double t = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+    {
+        Threading::ScopedMutexLock lock(_statsMutex);
+        _stats.prewarmed = _prewarmedMap.size();
+    }
+
+    OE_INFO << LC << "Prewarmed " << _prewarmedMap.size() << " geometries for LODs "
+        << firstLOD << "-" << maxLOD << " in " << t << " ms" << std::endl;
+}
+
+void
+GeometryPool::createMaskedKey(const TileKey&     tileKey,
+                              unsigned           tileSize,
+                              MaskGenerator*     maskSet,
+                              MaskedGeometryKey& out) const
+{
+    out.tileKey = tileKey;
+    createKeyForTileKey( tileKey, tileSize, out.geomKey );
+    out.revision = maskSet->getMapRevision();
+}
+
+bool
+GeometryPool::getCachedMaskedGeometry(const TileKey&                tileKey,
+                                      unsigned                      tileSize,
+                                      MaskGenerator*                maskSet,
+                                      osg::ref_ptr<SharedGeometry>& out)
+{
+    if ( !_enabled || !maskSet || !maskSet->hasMasks() )
+        return false;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    MaskedGeometryKey maskedKey;
+    createMaskedKey( tileKey, tileSize, maskSet, maskedKey );
+
+    MaskedGeometryCache::Record rec;
+    if ( _maskedCache.get(maskedKey, rec) )
+    {
+        out = rec.value().get();
+        recordLatency( true, start );
+        return true;
+    }
+    return false;
+}
+
 void
 GeometryPool::getPooledGeometry(const TileKey&                tileKey,
                                 unsigned                      tileSize,
                                 MaskGenerator*                maskSet,
                                 osg::ref_ptr<SharedGeometry>& out)
 {
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
     // convert to a unique-geometry key:
     GeometryKey geomKey;
     createKeyForTileKey( tileKey, tileSize, geomKey );
 
     if ( _enabled )
     {
-        // Look it up in the pool:
-        Threading::ScopedMutexLock exclusive( _geometryMapMutex );
+        bool masking = maskSet && maskSet->hasMasks();
 
-        // make our globally shared EBO if we need it
-        if ( !_defaultPrimSet.valid())
+        if ( !masking )
         {
-            _defaultPrimSet = createPrimitiveSet(tileSize, NULL, NULL);
+            // Immutable prewarmed table first; no lock required.
+            GeometryMap::const_iterator p = _prewarmedMap.find( geomKey );
+            if ( p != _prewarmedMap.end() )
+            {
+                out = p->second.get();
+                recordLatency( true, start );
+                return;
+            }
         }
 
-        bool masking = maskSet && maskSet->hasMasks();
+        else
+        {
+            // Masked geometry is unique per tile, but the same tile is often
+            // recreated after expiring, so keep a few recent ones around.
+            // TileNode builds it here from the tile's load job, never from cull.
+            MaskedGeometryKey maskedKey;
+            createMaskedKey( tileKey, tileSize, maskSet, maskedKey );
+
+            MaskedGeometryCache::Record rec;
+            if ( _maskedCache.get(maskedKey, rec) )
+            {
+                out = rec.value().get();
+                recordLatency( true, start );
+                return;
+            }
+
+            // Not cached; build it outside the pool lock so other tiles
+            // are not blocked while this one tessellates.
+            out = createGeometry( tileKey, geomKey, maskSet );
+
+            if ( out.valid() )
+            {
+                _maskedCache.insert( maskedKey, out.get() );
+            }
+
+            recordLatency( false, start );
+            return;
+        }
+
+        // Look it up in the pool:
+        Threading::ScopedMutexLock exclusive( _geometryMapMutex );
 
         GeometryMap::iterator i = _geometryMap.find( geomKey );
-        if ( !masking && i != _geometryMap.end() )
+        if ( i != _geometryMap.end() )
         {
             // Found. return it.
             out = i->second.get();
+            recordLatency( true, start );
         }
         else
         {
             // Not found. Create it.
-            out = createGeometry( tileKey, tileSize, maskSet );
+            out = createGeometry( tileKey, geomKey, maskSet );
 
-            if (!masking && out.valid())
+            if ( out.valid() )
             {
                 _geometryMap[ geomKey ] = out.get();
             }
 
+            recordLatency( false, start );
+
             if ( _debug )
             {
                 OE_NOTICE << LC << "Geometry pool size = " << _geometryMap.size() << "\n";
@@ -105,10 +260,48 @@ GeometryPool::getPooledGeometry(const TileKey&                tileKey,
 
     else
     {
-        out = createGeometry( tileKey, tileSize, maskSet );
+        out = createGeometry( tileKey, geomKey, maskSet );
+        recordLatency( false, start );
     }
 }
 
+void
+GeometryPool::recordLatency(bool pooled, const osg::Timer_t& start)
+{
+    double us = osg::Timer::instance()->delta_u(start, osg::Timer::instance()->tick());
+
+    Threading::ScopedMutexLock lock(_statsMutex);
+    if ( pooled )
+    {
+        _stats.pooledHits++;
+        _stats.pooledTime += us;
+        OE_PROFILING_PLOT("GeometryPool pooled (us)", us);
+    }
+    else
+    {
+        _stats.created++;
+        _stats.createdTime += us;
+        OE_PROFILING_PLOT("GeometryPool created (us)", us);
+    }
+
+    if ( _debug && ((_stats.pooledHits + _stats.created) % 1000u) == 0u )
+    {
+        OE_NOTICE << LC
+            << "Pooled: " << _stats.pooledHits << " avg "
+            << (_stats.pooledHits > 0 ? _stats.pooledTime / (double)_stats.pooledHits : 0.0) << " us; "
+            << "Created: " << _stats.created << " avg "
+            << (_stats.created > 0 ? _stats.createdTime / (double)_stats.created : 0.0) << " us"
+            << std::endl;
+    }
+}
+
+GeometryPool::Stats
+GeometryPool::getStats() const
+{
+    Threading::ScopedMutexLock lock(_statsMutex);
+    return _stats;
+}
+
 void
 GeometryPool::createKeyForTileKey(const TileKey&             tileKey,
                                   unsigned                   tileSize,
@@ -117,6 +310,27 @@ GeometryPool::createKeyForTileKey(const TileKey&             tileKey,
     out.lod  = tileKey.getLOD();
     out.tileY = tileKey.getProfile()->getSRS()->isGeographic()? tileKey.getTileY() : 0;
     out.size = tileSize;
+    out.patch = _options.gpuTessellation() == true;
+    out.skirtRatio = osg::maximum(_options.heightFieldSkirtRatio().get(), 0.0f);
+}
+
+osg::DrawElements*
+GeometryPool::getDefaultPrimSet(const GeometryKey& geomKey) const
+{
+    // The shared EBO depends only on the size, primitive mode and
+    // whether there is a skirt at all.
+    GeometryKey variant;
+    variant.size = geomKey.size;
+    variant.patch = geomKey.patch;
+    variant.skirtRatio = geomKey.skirtRatio > 0.0f ? 1.0f : 0.0f;
+
+    Threading::ScopedMutexLock lock( _primSetMutex );
+    osg::ref_ptr<osg::DrawElements>& primSet = _defaultPrimSets[variant];
+    if ( !primSet.valid() )
+    {
+        primSet = createPrimitiveSet( variant, NULL, NULL );
+    }
+    return primSet.get();
 }
 
 int
@@ -196,18 +410,20 @@ namespace
 }
 
 osg::DrawElements*
-GeometryPool::createPrimitiveSet(unsigned tileSize, MaskGenerator* maskSet, osg::Vec3Array* texCoords) const
+GeometryPool::createPrimitiveSet(const GeometryKey& geomKey, MaskGenerator* maskSet, osg::Vec3Array* texCoords) const
 {
+    unsigned tileSize = geomKey.size;
+
     // Attempt to calculate the number of verts in the surface geometry.
-    bool needsSkirt = _options.heightFieldSkirtRatio() > 0.0f;
+    bool needsSkirt = geomKey.skirtRatio > 0.0f;
 
     unsigned numVertsInSurface    = (tileSize*tileSize);
     unsigned numVertsInSkirt      = needsSkirt ? (tileSize-1)*2u * 4u : 0;
     unsigned numVerts             = numVertsInSurface + numVertsInSkirt;    
     unsigned numIndiciesInSurface = (tileSize-1) * (tileSize-1) * 6;
-    unsigned numIncidesInSkirt    = getNumSkirtElements(tileSize);
+    unsigned numIncidesInSkirt    = needsSkirt ? (tileSize-1) * 4 * 6 : 0;
 
-    GLenum mode = (_options.gpuTessellation() == true) ? GL_PATCHES : GL_TRIANGLES;
+    GLenum mode = geomKey.patch ? GL_PATCHES : GL_TRIANGLES;
 
     osg::ref_ptr<osg::DrawElements> primSet = new osg::DrawElementsUShort(mode);
     primSet->reserveElements(numIndiciesInSurface + numIncidesInSkirt);
@@ -297,10 +513,12 @@ GeometryPool::tessellateSurface(unsigned tileSize, MaskGenerator* maskSet, osg::
 }
 
 SharedGeometry*
-GeometryPool::createGeometry(const TileKey& tileKey,
-                             unsigned       tileSize,
-                             MaskGenerator* maskSet) const
+GeometryPool::createGeometry(const TileKey&     tileKey,
+                             const GeometryKey& geomKey,
+                             MaskGenerator*     maskSet) const
 {    
+    unsigned tileSize = geomKey.size;
+
     // Establish a local reference frame for the tile:
     osg::Vec3d centerWorld;
     GeoPoint centroid;
@@ -312,15 +530,11 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     local2world.invert( world2local );
 
     // Attempt to calculate the number of verts in the surface geometry.
-    bool needsSkirt = _options.heightFieldSkirtRatio() > 0.0f;
+    bool needsSkirt = geomKey.skirtRatio > 0.0f;
 
     unsigned numVertsInSurface    = (tileSize*tileSize);
     unsigned numVertsInSkirt      = needsSkirt ? (tileSize-1)*2u * 4u : 0;
     unsigned numVerts             = numVertsInSurface + numVertsInSkirt;
-    unsigned numIndiciesInSurface = (tileSize-1) * (tileSize-1) * 6;
-    unsigned numIncidesInSkirt    = getNumSkirtElements(tileSize);
-    
-    GLenum mode = (_options.gpuTessellation() == true) ? GL_PATCHES : GL_TRIANGLES;
 
     osg::BoundingSphere tileBound;
 
@@ -430,7 +644,7 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     if (needsSkirt)
     {
         // calculate the skirt extrusion height
-        double height = tileBound.radius() * _options.heightFieldSkirtRatio().get();
+        double height = tileBound.radius() * geomKey.skirtRatio;
 
         // Normal tile skirt first:
         unsigned skirtIndex = verts->size();
@@ -475,14 +689,14 @@ GeometryPool::createGeometry(const TileKey& tileKey,
             geom->setMaskElements(maskElements.get());
 
             // Need a custom primitive set, so clone the default one:
-            primSet = createPrimitiveSet(tileSize, maskSet, texCoords.get());
+            primSet = createPrimitiveSet(geomKey, maskSet, texCoords.get());
             primSet->setElementBufferObject(ebo);
 
             // Build a skirt for the mask geometry?
             if (needsSkirt)
             {
                 // calculate the skirt extrusion height
-                double height = tileBound.radius() * _options.heightFieldSkirtRatio().get();
+                double height = tileBound.radius() * geomKey.skirtRatio;
 
                 // Construct a node+edge graph out of the masking geometry:
                 osg::ref_ptr<TopologyGraph> graph = TopologyBuilder::create(verts.get(), maskElements.get(), tileKey.str());
@@ -536,7 +750,7 @@ GeometryPool::createGeometry(const TileKey& tileKey,
 
     if (tessellateSurface && primSet == NULL)
     {
-        primSet = _defaultPrimSet.get();
+        primSet = getDefaultPrimSet(geomKey);
     }
 
     if (primSet)
@@ -587,6 +801,7 @@ GeometryPool::clear()
     _geometryMapMutex.lock();
     _geometryMap.clear();
     _geometryMapMutex.unlock();
+    _maskedCache.clear();
 }
 
 void
@@ -602,6 +817,10 @@ GeometryPool::resizeGLObjectBuffers(unsigned maxsize)
         {
             i->second->resizeGLObjectBuffers(maxsize);
         }
+        for (GeometryMap::const_iterator i = _prewarmedMap.begin(); i != _prewarmedMap.end(); ++i)
+        {
+            i->second->resizeGLObjectBuffers(maxsize);
+        }
     }
     _geometryMapMutex.unlock();
 }
@@ -624,6 +843,13 @@ GeometryPool::releaseGLObjects(osg::State* state) const
             else
                 i->second->releaseGLObjects(state);
         }
+        for (GeometryMap::const_iterator i = _prewarmedMap.begin(); i != _prewarmedMap.end(); ++i)
+        {
+            if (_releaser.valid())
+                objects.push_back(i->second.get());
+            else
+                i->second->releaseGLObjects(state);
+        }
 
         if (_releaser.valid() && !objects.empty())
         {
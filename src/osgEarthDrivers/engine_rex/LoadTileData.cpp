@@ -37,6 +37,7 @@ _enableCancel(true)
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
     _engine = context->getEngine();
+    _masks = tilenode->getPendingMasks();
 }
 
 LoadTileData::LoadTileData(const CreateTileManifest& manifest, TileNode* tilenode, EngineContext* context) :
@@ -48,6 +49,7 @@ LoadTileData::LoadTileData(const CreateTileManifest& manifest, TileNode* tilenod
     this->setTileKey(tilenode->getKey());
     _map = context->getMap();
     _engine = context->getEngine();
+    _masks = tilenode->getPendingMasks();
 }
 
 // invoke runs in the background pager thread.
@@ -76,12 +78,38 @@ LoadTileData::run(ProgressCallback* progress)
         return false;
     }
 
+    osg::ref_ptr<EngineContext> context;
+    if (!_context.lock(context))
+        return false;
+
+    // A masked tile's geometry is built here instead of on the cull thread
+    // (see TileNode::create); merge() hands it to the tile.
+    if (_masks.valid() && !_maskedGeometry.valid())
+    {
+        context->getGeometryPool()->getPooledGeometry(
+            tilenode->getKey(),
+            context->options().tileSize().get(),
+            _masks.get(),
+            _maskedGeometry);
+    }
+
+    // Use prefetched data if we have it; it is only ever built for all layers.
+    if (_manifest.empty() && context->getPrefetcher())
+    {
+        _dataModel = context->getPrefetcher()->take(
+            tilenode->getKey(),
+            map->getDataModelRevision());
+    }
+
     // Assemble all the components necessary to display this tile
-    _dataModel = engine->createTileModel(
-        map.get(),
-        tilenode->getKey(),
-        _manifest,
-        _enableCancel? progress : 0L);
+    if (!_dataModel.valid())
+    {
+        _dataModel = engine->createTileModel(
+            map.get(),
+            tilenode->getKey(),
+            _manifest,
+            _enableCancel? progress : 0L);
+    }
 
     // if the operation was canceled, set the request to abandoned
     // so it can potentially retry later.
@@ -147,6 +175,11 @@ LoadTileData::merge()
         return false;
     }
 
+    if (_maskedGeometry.valid() && tilenode->isGeometryPending())
+    {
+        tilenode->setMaskedGeometry(_maskedGeometry.get());
+    }
+
     // Merge the new data into the tile.
     tilenode->merge(_dataModel.get(), this);
 
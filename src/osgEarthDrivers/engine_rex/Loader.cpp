@@ -39,6 +39,7 @@ using namespace osgEarth::REX;
 Loader::Request::Request() :
     _delay_s(0.0),
     _readyTick(0.0),
+    _firstLoadTick(0),
     _delayCount(0)
 {
     _uid = osgEarth::Registry::instance()->createUID();
@@ -233,7 +234,8 @@ PagerLoader::PagerLoader(TerrainEngineNode* engine) :
 _checkpoint    (0.0),
 _mergesPerFrame( 0 ),
 _frameLastUpdated( 0u ),
-_numLODs       ( 20u )
+_numLODs       ( 20u ),
+_nextLatency   ( 0u )
 {
     _myNodePath.push_back( this );
 
@@ -250,6 +252,34 @@ _numLODs       ( 20u )
     }
 }
 
+PagerLoader::Stats
+PagerLoader::getStats() const
+{
+    Threading::ScopedMutexLock lock(_statsMutex);
+    return _stats;
+}
+
+void
+PagerLoader::recordMerge(const Request* req)
+{
+    // keep the most recent latencies only
+    const unsigned maxLatencies = 65536u;
+
+    float latency = (float)osg::Timer::instance()->delta_s(req->_firstLoadTick, osg::Timer::instance()->tick());
+
+    Threading::ScopedMutexLock lock(_statsMutex);
+    ++_stats.merged;
+    if (_stats.latencies.size() < maxLatencies)
+    {
+        _stats.latencies.push_back(latency);
+    }
+    else
+    {
+        _stats.latencies[_nextLatency] = latency;
+        _nextLatency = (_nextLatency + 1u) % maxLatencies;
+    }
+}
+
 void
 PagerLoader::setNumLODs(unsigned lods)
 {
@@ -318,6 +348,8 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
 
             // if this is the first load request since idle, we need to remember this request.
             addToRequestSet = (request->_loadCount == 1);
+            if (addToRequestSet)
+                request->_firstLoadTick = now;
         }
         request->unlock();
 
@@ -379,6 +411,7 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                     
                         if (merged)
                         {
+                            recordMerge(req);
                             req->setState(Request::FINISHED);
                             //OE_INFO << LC << req->_key.str() << " finished (delays = " << req->_delayCount << ")" << std::endl;
                         }
@@ -453,6 +486,22 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
 
                 //OE_NOTICE << LC << "PagerLoader: requests=" << _requests.size() << "; mergeQueue=" << _mergeQueue.size() << std::endl;
             }
+
+            // sample the queues once per frame.
+            {
+                _requests.lock();
+                unsigned numRequests = _requests.size();
+                _requests.unlock();
+
+                unsigned mergeQueueSize = _mergeQueue.size();
+
+                Threading::ScopedMutexLock lock(_statsMutex);
+                _stats.requests = numRequests;
+                _stats.mergeQueueSize = mergeQueueSize;
+                _stats.mergeQueuePeak = osg::maximum(_stats.mergeQueuePeak, mergeQueueSize);
+                _stats.mergeQueueSum += (double)mergeQueueSize;
+                ++_stats.mergeQueueSamples;
+            }
         }
     }
 
@@ -489,7 +538,10 @@ PagerLoader::addChild(osg::Node* node)
                 else
                 {
                     if (req->merge())
+                    {
+                        recordMerge(req);
                         req->setState( Request::FINISHED );
+                    }
                     else
                         req->setState( Request::IDLE ); // retry
 
@@ -120,7 +120,7 @@ MaskGenerator::MaskGenerator(const TileKey& key, unsigned tileSize, const Map* m
     _tileLength(static_cast<double>(tileSize) - 1.0)
 {
     MaskLayerVector maskLayers;
-    map->getLayers(maskLayers);
+    _mapRevision = map->getLayers(maskLayers);
 
     for(MaskLayerVector::const_iterator it = maskLayers.begin();
         it != maskLayers.end(); 
@@ -41,6 +41,7 @@
 #include <osg/ValueObject>
 
 #include <cstdlib> // for getenv
+#include <algorithm>
 
 #define LC "[RexTerrainEngineNode] "
 
@@ -282,6 +283,25 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
     _geometryPool->setReleaser( _releaser.get());
     this->addChild( _geometryPool.get() );
 
+    // Pre-generate the shared geometry for the shallow LODs so that tile
+    // creation can read it from the pool without locking.
+    unsigned prewarmLOD = std::min(
+        options().maxLOD().getOrUse(DEFAULT_MAX_LOD),
+        options().firstLOD().get() + 6u);
+    const char* prewarmVal = ::getenv("OSGEARTH_REX_PREWARM_LOD");
+    if (prewarmVal)
+    {
+        prewarmLOD = as<unsigned>(prewarmVal, prewarmLOD);
+    }
+    if (prewarmLOD >= options().firstLOD().get())
+    {
+        _geometryPool->prewarm(
+            map->getProfile(),
+            options().tileSize().get(),
+            options().firstLOD().get(),
+            prewarmLOD);
+    }
+
     // Make a tile loader
     PagerLoader* loader = new PagerLoader( this );
     loader->setFrameClock(&_clock);
@@ -342,6 +362,15 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& inOptions)
         _selectionInfo,
         &_clock);
 
+    // Optionally load tile data ahead of the camera
+    if (options().prefetch() == true)
+    {
+        _prefetcher = new TilePrefetcher(options(), _selectionInfo);
+        _prefetcher->setFlightPlan(_prefetchPath);
+        _engineContext->setPrefetcher(_prefetcher.get());
+        OE_INFO << LC << "Tile prefetching enabled" << std::endl;
+    }
+
     // Calculate the LOD morphing parameters:
     unsigned maxLOD = options().maxLOD().getOrUse(DEFAULT_MAX_LOD);
 
@@ -366,6 +395,70 @@ RexTerrainEngineNode::computeBound() const
     return TerrainEngineNode::computeBound();
 }
 
+void
+RexTerrainEngineNode::setPrefetchPath(const std::vector<Viewpoint>& path)
+{
+    _prefetchPath = path;
+    if (_prefetcher.valid())
+    {
+        _prefetcher->setFlightPlan(path);
+    }
+}
+
+Config
+RexTerrainEngineNode::getStatistics() const
+{
+    Config conf("statistics");
+
+    if (_liveTiles.valid())
+    {
+        conf.set("live_tiles", _liveTiles->size());
+    }
+
+    const PagerLoader* pager = dynamic_cast<const PagerLoader*>(_loader.get());
+    if (pager)
+    {
+        PagerLoader::Stats stats = pager->getStats();
+        conf.set("requests", stats.requests);
+        conf.set("merged", stats.merged);
+        conf.set("merge_queue", stats.mergeQueueSize);
+        conf.set("merge_queue_peak", stats.mergeQueuePeak);
+        conf.set("merge_queue_mean", stats.mergeQueueSamples > 0 ? stats.mergeQueueSum / (double)stats.mergeQueueSamples : 0.0);
+
+        std::vector<float>& latencies = stats.latencies;
+        if (!latencies.empty())
+        {
+            std::vector<float>::iterator p50 = latencies.begin() + (latencies.size() - 1) / 2;
+            std::nth_element(latencies.begin(), p50, latencies.end());
+            conf.set("load_latency_p50_ms", *p50 * 1000.0f);
+
+            std::vector<float>::iterator p99 = latencies.begin() + ((latencies.size() - 1) * 99) / 100;
+            std::nth_element(latencies.begin(), p99, latencies.end());
+            conf.set("load_latency_p99_ms", *p99 * 1000.0f);
+        }
+    }
+
+    if (_geometryPool.valid())
+    {
+        GeometryPool::Stats stats = _geometryPool->getStats();
+        conf.set("geometry_prewarmed", stats.prewarmed);
+        conf.set("geometry_pooled_hits", stats.pooledHits);
+        conf.set("geometry_created", stats.created);
+    }
+
+    if (_prefetcher.valid())
+    {
+        TilePrefetcher::Stats stats = _prefetcher->getStats();
+        conf.set("prefetch_requested", stats.requested);
+        conf.set("prefetch_completed", stats.completed);
+        conf.set("prefetch_hits", stats.hits);
+        conf.set("prefetch_evicted", stats.evicted);
+        conf.set("prefetch_resident_bytes", stats.residentBytes);
+    }
+
+    return conf;
+}
+
 void
 RexTerrainEngineNode::invalidateRegion(const GeoExtent& extent,
     unsigned         minLevel,
@@ -390,6 +483,12 @@ RexTerrainEngineNode::invalidateRegion(const GeoExtent& extent,
         }
 
         _liveTiles->setDirty(extentLocal, minLevel, maxLevel, manifest);
+
+        // Prefetched models hold every layer, so drop them whole.
+        if (_prefetcher.valid())
+        {
+            _prefetcher->invalidate(extentLocal, minLevel, maxLevel);
+        }
     }
 }
 
@@ -421,6 +520,12 @@ RexTerrainEngineNode::invalidateRegion(const std::vector<const Layer*> layers,
         }
 
         _liveTiles->setDirty(extentLocal, minLevel, maxLevel, manifest);
+
+        // Prefetched models hold every layer, so drop them whole.
+        if (_prefetcher.valid())
+        {
+            _prefetcher->invalidate(extentLocal, minLevel, maxLevel);
+        }
     }
 }
 
@@ -537,6 +642,12 @@ RexTerrainEngineNode::dirtyTerrain()
     // scrub the geometry pool:
     _geometryPool->clear();
 
+    // discard any data loaded ahead of the camera:
+    if (_prefetcher.valid())
+    {
+        _prefetcher->clear();
+    }
+
     // Build the first level of the terrain.
     // Collect the tile keys comprising the root tiles of the terrain.
     std::vector<TileKey> keys;
@@ -615,6 +726,30 @@ RexTerrainEngineNode::cacheAllLayerExtentsInMapSRS()
         cacheLayerExtentInMapSRS(i->get());
     }
 }
+DrawCommandCache*
+RexTerrainEngineNode::getDrawCommandCache(const osg::Camera* camera)
+{
+    Threading::ScopedMutexLock lock(_drawCommandCachesMutex);
+
+    DrawCommandCaches::iterator i = _drawCommandCaches.find(camera);
+    if (i != _drawCommandCaches.end() && i->second->getCamera() == camera)
+        return i->second.get();
+
+    // New camera (or a new one at a deleted camera's address);
+    // take the chance to drop the caches of deleted cameras.
+    for (DrawCommandCaches::iterator j = _drawCommandCaches.begin(); j != _drawCommandCaches.end(); )
+    {
+        if (j->second->getCamera() == 0L)
+            _drawCommandCaches.erase(j++);
+        else
+            ++j;
+    }
+
+    DrawCommandCache* cache = new DrawCommandCache(camera);
+    _drawCommandCaches[camera] = cache;
+    return cache;
+}
+
 void
 RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 {
@@ -624,14 +759,30 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
 
     osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
 
+    // Predict where the camera is going and load tiles ahead of it
+    if (_prefetcher.valid())
+    {
+        _prefetcher->update(getEngineContext(), cv->getViewPoint(), _clock.getTime());
+    }
+
     // Initialize a new culler
     TerrainCuller culler(cv, this->getEngineContext());
 
     // Prepare the culler with the set of renderable layers:
-    culler.setup(getMap(), _cachedLayerExtents, this->getEngineContext()->getRenderBindings());
+    {
+        OE_PROFILING_ZONE_NAMED("Setup culler");
+        culler.setup(
+            getMap(),
+            _cachedLayerExtents,
+            this->getEngineContext()->getRenderBindings(),
+            getDrawCommandCache(cv->getCurrentCamera()));
+    }
 
     // Assemble the terrain drawables:
-    _terrain->accept(culler);
+    {
+        OE_PROFILING_ZONE_NAMED("Cull tiles");
+        _terrain->accept(culler);
+    }
 
     // If we're using geometry pooling, optimize the drawable for shared state
     // by sorting the draw commands.
@@ -639,6 +790,7 @@ RexTerrainEngineNode::cull_traverse(osg::NodeVisitor& nv)
     unsigned totalTiles = 0L;
     if (getEngineContext()->getGeometryPool()->isEnabled())
     {
+        OE_PROFILING_ZONE_NAMED("Sort draw commands");
         totalTiles = culler._terrain.sortDrawCommands();
     }
 
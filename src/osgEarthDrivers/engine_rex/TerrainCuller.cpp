@@ -23,6 +23,7 @@
 #include <osgEarth/TraversalData>
 #include <osgEarth/VisibleLayer>
 #include <osgEarth/Shadowing>
+#include <osgEarth/Metrics>
 
 #define LC "[TerrainCuller] "
 
@@ -34,7 +35,9 @@ _camera(0L),
 _currentTileNode(0L),
 _orphanedPassesDetected(0u),
 _cv(cullVisitor),
-_context(context)
+_context(context),
+_layerExtents(0L),
+_drawCache(0L)
 {
     setVisitorType(CULL_VISITOR);
     setTraversalMode(TRAVERSE_ALL_CHILDREN);
@@ -57,11 +60,30 @@ _context(context)
 }
 
 void
-TerrainCuller::setup(const Map* map, LayerExtentMap& layerExtents, const RenderBindings& bindings)
+TerrainCuller::setup(const Map* map, LayerExtentMap& layerExtents, const RenderBindings& bindings, DrawCommandCache* drawCache)
 {
     unsigned frameNum = getFrameStamp() ? getFrameStamp()->getFrameNumber() : 0u;
     _layerExtents = &layerExtents;
     _terrain.setup(map, bindings, frameNum, _cv);
+
+    _drawCache = drawCache;
+    if (_drawCache)
+    {
+        // Cached commands refer to layers by index and were culled by
+        // layer extent, so they hold only while the layer set, the draw
+        // flags and the computed extents stay the same.
+        std::vector<int> layout;
+        layout.reserve(_terrain.layers().size() * 3u);
+        for (LayerDrawableList::const_iterator i = _terrain.layers().begin(); i != _terrain.layers().end(); ++i)
+        {
+            const LayerDrawable* drawable = i->get();
+            UID uid = drawable->_layer ? drawable->_layer->getUID() : -1;
+            layout.push_back(uid);
+            layout.push_back(drawable->_draw ? 1 : 0);
+            layout.push_back(drawable->_layer ? (int)layerExtents[uid]._computed : 0);
+        }
+        _drawCache->begin(layout, frameNum);
+    }
 }
 
 float
@@ -71,14 +93,12 @@ TerrainCuller::getDistanceToViewPoint(const osg::Vec3& pos, bool withLODScale) c
     return _cv->getDistanceToViewPoint(pos, withLODScale);
 }
 
-DrawTileCommand*
-TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const RenderingPass* pass, TileNode* tileNode)
+bool
+TerrainCuller::buildDrawCommand(UID uid, const TileRenderModel* model, const RenderingPass* pass, TileNode* tileNode, DrawCommandCache::Entry& entry, unsigned& orphans)
 {
     SurfaceNode* surface = tileNode->getSurfaceNode();
     if ( !surface )
-        return 0L;
-
-    const RenderBindings& bindings = _context->getRenderBindings();
+        return false;
 
     // skip layers that are not visible:
     if (pass && 
@@ -86,10 +106,10 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
         pass->visibleLayer()->getVisible() == false)
     {
         //OE_DEBUG << LC << "Skipping " << pass->visibleLayer()->getName() << " because it's not visible." << std::endl;
-        return 0L;
+        return false;
     }
 
-    // add a new Draw command to the appropriate layer
+    // find the appropriate layer for the new draw command
     osg::ref_ptr<LayerDrawable> drawable = _terrain.layer(uid);
     if (drawable.valid())
     {
@@ -108,18 +128,19 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
                     //OE_DEBUG << LC << "Skippping " << drawable->_layer->getName() 
                     //    << " key " << tileNode->getKey().str()
                     //    << " because it was culled by extent." << std::endl;
-                    return 0L;
+                    return false;
                 }            
             }
 
-            drawable->_tiles.push_back(DrawTileCommand());
-            DrawTileCommand* tile = &drawable->_tiles.back();
+            entry._layerIndex = drawable->_drawOrder;
+            entry._visibleLayer = pass ? pass->visibleLayer() : 0L;
 
-            // install everything we need in the Draw Command:
+            DrawTileCommand* tile = &entry._cmd;
+
+            // install everything we need in the Draw Command, except for
+            // the per-frame modelview matrix and range:
             tile->_colorSamplers = pass ? &(pass->samplers()) : 0L;
             tile->_sharedSamplers = &model->_sharedSamplers;
-            tile->_modelViewMatrix = _cv->getModelViewMatrix();
-            tile->_keyValue = tileNode->getTileKeyValue();
             tile->_geom = surface->getDrawable()->_geom.get();
             tile->_tile = surface->getDrawable();
             //tile->_provider = surface->getDrawable();
@@ -127,9 +148,6 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
             tile->_key = &tileNode->getKey();
             tile->_tileRevision = tileNode->getRevision();
 
-            osg::Vec3 c = surface->getBound().center() * surface->getInverseMatrix();
-            tile->_range = getDistanceToViewPoint(c, true);
-
             tile->_layerOrder = drawable->_drawOrder;
 
             const osg::Image* elevRaster = tileNode->getElevationRaster();
@@ -150,7 +168,7 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
                 tile->_elevTexelCoeff.set((size - (2.0*bias)) / size, bias / size);
             }
 
-            return tile;
+            return true;
         }
     }
     else if (pass)
@@ -158,14 +176,61 @@ TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const Rende
         // The pass exists but it's layer is not in the render data draw list.
         // This means that the layer is no longer in the map. Detect and record
         // this information so we can run a cleanup visitor later on.
-        ++_orphanedPassesDetected;
+        ++orphans;
     }
     else
     {
         OE_WARN << "Added nothing for a UID -1 darw command" << std::endl;
     }
     
-    return 0L;
+    return false;
+}
+
+DrawTileCommand*
+TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const RenderingPass* pass, TileNode* tileNode)
+{
+    DrawCommandCache::Entry entry;
+    if (!buildDrawCommand(uid, model, pass, tileNode, entry, _orphanedPassesDetected))
+        return 0L;
+
+    LayerDrawable* drawable = _terrain.layers()[entry._layerIndex].get();
+    drawable->_tiles.push_back(entry._cmd);
+    DrawTileCommand* tile = &drawable->_tiles.back();
+
+    SurfaceNode* surface = tileNode->getSurfaceNode();
+    tile->_modelViewMatrix = _cv->getModelViewMatrix();
+    tile->_keyValue = tileNode->getTileKeyValue();
+    osg::Vec3 c = surface->getBound().center() * surface->getInverseMatrix();
+    tile->_range = getDistanceToViewPoint(c, true);
+
+    return tile;
+}
+
+void
+TerrainCuller::buildDrawCommands(TileNode* tileNode, DrawCommandCache::Record& record)
+{
+    OE_PROFILING_ZONE;
+
+    record.reset(tileNode);
+
+    TileRenderModel& renderModel = tileNode->renderModel();
+
+    // One command for each legit rendering pass in the Tile:
+    for (unsigned p = 0; p < renderModel._passes.size(); ++p)
+    {
+        const RenderingPass& pass = renderModel._passes[p];
+
+        //TODO: see if we can skip adding a draw command for 1-pixel images
+        // or other "placeholder" textures
+        DrawCommandCache::Entry entry;
+        if (buildDrawCommand(pass.sourceUID(), &renderModel, &pass, tileNode, entry, record._orphans))
+        {
+            record._entries.push_back(entry);
+        }
+    }
+
+    // UID = -1 is the special UID code for a blank.
+    record._hasBlank = buildDrawCommand(-1, &renderModel, 0L, tileNode, record._blank, record._orphans);
 }
 
 void
@@ -272,8 +337,6 @@ TerrainCuller::apply(TileNode& node)
 void
 TerrainCuller::apply(SurfaceNode& node)
 {
-    TileRenderModel& renderModel = _currentTileNode->renderModel();
-
     float range = _cv->getDistanceToViewPoint(node.getBound().center(), true) - node.getBound().radius();
 
     // push the surface matrix:
@@ -289,46 +352,62 @@ TerrainCuller::apply(SurfaceNode& node)
             node.setLastFramePassedCull(getFrameStamp()->getFrameNumber());
         }
 
-        int order = 0;
-        unsigned count = 0;
+        // Reuse the commands built in an earlier frame if the tile has
+        // not changed since; otherwise build them anew.
+        DrawCommandCache::Record scratch;
+        DrawCommandCache::Record* record = _drawCache ? &_drawCache->get(_currentTileNode) : &scratch;
+        if (!record->isCurrent(_currentTileNode))
+        {
+            buildDrawCommands(_currentTileNode, *record);
+        }
+
+        _orphanedPassesDetected += record->_orphans;
+
+        // Per-frame data shared by all of this tile's commands:
+        const osg::RefMatrix* modelViewMatrix = _cv->getModelViewMatrix();
+        const osg::Vec4f& keyValue = _currentTileNode->getTileKeyValue();
+        osg::Vec3 c = node.getBound().center() * node.getInverseMatrix();
+        float tileRange = getDistanceToViewPoint(c, true);
 
-        // First go through any legit rendering pass data in the Tile and
-        // and add a DrawCommand for each.
-        for (unsigned p = 0; p < renderModel._passes.size(); ++p)
+        const LayerDrawableList& layers = _terrain.layers();
+
+        for (unsigned e = 0; e < record->_entries.size(); ++e)
         {
-            const RenderingPass& pass = renderModel._passes[p];
+            const DrawCommandCache::Entry& entry = record->_entries[e];
 
             // is the tile in visible range?
-            if (pass.visibleLayer() && pass.visibleLayer()->getMaxVisibleRange() < range)
+            if (entry._visibleLayer && entry._visibleLayer->getMaxVisibleRange() < range)
                 continue;
 
-            //TODO: see if we can skip adding a draw command for 1-pixel images
-            // or other "placeholder" textures
-            DrawTileCommand* cmd = addDrawCommand(pass.sourceUID(), &renderModel, &pass, _currentTileNode);
-            if (cmd)
+            DrawTileCommands& tiles = layers[entry._layerIndex]->_tiles;
+            tiles.push_back(entry._cmd);
+            DrawTileCommand* cmd = &tiles.back();
+            cmd->_modelViewMatrix = modelViewMatrix;
+            cmd->_keyValue = keyValue;
+            cmd->_range = tileRange;
+
+            if (_firstDrawCommandForTile == 0L)
             {
-                if (_firstDrawCommandForTile == 0L)
-                {
-                    _firstDrawCommandForTile = cmd;
-                }
-                else if (cmd->_layerOrder < _firstDrawCommandForTile->_layerOrder)
-                {
-                    _firstDrawCommandForTile = cmd;
-                }
+                _firstDrawCommandForTile = cmd;
+            }
+            else if (cmd->_layerOrder < _firstDrawCommandForTile->_layerOrder)
+            {
+                _firstDrawCommandForTile = cmd;
             }
         }
 
         // If the culler added no draw commands for this tile... we still need
         // to draw something or else there will be a hole! So draw a blank tile.
-        // UID = -1 is the special UID code for a blank.
-        if (_firstDrawCommandForTile == 0L)
+        if (_firstDrawCommandForTile == 0L && record->_hasBlank)
         {
             //OE_INFO << LC << "Adding blank render for tile " << _currentTileNode->getKey().str() << std::endl;
-            DrawTileCommand* cmd = addDrawCommand(-1, &renderModel, 0L, _currentTileNode);
-            if (cmd)
-            {
-                _firstDrawCommandForTile = cmd;
-            }
+            DrawTileCommands& tiles = layers[record->_blank._layerIndex]->_tiles;
+            tiles.push_back(record->_blank._cmd);
+            DrawTileCommand* cmd = &tiles.back();
+            cmd->_modelViewMatrix = modelViewMatrix;
+            cmd->_keyValue = keyValue;
+            cmd->_range = tileRange;
+            _firstDrawCommandForTile = cmd;
         }
 
         // Set the layer order of the first draw command for this tile to zero,
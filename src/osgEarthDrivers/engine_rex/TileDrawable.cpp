@@ -24,6 +24,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/TerrainRayIntersector>
 
 using namespace osg;
 using namespace osgEarth::REX;
@@ -72,7 +73,7 @@ _bboxRadius  ( 1.0 ),
 _bboxCB      ( NULL )
 {   
     // a mesh to materialize the heightfield for functors
-    _mesh = new osg::Vec3f[ tileSize*tileSize ];
+    _mesh = new osg::Vec3Array( tileSize*tileSize );
     
     // allocate and prepopulate mesh index array. 
     // TODO: This is the same for all tiles (of the same tilesize)
@@ -101,7 +102,6 @@ _bboxCB      ( NULL )
 TileDrawable::~TileDrawable()
 {
     delete [] _meshIndices;
-    delete [] _mesh;
 }
 
 void
@@ -118,6 +118,7 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
     }
     
     const osg::Vec3Array& verts = *static_cast<osg::Vec3Array*>(_geom->getVertexArray());
+    osg::Vec3Array& mesh = *_mesh.get();
 
     if ( _elevationRaster.valid() )
     {
@@ -154,7 +155,7 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
 
                 readElevation(sample, u, v);
 
-                _mesh[index] = verts[index] + normals[index] * sample.r();
+                mesh[index] = verts[index] + normals[index] * sample.r();
             }
         }
     }
@@ -163,10 +164,21 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
     {
         for (int i = 0; i < _tileSize*_tileSize; ++i)
         {
-            _mesh[i] = verts[i];
+            mesh[i] = verts[i];
         }
     }
 
+    // Ray intersection acceleration (see TerrainRayIntersector). Like the
+    // mesh above, it is rebuilt in place, so intersection visitors must not
+    // run while the elevation raster is changing.
+    TileMeshBVH* bvh = dynamic_cast<TileMeshBVH*>(getShape());
+    if (!bvh)
+    {
+        bvh = new TileMeshBVH();
+        setShape(bvh);
+    }
+    bvh->build(_mesh.get(), _tileSize, _tileSize);
+
     dirtyBound();    
 }
 
@@ -174,7 +186,7 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
 void
 TileDrawable::accept(osg::PrimitiveFunctor& f) const
 {
-    f.setVertexArray(_tileSize*_tileSize, _mesh);
+    f.setVertexArray(_tileSize*_tileSize, &_mesh->front());
     f.drawElements(GL_TRIANGLES, (_tileSize - 1)*(_tileSize-1)*6, _meshIndices);
 }
 
@@ -192,7 +204,7 @@ TileDrawable::computeBoundingBox() const
     // core bbox created from the mesh:
     for(int i=0; i<_tileSize*_tileSize; ++i)
     {
-        box.expandBy(_mesh[i]);
+        box.expandBy((*_mesh)[i]);
     }
 
     // finally see if any of the layers request a bbox change:
@@ -33,6 +33,11 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Metrics>
 
+#include <osg/Texture2D>
+#include <osg/GLExtensions>
+
+#include <cstring>
+
 using namespace osgEarth::REX;
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -55,6 +60,98 @@ namespace
         osg::Matrixf(0.5f,0,0,0, 0,0.5f,0,0, 0,0,1.0f,0, 0.0f,0.0f,0,1.0f),
         osg::Matrixf(0.5f,0,0,0, 0,0.5f,0,0, 0,0,1.0f,0, 0.5f,0.0f,0,1.0f)
     };
+
+    // Whether two normal map images can be edge-copied with raw memory ops.
+    bool isDirectlyCopyable(const osg::Image* a, const osg::Image* b)
+    {
+        return
+            a->getPixelFormat() == GL_RGBA && a->getDataType() == GL_UNSIGNED_BYTE &&
+            b->getPixelFormat() == GL_RGBA && b->getDataType() == GL_UNSIGNED_BYTE &&
+            a->getPacking() == b->getPacking();
+    }
+
+    // Uploads just the edge texels updateNormalMap copies in from the
+    // neighbors (the east column and the south row of level 0) instead of
+    // re-uploading the whole normal map and its mipmaps. RGBA8 only; load()
+    // does the initial upload since OSG hands that to the callback too.
+    struct NormalMapEdgeSubload : public osg::Texture2D::SubloadCallback
+    {
+        OpenThreads::Atomic _revision;
+        mutable osg::buffered_value<unsigned> _uploaded;
+
+        void load(const osg::Texture2D& texture, osg::State& state) const
+        {
+            const osg::Image* image = texture.getImage();
+            if (!image)
+                return;
+
+            unsigned revision = _revision;
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, image->getPacking());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            int levels = (int)image->getNumMipmapLevels();
+            for (int level = 0; level < levels; ++level)
+            {
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8,
+                    osg::maximum(image->s() >> level, 1),
+                    osg::maximum(image->t() >> level, 1),
+                    0, GL_RGBA, GL_UNSIGNED_BYTE, image->getMipmapData(level));
+            }
+
+            osg::Texture::FilterMode minFilter = texture.getFilter(osg::Texture::MIN_FILTER);
+            const osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+            if (levels == 1 && minFilter != osg::Texture::LINEAR && minFilter != osg::Texture::NEAREST &&
+                ext->glGenerateMipmap)
+            {
+                ext->glGenerateMipmap(GL_TEXTURE_2D);
+            }
+
+            _uploaded[state.getContextID()] = revision;
+        }
+
+        void subload(const osg::Texture2D& texture, osg::State& state) const
+        {
+            unsigned revision = _revision;
+            unsigned& uploaded = _uploaded[state.getContextID()];
+            if (uploaded == revision)
+                return;
+
+            const osg::Image* image = texture.getImage();
+            if (!image)
+                return;
+
+            int width = image->s(), height = image->t();
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, image->getPacking());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, width-1, 0, 1, height, GL_RGBA, GL_UNSIGNED_BYTE, image->data(width-1, 0));
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, 1, GL_RGBA, GL_UNSIGNED_BYTE, image->data(0, 0));
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            uploaded = revision;
+        }
+    };
+
+    // Schedules the upload of a normal map's edited edges.
+    void dirtyNormalMapEdges(osg::Texture* texture, osg::Image* image)
+    {
+        osg::Texture2D* tex2d = dynamic_cast<osg::Texture2D*>(texture);
+        if (!tex2d || image->getPixelFormat() != GL_RGBA || image->getDataType() != GL_UNSIGNED_BYTE)
+        {
+            image->dirty();
+            return;
+        }
+
+        NormalMapEdgeSubload* subload = dynamic_cast<NormalMapEdgeSubload*>(tex2d->getSubloadCallback());
+        if (!subload)
+        {
+            subload = new NormalMapEdgeSubload();
+            tex2d->setTextureSize(image->s(), image->t());
+            tex2d->setSubloadCallback(subload);
+        }
+        ++subload->_revision;
+    }
 }
 
 TileNode::TileNode() : 
@@ -102,13 +199,21 @@ TileNode::create(const TileKey& key, TileNode* parent, EngineContext* context)
     // Mask generator creates geometry from masking boundaries when they exist.
     osg::ref_ptr<MaskGenerator> masks = new MaskGenerator(key, tileSize, map.get());
 
-    // Get a shared geometry from the pool that corresponds to this tile key:
+    // Get a shared geometry from the pool that corresponds to this tile key.
+    // Tessellating around mask boundaries is too slow for the cull thread, so
+    // unless it's cached a masked tile stands in with the plain grid (which it
+    // doesn't draw) until its load job builds the real geometry.
     osg::ref_ptr<SharedGeometry> geom;
-    context->getGeometryPool()->getPooledGeometry(
-        key,
-        tileSize,
-        masks.get(), 
-        geom);
+    GeometryPool* pool = context->getGeometryPool();
+    if (masks->hasMasks() && !pool->getCachedMaskedGeometry(key, tileSize, masks.get(), geom))
+    {
+        _pendingMasks = masks.get();
+        pool->getPooledGeometry(key, tileSize, NULL, geom);
+    }
+    else
+    {
+        pool->getPooledGeometry(key, tileSize, masks.get(), geom);
+    }
 
     // If we donget an empty, that most likely means the tile was completely
     // contained by a masking boundary. Mark as empty and we are done.
@@ -429,6 +534,13 @@ TileNode::cull(TerrainCuller* culler)
         return false;
     }
     
+    // Nothing to draw until the load job delivers the masked geometry.
+    if (isGeometryPending())
+    {
+        load(culler);
+        return true;
+    }
+
     // determine whether we can and should subdivide to a higher resolution:
     bool childrenInRange = shouldSubDivide(culler, context->getSelectionInfo());
 
@@ -497,7 +609,7 @@ TileNode::cull(TerrainCuller* culler)
         }
 
         // If all are ready, traverse them now.
-        if ( _childrenReady )
+        if ( _childrenReady && !loadPendingChildGeometry(culler) )
         {
             for(int i=0; i<4; ++i)
             {
@@ -651,6 +763,46 @@ TileNode::traverse(osg::NodeVisitor& nv)
     }
 }
 
+bool
+TileNode::loadPendingChildGeometry(TerrainCuller* culler)
+{
+    // A child still waiting for its masked geometry can't draw, so the
+    // caller draws this tile instead; keep the child alive and its load
+    // request moving in the meantime.
+    bool pending = false;
+    for(int i=0; i<4; ++i)
+    {
+        TileNode* child = getSubTile(i);
+        if (child && child->isGeometryPending())
+        {
+            child->_lastTraversalFrame.exchange(_context->getClock()->getFrame());
+            child->_lastTraversalTime = _context->getClock()->getTime();
+            child->load(culler);
+            pending = true;
+        }
+    }
+    return pending;
+}
+
+void
+TileNode::setMaskedGeometry(SharedGeometry* geom)
+{
+    _pendingMasks = 0L;
+
+    // the masking boundary swallowed the whole tile
+    if (!geom || geom->empty())
+    {
+        _empty = true;
+        return;
+    }
+
+    // The grid vertices are the same as the stand-in's, so only the
+    // primitives and the derived bounds change.
+    _surface->getDrawable()->setGeometry(geom);
+    _surface->setElevationRaster(_surface->getElevationRaster(), _surface->getElevationMatrix());
+    dirtyBound();
+}
+
 void
 TileNode::createChildren(EngineContext* context)
 {
@@ -1277,18 +1429,42 @@ TileNode::updateNormalMap()
         // Averaging them would be more accurate, but then we'd have to
         // re-generate each texture multiple times instead of just once.
         // Besides, there's almost no visual difference anyway.
-        osg::Vec4 pixel;
-        ImageUtils::PixelReader readThat(thatImage);
-        ImageUtils::PixelWriter writeThis(thisImage);
-        
-        for (int t=0; t<height; ++t)
+        // Normal maps built from a bordered heightfield already match, in
+        // which case nothing changes and we skip the upload; otherwise only
+        // the edge texels go to the GPU.
+        bool changed = false;
+
+        if (isDirectlyCopyable(thisImage, thatImage))
+        {
+            for (int t=0; t<height; ++t)
+            {
+                unsigned char* dst = thisImage->data(width-1, t);
+                const unsigned char* src = thatImage->data(0, t);
+                if (::memcmp(dst, src, 4) != 0)
+                {
+                    ::memcpy(dst, src, 4);
+                    changed = true;
+                }
+            }
+        }
+        else
         {
-            readThat(pixel, 0, t);
-            writeThis(pixel, width-1, t);
-            //writeThis(readThat(0, t), width-1, t);
+            osg::Vec4 pixel;
+            ImageUtils::PixelReader readThat(thatImage);
+            ImageUtils::PixelWriter writeThis(thisImage);
+
+            for (int t=0; t<height; ++t)
+            {
+                readThat(pixel, 0, t);
+                writeThis(pixel, width-1, t);
+            }
+            changed = true;
         }
 
-        thisImage->dirty();
+        if (changed)
+        {
+            dirtyNormalMapEdges(thisNormalMap._texture.get(), thisImage);
+        }
     }
 
     osg::ref_ptr<TileNode> south;
@@ -1307,21 +1483,37 @@ TileNode::updateNormalMap()
             return;
 
         // Just copy the neighbor's edge normals over to our texture.
-        // Averaging them would be more accurate, but then we'd have to
-        // re-generate each texture multiple times instead of just once.
-        // Besides, there's almost no visual difference anyway.
-        osg::Vec4 pixel;
-        ImageUtils::PixelReader readThat(thatImage);
-        ImageUtils::PixelWriter writeThis(thisImage);
+        bool changed = false;
 
-        for (int s=0; s<width; ++s)
+        if (isDirectlyCopyable(thisImage, thatImage))
         {
-            readThat(pixel, s, height-1);
-            writeThis(pixel, s, 0);
-            //writeThis(readThat(s, height-1), s, 0);
+            unsigned char* dst = thisImage->data(0, 0);
+            const unsigned char* src = thatImage->data(0, height-1);
+            unsigned rowSize = 4u * (unsigned)width;
+            if (::memcmp(dst, src, rowSize) != 0)
+            {
+                ::memcpy(dst, src, rowSize);
+                changed = true;
+            }
         }
+        else
+        {
+            osg::Vec4 pixel;
+            ImageUtils::PixelReader readThat(thatImage);
+            ImageUtils::PixelWriter writeThis(thisImage);
 
-        thisImage->dirty();
+            for (int s=0; s<width; ++s)
+            {
+                readThat(pixel, s, height-1);
+                writeThis(pixel, s, 0);
+            }
+            changed = true;
+        }
+
+        if (changed)
+        {
+            dirtyNormalMapEdges(thisNormalMap._texture.get(), thisImage);
+        }
     }
 
     //OE_INFO << LC << _key.str() << " : updated normal map.\n";
@@ -0,0 +1,472 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "TilePrefetcher"
+#include "EngineContext"
+#include "SelectionInfo"
+#include <osgEarth/TerrainEngineNode>
+#include <osgEarth/Map>
+#include <osgEarth/Metrics>
+#include <osg/OperationThread>
+#include <algorithm>
+#include <cfloat>
+
+using namespace osgEarth::REX;
+using namespace osgEarth;
+
+#define LC "[TilePrefetcher] "
+
+namespace
+{
+    // Number of positions sampled along an extrapolated camera path
+    const unsigned NUM_PREDICTION_STEPS = 4u;
+
+    // Number of ancestor LODs to prefetch above each predicted tile
+    const unsigned NUM_ANCESTOR_LODS = 2u;
+
+    // Number of upcoming flight plan waypoints to prefetch
+    const unsigned NUM_WAYPOINTS = 3u;
+
+    // Forget previously attempted keys once the set reaches this size
+    const unsigned MAX_ATTEMPTED_KEYS = 8192u;
+
+    // Builds a tile model for one key in the prefetch thread pool.
+    struct PrefetchOperation : public osg::Operation
+    {
+        PrefetchOperation(
+            TilePrefetcher* prefetcher,
+            TerrainEngineNode* engine,
+            const Map* map,
+            const TileKey& key) :
+            osg::Operation("TilePrefetch", false),
+            _prefetcher(prefetcher),
+            _engine(engine),
+            _map(map),
+            _key(key) { }
+
+        void operator()(osg::Object*)
+        {
+            osg::ref_ptr<TilePrefetcher> prefetcher;
+            if (!_prefetcher.lock(prefetcher))
+                return;
+
+            osg::ref_ptr<TerrainTileModel> model;
+
+            // Skip the work if the region was invalidated while we waited.
+            if (prefetcher->isCanceled(_key))
+            {
+                prefetcher->complete(_key, 0L);
+                return;
+            }
+
+            osg::ref_ptr<TerrainEngineNode> engine;
+            osg::ref_ptr<const Map> map;
+            if (_engine.lock(engine) && _map.lock(map))
+            {
+                OE_PROFILING_ZONE_NAMED("Prefetch");
+                model = engine->createTileModel(
+                    map.get(),
+                    _key,
+                    CreateTileManifest(),
+                    0L);
+            }
+
+            prefetcher->complete(_key, model.get());
+        }
+
+        osg::observer_ptr<TilePrefetcher> _prefetcher;
+        osg::observer_ptr<TerrainEngineNode> _engine;
+        osg::observer_ptr<const Map> _map;
+        TileKey _key;
+    };
+}
+
+TilePrefetcher::TilePrefetcher(const TerrainOptions& options, const SelectionInfo& selectionInfo) :
+_options(options),
+_selectionInfo(selectionInfo),
+_tokens(0.0),
+_lastTime(-1.0)
+{
+    _pool = new ThreadPool(osg::maximum(_options.prefetchMaxRequests().get(), 1u));
+}
+
+void
+TilePrefetcher::setFlightPlan(const std::vector<Viewpoint>& plan)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _plan = plan;
+}
+
+TerrainTileModel*
+TilePrefetcher::take(const TileKey& key, const Revision& mapRevision)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    ReadyTable::iterator i = _ready.find(key);
+    if (i == _ready.end())
+        return 0L;
+
+    osg::ref_ptr<TerrainTileModel> model = i->second;
+    _ready.erase(i);
+    _stats.residentBytes -= osg::minimum(_stats.residentBytes, getSizeInBytes(model.get()));
+
+    if (model->getRevision() != mapRevision)
+        return 0L;
+
+    ++_stats.hits;
+    return model.release();
+}
+
+void
+TilePrefetcher::complete(const TileKey& key, TerrainTileModel* model)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    _inFlight.erase(key);
+
+    // A model built before its region was invalidated holds stale data.
+    if (_canceled.erase(key) > 0u)
+        return;
+
+    if (model == 0L)
+        return;
+
+    ++_stats.completed;
+
+    if (_ready.find(key) == _ready.end())
+    {
+        _ready[key] = model;
+        _readyOrder.push_back(key);
+        _stats.residentBytes += getSizeInBytes(model);
+    }
+
+    // Drop the oldest models until we are back within budget.
+    size_t budget = (size_t)_options.prefetchMemoryBudget().get() * 1024u * 1024u;
+    while (_stats.residentBytes > budget && !_readyOrder.empty())
+    {
+        ReadyTable::iterator i = _ready.find(_readyOrder.front());
+        _readyOrder.pop_front();
+        if (i != _ready.end())
+        {
+            _stats.residentBytes -= osg::minimum(_stats.residentBytes, getSizeInBytes(i->second.get()));
+            _ready.erase(i);
+            ++_stats.evicted;
+        }
+    }
+
+    // Entries already taken leave stale keys in the order queue; 
+    // trim them so the queue does not grow without bound.
+    while (!_readyOrder.empty() && _ready.find(_readyOrder.front()) == _ready.end())
+    {
+        _readyOrder.pop_front();
+    }
+}
+
+void
+TilePrefetcher::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _ready.clear();
+    _readyOrder.clear();
+    _attempted.clear();
+    _stats.residentBytes = 0u;
+}
+
+bool
+TilePrefetcher::intersects(const TileKey& key, const GeoExtent& extent, unsigned minLevel, unsigned maxLevel) const
+{
+    if (key.getLOD() < minLevel || key.getLOD() > maxLevel)
+        return false;
+
+    return !extent.isValid() || key.getExtent().intersects(extent);
+}
+
+void
+TilePrefetcher::invalidate(const GeoExtent& extent, unsigned minLevel, unsigned maxLevel)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    for (ReadyTable::iterator i = _ready.begin(); i != _ready.end(); )
+    {
+        if (intersects(i->first, extent, minLevel, maxLevel))
+        {
+            _stats.residentBytes -= osg::minimum(_stats.residentBytes, getSizeInBytes(i->second.get()));
+            _ready.erase(i++);
+        }
+        else ++i;
+    }
+
+    // Stale keys left in _readyOrder are skipped by complete().
+
+    // Let the region be fetched again with fresh data.
+    for (KeySet::iterator i = _attempted.begin(); i != _attempted.end(); )
+    {
+        if (intersects(*i, extent, minLevel, maxLevel))
+            _attempted.erase(i++);
+        else ++i;
+    }
+
+    for (KeySet::const_iterator i = _inFlight.begin(); i != _inFlight.end(); ++i)
+    {
+        if (intersects(*i, extent, minLevel, maxLevel))
+            _canceled.insert(*i);
+    }
+}
+
+bool
+TilePrefetcher::isCanceled(const TileKey& key) const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _canceled.find(key) != _canceled.end();
+}
+
+TilePrefetcher::Stats
+TilePrefetcher::getStats() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _stats;
+}
+
+unsigned
+TilePrefetcher::getLODForRange(double range) const
+{
+    // Visibility ranges shrink as the LOD increases, so the LOD we want
+    // is the deepest one whose range still reaches the camera.
+    unsigned best = 0u;
+    for (unsigned lod = 0; lod < _selectionInfo.getNumLODs(); ++lod)
+    {
+        if (_selectionInfo.getLOD(lod)._visibilityRange >= range)
+            best = lod;
+        else
+            break;
+    }
+    return best;
+}
+
+size_t
+TilePrefetcher::getSizeInBytes(const TerrainTileModel* model) const
+{
+    std::vector<const osg::Texture*> textures;
+    for (TerrainTileColorLayerModelVector::const_iterator i = model->colorLayers().begin();
+        i != model->colorLayers().end();
+        ++i)
+    {
+        if (i->valid())
+            textures.push_back(i->get()->getTexture());
+    }
+    textures.push_back(model->getElevationTexture());
+    textures.push_back(model->getNormalTexture());
+    textures.push_back(model->getLandCoverTexture());
+
+    size_t bytes = 0u;
+    for (unsigned t = 0; t < textures.size(); ++t)
+    {
+        const osg::Texture* tex = textures[t];
+        if (tex == 0L)
+            continue;
+        for (unsigned i = 0; i < tex->getNumImages(); ++i)
+        {
+            const osg::Image* image = tex->getImage(i);
+            if (image)
+                bytes += image->getTotalSizeInBytes();
+        }
+    }
+    return bytes;
+}
+
+void
+TilePrefetcher::predict(const osg::Vec3d& eye, std::vector<Target>& targets) const
+{
+    // Follow the flight plan if we have one: prefetch the waypoint closest
+    // to the camera and the few after it.
+    if (!_plan.empty())
+    {
+        unsigned closest = 0u;
+        double closestDist2 = DBL_MAX;
+        std::vector<Target> waypoints;
+        waypoints.reserve(_plan.size());
+
+        for (unsigned i = 0; i < _plan.size(); ++i)
+        {
+            const Viewpoint& vp = _plan[i];
+            Target target;
+            if (!vp.focalPoint().isSet() || !vp.focalPoint()->toWorld(target._world))
+                continue;
+            target._range = vp.range().isSet() ? vp.range()->as(Units::METERS) : 0.0;
+
+            double d2 = (target._world - eye).length2();
+            if (d2 < closestDist2)
+            {
+                closestDist2 = d2;
+                closest = waypoints.size();
+            }
+            waypoints.push_back(target);
+        }
+
+        for (unsigned i = closest; i < waypoints.size() && i < closest + NUM_WAYPOINTS; ++i)
+        {
+            targets.push_back(waypoints[i]);
+        }
+        return;
+    }
+
+    // Otherwise extrapolate the camera's recent motion.
+    if (_history.size() < 2)
+        return;
+
+    const Sample& first = _history.front();
+    const Sample& last = _history.back();
+    double dt = last._time - first._time;
+    if (dt <= 0.0)
+        return;
+
+    osg::Vec3d velocity = (last._eye - first._eye) / dt;
+    if (velocity.length2() == 0.0)
+        return;
+
+    double lookahead = _options.prefetchLookahead().get();
+    for (unsigned step = 1; step <= NUM_PREDICTION_STEPS; ++step)
+    {
+        Target target;
+        target._world = eye + velocity * (lookahead * (double)step / (double)NUM_PREDICTION_STEPS);
+        target._range = -1.0; // use the altitude of the predicted point
+        targets.push_back(target);
+    }
+}
+
+void
+TilePrefetcher::update(EngineContext* context, const osg::Vec3d& eye, double time)
+{
+    OE_PROFILING_ZONE;
+
+    // serialize updates from multiple cull threads
+    Threading::ScopedMutexLock updateLock(_updateMutex);
+
+    osg::ref_ptr<const Map> map = context->getMap();
+    if (!map.valid())
+        return;
+
+    osg::ref_ptr<TerrainEngineNode> engine;
+    if (!context->_terrainEngine.lock(engine))
+        return;
+
+    // Refill the request budget.
+    double maxTokens = (double)_options.prefetchMaxRequests().get();
+    if (_lastTime >= 0.0 && time > _lastTime)
+    {
+        _tokens = osg::minimum(maxTokens, _tokens + (time - _lastTime) * _options.prefetchRequestsPerSecond().get());
+    }
+    _lastTime = time;
+
+    // Keep about a second of camera history for velocity estimation.
+    Sample sample;
+    sample._eye = eye;
+    sample._time = time;
+    _history.push_back(sample);
+    while (_history.size() > 2 && _history.back()._time - _history.front()._time > 1.0)
+    {
+        _history.pop_front();
+    }
+
+    if (_tokens < 1.0)
+        return;
+
+    std::vector<Target> targets;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        predict(eye, targets);
+    }
+
+    if (targets.empty())
+        return;
+
+    const Profile* profile = map->getProfile();
+    unsigned maxLOD = _options.maxLOD().get();
+    unsigned firstLOD = _options.firstLOD().get();
+
+    // Collect candidate keys, coarsest first, since the terrain pages
+    // top-down and needs the ancestors before the target tiles.
+    std::vector<TileKey> candidates;
+    for (unsigned t = 0; t < targets.size(); ++t)
+    {
+        GeoPoint point;
+        if (!point.fromWorld(profile->getSRS(), targets[t]._world))
+            continue;
+
+        double range = targets[t]._range >= 0.0 ? targets[t]._range : osg::maximum(point.z(), 0.0);
+        unsigned lod = osg::minimum(getLODForRange(range), maxLOD);
+        if (lod < firstLOD)
+            continue;
+
+        unsigned topLOD = osg::maximum(firstLOD, lod > NUM_ANCESTOR_LODS ? lod - NUM_ANCESTOR_LODS : 0u);
+        for (unsigned l = topLOD; l <= lod; ++l)
+        {
+            TileKey key = profile->createTileKey(point.x(), point.y(), l);
+            if (!key.valid())
+                continue;
+
+            candidates.push_back(key);
+
+            if (l == lod)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        if (dx != 0 || dy != 0)
+                            candidates.push_back(key.createNeighborKey(dx, dy));
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (_attempted.size() > MAX_ATTEMPTED_KEYS)
+        _attempted.clear();
+
+    size_t budget = (size_t)_options.prefetchMemoryBudget().get() * 1024u * 1024u;
+
+    // TileKey sorts by LOD first, so this schedules coarse tiles first.
+    for (unsigned i = 0; i < candidates.size(); ++i)
+    {
+        if (_tokens < 1.0 ||
+            _inFlight.size() >= _options.prefetchMaxRequests().get() ||
+            _stats.residentBytes >= budget)
+        {
+            break;
+        }
+
+        const TileKey& key = candidates[i];
+        if (!key.valid() || _attempted.find(key) != _attempted.end() || _inFlight.find(key) != _inFlight.end())
+            continue;
+
+        _attempted.insert(key);
+        _inFlight.insert(key);
+        _tokens -= 1.0;
+        ++_stats.requested;
+
+        _pool->getQueue()->add(new PrefetchOperation(this, engine.get(), map.get(), key));
+    }
+
+    OE_PROFILING_PLOT("Prefetch resident MB", (float)_stats.residentBytes / 1048576.0f);
+}
@@ -0,0 +1,80 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/Containers>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+TEST_CASE( "flat_hash_map" ) {
+
+    flat_hash_map<long long, unsigned> map;
+    std::map<long long, unsigned> expected;
+
+    // a mix of inserts and erases on a small key range forces
+    // plenty of collisions and backward-shift deletions.
+    unsigned seed = 1u;
+    for (unsigned i = 0; i < 50000; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        long long key = (seed >> 8) % 2000;
+        if ((seed >> 4) % 3 != 0)
+        {
+            map[key] = i;
+            expected[key] = i;
+        }
+        else
+        {
+            REQUIRE(map.erase(key) == (expected.erase(key) > 0));
+        }
+    }
+
+    SECTION("Contents")
+    {
+        REQUIRE(map.size() == expected.size());
+        for (std::map<long long, unsigned>::const_iterator i = expected.begin(); i != expected.end(); ++i)
+        {
+            flat_hash_map<long long, unsigned>::const_iterator f = map.find(i->first);
+            REQUIRE(f != map.end());
+            REQUIRE(f->second == i->second);
+        }
+    }
+
+    SECTION("Iteration")
+    {
+        unsigned count = 0;
+        for (flat_hash_map<long long, unsigned>::const_iterator i = map.begin(); i != map.end(); ++i)
+        {
+            REQUIRE(expected.find(i->first) != expected.end());
+            ++count;
+        }
+        REQUIRE(count == expected.size());
+    }
+
+    SECTION("Reserve")
+    {
+        map.reserve(100000);
+        REQUIRE(map.size() == expected.size());
+        REQUIRE(map.find(expected.begin()->first) != map.end());
+    }
+}
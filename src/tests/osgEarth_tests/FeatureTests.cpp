@@ -24,6 +24,12 @@
 
 #include <osgEarth/Feature>
 #include <osgEarth/GeometryUtils>
+#include <osgEarth/FeatureTileCodec>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/Switch>
+#include <cstring>
 
 using namespace osgEarth;
 
@@ -109,3 +115,224 @@ TEST_CASE("Feature handles attributes correctly.") {
         REQUIRE(feature->getBool("bool") == false);
     }
 }
+
+namespace
+{
+    bool sameArray(const osg::Array* a, const osg::Array* b)
+    {
+        if (!a || !b)
+            return a == b;
+
+        return
+            a->getType() == b->getType() &&
+            a->getBinding() == b->getBinding() &&
+            a->getNormalize() == b->getNormalize() &&
+            a->getNumElements() == b->getNumElements() &&
+            a->getTotalDataSize() == b->getTotalDataSize() &&
+            memcmp(a->getDataPointer(), b->getDataPointer(), a->getTotalDataSize()) == 0;
+    }
+
+    bool samePrimitiveSet(const osg::PrimitiveSet* a, const osg::PrimitiveSet* b)
+    {
+        if (a->getType() != b->getType() || a->getMode() != b->getMode() || a->getNumIndices() != b->getNumIndices())
+            return false;
+
+        for (unsigned i = 0; i < a->getNumIndices(); ++i)
+        {
+            if (a->index(i) != b->index(i))
+                return false;
+        }
+        return true;
+    }
+
+    bool sameGeometry(const osg::Geometry* a, const osg::Geometry* b)
+    {
+        if (a->getName() != b->getName() ||
+            a->getUseVertexBufferObjects() != b->getUseVertexBufferObjects() ||
+            !sameArray(a->getVertexArray(), b->getVertexArray()) ||
+            !sameArray(a->getNormalArray(), b->getNormalArray()) ||
+            !sameArray(a->getColorArray(), b->getColorArray()) ||
+            a->getNumTexCoordArrays() != b->getNumTexCoordArrays() ||
+            a->getNumVertexAttribArrays() != b->getNumVertexAttribArrays() ||
+            a->getNumPrimitiveSets() != b->getNumPrimitiveSets())
+            return false;
+
+        for (unsigned i = 0; i < a->getNumTexCoordArrays(); ++i)
+            if (!sameArray(a->getTexCoordArray(i), b->getTexCoordArray(i)))
+                return false;
+
+        for (unsigned i = 0; i < a->getNumVertexAttribArrays(); ++i)
+            if (!sameArray(a->getVertexAttribArray(i), b->getVertexAttribArray(i)))
+                return false;
+
+        for (unsigned i = 0; i < a->getNumPrimitiveSets(); ++i)
+            if (!samePrimitiveSet(a->getPrimitiveSet(i), b->getPrimitiveSet(i)))
+                return false;
+
+        return true;
+    }
+
+    osg::Node* roundTrip(const osg::Node* node)
+    {
+        std::string buffer;
+        if (!FeatureTileCodec::encode(node, 0L, buffer) || !FeatureTileCodec::isEncoded(buffer))
+            return 0L;
+        return FeatureTileCodec::decode(buffer, 0L);
+    }
+}
+
+TEST_CASE("FeatureTileCodec round-trips compiled feature tiles") {
+
+    SECTION("Geometry with every supported array type") {
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+        geom->setName("building");
+        geom->setUseVertexBufferObjects(true);
+        geom->setUseDisplayList(false);
+
+        osg::Vec3Array* verts = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX);
+        verts->push_back(osg::Vec3(0, 0, 0));
+        verts->push_back(osg::Vec3(1, 0, 0));
+        verts->push_back(osg::Vec3(1, 1, 0));
+        verts->push_back(osg::Vec3(0, 1, 5));
+        geom->setVertexArray(verts);
+
+        osg::Vec3Array* normals = new osg::Vec3Array(osg::Array::BIND_OVERALL);
+        normals->push_back(osg::Vec3(0, 0, 1));
+        geom->setNormalArray(normals);
+
+        osg::Vec4Array* colors = new osg::Vec4Array(osg::Array::BIND_PER_VERTEX);
+        colors->assign(4, osg::Vec4(1, 0.5f, 0.25f, 1));
+        geom->setColorArray(colors);
+
+        osg::Vec2Array* texcoords = new osg::Vec2Array(osg::Array::BIND_PER_VERTEX);
+        texcoords->push_back(osg::Vec2(0, 0));
+        texcoords->push_back(osg::Vec2(1, 0));
+        texcoords->push_back(osg::Vec2(1, 1));
+        texcoords->push_back(osg::Vec2(0, 1));
+        geom->setTexCoordArray(1, texcoords);
+
+        osg::FloatArray* heights = new osg::FloatArray(osg::Array::BIND_PER_VERTEX);
+        heights->push_back(0.0f);
+        heights->push_back(1.5f);
+        heights->push_back(-2.0f);
+        heights->push_back(1e6f);
+        heights->setNormalize(true);
+        geom->setVertexAttribArray(6, heights);
+
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_STRIP, 1, 3));
+        const GLubyte ub[3] = { 0, 1, 2 };
+        geom->addPrimitiveSet(new osg::DrawElementsUByte(GL_TRIANGLES, 3, ub));
+        const GLushort us[6] = { 0, 1, 2, 0, 2, 3 };
+        geom->addPrimitiveSet(new osg::DrawElementsUShort(GL_TRIANGLES, 6, us));
+        const GLuint ui[4] = { 3, 2, 1, 0 };
+        geom->addPrimitiveSet(new osg::DrawElementsUInt(GL_LINE_LOOP, 4, ui));
+
+        // one state set shared by two geometries, one on a transform
+        osg::ref_ptr<osg::StateSet> shared = new osg::StateSet();
+        shared->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+        geom->setStateSet(shared.get());
+
+        osg::ref_ptr<osg::Geometry> geom2 = new osg::Geometry(*geom, osg::CopyOp::SHALLOW_COPY);
+        geom2->setName("roof");
+
+        osg::Geode* geode = new osg::Geode();
+        geode->setName("features");
+        geode->addDrawable(geom.get());
+        geode->addDrawable(geom2.get());
+
+        osg::MatrixTransform* xform = new osg::MatrixTransform();
+        xform->setMatrix(osg::Matrixd::translate(6378137.0, -12.5, 0.125));
+        xform->setStateSet(shared.get());
+        xform->addChild(geode);
+
+        osg::ref_ptr<osg::Group> root = new osg::Group();
+        root->setName("tile");
+        root->setNodeMask(0x5);
+        root->addChild(xform);
+
+        osg::ref_ptr<osg::Node> out = roundTrip(root.get());
+        REQUIRE(out.valid());
+
+        osg::Group* outRoot = out->asGroup();
+        REQUIRE(outRoot != 0L);
+        REQUIRE(outRoot->getName() == "tile");
+        REQUIRE(outRoot->getNodeMask() == 0x5);
+        REQUIRE(outRoot->getNumChildren() == 1);
+
+        osg::MatrixTransform* outXform = dynamic_cast<osg::MatrixTransform*>(outRoot->getChild(0));
+        REQUIRE(outXform != 0L);
+        REQUIRE(outXform->getMatrix() == xform->getMatrix());
+        REQUIRE(outXform->getNumChildren() == 1);
+
+        osg::Geode* outGeode = dynamic_cast<osg::Geode*>(outXform->getChild(0));
+        REQUIRE(outGeode != 0L);
+        REQUIRE(outGeode->getName() == "features");
+        REQUIRE(outGeode->getNumDrawables() == 2);
+
+        osg::Geometry* outGeom = outGeode->getDrawable(0)->asGeometry();
+        osg::Geometry* outGeom2 = outGeode->getDrawable(1)->asGeometry();
+        REQUIRE(outGeom != 0L);
+        REQUIRE(outGeom2 != 0L);
+        REQUIRE(sameGeometry(geom.get(), outGeom));
+        REQUIRE(sameGeometry(geom2.get(), outGeom2));
+
+        // the state set table restores sharing
+        REQUIRE(outXform->getStateSet() != 0L);
+        REQUIRE(outGeom->getStateSet() == outXform->getStateSet());
+        REQUIRE(outGeom2->getStateSet() == outXform->getStateSet());
+        REQUIRE(outGeom->getStateSet()->getMode(GL_LIGHTING) == osg::StateAttribute::OFF);
+    }
+
+    SECTION("Empty tiles") {
+        std::string buffer;
+        REQUIRE_FALSE(FeatureTileCodec::encode(0L, 0L, buffer));
+
+        osg::ref_ptr<osg::Group> emptyGroup = new osg::Group();
+        osg::ref_ptr<osg::Node> out = roundTrip(emptyGroup.get());
+        REQUIRE(out.valid());
+        REQUIRE(out->asGroup() != 0L);
+        REQUIRE(out->asGroup()->getNumChildren() == 0);
+
+        // a geode holding a geometry with no arrays or primitives
+        osg::ref_ptr<osg::Geode> emptyGeode = new osg::Geode();
+        osg::ref_ptr<osg::Geometry> emptyGeom = new osg::Geometry();
+        emptyGeode->addDrawable(emptyGeom.get());
+        out = roundTrip(emptyGeode.get());
+        REQUIRE(out.valid());
+        osg::Geode* outGeode = dynamic_cast<osg::Geode*>(out.get());
+        REQUIRE(outGeode != 0L);
+        REQUIRE(outGeode->getNumDrawables() == 1);
+        REQUIRE(sameGeometry(emptyGeom.get(), outGeode->getDrawable(0)->asGeometry()));
+    }
+
+    SECTION("Graphs the compact form can't hold fall back to osgb") {
+        osg::ref_ptr<osg::Switch> root = new osg::Switch();
+        osg::Geode* geode = new osg::Geode();
+        osg::Geometry* geom = new osg::Geometry();
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        verts->push_back(osg::Vec3(1, 2, 3));
+        geom->setVertexArray(verts);
+        osg::UIntArray* ids = new osg::UIntArray(osg::Array::BIND_PER_VERTEX);
+        ids->push_back(42u);
+        geom->setVertexAttribArray(7, ids);
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_POINTS, 0, 1));
+        geode->addDrawable(geom);
+        root->addChild(geode, false);
+
+        osg::ref_ptr<osg::Node> out = roundTrip(root.get());
+        REQUIRE(out.valid());
+        osg::Switch* outSwitch = dynamic_cast<osg::Switch*>(out.get());
+        REQUIRE(outSwitch != 0L);
+        REQUIRE(outSwitch->getValue(0) == false);
+        osg::Geode* outGeode = dynamic_cast<osg::Geode*>(outSwitch->getChild(0));
+        REQUIRE(outGeode != 0L);
+        REQUIRE(sameGeometry(geom, outGeode->getDrawable(0)->asGeometry()));
+    }
+
+    SECTION("Buffers that aren't codec output are rejected") {
+        REQUIRE_FALSE(FeatureTileCodec::isEncoded(""));
+        REQUIRE(FeatureTileCodec::decode("", 0L) == 0L);
+        REQUIRE(FeatureTileCodec::decode("OEFT", 0L) == 0L);
+        REQUIRE(FeatureTileCodec::decode("not a tile", 0L) == 0L);
+    }
+}
@@ -0,0 +1,170 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/LineDrawable>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace
+{
+    template<typename T>
+    bool sameArray(const osg::Array* a, const osg::Array* b)
+    {
+        if (a == 0L || b == 0L)
+            return a == b;
+
+        const T* lhs = dynamic_cast<const T*>(a);
+        const T* rhs = dynamic_cast<const T*>(b);
+        if (lhs == 0L || rhs == 0L || lhs->size() != rhs->size())
+            return false;
+
+        for (unsigned i = 0; i < lhs->size(); ++i)
+            if ((*lhs)[i] != (*rhs)[i])
+                return false;
+
+        return true;
+    }
+
+    bool samePrimitives(const osg::Geometry* a, const osg::Geometry* b)
+    {
+        if (a->getNumPrimitiveSets() != b->getNumPrimitiveSets())
+            return false;
+
+        for (unsigned p = 0; p < a->getNumPrimitiveSets(); ++p)
+        {
+            const osg::PrimitiveSet* lhs = a->getPrimitiveSet(p);
+            const osg::PrimitiveSet* rhs = b->getPrimitiveSet(p);
+            if (lhs->getMode() != rhs->getMode() || lhs->getNumIndices() != rhs->getNumIndices())
+                return false;
+
+            for (unsigned i = 0; i < lhs->getNumIndices(); ++i)
+                if (lhs->index(i) != rhs->index(i))
+                    return false;
+        }
+        return true;
+    }
+
+    // Everything a LineDrawable sends to GL must match, whichever way it was built.
+    bool sameLine(const LineDrawable* a, const LineDrawable* b)
+    {
+        return
+            a->getNumVerts() == b->getNumVerts() &&
+            sameArray<osg::Vec3Array>(a->getVertexArray(), b->getVertexArray()) &&
+            sameArray<osg::Vec4Array>(a->getColorArray(), b->getColorArray()) &&
+            sameArray<osg::Vec3Array>(a->getVertexAttribArray(LineDrawable::PreviousVertexAttrLocation), b->getVertexAttribArray(LineDrawable::PreviousVertexAttrLocation)) &&
+            sameArray<osg::Vec3Array>(a->getVertexAttribArray(LineDrawable::NextVertexAttrLocation), b->getVertexAttribArray(LineDrawable::NextVertexAttrLocation)) &&
+            samePrimitives(a, b);
+    }
+
+    LineDrawable* makeLine(GLenum mode, bool useGPU)
+    {
+        LineDrawable* line = new LineDrawable(mode);
+        line->setUseGPU(useGPU);
+        line->setColor(osg::Vec4(1.0f, 0.5f, 0.25f, 1.0f));
+        return line;
+    }
+
+    // the reference: one pushVertex at a time
+    LineDrawable* pushLine(GLenum mode, bool useGPU, const std::vector<osg::Vec3>& verts)
+    {
+        LineDrawable* line = makeLine(mode, useGPU);
+        for (unsigned i = 0; i < verts.size(); ++i)
+            line->pushVertex(verts[i]);
+        line->dirty();
+        return line;
+    }
+
+    const osg::Vec3* data(const std::vector<osg::Vec3>& verts, unsigned first =0u)
+    {
+        return first < verts.size() ? &verts[first] : 0L;
+    }
+}
+
+TEST_CASE("LineDrawable bulk vertex calls match pushVertex") {
+
+    const GLenum modes[] = { GL_LINE_STRIP, GL_LINE_LOOP, GL_LINES };
+    const char* modeNames[] = { "GL_LINE_STRIP", "GL_LINE_LOOP", "GL_LINES" };
+
+    // 1 vertex, odd and even counts, and enough to need 16-bit indices
+    const unsigned counts[] = { 0u, 1u, 2u, 3u, 4u, 7u, 300u };
+
+    for (unsigned gpu = 0; gpu < 2; ++gpu)
+    {
+        bool useGPU = gpu == 1;
+
+        for (unsigned m = 0; m < 3; ++m)
+        {
+            for (unsigned c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c)
+            {
+                unsigned n = counts[c];
+                INFO(modeNames[m] << ", " << n << " vertices, useGPU=" << useGPU);
+
+                std::vector<osg::Vec3> verts;
+                for (unsigned i = 0; i < n; ++i)
+                    verts.push_back(osg::Vec3((float)i, (float)(i*i % 17), (float)(i % 3)));
+
+                osg::ref_ptr<LineDrawable> expected = pushLine(modes[m], useGPU, verts);
+
+                // setVertices
+                osg::ref_ptr<LineDrawable> set = makeLine(modes[m], useGPU);
+                set->setVertices(data(verts), n);
+                REQUIRE(sameLine(set.get(), expected.get()));
+
+                // setVertices again, replacing older data
+                set->setVertices(data(verts), n);
+                REQUIRE(sameLine(set.get(), expected.get()));
+
+                // appendVertices in one call
+                osg::ref_ptr<LineDrawable> append = makeLine(modes[m], useGPU);
+                append->appendVertices(data(verts), n);
+                append->dirty();
+                REQUIRE(sameLine(append.get(), expected.get()));
+
+                // appendVertices split at every point, including splits that
+                // leave a GL_LINES segment unpaired until the next call
+                for (unsigned split = 1; split < n && split <= 8u; ++split)
+                {
+                    INFO("split at " << split);
+                    osg::ref_ptr<LineDrawable> parts = makeLine(modes[m], useGPU);
+                    parts->appendVertices(data(verts), split);
+                    parts->appendVertices(data(verts, split), n - split);
+                    parts->dirty();
+                    REQUIRE(sameLine(parts.get(), expected.get()));
+                }
+
+                // appendVertices after pushVertex, and the other way around
+                if (n >= 2u)
+                {
+                    osg::ref_ptr<LineDrawable> mixed = makeLine(modes[m], useGPU);
+                    mixed->pushVertex(verts[0]);
+                    mixed->appendVertices(data(verts, 1u), n - 2u);
+                    mixed->pushVertex(verts[n-1]);
+                    mixed->dirty();
+                    REQUIRE(sameLine(mixed.get(), expected.get()));
+                }
+            }
+        }
+    }
+}
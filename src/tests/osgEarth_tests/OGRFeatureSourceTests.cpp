@@ -0,0 +1,91 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/OGRFeatureSource>
+#include <osgEarth/FeatureCursor>
+#include <map>
+
+using namespace osgEarth;
+
+TEST_CASE("OGRFeatureSource attribute projection keeps geometry and FIDs on SQL drivers")
+{
+    osg::ref_ptr<OGRFeatureSource> source = new OGRFeatureSource();
+    source->setURL("../data/cities.gpkg");
+    source->setOGRDriver("GPKG");
+
+    Status status = source->open();
+    REQUIRE(status.isOK());
+
+    Query full;
+    full.expression() = "pop_max > 10000000";
+
+    Query projected = full;
+    projected.attributes().push_back("name");
+
+    FeatureList fullFeatures;
+    osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor(full, 0L);
+    REQUIRE(cursor.valid());
+    cursor->fill(fullFeatures);
+    REQUIRE(fullFeatures.size() > 0);
+
+    FeatureList projectedFeatures;
+    cursor = source->createFeatureCursor(projected, 0L);
+    REQUIRE(cursor.valid());
+    cursor->fill(projectedFeatures);
+    REQUIRE(projectedFeatures.size() == fullFeatures.size());
+
+    std::map<FeatureID, std::string> names;
+    for (FeatureList::const_iterator i = fullFeatures.begin(); i != fullFeatures.end(); ++i)
+    {
+        names[i->get()->getFID()] = i->get()->getString("name");
+    }
+
+    SECTION("Projected features keep their geometry")
+    {
+        for (FeatureList::const_iterator i = projectedFeatures.begin(); i != projectedFeatures.end(); ++i)
+        {
+            const Geometry* geom = i->get()->getGeometry();
+            REQUIRE(geom != 0L);
+            REQUIRE(geom->size() > 0);
+        }
+    }
+
+    SECTION("Projected features keep their FIDs and requested attributes")
+    {
+        for (FeatureList::const_iterator i = projectedFeatures.begin(); i != projectedFeatures.end(); ++i)
+        {
+            std::map<FeatureID, std::string>::const_iterator n = names.find(i->get()->getFID());
+            REQUIRE(n != names.end());
+            REQUIRE(i->get()->getString("name") == n->second);
+        }
+    }
+
+    SECTION("Unrequested attributes are dropped")
+    {
+        for (FeatureList::const_iterator i = projectedFeatures.begin(); i != projectedFeatures.end(); ++i)
+        {
+            REQUIRE_FALSE(i->get()->hasAttr("rank_max"));
+        }
+    }
+}
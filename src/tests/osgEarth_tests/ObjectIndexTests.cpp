@@ -0,0 +1,214 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2020 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ObjectIndex>
+#include <osgEarth/FeatureSourceIndexNode>
+#include <osg/Geometry>
+
+using namespace osgEarth;
+
+TEST_CASE( "ObjectIDRemap" ) {
+
+    ObjectIDRemap remap;
+    remap.add(30u, 3u);
+    remap.add(10u, 1u);
+    remap.add(20u, 2u);
+
+    ObjectID out = 0u;
+    REQUIRE(remap.find(10u, out));
+    REQUIRE(out == 1u);
+    REQUIRE(remap.find(30u, out));
+    REQUIRE(out == 3u);
+    REQUIRE_FALSE(remap.find(15u, out));
+
+    SECTION("Later mappings replace earlier ones")
+    {
+        remap.add(20u, 22u);
+        remap.add(5u, 0u);
+        REQUIRE(remap.size() == 4u);
+        REQUIRE(remap.find(20u, out));
+        REQUIRE(out == 22u);
+        REQUIRE(remap.find(5u, out));
+        REQUIRE(out == 0u);
+    }
+
+    SECTION("Interleaved adds and finds")
+    {
+        for (ObjectID i = 1000u; i < 3000u; ++i)
+        {
+            REQUIRE_FALSE(remap.find(i, out));
+            remap.add(i, i + 1u);
+            if ((i % 7u) == 0u)
+                remap.add(i - 500u, 7u);
+        }
+        REQUIRE(remap.find(1001u, out));
+        REQUIRE(out == 1002u);
+        REQUIRE(remap.find(2300u, out));
+        REQUIRE(out == 7u);
+        REQUIRE(remap.find(10u, out));
+        REQUIRE(out == 1u);
+        REQUIRE(remap.size() == 2075u);
+    }
+}
+
+TEST_CASE( "ObjectIndex" ) {
+
+    osg::ref_ptr<ObjectIndex> index = new ObjectIndex();
+
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+    geom->setVertexArray(new osg::Vec3Array(10));
+
+    osg::ref_ptr<osg::Referenced> a = new osg::Referenced();
+    osg::ref_ptr<osg::Referenced> b = new osg::Referenced();
+    ObjectID aid = index->insert(a.get());
+    ObjectID bid = index->insert(b.get());
+    REQUIRE(index->size() == 2u);
+    REQUIRE(index->get<osg::Referenced>(aid) == a.get());
+
+    index->tagRange(geom.get(), aid, 0u, 4u);
+    index->tagRange(geom.get(), bid, 6u, 100u);
+
+    ObjectIDArray* ids = dynamic_cast<ObjectIDArray*>(
+        geom->getVertexAttribArray(index->getObjectIDAttribLocation()));
+    REQUIRE(ids != 0L);
+    REQUIRE(ids->size() == 10u);
+    REQUIRE((*ids)[3] == aid);
+    REQUIRE((*ids)[4] == OSGEARTH_OBJECTID_EMPTY);
+    REQUIRE((*ids)[9] == bid);
+
+    SECTION("Remap IDs")
+    {
+        ObjectIDRemap remap;
+        osg::ref_ptr<osg::Referenced> c = new osg::Referenced();
+        REQUIRE(index->updateObjectIDs(geom.get(), remap, c.get()));
+        REQUIRE(remap.size() == 2u);
+
+        ObjectID newA = 0u;
+        REQUIRE(remap.find(aid, newA));
+        REQUIRE(newA != aid);
+        REQUIRE((*ids)[0] == newA);
+        REQUIRE((*ids)[3] == newA);
+        REQUIRE((*ids)[4] == OSGEARTH_OBJECTID_EMPTY);
+        REQUIRE(index->get<osg::Referenced>(newA) == c.get());
+    }
+
+    index->remove(aid);
+    REQUIRE(index->get<osg::Referenced>(aid) == 0L);
+}
+
+namespace
+{
+    // Builder that implements only the per-object calls, to exercise
+    // the default tagRange.
+    struct PerObjectBuilder : public ObjectIndexBuilder<osg::Referenced>
+    {
+        osg::ref_ptr<ObjectIndex> _index;
+        PerObjectBuilder(ObjectIndex* index) : _index(index) { }
+
+        ObjectID tagDrawable(osg::Drawable* drawable, osg::Referenced* object) {
+            return _index->tagDrawable(drawable, object);
+        }
+        ObjectID tagAllDrawables(osg::Node* node, osg::Referenced* object) {
+            return _index->tagAllDrawables(node, object);
+        }
+        ObjectID tagNode(osg::Node* node, osg::Referenced* object) {
+            return _index->tagNode(node, object);
+        }
+    };
+}
+
+TEST_CASE( "ObjectIndexBuilder default tagRange" ) {
+
+    osg::ref_ptr<ObjectIndex> index = new ObjectIndex();
+    PerObjectBuilder builder(index.get());
+
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+    geom->setVertexArray(new osg::Vec3Array(10));
+
+    osg::ref_ptr<osg::Referenced> a = new osg::Referenced();
+    osg::ref_ptr<osg::Referenced> b = new osg::Referenced();
+    ObjectID aid = builder.tagRange(geom.get(), a.get(), 0u, 4u);
+    ObjectID bid = builder.tagRange(geom.get(), b.get(), 6u, 100u);
+    REQUIRE(index->get<osg::Referenced>(aid) == a.get());
+    REQUIRE(index->get<osg::Referenced>(bid) == b.get());
+
+    ObjectIDArray* ids = dynamic_cast<ObjectIDArray*>(
+        geom->getVertexAttribArray(index->getObjectIDAttribLocation()));
+    REQUIRE(ids != 0L);
+    REQUIRE(ids->size() == 10u);
+    REQUIRE((*ids)[0] == aid);
+    REQUIRE((*ids)[3] == aid);
+    REQUIRE((*ids)[4] == OSGEARTH_OBJECTID_EMPTY);
+    REQUIRE((*ids)[5] == OSGEARTH_OBJECTID_EMPTY);
+    REQUIRE((*ids)[6] == bid);
+    REQUIRE((*ids)[9] == bid);
+}
+
+TEST_CASE( "FeatureSourceIndexNode bulk insert" ) {
+
+    osg::ref_ptr<ObjectIndex> master = new ObjectIndex();
+    osg::ref_ptr<FeatureSourceIndex> index = new FeatureSourceIndex(0L, master.get(), FeatureSourceIndexOptions());
+    osg::ref_ptr<FeatureSourceIndexNode> node = new FeatureSourceIndexNode(index.get());
+
+    osg::ref_ptr<const SpatialReference> srs = SpatialReference::get("wgs84");
+    FeatureList features;
+    features.push_back(new Feature(new Point(), srs.get(), Style(), 10));
+    features.push_back(new Feature(new Point(), srs.get(), Style(), 11));
+    features.push_back(features.front().get()); // repeated FID
+
+    std::vector<ObjectID> oids;
+    node->insert(features, oids);
+
+    REQUIRE(oids.size() == 3);
+    REQUIRE(oids[0] != OSGEARTH_OBJECTID_EMPTY);
+    REQUIRE(oids[1] != OSGEARTH_OBJECTID_EMPTY);
+    REQUIRE(oids[0] != oids[1]);
+    REQUIRE(oids[2] == oids[0]);
+
+    REQUIRE(index->size() == 2);
+    REQUIRE(index->getObjectID(11) == oids[1]);
+    // with no feature source, the index embeds the features
+    REQUIRE(index->getFeature(oids[0]) == features.front().get());
+    REQUIRE(master->get<osg::Referenced>(oids[0]).get() == index.get());
+
+    const FeatureIndex* asFeatureIndex = index.get();
+    REQUIRE(asFeatureIndex->getMemoryUsage() > 0u);
+    REQUIRE(asFeatureIndex->getBytesPerFeature() > 0.0);
+
+    // a second node sharing a feature keeps it alive after the first goes away
+    osg::ref_ptr<FeatureSourceIndexNode> node2 = new FeatureSourceIndexNode(index.get());
+    FeatureList shared;
+    shared.push_back(features.front().get());
+    std::vector<ObjectID> oids2;
+    node2->insert(shared, oids2);
+    REQUIRE(oids2[0] == oids[0]);
+
+    node = 0L;
+    REQUIRE(index->size() == 1);
+    REQUIRE(index->getObjectID(10) == oids[0]);
+    REQUIRE(index->getObjectID(11) == OSGEARTH_OBJECTID_EMPTY);
+
+    node2 = 0L;
+    REQUIRE(index->size() == 0);
+    REQUIRE(master->get<osg::Referenced>(oids[0]).valid() == false);
+}
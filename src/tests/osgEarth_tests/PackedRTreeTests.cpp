@@ -0,0 +1,121 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/PackedRTree>
+#include <algorithm>
+#include <cstdio>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Grid of small boxes with IDs 100, 101, ...
+    void makeItems(std::vector<PackedRTree::Item>& items)
+    {
+        long long id = 100;
+        for (int y = 0; y < 40; ++y)
+        {
+            for (int x = 0; x < 50; ++x)
+            {
+                PackedRTree::Item item = { (double)x, (double)y, x + 0.5, y + 0.5, id++ };
+                items.push_back(item);
+            }
+        }
+    }
+
+    // IDs of the items that intersect the box, by brute force.
+    std::vector<long long> bruteForce(const std::vector<PackedRTree::Item>& items,
+                                      double xmin, double ymin, double xmax, double ymax)
+    {
+        std::vector<long long> ids;
+        for (unsigned i = 0; i < items.size(); ++i)
+        {
+            const PackedRTree::Item& item = items[i];
+            if (!(item.xmax < xmin || item.xmin > xmax || item.ymax < ymin || item.ymin > ymax))
+                ids.push_back(item.id);
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    std::vector<long long> search(const PackedRTree* tree,
+                                  double xmin, double ymin, double xmax, double ymax)
+    {
+        std::vector<long long> ids;
+        tree->search(xmin, ymin, xmax, ymax, ids);
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+}
+
+TEST_CASE("PackedRTree")
+{
+    std::vector<PackedRTree::Item> items;
+    makeItems(items);
+    std::vector<PackedRTree::Item> original = items;
+
+    osg::ref_ptr<PackedRTree> tree = new PackedRTree();
+    tree->build(items, 8u);
+    REQUIRE(tree->size() == original.size());
+
+    SECTION("Search matches a brute force scan")
+    {
+        REQUIRE(search(tree.get(), 10.2, 5.2, 14.7, 9.1) == bruteForce(original, 10.2, 5.2, 14.7, 9.1));
+        REQUIRE(search(tree.get(), -100, -100, 100, 100).size() == original.size());
+        REQUIRE(search(tree.get(), 60, 60, 70, 70).empty());
+        REQUIRE(search(tree.get(), 3.5, 3.5, 3.5, 3.5) == bruteForce(original, 3.5, 3.5, 3.5, 3.5));
+    }
+
+    SECTION("An empty tree finds nothing")
+    {
+        std::vector<PackedRTree::Item> none;
+        osg::ref_ptr<PackedRTree> empty = new PackedRTree();
+        empty->build(none);
+        REQUIRE(empty->size() == 0u);
+        REQUIRE(search(empty.get(), -100, -100, 100, 100).empty());
+    }
+
+    SECTION("A tree read back from a file answers the same queries")
+    {
+        const std::string filename = "PackedRTreeTests.oeidx";
+        const TimeStamp sourceTime = 1234567;
+        REQUIRE(tree->write(filename, sourceTime, "layer"));
+
+        osg::ref_ptr<PackedRTree> mapped = PackedRTree::read(filename, sourceTime, "layer");
+        REQUIRE(mapped.valid());
+        REQUIRE(mapped->size() == tree->size());
+        REQUIRE(search(mapped.get(), 10.2, 5.2, 14.7, 9.1) == search(tree.get(), 10.2, 5.2, 14.7, 9.1));
+        REQUIRE(search(mapped.get(), 0, 0, 49, 39).size() == original.size());
+        mapped = 0L;
+
+        // a stale timestamp or another key invalidates the file
+        osg::ref_ptr<PackedRTree> stale = PackedRTree::read(filename, sourceTime + 1, "layer");
+        REQUIRE_FALSE(stale.valid());
+        stale = PackedRTree::read(filename, sourceTime, "other");
+        REQUIRE_FALSE(stale.valid());
+
+        ::remove(filename.c_str());
+    }
+}
@@ -0,0 +1,83 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ScreenSpaceLayoutImpl>
+#include <osg/Group>
+
+using namespace osgEarth;
+using namespace osgEarth::Internal;
+
+TEST_CASE( "DeclutterGrid" ) {
+
+    std::vector< osg::ref_ptr<osg::Group> > parents;
+    for (unsigned i = 0; i < 50; ++i)
+        parents.push_back(new osg::Group());
+
+    DeclutterGrid grid;
+
+    // the grid must accept exactly the boxes that a brute-force scan would,
+    // including boxes that hang off the viewport.
+    unsigned seed = 1u;
+    for (unsigned frame = 0; frame < 3; ++frame)
+    {
+        grid.reset(0, 0, 1920, 1080);
+        std::vector<DeclutterGrid::Entry> used;
+        unsigned mismatches = 0;
+
+        for (unsigned i = 0; i < 5000; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            float x = (float)((seed >> 8) % 2300) - 200.0f;
+            seed = seed * 1664525u + 1013904223u;
+            float y = (float)((seed >> 8) % 1500) - 200.0f;
+            float w = (float)(5 + (seed >> 4) % 150);
+            float h = (float)(5 + (seed >> 12) % 30);
+            osg::BoundingBox box(x, y, 0, x + w, y + h, 0);
+            const osg::Node* parent = parents[(seed >> 16) % parents.size()].get();
+
+            bool expected = true;
+            for (unsigned j = 0; j < used.size() && expected; ++j)
+            {
+                bool isClear =
+                    box.xMin() > used[j].second.xMax() ||
+                    box.xMax() < used[j].second.xMin() ||
+                    box.yMin() > used[j].second.yMax() ||
+                    box.yMax() < used[j].second.yMin();
+                expected = isClear || parent == used[j].first;
+            }
+
+            bool actual = grid.isClear(box, parent);
+            if (actual != expected)
+                ++mismatches;
+
+            if (expected)
+            {
+                used.push_back(DeclutterGrid::Entry(parent, box));
+                grid.insert(box, parent);
+            }
+        }
+
+        REQUIRE(mismatches == 0u);
+        REQUIRE(grid.getEntries().size() == used.size());
+    }
+}
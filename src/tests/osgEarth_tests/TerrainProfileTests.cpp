@@ -0,0 +1,153 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/TerrainProfileImpl>
+#include <osgEarth/SpatialReference>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Contrib::Internal;
+
+namespace
+{
+    // Rolling terrain whose tiles can be changed one at a time
+    class TestElevationSource : public ProfileElevationSource
+    {
+    public:
+        TestElevationSource() : _profile(Profile::create("global-geodetic")) { }
+
+        const Profile* getProfile() const { return _profile.get(); }
+
+        unsigned getTileSize() const { return 257u; }
+
+        unsigned getRevision(const TileKey& key) const
+        {
+            std::map<TileKey, unsigned>::const_iterator i = _revisions.find(key);
+            return i != _revisions.end() ? i->second : 0u;
+        }
+
+        void getElevations(const std::vector<osg::Vec3d>& points, unsigned lod, std::vector<float>& out)
+        {
+            out.resize(points.size());
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                const osg::Vec3d& p = points[i];
+                TileKey key = _profile->createTileKey(p.x(), p.y(), lod);
+                out[i] = (float)(1000.0 + 300.0*sin(p.x()*10.0)*cos(p.y()*7.0) + 50.0*(double)getRevision(key));
+            }
+        }
+
+        void change(const TileKey& key) { ++_revisions[key]; }
+
+    private:
+        osg::ref_ptr<const Profile> _profile;
+        std::map<TileKey, unsigned> _revisions;
+    };
+
+    unsigned countSegmentsThatRead(const ProfileSampler& sampler, const TileKey& key)
+    {
+        unsigned count = 0u;
+        for (unsigned i = 0; i < sampler.getSegments().size(); ++i)
+        {
+            if (sampler.getSegments()[i].sources.count(key) > 0)
+                ++count;
+        }
+        return count;
+    }
+}
+
+TEST_CASE( "ProfileSampler" ) {
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+    osg::ref_ptr<TestElevationSource> source = new TestElevationSource();
+
+    osg::ref_ptr<ProfileSampler> sampler = new ProfileSampler();
+    sampler->setPath(
+        GeoPoint(wgs84, -100.0, 40.0, 0.0, ALTMODE_ABSOLUTE),
+        GeoPoint(wgs84, -96.0, 40.0, 0.0, ALTMODE_ABSOLUTE));
+
+    const std::vector<ProfileSampler::Segment>& segments = sampler->getSegments();
+    REQUIRE(segments.size() > 4u);
+
+    // the first update samples the whole path:
+    REQUIRE(sampler->update(source.get(), 0L) == segments.size());
+    for (unsigned i = 0; i < segments.size(); ++i)
+    {
+        REQUIRE(segments[i].samplings == 1u);
+        REQUIRE(segments[i].sources.empty() == false);
+    }
+
+    std::vector< std::pair<double,double> > samples;
+    sampler->getSamples(samples);
+    REQUIRE(samples.empty() == false);
+    for (unsigned i = 1; i < samples.size(); ++i)
+        REQUIRE(samples[i-1].first < samples[i].first);
+
+    // a tile under the middle of one segment, that no other segment reads:
+    const unsigned target = 3u;
+    osg::Vec3d center = segments[target].extent.getCentroid();
+    TileKey key = source->getProfile()->createTileKey(center.x(), center.y(), segments[target].lod);
+    REQUIRE(segments[target].sources.count(key) == 1u);
+    REQUIRE(countSegmentsThatRead(*sampler, key) == 1u);
+
+    std::vector<GeoExtent> changed;
+    changed.push_back(key.getExtent());
+
+    SECTION("Unchanged data") {
+        // a tile update without new elevation data resamples nothing:
+        REQUIRE(sampler->update(source.get(), &changed) == 0u);
+        REQUIRE(sampler->update(source.get(), 0L) == 0u);
+    }
+
+    SECTION("Only the affected segment is resampled") {
+        source->change(key);
+        REQUIRE(sampler->update(source.get(), &changed) == 1u);
+
+        for (unsigned i = 0; i < segments.size(); ++i)
+            REQUIRE(segments[i].samplings == (i == target ? 2u : 1u));
+
+        // and it picked up the new data:
+        REQUIRE(segments[target].sources.find(key)->second == 1u);
+        REQUIRE(sampler->update(source.get(), &changed) == 0u);
+    }
+
+    SECTION("Changes outside the changed extents are deferred") {
+        source->change(key);
+
+        std::vector<GeoExtent> elsewhere;
+        elsewhere.push_back(GeoExtent(wgs84, 10.0, 10.0, 11.0, 11.0));
+        REQUIRE(sampler->update(source.get(), &elsewhere) == 0u);
+
+        // until every tile is checked:
+        REQUIRE(sampler->update(source.get(), 0L) == 1u);
+        REQUIRE(segments[target].samplings == 2u);
+    }
+
+    SECTION("Copies are independent") {
+        osg::ref_ptr<ProfileSampler> copy = new ProfileSampler(*sampler.get());
+        source->change(key);
+        REQUIRE(copy->update(source.get(), &changed) == 1u);
+        REQUIRE(copy->getSegments()[target].samplings == 2u);
+        REQUIRE(segments[target].samplings == 1u);
+    }
+}
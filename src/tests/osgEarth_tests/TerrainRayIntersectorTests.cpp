@@ -0,0 +1,159 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/TerrainRayIntersector>
+#include <osgUtil/IntersectionVisitor>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <cmath>
+
+using namespace osgEarth;
+
+TEST_CASE( "TileMeshBVH" ) {
+
+    unsigned seed = 1u;
+
+    // a bumpy tile, 17x17 like the default terrain tile size
+    const unsigned size = 17;
+    osg::ref_ptr<osg::Vec3Array> verts = new osg::Vec3Array(size*size);
+    for (unsigned r = 0; r < size; ++r)
+    {
+        for (unsigned c = 0; c < size; ++c)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            float noise = (float)((seed >> 8) % 100);
+            (*verts)[r*size + c].set(
+                100.0f*c - 800.0f,
+                100.0f*r - 800.0f,
+                300.0f*sin(0.7f*c)*cos(0.5f*r) + noise);
+        }
+    }
+
+    osg::ref_ptr<TileMeshBVH> bvh = new TileMeshBVH();
+    bvh->build(verts.get(), size, size);
+    REQUIRE(bvh->valid());
+
+    SECTION("Matches brute force") {
+        unsigned mismatches = 0, hits = 0;
+        for (unsigned i = 0; i < 5000; ++i)
+        {
+            double v[6];
+            for (unsigned j = 0; j < 6; ++j)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                v[j] = (double)((seed >> 8) % 2000) - 1000.0;
+            }
+            osg::Vec3d start(v[0], v[1], 2000.0 + v[2]);
+            osg::Vec3d end(v[3], v[4], (i % 2) ? v[5] * 0.3 : -2000.0);
+
+            double r1 = 0.0, r2 = 0.0;
+            osg::Vec3d n1, n2;
+            unsigned t1 = 0, t2 = 0;
+            bool h1 = bvh->intersect(start, end, r1, n1, t1);
+            bool h2 = bvh->intersectBruteForce(start, end, r2, n2, t2);
+            if (h1 != h2 || (h1 && r1 != r2))
+                ++mismatches;
+            if (h1)
+                ++hits;
+        }
+        REQUIRE(hits > 0);
+        REQUIRE(mismatches == 0);
+    }
+
+    SECTION("Matches osgUtil::LineSegmentIntersector") {
+        // the same mesh as a drawable, triangulated the way TileDrawable does it
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry();
+        geom->setVertexArray(verts.get());
+        osg::DrawElementsUInt* tris = new osg::DrawElementsUInt(GL_TRIANGLES);
+        for (unsigned r = 0; r < size - 1; ++r)
+        {
+            for (unsigned c = 0; c < size - 1; ++c)
+            {
+                unsigned i00 = r*size + c, i10 = i00 + 1, i01 = i00 + size, i11 = i01 + 1;
+                tris->push_back(i00); tris->push_back(i10); tris->push_back(i01);
+                tris->push_back(i01); tris->push_back(i10); tris->push_back(i11);
+            }
+        }
+        geom->addPrimitiveSet(tris);
+        geom->setShape(bvh.get());
+
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+        geode->addDrawable(geom.get());
+
+        unsigned mismatches = 0, hits = 0;
+        for (unsigned i = 0; i < 1000; ++i)
+        {
+            double v[6];
+            for (unsigned j = 0; j < 6; ++j)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                v[j] = (double)((seed >> 8) % 2000) - 1000.0;
+            }
+            osg::Vec3d start(v[0], v[1], 2000.0 + v[2]);
+            osg::Vec3d end(v[3], v[4], (i % 2) ? v[5] * 0.3 : -2000.0);
+
+            osg::ref_ptr<TerrainRayIntersector> bvhLSI = new TerrainRayIntersector(start, end);
+            osgUtil::IntersectionVisitor bvhIV(bvhLSI.get());
+            geode->accept(bvhIV);
+
+            osg::ref_ptr<osgUtil::LineSegmentIntersector> osgLSI = new osgUtil::LineSegmentIntersector(start, end);
+            osgUtil::IntersectionVisitor osgIV(osgLSI.get());
+            geode->accept(osgIV);
+
+            bool h1 = bvhLSI->containsIntersections();
+            bool h2 = osgLSI->containsIntersections();
+            if (h1 != h2)
+            {
+                ++mismatches;
+            }
+            else if (h1)
+            {
+                const osgUtil::LineSegmentIntersector::Intersection& a = bvhLSI->getFirstIntersection();
+                const osgUtil::LineSegmentIntersector::Intersection& b = osgLSI->getFirstIntersection();
+                if (a.primitiveIndex != b.primitiveIndex ||
+                    (a.getWorldIntersectPoint() - b.getWorldIntersectPoint()).length() > 1e-2)
+                {
+                    ++mismatches;
+                }
+                ++hits;
+            }
+        }
+        REQUIRE(hits > 0);
+        REQUIRE(mismatches == 0);
+    }
+
+    SECTION("Vertical ray hits the right triangle") {
+        // cell (3,5), lower-left triangle:
+        const osg::Vec3f& v00 = (*verts)[5*size + 3];
+        const osg::Vec3f& v10 = (*verts)[5*size + 4];
+        const osg::Vec3f& v01 = (*verts)[6*size + 3];
+        osg::Vec3d p = (osg::Vec3d(v00) + osg::Vec3d(v10) + osg::Vec3d(v01)) / 3.0;
+
+        double ratio;
+        osg::Vec3d normal;
+        unsigned triangle;
+        REQUIRE(bvh->intersect(osg::Vec3d(p.x(), p.y(), 5000.0), osg::Vec3d(p.x(), p.y(), -5000.0), ratio, normal, triangle));
+        REQUIRE(triangle == 2u * (5u*(size - 1) + 3u));
+        REQUIRE(fabs((5000.0 - ratio*10000.0) - p.z()) < 1e-3);
+    }
+}
@@ -0,0 +1,260 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/Text>
+#include <osgEarth/TextBatch>
+#include <osgEarth/TextCache>
+#include <osgEarth/TextSymbol>
+#include <osgEarth/AltitudeSymbol>
+#include <osgEarth/AnnotationUtils>
+#include <osgEarth/BuildTextFilter>
+#include <osgEarth/FilterContext>
+#include <osgEarth/Feature>
+#include <osgEarth/Geometry>
+#include <osgEarth/PlaceNode>
+#include <osg/MatrixTransform>
+#include <osg/Version>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // a label styled the way AnnotationUtils styles them
+    osgEarth::Text* makeText(const std::string& str, const TextSymbol* symbol)
+    {
+        return dynamic_cast<osgEarth::Text*>(
+            AnnotationUtils::createTextDrawable(str, symbol, 0L, osg::BoundingBox()));
+    }
+
+    void makeFeatures(FeatureList& features, unsigned count)
+    {
+        osg::ref_ptr<const SpatialReference> wgs84 = SpatialReference::get("wgs84");
+        for (unsigned i = 0; i < count; ++i)
+        {
+            Point* point = new Point();
+            point->push_back(osg::Vec3d(-80.0 + (double)i, 35.0, 0.0));
+            features.push_back(new Feature(point, wgs84.get()));
+        }
+    }
+
+    unsigned countPlaceNodes(const osg::Group* group)
+    {
+        unsigned count = 0u;
+        for (unsigned i = 0; i < group->getNumChildren(); ++i)
+            if (dynamic_cast<const PlaceNode*>(group->getChild(i)))
+                ++count;
+        return count;
+    }
+
+    const TextBatch* findBatch(const osg::Group* group)
+    {
+        for (unsigned i = 0; i < group->getNumChildren(); ++i)
+        {
+            const osg::MatrixTransform* xform = dynamic_cast<const osg::MatrixTransform*>(group->getChild(i));
+            if (xform && xform->getNumChildren() > 0)
+            {
+                const TextBatch* batch = dynamic_cast<const TextBatch*>(xform->getChild(0));
+                if (batch)
+                    return batch;
+            }
+        }
+        return 0L;
+    }
+}
+
+TEST_CASE("TextCache") {
+
+    osg::ref_ptr<TextCache> cache = new TextCache();
+    TextSymbol symbol;
+    symbol.size() = 20.0;
+
+    osg::ref_ptr<osgEarth::Text> original = makeText("Portland", &symbol);
+    REQUIRE(original.valid());
+
+    std::string key = TextCache::makeKey("Portland", &symbol, 0L, osg::BoundingBox());
+    REQUIRE(cache->createText(key) == 0L);
+    cache->insert(key, original.get());
+
+    SECTION("Keys split on the symbol and the string") {
+        TextSymbol bigger;
+        bigger.size() = 24.0;
+        REQUIRE(TextCache::makeKey("Portland", &bigger, 0L, osg::BoundingBox()) != key);
+        REQUIRE(TextCache::makeKey("Portland ", &symbol, 0L, osg::BoundingBox()) != key);
+        REQUIRE(TextCache::makeKey("Portland", &symbol, 0L, osg::BoundingBox()) == key);
+    }
+
+    SECTION("Copies match the original") {
+        osg::ref_ptr<osgEarth::Text> a = cache->createText(key);
+        osg::ref_ptr<osgEarth::Text> b = cache->createText(key);
+        REQUIRE(a.valid());
+        REQUIRE(b.valid());
+        REQUIRE(a.get() != b.get());
+        REQUIRE(a->getText().createUTF8EncodedString() == "Portland");
+        REQUIRE(a->getCharacterHeight() == original->getCharacterHeight());
+        REQUIRE(a->getAlignment() == original->getAlignment());
+        REQUIRE(a->getStateSet() == original->getStateSet());
+        REQUIRE(a->getBoundingBox().xMin() == Approx(original->getBoundingBox().xMin()));
+        REQUIRE(a->getBoundingBox().xMax() == Approx(original->getBoundingBox().xMax()));
+        REQUIRE(a->getBoundingBox().yMax() == Approx(original->getBoundingBox().yMax()));
+
+        TextCache::Stats stats = cache->getStats();
+        REQUIRE(stats.prototypes == 1u);
+        REQUIRE(stats.hits == 2u);
+        REQUIRE(stats.misses == 1u);
+        REQUIRE(stats.characters == 8u);
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+        REQUIRE(stats.shared == 2u);
+#endif
+    }
+
+    SECTION("Changing a copy leaves the others alone") {
+        osg::ref_ptr<osgEarth::Text> a = cache->createText(key);
+        osg::ref_ptr<osgEarth::Text> b = cache->createText(key);
+        osg::BoundingBox before = b->getBoundingBox();
+
+        a->setText("Portland, Oregon");
+        REQUIRE(a->getBoundingBox().xMax() - a->getBoundingBox().xMin() > before.xMax() - before.xMin());
+
+        REQUIRE(b->getText().createUTF8EncodedString() == "Portland");
+        REQUIRE(b->getBoundingBox().xMin() == Approx(before.xMin()));
+        REQUIRE(b->getBoundingBox().xMax() == Approx(before.xMax()));
+
+        osg::ref_ptr<osgEarth::Text> c = cache->createText(key);
+        REQUIRE(c->getText().createUTF8EncodedString() == "Portland");
+        REQUIRE(c->getBoundingBox().xMax() == Approx(before.xMax()));
+    }
+
+    SECTION("Changing the original leaves the cache alone") {
+        osg::BoundingBox before = original->getBoundingBox();
+        original->setText("Salem");
+        osg::ref_ptr<osgEarth::Text> a = cache->createText(key);
+        REQUIRE(a->getText().createUTF8EncodedString() == "Portland");
+        REQUIRE(a->getBoundingBox().xMax() == Approx(before.xMax()));
+    }
+}
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+
+TEST_CASE("TextBatch") {
+
+    TextSymbol symbol;
+    osg::ref_ptr<TextBatch> batch = new TextBatch();
+
+    osg::ref_ptr<osgEarth::Text> a = makeText("Boise", &symbol);
+    REQUIRE(batch->addText(a.get(), osg::Vec3f(0, 0, 0)));
+    REQUIRE(batch->getNumTexts() == 1u);
+
+    unsigned verts = batch->getNumVertices();
+    REQUIRE(verts > 0u);
+    REQUIRE(verts % 4u == 0u);
+    unsigned children = batch->getNumChildren();
+    REQUIRE(children > 0u);
+
+    SECTION("Texts with the same style share geometry") {
+        osg::ref_ptr<osgEarth::Text> b = makeText("Boise", &symbol);
+        REQUIRE(batch->addText(b.get(), osg::Vec3f(1000, 0, 0)));
+        REQUIRE(batch->getNumTexts() == 2u);
+        REQUIRE(batch->getNumVertices() == 2u * verts);
+        REQUIRE(batch->getNumChildren() == children);
+    }
+
+    SECTION("Texts that need extra backdrop geometry are refused") {
+        osg::ref_ptr<osgEarth::Text> b = new osgEarth::Text("Boise");
+        b->setShaderTechnique(osgText::NO_TEXT_SHADER);
+        b->setBackdropType(osgText::Text::OUTLINE);
+        REQUIRE(batch->addText(b.get(), osg::Vec3f(0, 0, 0)) == false);
+        REQUIRE(batch->getNumTexts() == 1u);
+        REQUIRE(batch->getNumVertices() == verts);
+    }
+
+    SECTION("Empty input is refused") {
+        REQUIRE(batch->addText(0L, osg::Vec3f(0, 0, 0)) == false);
+        REQUIRE(batch->getNumTexts() == 1u);
+    }
+}
+
+#endif
+
+TEST_CASE("BuildTextFilter") {
+
+    FeatureList features;
+    makeFeatures(features, 3);
+
+    Style style;
+    TextSymbol* text = style.getOrCreate<TextSymbol>();
+    text->content() = StringExpression();
+    text->content()->setLiteral("Label");
+
+    FilterContext context;
+
+    SECTION("Labels get a PlaceNode each by default") {
+        BuildTextFilter filter(style);
+        osg::ref_ptr<osg::Node> node = filter.push(features, context);
+        REQUIRE(node.valid());
+        REQUIRE(countPlaceNodes(node->asGroup()) == 3u);
+        REQUIRE(findBatch(node->asGroup()) == 0L);
+    }
+
+    SECTION("Map-clamped labels still get PlaceNodes while they declutter") {
+        AltitudeSymbol* alt = style.getOrCreate<AltitudeSymbol>();
+        alt->clamping() = alt->CLAMP_TO_TERRAIN;
+        alt->technique() = alt->TECHNIQUE_MAP;
+
+        BuildTextFilter filter(style);
+        osg::ref_ptr<osg::Node> node = filter.push(features, context);
+        REQUIRE(countPlaceNodes(node->asGroup()) == 3u);
+        REQUIRE(findBatch(node->asGroup()) == 0L);
+    }
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,5,8)
+    SECTION("Map-clamped labels that opt out of decluttering share a batch") {
+        AltitudeSymbol* alt = style.getOrCreate<AltitudeSymbol>();
+        alt->clamping() = alt->CLAMP_TO_TERRAIN;
+        alt->technique() = alt->TECHNIQUE_MAP;
+        text->declutter() = false;
+
+        BuildTextFilter filter(style);
+        osg::ref_ptr<osg::Node> node = filter.push(features, context);
+        REQUIRE(countPlaceNodes(node->asGroup()) == 0u);
+
+        const TextBatch* batch = findBatch(node->asGroup());
+        REQUIRE(batch != 0L);
+        REQUIRE(batch->getNumTexts() == 3u);
+    }
+
+    SECTION("Labels with a pixel offset are not batched") {
+        AltitudeSymbol* alt = style.getOrCreate<AltitudeSymbol>();
+        alt->clamping() = alt->CLAMP_TO_TERRAIN;
+        alt->technique() = alt->TECHNIQUE_MAP;
+        text->declutter() = false;
+        text->pixelOffset() = osg::Vec2s(0, 10);
+
+        BuildTextFilter filter(style);
+        osg::ref_ptr<osg::Node> node = filter.push(features, context);
+        REQUIRE(countPlaceNodes(node->asGroup()) == 3u);
+        REQUIRE(findBatch(node->asGroup()) == 0L);
+    }
+#endif
+}
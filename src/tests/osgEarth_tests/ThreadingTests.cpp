@@ -132,4 +132,34 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+namespace ParallelForTest
+{
+    struct CountJob : public osgEarth::Threading::ParallelFor::Job
+    {
+        CountJob(unsigned count) : _hits(count, 0), _workers(count, 0u) { }
+
+        void operator()(unsigned i, unsigned worker)
+        {
+            ++_hits[i];
+            _workers[i] = worker;
+        }
+
+        std::vector<int> _hits;
+        std::vector<unsigned> _workers;
+    };
+}
+
+TEST_CASE( "ParallelFor runs every index exactly once" ) {
+
+    const unsigned count = 1000u;
+    ParallelForTest::CountJob job(count);
+    osgEarth::Threading::ParallelFor::run(job, count);
+
+    unsigned numWorkers = osgEarth::Threading::ParallelFor::getNumWorkers(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        REQUIRE(job._hits[i] == 1);
+        REQUIRE(job._workers[i] < numWorkers);
+    }
+}